@@ -5,6 +5,18 @@
 #include <WiFiClient.h>
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
+#include <Preferences.h>
+#include <lwip/sockets.h>
+#include <esp_timer.h>
+#include "Lichtschranke-Treiber.h"
+#include "Lichtschranke-Detektor.h"
+#include "Lichtschranke-Speicher.h"
+#include "Lichtschranke-Protokoll.h"
+#include "Lichtschranke-Zustand.h"
+#include "Lichtschranke-Energie.h"
+#include "Lichtschranke-Geschwindigkeit.h"
+#include "Lichtschranke-Telemetrie.h"
+#include "Lichtschranke-Verbindung.h"
 
 // WiFi-Verbindung zum Server
 const char *ssid_ap = "MeinESP32AP";
@@ -22,15 +34,54 @@ LiquidCrystal_I2C lcd(0x3F, 20, 4);
 // HC-SR04 auf anderen Pins als Server um Konflikte zu vermeiden
 const int trigPin2 = 12;
 const int echoPin2 = 14;
-#define SOUND_SPEED 0.034f  // cm/µs bei 20°C
+
+// Mehrere HC-SR04 pro Schranke, z.B. mit -DSENSOR_COUNT=3 übersetzen
+// Gleiches Schema wie Server: Sensor 0 auf den bisherigen Pins
+#ifndef SENSOR_COUNT
+#define SENSOR_COUNT 1
+#endif
+#if SENSOR_COUNT == 1
+typedef SensorGroup<UltrasonicSensor<trigPin2, echoPin2>> GateSensors;
+#elif SENSOR_COUNT == 2
+typedef SensorGroup<UltrasonicSensor<trigPin2, echoPin2>, UltrasonicSensor<32, 34>> GateSensors;
+#elif SENSOR_COUNT == 3
+typedef SensorGroup<UltrasonicSensor<trigPin2, echoPin2>, UltrasonicSensor<32, 34>, UltrasonicSensor<33, 35>> GateSensors;
+#else
+#error "SENSOR_COUNT: 1 bis 3 Sensoren pro Schranke"
+#endif
 
 // Timing- und Sensor-Konstanten
 const unsigned long RECONNECT_DELAY_MS = 2000;      // Wartezeit zwischen Verbindungsversuchen
 const unsigned long LOOP_DELAY_MS = 20;             // Gleiche Abtastrate wie Server für Synchronität
 const unsigned long CONNECTION_TIMEOUT_MS = 15000;  // WiFi-Verbindungs-Timeout
-const float MIN_VALID_DISTANCE = 2.0f;              // HC-SR04 technisches Minimum
-const float MAX_VALID_DISTANCE = 400.0f;            // HC-SR04 technisches Maximum
 const int REFERENCE_SAMPLES = 15;                   // Gleiche Anzahl wie Server für konsistente Kalibrierung
+const unsigned long ECHO_TIMEOUT_US = 30000;        // 30ms = ~5m Reichweite
+const float ECHO_RANGE_MARGIN = 1.5f;               // Echo-Timeout nach Kalibrierung = 1.5x Referenz
+
+// Objekterkennung: CUSUM-Änderungstest (1) oder bisheriger fester Schwellwert (0), wie beim Server
+#ifndef CUSUM_DETECTOR
+#define CUSUM_DETECTOR 1
+#endif
+const float DETECTOR_FALSE_ALARM_RATE = 1e-4f;      // Fehlalarme pro Messwert, Schwelle h = ln(1/alpha)
+const int DETECTOR_MIN_SAMPLES = 2;                 // Ein einzelner Ausreißer stoppt nie die Zeit
+const float DETECTOR_MIN_SIGMA_CM = 1.0f;
+const float HYSTERESIS_FACTOR = 1.15f;              // Nur für den Schwellwert-Detektor
+
+// TDMA-Zeitplan gegen Übersprechen zwischen den Schranken (Gegenstück zum Server)
+// Der Client pingt nur in Slot 1 des gemeinsamen Rahmens, Zeitbasis ist micros() des Servers
+#ifndef TDMA_ENABLED
+#define TDMA_ENABLED 1
+#endif
+const unsigned long TDMA_SLOT_US = 40000;           // Muss mit dem Server übereinstimmen
+const unsigned long TDMA_FRAME_US = 2 * TDMA_SLOT_US;
+const unsigned long TDMA_GUARD_US = 2000;
+const unsigned long TDMA_SLOT_INDEX = 1;
+const int TIME_SYNC_ROUNDS = 8;                     // Beste von 8 Messungen beim Verbindungsaufbau
+const unsigned long TIME_SYNC_TIMEOUT_MS = 300;     // Wartezeit auf TIME_RESP pro Runde
+const unsigned long TIME_SYNC_INTERVAL_MS = 10000;  // Nachsynchronisation gegen Quarz-Drift
+const unsigned long TIME_SYNC_RETRY_MS = 1000;      // Nach unbeantworteter Nachsynchronisation
+const unsigned long TIME_SYNC_MAX_RTT_US = 20000;   // Langsamere Antworten sind zu ungenau
+const unsigned long CLOCK_DRIFT_PPM = 50;           // Angenommene Drift zwischen zwei ESP32-Quarzen
 
 // Client-Zustandsmaschine synchronisiert mit Server-States
 enum StateClient
@@ -38,48 +89,268 @@ enum StateClient
     WAITING_FOR_CONNECTION,     // Versucht WiFi/Server-Verbindung herzustellen
     IDLE_WAITING_FOR_START,     // Bereit, wartet auf START_TIMER vom Server
     TIMING_IN_PROGRESS,         // Misst aktiv Zeit und wartet auf Objekt
-    DISPLAYING_RESULT           // Zeigt Ergebnis für definierte Zeit
+    DISPLAYING_RESULT,          // Zeigt Ergebnis für definierte Zeit
+    CLIENT_STATE_COUNT
+};
+
+// Ereignisse der Client-Zustandsmaschine - die Übergänge stehen in clientTransitions
+enum ClientEvent
+{
+    EVC_CONNECTED,              // CLIENT_READY gesendet
+    EVC_START,                  // START_TIMER vom Server
+    EVC_OBJECT_DETECTED,        // Detektor bestätigt Objekt an Schranke 2
+    EVC_DISPLAY_DONE,           // Ergebnis lange genug angezeigt
+    EVC_LINK_LOST,              // Verbindung weg oder Heartbeat-Ausfall
+    EVC_TIMEOUT,                // Offline-Messung über MAX_OFFLINE_TIMING_MS
+    CLIENT_EVENT_COUNT
+};
+
+// Round-Robin-Zeitplan und Median-Fusion wie beim Server (Lichtschranke-Treiber.h)
+GateSensors gateSensors("ESP2");
+
+// Gemeinsame Zeitbasis mit dem Server
+// Unsicherheit = halbe Laufzeit der besten Messung plus seither aufgelaufene Drift
+struct TimeBase {
+    bool synced = false;
+    unsigned long offsetUs = 0;             // Server-micros minus Client-micros (modulo 2^32)
+    unsigned long baseUncertaintyUs = 0;
+    uint64_t syncedAt = 0;                  // esp_timer_get_time() bei der letzten Übernahme
+
+    unsigned long now() const { return micros() + offsetUs; }
+
+    // Alter in 64 Bit: micros() läuft nach 71,6 Minuten über, so lange kann der Sparbetrieb dauern
+    unsigned long uncertaintyUs() const {
+        uint64_t ageUs = esp_timer_get_time() - syncedAt;
+        return baseUncertaintyUs + (unsigned long)(ageUs / 1000000ULL) * CLOCK_DRIFT_PPM;
+    }
+
+    // Übernimmt eine Messung nur, wenn sie genauer ist als der aktuelle Stand
+    bool accept(unsigned long sentAt, unsigned long serverUs, unsigned long receivedAt) {
+        unsigned long rtt = receivedAt - sentAt;
+        if (rtt > TIME_SYNC_MAX_RTT_US || (synced && rtt / 2 >= uncertaintyUs())) {
+            return false;
+        }
+        offsetUs = serverUs + rtt / 2 - receivedAt;
+        baseUncertaintyUs = rtt / 2;
+        syncedAt = esp_timer_get_time();
+        synced = true;
+        return true;
+    }
 };
-StateClient clientState = WAITING_FOR_CONNECTION;
+TimeBase timeBase;
+unsigned long lastTimeSyncRequest = 0;
+unsigned long echoTimeoutUs = ECHO_TIMEOUT_US;  // Wird nach Kalibrierung an die Referenz angepasst
+
+// Heartbeat-System erkennt Verbindungsabbrüche (Parameter in Lichtschranke-Verbindung.h)
+const unsigned long LINK_STATS_INTERVAL_MS = 30000; // Periodische Ausgabe von RTT und Jitter
+unsigned long lastHeartbeatSent = 0;
 
-// Heartbeat-System erkennt Verbindungsabbrüche
-unsigned long lastHeartbeatReceived = 0;
-const unsigned long HEARTBEAT_TIMEOUT_MS = 15000;  // 3x Heartbeat-Intervall als Puffer
+LinkMonitor linkMonitor;
 
 // Sensor- und Timing-Variablen
 float referenceDistance2 = -1.0f;       // Kalibrierte Referenzdistanz
 float triggerThreshold2 = -1.0f;        // Auslöseschwelle = Referenz / 2
-unsigned long timingStartTime = 0;      // Zeitpunkt des START_TIMER Empfangs
+float noiseSigma2 = DETECTOR_MIN_SIGMA_CM;  // Standardabweichung der Kalibriermessungen
+
+#if CUSUM_DETECTOR
+CusumDetector cusumDetector(DETECTOR_FALSE_ALARM_RATE, DETECTOR_MIN_SAMPLES, DETECTOR_MIN_SIGMA_CM);
+CrossingDetector &gateDetector = cusumDetector;
+#else
+ThresholdDetector thresholdDetector(HYSTERESIS_FACTOR);
+CrossingDetector &gateDetector = thresholdDetector;
+#endif
+unsigned long timingStartTime = 0;      // Verlassen der Startschranke, aus START_TIMER zurückgerechnet
+unsigned long startTimerSinceMs = 0;    // START_TIMER:<ms> - Verlassen liegt beim Senden so weit zurück
 unsigned long lastMeasuredTime = 0;     // Letzte gemessene Zeit für Anzeige
 unsigned long lastConnectionAttempt = 0;
 unsigned long displayStartTime = 0;
 const unsigned long DISPLAY_DURATION_MS = 5000;  // Ergebnis 5s anzeigen
 bool displayAvailable = false;          // Flag ob Display gefunden wurde
 
+// Schnellstart: LCD-Adresse im NVS, WLAN-Assoziation parallel zur Display-Initialisierung
+Preferences preferences;
+bool wifiAssociationPending = false;    // WiFi.begin() aus setup() läuft noch im Hintergrund
+unsigned long wifiBeginTime = 0;
+
+// Boot-Phasen in ms seit Start, werden einmalig nach der ersten Server-Verbindung gemeldet
+struct BootTimings {
+    unsigned long displayReady = 0;
+    unsigned long setupDone = 0;
+    unsigned long wifiConnected = 0;
+    unsigned long serverConnected = 0;
+    bool cachedDisplay = false;
+    bool reported = false;
+};
+BootTimings bootTimings;
+
+// Store-and-Forward: jedes Ergebnis wird mit Sequenznummer im NVS abgelegt, bis der Server
+// es mit RESULT_ACK bestätigt. Bei Verbindungsabbruch geht so kein Ergebnis verloren.
+// Der Server verwirft Duplikate anhand der Sequenznummer, wiederholtes Senden ist harmlos.
+const int RESULT_QUEUE_SIZE = 32;                    // Begrenzter Rückstand, ältestes fällt bei Überlauf heraus
+const int RESULT_BATCH_SIZE = 8;                     // Ergebnisse pro RESULTS-Nachricht
+const unsigned long RESULT_RETRY_MS = 2000;          // Unbestätigte Ergebnisse erneut senden
+const unsigned long MAX_OFFLINE_TIMING_MS = 30000;   // Wie MAX_TIMING_DURATION_MS des Servers
+
+struct QueuedResult {
+    uint32_t seq;
+    uint32_t timeMs;
+};
+
+struct ResultQueue {
+    uint32_t epoch = 0;                      // Zufallskennung, ändert sich nur bei gelöschtem NVS
+    uint32_t nextSeq = 1;
+    uint8_t head = 0;
+    uint8_t count = 0;
+    QueuedResult entries[RESULT_QUEUE_SIZE];
+
+    const QueuedResult &at(int i) const { return entries[(head + i) % RESULT_QUEUE_SIZE]; }
+
+    uint32_t push(uint32_t timeMs, unsigned long &overflow) {
+        if (count == RESULT_QUEUE_SIZE) {
+            head = (head + 1) % RESULT_QUEUE_SIZE;
+            count--;
+            overflow++;
+        }
+        QueuedResult &e = entries[(head + count) % RESULT_QUEUE_SIZE];
+        e.seq = nextSeq++;
+        e.timeMs = timeMs;
+        count++;
+        return e.seq;
+    }
+
+    // Kumulatives ACK: alles bis einschließlich seq ist beim Server angekommen
+    int acknowledge(uint32_t seq) {
+        int removed = 0;
+        while (count > 0 && at(0).seq <= seq) {
+            head = (head + 1) % RESULT_QUEUE_SIZE;
+            count--;
+            removed++;
+        }
+        return removed;
+    }
+};
+ResultQueue resultQueue;
+uint32_t resultSentSeq = 0;                  // Bis hierher in dieser Verbindung gesendet
+unsigned long lastResultSend = 0;
+unsigned long resultQueueOverflow = 0;
+unsigned long backlogStartTime = 0;          // Beginn der Übertragung eines Rückstands, 0 = keiner
+bool offlineTiming = false;                  // Messung läuft trotz Verbindungsverlust weiter
+uint32_t stopTimerSeq = 0;                   // Letzter Lauf bis zum ACK, der Server wartet evtl. noch auf ihn
+
+// Empfang vom Server, Teilzeilen bleiben bis zum nächsten Durchlauf im Puffer
+LineReader<PROTOCOL_LINE_MAX> serverLine;
+
+// Speicherbudget, wird einmal pro Minute an den Server gemeldet
+MemoryTelemetry memoryTelemetry;
+unsigned long lastMemorySample = 0;
+
+// Sparbetrieb in IDLE_WAITING_FOR_START: Modem-Sleep hält die Verbindung, längere Schlafscheiben
+// Schranke 2 misst erst nach START_TIMER, der Server kündigt ihn per WAKE an
+IdleScheduler idleScheduler(LOOP_DELAY_MS, IDLE_SLEEP_SLICE_MS);
+PowerControl powerControl(true);
+unsigned long lastPowerReport = 0;
+
+// Speed-Trap: Abstandsverlauf während der Messung für die Momentangeschwindigkeit an Schranke 2
+SpeedWindow gateSpeed;
+uint32_t lastFinishSpeed = 0;                // cm/s, 0 = unbekannt
+
+// Rohdaten-Stream auf TELEMETRY_PORT, nur bei verbundenem Empfänger (siehe Lichtschranke-Telemetrie.h)
+WiFiServer telemetryServer(TELEMETRY_PORT);
+WiFiClient telemetryClient;
+TelemetryStream telemetry(2);
+
 // Function Prototypes
-float measureDistanceClient(int trigPin, int echoPin);
+float measureGateDistanceClient(int pings);
 void connectToWiFiAndServer();
 bool establishInitialReferenceDistanceClient();
 void updateDisplay(const String &line1, const String &line2 = "", const String &line3 = "", const String &line4 = "");
 void initializeDisplay();
 void handleConnectionLoss();
 void scanI2CDevices();
+bool synchronizeTimeBase();
+bool handleTimeResponse(const String &message);
+void resyncTimeBase();
+void handleServerMessage(const String &serverData);
+unsigned long ownSlotWaitUs(unsigned long pingBudgetUs);
+unsigned long pingBudgetUs();
+void waitForOwnSlot(unsigned long pingBudgetUs);
+void printTdmaBudget();
+bool initializeLcdAt(uint8_t address, bool quick);
+void reportBootTimings();
+void loadResultQueue();
+void saveResultQueue();
+void sendPendingResults(uint32_t beforeSeq = UINT32_MAX);
+void sendStopTimer(uint32_t seq);
+void handleResultAck(const String &message);
+void sampleMemory();
+void updatePowerMode();
+void wakeFromIdle(const char *reason);
+void reportPower();
+void serviceTelemetry();
+bool linkStillUp();
+void startTiming();
+void finishTiming();
+void showReady();
+void enterWaiting();
+void continueOffline();
+void abortOfflineTiming();
+void traceTransition(StateClient from, StateClient to, ClientEvent event, unsigned long atUs);
+const char *clientStateName(StateClient state);
+const char *clientEventName(ClientEvent event);
+
+// Übergangstabelle: {von, Ereignis, nach, Bedingung, Aktion}
+// Verbindungsverlust während der Messung bleibt in TIMING_IN_PROGRESS (einmalig offline weiter)
+constexpr Transition<StateClient, ClientEvent> clientTransitions[] = {
+    {WAITING_FOR_CONNECTION, EVC_CONNECTED,       IDLE_WAITING_FOR_START, nullptr,      nullptr},
+    {IDLE_WAITING_FOR_START, EVC_START,           TIMING_IN_PROGRESS,     nullptr,      startTiming},
+    {TIMING_IN_PROGRESS,     EVC_OBJECT_DETECTED, DISPLAYING_RESULT,      nullptr,      finishTiming},
+    {DISPLAYING_RESULT,      EVC_DISPLAY_DONE,    IDLE_WAITING_FOR_START, nullptr,      showReady},
+    {IDLE_WAITING_FOR_START, EVC_LINK_LOST,       WAITING_FOR_CONNECTION, nullptr,      enterWaiting},
+    {DISPLAYING_RESULT,      EVC_LINK_LOST,       WAITING_FOR_CONNECTION, nullptr,      enterWaiting},
+    {TIMING_IN_PROGRESS,     EVC_LINK_LOST,       TIMING_IN_PROGRESS,     linkStillUp,  continueOffline},
+    {TIMING_IN_PROGRESS,     EVC_TIMEOUT,         WAITING_FOR_CONNECTION, nullptr,      abortOfflineTiming},
+};
+static_assert(transitionsUnique(clientTransitions), "Doppelter Übergang in clientTransitions");
+static_assert(transitionsInRange(clientTransitions, CLIENT_STATE_COUNT, CLIENT_EVENT_COUNT),
+              "Ungültiger Wert in clientTransitions");
+static_assert(transitionsComplete(clientTransitions, CLIENT_STATE_COUNT, CLIENT_EVENT_COUNT, WAITING_FOR_CONNECTION),
+              "Unerreichbarer Zustand, Sackgasse oder unbenutztes Ereignis in clientTransitions");
+static_assert(handledInStates(clientTransitions, EVC_LINK_LOST,
+                              ((1u << CLIENT_STATE_COUNT) - 1) & ~(1u << WAITING_FOR_CONNECTION)),
+              "EVC_LINK_LOST muss in jedem verbundenen Zustand behandelt werden");
+constexpr TransitionTable<CLIENT_STATE_COUNT * CLIENT_EVENT_COUNT> clientTable =
+    buildTransitionTable<CLIENT_STATE_COUNT, CLIENT_EVENT_COUNT>(clientTransitions);
+StateMachine<StateClient, ClientEvent, CLIENT_STATE_COUNT, CLIENT_EVENT_COUNT> clientMachine(
+    clientTransitions, clientTable, WAITING_FOR_CONNECTION);
+const StateClient &clientState = clientMachine.state; // Nur lesen - Wechsel ausschließlich per dispatch()
+unsigned long lastTransitionUs = 0;
 
 void setup()
 {
     Serial.begin(115200);
     delay(100);
+    clientMachine.trace = traceTransition;
+
+    GateSensors::begin();
 
-    pinMode(trigPin2, OUTPUT);
-    pinMode(echoPin2, INPUT);
+    // WLAN-Assoziation sofort starten, sie läuft im Hintergrund während das Display hochfährt
+    WiFi.mode(WIFI_STA);
+    powerControl.begin();
+    WiFi.begin(ssid_ap, password_ap);
+    wifiBeginTime = millis();
+    wifiAssociationPending = true;
 
-    // Display-Initialisierung mit I2C-Scan
+    // Display-Initialisierung, I2C-Scan nur ohne gespeicherte Adresse
+    preferences.begin("lichtschranke", false);
+    loadResultQueue();
     initializeDisplay();
+    bootTimings.displayReady = millis();
 
     Serial.println("\nESP2: Client Setup gestartet");
     updateDisplay("ESP2 Client", "Initialisierung...", "", "");
 
-    clientState = WAITING_FOR_CONNECTION;
+    lastConnectionAttempt = millis() - RECONNECT_DELAY_MS; // Erster Versuch ohne Wartezeit
+    bootTimings.setupDone = millis();
 }
 
 // I2C-Scanner hilft bei Display-Problemen die richtige Adresse zu finden
@@ -108,60 +379,87 @@ void scanI2CDevices() {
     }
 }
 
+// Initialisiert das LCD an einer bekannten Adresse
+// quick = true überspringt Begrüßung und lange Wartezeiten (Adresse stammt aus dem Cache)
+bool initializeLcdAt(uint8_t address, bool quick)
+{
+    Wire.beginTransmission(address);
+    uint8_t error = Wire.endTransmission();
+    if (error != 0) {
+        Serial.print("ESP2: Fehler ");
+        Serial.print(error);
+        Serial.print(" bei 0x");
+        Serial.println(address, HEX);
+        return false;
+    }
+
+    Serial.print("ESP2: 5V-Display gefunden bei 0x");
+    Serial.println(address, HEX);
+
+    // Display mit gefundener Adresse neu initialisieren
+    lcd = LiquidCrystal_I2C(address, 20, 4);
+    if (!quick) delay(100);
+    lcd.init();
+    if (!quick) delay(100);
+    lcd.backlight();
+
+    if (!quick) {
+        delay(100);
+
+        // Funktionstest
+        lcd.clear();
+        lcd.setCursor(0, 0);
+        lcd.print("5V Display OK!");
+        lcd.setCursor(0, 1);
+        lcd.print("Lichtschranke v1.0");
+        delay(2000);
+    }
+
+    displayAvailable = true;
+    return true;
+}
+
 void initializeDisplay()
 {
     Serial.println("ESP2: Initialisiere Display mit 5V...");
     Wire.begin(21, 22);     // Standard I2C Pins auf ESP32
     Wire.setTimeout(1000);  // Timeout verhindert Hänger bei fehlerhafter Verkabelung
     Wire.setClock(50000);   // Reduzierte Geschwindigkeit für 5V-Displays an 3.3V ESP32
-    
+
+    displayAvailable = false;
+
+    // Schnellstart: gespeicherte Adresse direkt prüfen, voller Scan nur bei Cache-Miss
+    uint8_t cachedAddress = preferences.getUChar("lcdAddr", 0);
+    if (cachedAddress != 0) {
+        delay(50); // HD44780 braucht nach dem Einschalten min. 40ms
+        if (initializeLcdAt(cachedAddress, true)) {
+            bootTimings.cachedDisplay = true;
+            Serial.println("ESP2: 5V-Display aus Cache initialisiert!");
+            return;
+        }
+        Serial.println("ESP2: Gespeicherte Display-Adresse antwortet nicht - voller Scan");
+        preferences.remove("lcdAddr");
+    }
+
     delay(500); // Display benötigt Zeit zum Starten
-    
+
     scanI2CDevices();
-    
+
     // Teste häufigste I2C-Adressen für LCD-Module
     uint8_t addresses[] = {0x27, 0x3F, 0x20, 0x26};
-    displayAvailable = false;
-    
+
     // Automatische Adresserkennung durch systematisches Testen
     for (int i = 0; i < 4; i++) {
         Serial.print("ESP2: Teste 5V-Display bei 0x");
         Serial.println(addresses[i], HEX);
-        
-        Wire.beginTransmission(addresses[i]);
-        uint8_t error = Wire.endTransmission();
-        
-        if (error == 0) {
-            Serial.print("ESP2: 5V-Display gefunden bei 0x");
-            Serial.println(addresses[i], HEX);
-            
-            // Display mit gefundener Adresse neu initialisieren
-            lcd = LiquidCrystal_I2C(addresses[i], 20, 4);
-            delay(100);
-            lcd.init();
-            delay(100);
-            lcd.backlight();
-            delay(100);
-            
-            // Funktionstest
-            lcd.clear();
-            lcd.setCursor(0, 0);
-            lcd.print("5V Display OK!");
-            lcd.setCursor(0, 1);
-            lcd.print("Lichtschranke v1.0");
-            
-            displayAvailable = true;
-            delay(2000);
+
+        if (initializeLcdAt(addresses[i], false)) {
+            preferences.putUChar("lcdAddr", addresses[i]);
             break;
-        } else {
-            Serial.print("ESP2: Fehler ");
-            Serial.print(error);
-            Serial.print(" bei 0x");
-            Serial.println(addresses[i], HEX);
         }
         delay(100);
     }
-    
+
     if (!displayAvailable) {
         Serial.println("ESP2: Kein 5V-Display gefunden - prüfe Verkabelung:");
         Serial.println("  VCC -> 5V (nicht 3.3V!)");
@@ -220,11 +518,16 @@ void connectToWiFiAndServer()
         Serial.println("'...");
         updateDisplay("Verbinde WLAN...", ssid_ap, "", "");
 
-        WiFi.begin(ssid_ap, password_ap);
+        // Assoziation aus setup() nicht abbrechen, sondern deren Restzeit abwarten
+        if (!wifiAssociationPending)
+        {
+            WiFi.begin(ssid_ap, password_ap);
+            wifiBeginTime = millis();
+        }
+        wifiAssociationPending = false;
 
-        unsigned long startTime = millis();
         while (WiFi.status() != WL_CONNECTED &&
-               (millis() - startTime) < CONNECTION_TIMEOUT_MS)
+               (millis() - wifiBeginTime) < CONNECTION_TIMEOUT_MS)
         {
             delay(500);
             Serial.print(".");
@@ -238,12 +541,22 @@ void connectToWiFiAndServer()
         }
 
         Serial.println("\nESP2: WLAN verbunden!");
+        if (bootTimings.wifiConnected == 0) bootTimings.wifiConnected = millis();
         Serial.print("ESP2: IP: ");
         Serial.println(WiFi.localIP());
         updateDisplay("WLAN verbunden", "IP: " + WiFi.localIP().toString(), "", "");
         delay(1000);
     }
 
+    // Die Assoziation aus setup() ist oft schon fertig, dann wurde der Block oben übersprungen
+    if (bootTimings.wifiConnected == 0) bootTimings.wifiConnected = millis();
+    if (!telemetryServer)
+    {
+        telemetryServer.begin();
+        Serial.print("ESP2: Telemetrie auf Port ");
+        Serial.println(TELEMETRY_PORT);
+    }
+
     // TCP-Verbindung zum Server
     if (!client.connected())
     {
@@ -252,7 +565,15 @@ void connectToWiFiAndServer()
 
         if (client.connect(serverIP, serverPort))
         {
+            serverLine.reset();
             Serial.println("ESP2: Mit Server verbunden!");
+            if (bootTimings.serverConnected == 0) bootTimings.serverConnected = millis();
+
+            // Zeitbasis vor der Kalibrierung abgleichen, damit schon diese im eigenen Slot pingt
+            if (!synchronizeTimeBase())
+            {
+                Serial.println("ESP2: WARNUNG - Keine Zeitsynchronisation, TDMA inaktiv");
+            }
 
             // Sensor-Kalibrierung mit Fallback bei Fehler
             if (!establishInitialReferenceDistanceClient())
@@ -264,19 +585,43 @@ void connectToWiFiAndServer()
             }
 
             triggerThreshold2 = referenceDistance2 / 2.0f;
+            gateDetector.configure(referenceDistance2, noiseSigma2);
             Serial.print("ESP2: Referenz: ");
             Serial.print(referenceDistance2);
             Serial.print("cm, Trigger: ");
             Serial.print(triggerThreshold2);
-            Serial.println("cm");
+            Serial.print("cm, Rauschen: ");
+            Serial.print(noiseSigma2);
+            Serial.println(CUSUM_DETECTOR ? "cm (CUSUM)" : "cm (Schwellwert)");
 
-            // Protokoll: CLIENT_READY signalisiert Bereitschaft
-            client.println("CLIENT_READY");
-            clientState = IDLE_WAITING_FOR_START;
-            lastHeartbeatReceived = millis(); // Startet Heartbeat-Überwachung
+            // Protokoll: CLIENT_READY:<epoch>[:<seq>] signalisiert Bereitschaft, die Kennung
+            // erlaubt dem Server, unsere Sequenznummern wiederzuerkennen. seq = unbestätigter
+            // letzter Lauf, der gleich als STOP_TIMER folgt
+            client.print("CLIENT_READY:");
+            if (stopTimerSeq != 0)
+            {
+                client.print(resultQueue.epoch);
+                client.print(":");
+                client.println(stopTimerSeq);
+            }
+            else
+            {
+                client.println(resultQueue.epoch);
+            }
+            resultSentSeq = 0; // Unbestätigte Ergebnisse in der neuen Verbindung erneut senden
+            if (resultQueue.count > 0)
+            {
+                Serial.print("ESP2: Rückstand ");
+                Serial.print(resultQueue.count);
+                Serial.println(" Ergebnisse - sende nach");
+                backlogStartTime = millis();
+            }
+            clientMachine.dispatch(EVC_CONNECTED);
+            linkMonitor.arm(millis()); // Startet Heartbeat-Überwachung
             updateDisplay("Bereit!", "Warte auf Start...",
                           "Referenz: " + String(referenceDistance2, 1) + "cm",
                           "Trigger: " + String(triggerThreshold2, 1) + "cm");
+            reportBootTimings();
         }
         else
         {
@@ -290,18 +635,21 @@ bool establishInitialReferenceDistanceClient()
 {
     Serial.println("ESP2: Messe Referenzdistanz...");
     updateDisplay("Kalibrierung...", "Messe Referenz", "Bereich freihalten!", "");
+    echoTimeoutUs = ECHO_TIMEOUT_US;    // Volle Reichweite, solange die Referenz unbekannt ist
 
     float totalDist = 0;
+    float samples[REFERENCE_SAMPLES];   // Gültige Messungen für die Rauschschätzung des Detektors
     int validSamples = 0;
 
     // Gleiche Kalibrierungsmethode wie Server für Konsistenz
     for (int i = 0; i < REFERENCE_SAMPLES; i++)
     {
-        float dist = measureDistanceClient(trigPin2, echoPin2);
-        if (dist > MIN_VALID_DISTANCE && dist < MAX_VALID_DISTANCE)
+        waitForOwnSlot(pingBudgetUs()); // Verbindungsaufbau blockiert ohnehin
+        float dist = measureGateDistanceClient(SENSOR_COUNT);
+        if (isValidDistance(dist))
         {
             totalDist += dist;
-            validSamples++;
+            samples[validSamples++] = dist;
         }
 
         // Live-Fortschrittsanzeige
@@ -316,6 +664,11 @@ bool establishInitialReferenceDistanceClient()
     if (validSamples >= REFERENCE_SAMPLES / 2)
     {
         referenceDistance2 = totalDist / validSamples;
+        noiseSigma2 = max(robustNoiseSigma(samples, validSamples), DETECTOR_MIN_SIGMA_CM);
+        // Kürzerer Echo-Timeout lässt mehr Pings in einen TDMA-Slot passen
+        echoTimeoutUs = min(ECHO_TIMEOUT_US,
+                            (unsigned long)(referenceDistance2 * ECHO_RANGE_MARGIN * 2.0f / SOUND_SPEED));
+        printTdmaBudget();
         Serial.print("ESP2: Referenzdistanz: ");
         Serial.print(referenceDistance2);
         Serial.println("cm");
@@ -328,86 +681,149 @@ bool establishInitialReferenceDistanceClient()
     }
 }
 
-float measureDistanceClient(int trigPin, int echoPin)
+// Ein Schranken-Messwert aus Round-Robin-Pings aller Sensoren, -1 = ungültig
+// Der Aufrufer startet im eigenen TDMA-Slot, endet der Slot, zählen die Pings bis dahin
+float measureGateDistanceClient(int pings)
 {
-    // Identische Messmethode wie Server für vergleichbare Ergebnisse
-    digitalWrite(trigPin, LOW);
-    delayMicroseconds(2);
-    digitalWrite(trigPin, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(trigPin, LOW);
-
-    long duration = pulseIn(echoPin, HIGH, 30000);
-    if (duration == 0)
-    {
-        return -1.0f;
-    }
-    return (duration * SOUND_SPEED / 2.0f);
+    return gateSensors.measureFused(pings, echoTimeoutUs, ownSlotWaitUs);
 }
 
 void handleConnectionLoss()
 {
-    // Automatischer State-Reset bei Verbindungsverlust
-    if (!client.connected() && clientState != WAITING_FOR_CONNECTION)
+    // Laufende Messung läuft offline weiter, sonst automatischer State-Reset (Übergangstabelle)
+    if (!client.connected() && clientState != WAITING_FOR_CONNECTION && !offlineTiming)
     {
-        Serial.println("ESP2: Verbindung verloren!");
-        updateDisplay("Verbindung verloren!", "Reconnecting...", "", "");
-        clientState = WAITING_FOR_CONNECTION;
-        timingStartTime = 0; // Verhindert falsche Zeitmessung nach Reconnect
+        clientMachine.dispatch(EVC_LINK_LOST);
     }
 }
 
+// Bedingung TIMING --LINK_LOST-->: nur beim ersten Verlust auf Offline-Messung umschalten
+bool linkStillUp()
+{
+    return !offlineTiming;
+}
+
+// Aktion TIMING --LINK_LOST--> TIMING: Messung lokal zu Ende führen, Ergebnis in die Warteschlange
+void continueOffline()
+{
+    Serial.println("ESP2: Verbindung verloren - Messung läuft offline weiter");
+    offlineTiming = true;
+    timeBase.synced = false; // Ohne Zeitbasis frei pingen
+    linkMonitor.armed = false;
+}
+
+// Aktion -> WAITING_FOR_CONNECTION nach Verbindungsverlust außerhalb einer Messung
+void enterWaiting()
+{
+    Serial.println("ESP2: Verbindung verloren!");
+    updateDisplay("Verbindung verloren!", "Reconnecting...", "", "");
+    timingStartTime = 0; // Verhindert falsche Zeitmessung nach Reconnect
+    timeBase.synced = false; // Neue Verbindung = neue Synchronisation
+    linkMonitor.armed = false;
+}
+
 void loop()
 {
+    unsigned long loopStart = micros();
+    idleScheduler.sampled(loopStart);
     handleConnectionLoss();
+    sampleMemory();
 
     if (clientState == WAITING_FOR_CONNECTION)
     {
         connectToWiFiAndServer();
-        delay(1000);
+        // Nach erfolgreichem Aufbau ohne Pause weiter: der Server wartet auf den ersten Heartbeat
+        if (clientState == WAITING_FOR_CONNECTION)
+        {
+            delay(1000);
+        }
         return;
     }
 
-    // Protokoll-Handler für Server-Nachrichten
-    if (client.available())
+    // Protokoll-Handler für Server-Nachrichten: alle vollständigen Zeilen dieses Durchlaufs,
+    // sonst wartet z.B. START_TIMER hinter einem HEARTBEAT einen ganzen LOOP_DELAY_MS
+    unsigned long rxStart = micros();
+    while (serverLine.poll(client))
     {
-        String serverData = client.readStringUntil('\n');
+        String serverData(serverLine.line());
         serverData.trim();
-        Serial.print("ESP2: Server: '");
-        Serial.print(serverData);
-        Serial.println("'");
+        handleServerMessage(serverData);
 
-        if (serverData.equals("START_TIMER") && clientState == IDLE_WAITING_FOR_START)
+        if (micros() - rxStart >= PROTOCOL_RX_BUDGET_US)
         {
-            Serial.println("ESP2: Zeitmessung gestartet!");
-            timingStartTime = millis();
-            clientState = TIMING_IN_PROGRESS;
-            updateDisplay("MESSUNG LAEUFT!", "Zeit: 0.000s",
-                          "Warte auf Objekt...", "Ref: " + String(referenceDistance2, 1) + "cm");
+            break; // Rest im nächsten Durchlauf, die Abtastung hat Vorrang
         }
-        else if (serverData.equals("START_TIMER") && clientState != IDLE_WAITING_FOR_START)
+    }
+
+    // Rückstand nachsenden bzw. unbestätigte Ergebnisse wiederholen
+    // Der letzte Lauf geht auch bei Wiederholung als STOP_TIMER hinter den älteren Ergebnissen
+    // raus, der Server ordnet ihn damit noch der laufenden Messung zu
+    if (client.connected() && !offlineTiming && clientState != WAITING_FOR_CONNECTION)
+    {
+        if (stopTimerSeq != 0)
         {
-            // State-Check verhindert fehlerhafte Messungen
-            Serial.println("ESP2: WARNUNG - START_TIMER ignoriert, nicht bereit!");
-            Serial.print("ESP2: Aktueller State: ");
-            Serial.println(clientState);
+            sendPendingResults(stopTimerSeq);
+            if (resultSentSeq < stopTimerSeq)
+            {
+                sendStopTimer(stopTimerSeq);
+            }
         }
-        else if (serverData.equals("HEARTBEAT"))
+        else
         {
-            lastHeartbeatReceived = millis();
-            client.println("HEARTBEAT_ACK");  // Bestätigung zurück an Server
-            Serial.println("ESP2: Heartbeat empfangen und bestätigt");
+            sendPendingResults();
         }
     }
+
+    // Regelmäßige Nachsynchronisation hält die Drift unter dem Schutzabstand
+    // Nicht während der Messung und nicht im Modem-Sleep (Antwort käme erst zum nächsten Beacon)
+    if (millis() - lastTimeSyncRequest >= TIME_SYNC_INTERVAL_MS &&
+        clientState != TIMING_IN_PROGRESS && !idleScheduler.saving)
+    {
+        resyncTimeBase();
+    }
     
-    // Heartbeat-Timeout erkennt stille Verbindungsabbrüche
-    if (clientState != WAITING_FOR_CONNECTION && 
-        millis() - lastHeartbeatReceived > HEARTBEAT_TIMEOUT_MS)
+    // Eigener Heartbeat mit Zeitstempel, das ACK des Servers liefert die Round-Trip-Time
+    if (millis() - lastHeartbeatSent >= HEARTBEAT_INTERVAL_MS)
     {
-        Serial.println("ESP2: Heartbeat Timeout - Verbindung verloren!");
-        updateDisplay("Heartbeat Timeout!", "Verbindung verloren", "", "");
-        clientState = WAITING_FOR_CONNECTION;
+        client.print("HEARTBEAT:");
+        client.print(++linkMonitor.sentSeq);
+        client.print(":");
+        client.println(micros());
+        lastHeartbeatSent = millis();
+    }
+
+    static unsigned long lastLinkStats = 0;
+    if (linkMonitor.hasRtt && millis() - lastLinkStats >= LINK_STATS_INTERVAL_MS)
+    {
+        Serial.print("ESP2: Link - RTT=");
+        Serial.print(linkMonitor.srttMs);
+        Serial.print("±");
+        Serial.print(linkMonitor.rttVarMs);
+        Serial.print("ms, Heartbeat-Abstand=");
+        Serial.print(linkMonitor.meanIntervalMs);
+        Serial.print("ms, Verlust=");
+        Serial.println(linkMonitor.lostHeartbeats);
+        if (telemetry.enabled)
+        {
+            Serial.print("ESP2: ");
+            Serial.println(telemetry.summary());
+        }
+        lastLinkStats = millis();
+    }
+
+    // Adaptive Ausfallerkennung ersetzt den festen 15s-Timeout
+    if (linkMonitor.suspected(millis()))
+    {
+        Serial.print("ESP2: Verbindung verdächtig - Phi=");
+        Serial.print(linkMonitor.phi(millis()));
+        Serial.print(", Stille ");
+        Serial.print(millis() - linkMonitor.lastArrival);
+        Serial.println("ms");
+        timeBase.synced = false;
+        linkMonitor.armed = false;
         client.stop();  // Sauberer Verbindungsabbau
+        // Während der Messung offline weiter, Ergebnis wird nachgereicht
+        clientMachine.dispatch(EVC_LINK_LOST);
     }
 
     // Client-Zustandsmaschine
@@ -415,7 +831,16 @@ void loop()
     {
     case TIMING_IN_PROGRESS:
     {
-        float currentDistance2 = measureDistanceClient(trigPin2, echoPin2);
+        // Nur im eigenen TDMA-Slot messen, der Loop schläft höchstens bis zum Slot-Beginn
+        if (ownSlotWaitUs(pingBudgetUs()) > 0)
+        {
+            break;
+        }
+
+        // Ein Ping pro Sensor hält die Abtastrate hoch, mehrere Sensoren sichern gegen Echo-Ausfall ab
+        unsigned long sampleUs = micros();
+        float currentDistance2 = measureGateDistanceClient(SENSOR_COUNT);
+        telemetry.record(sampleUs, currentDistance2, gateSensors.rawPings, gateSensors.rawCount);
         unsigned long currentTime = millis();
         unsigned long elapsedTime = currentTime - timingStartTime;
 
@@ -430,36 +855,32 @@ void loop()
             lastDisplayUpdate = currentTime;
         }
 
+        // Offline ohne Server-Timeout: gleiche Obergrenze wie der Server
+        if (offlineTiming && elapsedTime > MAX_OFFLINE_TIMING_MS)
+        {
+            clientMachine.dispatch(EVC_TIMEOUT);
+            break;
+        }
+
         // Objekterkennung beendet Zeitmessung
-        if (currentDistance2 > 0 && currentDistance2 <= triggerThreshold2)
+        // Gestoppt wird am geschätzten Beginn der Änderung, nicht erst bei ihrer Bestätigung
+        bool validDistance = isValidDistance(currentDistance2);
+        if (validDistance && speedTrapEnabled())
+        {
+            gateSpeed.push(currentTime, currentDistance2);
+        }
+        if (gateDetector.update(validDistance ? currentDistance2 : -1.0f, currentTime) &&
+            gateDetector.occupied())
         {
-            lastMeasuredTime = elapsedTime;
+            lastMeasuredTime = gateDetector.changeTime() - timingStartTime;
             Serial.print("ESP2: Objekt erkannt! Zeit: ");
             Serial.print(lastMeasuredTime);
-            Serial.println("ms");
-
-            if (client.connected())
-            {
-                // Protokoll: STOP_TIMER:Zeit_in_ms
-                String message = "STOP_TIMER:" + String(lastMeasuredTime);
-                client.println(message);
-                Serial.print("ESP2: Gesendet: '");
-                Serial.print(message);
-                Serial.println("'");
-            }
-            else
-            {
-                Serial.println("ESP2: FEHLER - Nicht verbunden!");
-            }
+            Serial.print("ms (bestätigt nach ");
+            Serial.print(gateDetector.confirmSamples());
+            Serial.println(" Messungen)");
+            lastFinishSpeed = speedTrapEnabled() ? gateSpeed.speedCmS(currentTime) : 0;
 
-            clientState = DISPLAYING_RESULT;
-            displayStartTime = millis();
-
-            // Ergebnis anzeigen
-            updateDisplay("ERGEBNIS:",
-                          "Zeit: " + String(lastMeasuredTime / 1000.0, 3) + "s",
-                          "= " + String(lastMeasuredTime) + "ms",
-                          "Druecke Reset...");
+            clientMachine.dispatch(EVC_OBJECT_DETECTED);
         }
         break;
     }
@@ -469,21 +890,607 @@ void loop()
         // Automatischer Übergang zu IDLE nach Anzeigedauer
         if (millis() - displayStartTime >= DISPLAY_DURATION_MS)
         {
-            clientState = IDLE_WAITING_FOR_START;
-            updateDisplay("Bereit!", "Warte auf Start...",
-                          "Letzte Zeit: " + String(lastMeasuredTime / 1000.0, 3) + "s",
-                          "Ref: " + String(referenceDistance2, 1) + "cm");
+            clientMachine.dispatch(EVC_DISPLAY_DONE);
         }
         break;
     }
 
     case IDLE_WAITING_FOR_START:
-        // Wartet passiv auf START_TIMER vom Server
+    {
+        // Wartet passiv auf START_TIMER vom Server, misst nur für einen Telemetrie-Empfänger (Aufbau)
+        if (telemetry.enabled && ownSlotWaitUs(pingBudgetUs()) == 0)
+        {
+            unsigned long sampleUs = micros();
+            float distance = measureGateDistanceClient(SENSOR_COUNT);
+            telemetry.record(sampleUs, distance, gateSensors.rawPings, gateSensors.rawCount);
+        }
         break;
+    }
 
     default:
         break;
     }
 
-    delay(LOOP_DELAY_MS);
-}
\ No newline at end of file
+    serviceTelemetry();
+    updatePowerMode();
+
+    // Im Sparbetrieb längere Scheiben, Heartbeats und Befehle warten so lange im Empfangspuffer
+    // Beim Messen höchstens bis zum Beginn des eigenen TDMA-Slots
+    unsigned long sleepMs = idleScheduler.sampleIntervalMs();
+    unsigned long slotWaitUs = ownSlotWaitUs(pingBudgetUs());
+    if ((clientState == TIMING_IN_PROGRESS || telemetry.enabled) && slotWaitUs > 0)
+    {
+        sleepMs = min(sleepMs, (slotWaitUs + 999) / 1000);
+    }
+    unsigned long sleepStart = micros();
+    delay(sleepMs);
+    if (idleScheduler.saving)
+    {
+        idleScheduler.account(sleepStart - loopStart, micros() - sleepStart);
+    }
+}
+
+// Eine vollständige Zeile vom Server, auch während einer Nachsynchronisation
+void handleServerMessage(const String &serverData)
+{
+    if (!serverData.startsWith("HEARTBEAT"))
+    {
+        Serial.print("ESP2: Server: '");
+        Serial.print(serverData);
+        Serial.println("'");
+    }
+
+    if (serverData.equals("WAKE") || serverData.startsWith("START_TIMER"))
+    {
+        // Protokoll: "WAKE" bei Objekterkennung am Start, START_TIMER weckt, falls WAKE verloren ging
+        wakeFromIdle(serverData.c_str());
+    }
+
+    if (serverData.startsWith("START_TIMER"))
+    {
+        // Protokoll: "START_TIMER:<ms>", ohne Angabe (ältere Server) zählt der Empfang
+        startTimerSinceMs = serverData.length() > 12 ? strtoul(serverData.c_str() + 12, nullptr, 10) : 0;
+        // Nur IDLE_WAITING_FOR_START nimmt START_TIMER an - verhindert fehlerhafte Messungen
+        if (!clientMachine.dispatch(EVC_START))
+        {
+            Serial.println("ESP2: WARNUNG - START_TIMER ignoriert, nicht bereit!");
+            Serial.print("ESP2: Aktueller State: ");
+            Serial.println(clientStateName(clientState));
+        }
+    }
+    else if (serverData.startsWith("HEARTBEAT:"))
+    {
+        // Protokoll: "HEARTBEAT:<seq>:<micros>" -> Echo als "HEARTBEAT_ACK:<seq>:<micros>"
+        client.print("HEARTBEAT_ACK");
+        client.println(serverData.substring(9));
+        linkMonitor.onHeartbeat(strtoul(serverData.c_str() + 10, nullptr, 10), millis());
+    }
+    else if (serverData.startsWith("HEARTBEAT_ACK:"))
+    {
+        int secondColon = serverData.indexOf(':', 14);
+        if (secondColon != -1)
+        {
+            linkMonitor.onAck(strtoul(serverData.c_str() + secondColon + 1, nullptr, 10), micros());
+        }
+    }
+    else if (serverData.startsWith("TIME_RESP:"))
+    {
+        handleTimeResponse(serverData);
+    }
+    else if (serverData.startsWith("RESULT_ACK:"))
+    {
+        handleResultAck(serverData);
+    }
+}
+
+// Verarbeitet "TIME_RESP:<t0>:<Server-micros>" und übernimmt bessere Messungen
+bool handleTimeResponse(const String &message)
+{
+    unsigned long receivedAt = micros();
+    int secondColon = message.indexOf(':', 10);
+    if (secondColon == -1)
+    {
+        return false;
+    }
+    unsigned long sentAt = strtoul(message.c_str() + 10, nullptr, 10);
+    unsigned long serverUs = strtoul(message.c_str() + secondColon + 1, nullptr, 10);
+    return timeBase.accept(sentAt, serverUs, receivedAt);
+}
+
+// Mehrere Anfragen, die Antwort mit der kürzesten Laufzeit ist am genauesten
+bool synchronizeTimeBase()
+{
+    timeBase.synced = false;
+
+    for (int round = 0; round < TIME_SYNC_ROUNDS; round++)
+    {
+        client.print("TIME_REQ:");
+        client.println(micros());
+
+        // Aktives Warten: der Empfangszeitpunkt geht direkt in die Laufzeitmessung ein
+        unsigned long waitStart = millis();
+        while (millis() - waitStart < TIME_SYNC_TIMEOUT_MS)
+        {
+            if (!serverLine.poll(client))
+            {
+                yield();
+                continue;
+            }
+            String response(serverLine.line());
+            response.trim();
+            if (response.startsWith("TIME_RESP:"))
+            {
+                handleTimeResponse(response);
+                break;
+            }
+        }
+    }
+    lastTimeSyncRequest = millis();
+
+    if (timeBase.synced)
+    {
+        Serial.print("ESP2: Zeitbasis synchronisiert - Unsicherheit ");
+        Serial.print(timeBase.baseUncertaintyUs);
+        Serial.println("us");
+    }
+    return timeBase.synced;
+}
+
+// Nachsynchronisation im laufenden Betrieb: eine Anfrage mit aktivem Warten, aber nur so lange,
+// wie eine noch verwertbare Antwort (TIME_SYNC_MAX_RTT_US) brauchen darf. Im Loop gelesen käme die
+// Antwort erst nach dem nächsten delay() an und wäre immer zu langsam.
+void resyncTimeBase()
+{
+    unsigned long sentAt = micros();
+    client.print("TIME_REQ:");
+    client.println(sentAt);
+
+    bool answered = false;
+    while (!answered && micros() - sentAt < TIME_SYNC_MAX_RTT_US)
+    {
+        if (!serverLine.poll(client))
+        {
+            yield();
+            continue;
+        }
+        String message(serverLine.line());
+        message.trim();
+        if (message.startsWith("TIME_RESP:"))
+        {
+            handleTimeResponse(message);
+            answered = true;
+        }
+        else
+        {
+            handleServerMessage(message); // z.B. START_TIMER darf nicht verloren gehen
+        }
+    }
+
+    // Zu langsame Antwort: bald erneut versuchen statt erst nach dem vollen Intervall
+    lastTimeSyncRequest = answered ? millis() : millis() - (TIME_SYNC_INTERVAL_MS - TIME_SYNC_RETRY_MS);
+}
+
+// Wartezeit bis der eigene TDMA-Slot noch Platz für einen vollständigen Ping hat, 0 = sofort
+// Die Sync-Unsicherheit verkleinert das nutzbare Fenster auf beiden Seiten
+unsigned long ownSlotWaitUs(unsigned long pingBudgetUs)
+{
+#if TDMA_ENABLED
+    if (!timeBase.synced)
+    {
+        return 0;
+    }
+
+    // Obergrenze verhindert ein leeres Fenster, falls Nachsynchronisationen ausbleiben
+    unsigned long margin = min(TDMA_GUARD_US + timeBase.uncertaintyUs(), TDMA_SLOT_US / 4);
+    unsigned long windowStart = TDMA_SLOT_INDEX * TDMA_SLOT_US + margin;
+    unsigned long windowEnd = (TDMA_SLOT_INDEX + 1) * TDMA_SLOT_US - margin;
+    unsigned long phase = timeBase.now() % TDMA_FRAME_US;
+
+    if (phase >= windowStart && phase + pingBudgetUs <= windowEnd)
+    {
+        return 0;
+    }
+    return (windowStart + TDMA_FRAME_US - phase) % TDMA_FRAME_US;
+#else
+    return 0;
+#endif
+}
+
+// Blockierend, nur für die Kalibrierung beim Verbindungsaufbau
+void waitForOwnSlot(unsigned long pingBudgetUs)
+{
+    unsigned long waitUs = ownSlotWaitUs(pingBudgetUs);
+    delay(waitUs / 1000);
+    delayMicroseconds(waitUs % 1000);
+}
+
+// Längster Ping samt Schutzabstand davor
+unsigned long pingBudgetUs()
+{
+    return GateSensors::pingBudgetUs(echoTimeoutUs);
+}
+
+// Meldet die erreichbare Abtastrate dieser Schranke im TDMA-Betrieb
+void printTdmaBudget()
+{
+    unsigned long margin = min(TDMA_GUARD_US + timeBase.uncertaintyUs(), TDMA_SLOT_US / 4);
+    unsigned long window = TDMA_SLOT_US - 2 * margin;
+    unsigned long pingsPerSlot = window / (pingBudgetUs());
+    Serial.print("ESP2: TDMA ");
+    Serial.print(timeBase.synced ? "aktiv" : "inaktiv");
+    Serial.print(" - ");
+    Serial.print(pingsPerSlot);
+    Serial.print(" Pings/Slot, ");
+    Serial.print(pingsPerSlot * 1000000UL / TDMA_FRAME_US);
+    Serial.print(" Pings/s, ");
+    Serial.print(1000000UL / TDMA_FRAME_US);
+    Serial.println(" Messwerte/s");
+}
+
+// Einmalige Meldung der Boot-Phasen nach der ersten vollständigen Verbindung
+void reportBootTimings()
+{
+    if (bootTimings.reported)
+    {
+        return;
+    }
+    bootTimings.reported = true;
+
+    Serial.print("ESP2: Boot-Phasen - Display: ");
+    Serial.print(bootTimings.displayReady);
+    Serial.print(bootTimings.cachedDisplay ? "ms (Cache)" : "ms (Scan)");
+    Serial.print(", Setup: ");
+    Serial.print(bootTimings.setupDone);
+    Serial.print("ms, WLAN: ");
+    Serial.print(bootTimings.wifiConnected);
+    Serial.print("ms, Server: ");
+    Serial.print(bootTimings.serverConnected);
+    Serial.print("ms, Bereit: ");
+    Serial.print(millis());
+    Serial.println("ms");
+}
+
+// Warteschlange aus dem NVS, beim ersten Start neue Kennung für die Deduplizierung
+void loadResultQueue()
+{
+    if (preferences.getBytesLength("resultQ") != sizeof(ResultQueue) ||
+        preferences.getBytes("resultQ", &resultQueue, sizeof(ResultQueue)) != sizeof(ResultQueue))
+    {
+        resultQueue = ResultQueue();
+        resultQueue.epoch = esp_random();
+        saveResultQueue();
+        return;
+    }
+    if (resultQueue.count > 0)
+    {
+        Serial.print("ESP2: ");
+        Serial.print(resultQueue.count);
+        Serial.println(" unbestätigte Ergebnisse aus dem NVS");
+    }
+}
+
+void saveResultQueue()
+{
+    preferences.putBytes("resultQ", &resultQueue, sizeof(ResultQueue));
+}
+
+// Protokoll: "RESULTS:<seq>:<ms>,<seq>:<ms>,..." mit bis zu RESULT_BATCH_SIZE Einträgen
+// Sendet alle noch nicht gesendeten Einträge vor beforeSeq, nach RESULT_RETRY_MS ohne ACK alles erneut
+void sendPendingResults(uint32_t beforeSeq)
+{
+    if (resultQueue.count == 0)
+    {
+        return;
+    }
+    if (resultSentSeq >= resultQueue.at(resultQueue.count - 1).seq &&
+        millis() - lastResultSend >= RESULT_RETRY_MS)
+    {
+        resultSentSeq = 0; // ACK ausgeblieben
+    }
+
+    String batch;
+    int inBatch = 0;
+    bool sentAny = false;
+    for (int i = 0; i < resultQueue.count; i++)
+    {
+        const QueuedResult &e = resultQueue.at(i);
+        if (e.seq <= resultSentSeq)
+        {
+            continue;
+        }
+        if (e.seq >= beforeSeq)
+        {
+            break;
+        }
+        batch += (inBatch == 0 ? "RESULTS:" : ",") + String(e.seq) + ":" + String(e.timeMs);
+        resultSentSeq = e.seq;
+        sentAny = true;
+        if (++inBatch == RESULT_BATCH_SIZE)
+        {
+            client.println(batch);
+            batch = "";
+            inBatch = 0;
+        }
+    }
+    if (inBatch > 0)
+    {
+        client.println(batch);
+    }
+    if (sentAny)
+    {
+        lastResultSend = millis();
+    }
+}
+
+// Protokoll: "RESULT_ACK:<seq>" bestätigt alle Ergebnisse bis einschließlich seq
+void handleResultAck(const String &message)
+{
+    uint32_t seq = strtoul(message.c_str() + 11, nullptr, 10);
+    if (seq >= stopTimerSeq)
+    {
+        stopTimerSeq = 0;
+    }
+    if (resultQueue.acknowledge(seq) == 0)
+    {
+        return;
+    }
+    saveResultQueue();
+
+    if (backlogStartTime != 0 && resultQueue.count == 0)
+    {
+        Serial.print("ESP2: Rückstand übertragen in ");
+        Serial.print(millis() - backlogStartTime);
+        Serial.println("ms");
+        backlogStartTime = 0;
+    }
+    if (resultQueueOverflow > 0)
+    {
+        Serial.print("ESP2: WARNUNG - ");
+        Serial.print(resultQueueOverflow);
+        Serial.println(" Ergebnisse wegen voller Warteschlange verworfen");
+        resultQueueOverflow = 0;
+    }
+}
+
+// Speicher-Messpunkt einmal pro Minute, auch ohne Verbindung
+// Protokoll: "MEM:<frei>,<minimum>,<größter Block>,<Stack-Reserve>"
+void sampleMemory()
+{
+    if (memoryTelemetry.count > 0 && millis() - lastMemorySample < MEMORY_SAMPLE_INTERVAL_MS)
+    {
+        return;
+    }
+    lastMemorySample = millis();
+    MemorySample sample = readMemorySample(lastMemorySample);
+    if (memoryTelemetry.record(sample))
+    {
+        Serial.print("ESP2: WARNUNG Speicher - ");
+        Serial.println(memoryTelemetry.toJSON());
+    }
+
+    if (clientState != WAITING_FOR_CONNECTION && client.connected())
+    {
+        client.print("MEM:");
+        client.print(sample.freeHeap);
+        client.print(",");
+        client.print(sample.minFreeHeap);
+        client.print(",");
+        client.print(sample.largestBlock);
+        client.print(",");
+        client.println(sample.stackFree);
+    }
+}
+
+// Aktion IDLE -> TIMING auf START_TIMER
+void startTiming()
+{
+    Serial.println("ESP2: Zeitmessung gestartet!");
+    timingStartTime = millis() - startTimerSinceMs;
+    gateDetector.reset(false);
+    gateSpeed.reset();
+    updateDisplay("MESSUNG LAEUFT!", "Zeit: 0.000s",
+                  "Warte auf Objekt...", "Ref: " + String(referenceDistance2, 1) + "cm");
+}
+
+// Aktion TIMING -> DISPLAYING_RESULT: lastMeasuredTime ist gesetzt
+void finishTiming()
+{
+    // Erst persistent ablegen, dann senden - bestätigt wird per RESULT_ACK
+    uint32_t seq = resultQueue.push(lastMeasuredTime, resultQueueOverflow);
+    saveResultQueue();
+    stopTimerSeq = seq;
+
+    if (client.connected() && !offlineTiming)
+    {
+        // Ältere Rückstände zuerst: der Server erwartet steigende Sequenznummern
+        sendPendingResults(seq);
+        sendStopTimer(seq);
+    }
+    else
+    {
+        // Geht nach dem Wiederverbinden raus, der Server wartet bis zu seinem Timeout
+        Serial.print("ESP2: Nicht verbunden - Ergebnis gespeichert, ");
+        Serial.print(resultQueue.count);
+        Serial.println(" ausstehend");
+    }
+
+    displayStartTime = millis();
+
+    // Ergebnis anzeigen, im Speed-Trap-Modus mit Durchschnitts- und Zielgeschwindigkeit
+    if (speedTrapEnabled())
+    {
+        Serial.print("ESP2: Geschwindigkeit ");
+        Serial.print(formatSpeed(averageSpeedCmS(lastMeasuredTime)));
+        Serial.print(", am Ziel ");
+        Serial.println(formatSpeed(lastFinishSpeed));
+        updateDisplay("ERGEBNIS: " + String(lastMeasuredTime / 1000.0, 3) + "s",
+                      "v " + formatSpeed(averageSpeedCmS(lastMeasuredTime)),
+                      lastFinishSpeed > 0 ? "Ziel " + String(lastFinishSpeed * 0.036f, 1) + "km/h" : "Ziel -",
+                      offlineTiming ? "Offline gespeichert" : "Druecke Reset...");
+    }
+    else
+    {
+        updateDisplay("ERGEBNIS:",
+                      "Zeit: " + String(lastMeasuredTime / 1000.0, 3) + "s",
+                      "= " + String(lastMeasuredTime) + "ms",
+                      offlineTiming ? "Offline gespeichert" : "Druecke Reset...");
+    }
+    offlineTiming = false;
+}
+
+// Protokoll: STOP_TIMER:Zeit_in_ms:Sequenznummer[:Zielgeschwindigkeit_cm/s] für den letzten Lauf
+void sendStopTimer(uint32_t seq)
+{
+    String message = "STOP_TIMER:" + String(lastMeasuredTime) + ":" + String(seq);
+    if (speedTrapEnabled())
+    {
+        message += ":" + String(lastFinishSpeed);
+    }
+    client.println(message);
+    resultSentSeq = seq;
+    lastResultSend = millis();
+    Serial.print("ESP2: Gesendet: '");
+    Serial.print(message);
+    Serial.println("'");
+}
+
+// Aktion DISPLAYING_RESULT -> IDLE nach Anzeigedauer
+void showReady()
+{
+    updateDisplay("Bereit!", "Warte auf Start...",
+                  "Letzte Zeit: " + String(lastMeasuredTime / 1000.0, 3) + "s",
+                  "Ref: " + String(referenceDistance2, 1) + "cm");
+}
+
+// Aktion TIMING -> WAITING: Offline-Messung ohne Server-Timeout hat die gleiche Obergrenze wie der Server
+void abortOfflineTiming()
+{
+    Serial.println("ESP2: Offline-Messung abgebrochen - Timeout");
+    offlineTiming = false;
+    timingStartTime = 0;
+    updateDisplay("Messung Timeout!", "Verbindung verloren", "", "");
+}
+
+const char *clientStateName(StateClient state)
+{
+    static const char *names[CLIENT_STATE_COUNT] = {"WAITING", "IDLE", "TIMING", "DISPLAY"};
+    return state < CLIENT_STATE_COUNT ? names[state] : "UNKNOWN";
+}
+
+const char *clientEventName(ClientEvent event)
+{
+    static const char *names[CLIENT_EVENT_COUNT] = {"CONNECTED", "START", "OBJECT_DETECTED",
+                                                    "DISPLAY_DONE", "LINK_LOST", "TIMEOUT"};
+    return event < CLIENT_EVENT_COUNT ? names[event] : "UNKNOWN";
+}
+
+// Trace-Hook der Zustandsmaschine: jeder Übergang mit Zeitabstand zum vorherigen
+void traceTransition(StateClient from, StateClient to, ClientEvent event, unsigned long atUs)
+{
+    Serial.print("ESP2: Zustand ");
+    Serial.print(clientStateName(from));
+    Serial.print(" -> ");
+    Serial.print(clientStateName(to));
+    Serial.print(" (");
+    Serial.print(clientEventName(event));
+    Serial.print(", +");
+    Serial.print(atUs - lastTransitionUs);
+    Serial.println("us)");
+    lastTransitionUs = atUs;
+}
+
+// Sparbetrieb nur bereit und verbunden, jeder andere Zustand weckt
+void updatePowerMode()
+{
+    if (clientState != IDLE_WAITING_FOR_START)
+    {
+        wakeFromIdle(clientStateName(clientState));
+    }
+    else if (telemetry.enabled)
+    {
+        wakeFromIdle("Telemetrie"); // Empfänger soll die volle Abtastrate sehen
+    }
+    else if (idleScheduler.update(millis(), true))
+    {
+        powerControl.enterSaving();
+        Serial.print("ESP2: Sparbetrieb (");
+        Serial.print(powerControl.mode());
+        Serial.println(", Modem-Sleep)");
+    }
+    reportPower();
+}
+
+void wakeFromIdle(const char *reason)
+{
+    if (!idleScheduler.wake(millis(), micros()))
+    {
+        return;
+    }
+    powerControl.leaveSaving();
+    // Im Sparbetrieb gab es keine Nachsynchronisation: gleich im nächsten Loop nachholen
+    lastTimeSyncRequest = millis() - TIME_SYNC_INTERVAL_MS;
+    Serial.print("ESP2: Sparbetrieb beendet - ");
+    Serial.println(reason);
+}
+
+// Wachanteil und Aufwachlatenz einmal pro Minute, nur wenn es einen Sparbetrieb gab
+void reportPower()
+{
+    if (millis() - lastPowerReport < POWER_REPORT_INTERVAL_MS)
+    {
+        return;
+    }
+    lastPowerReport = millis();
+    if (idleScheduler.saving || idleScheduler.wakeUps > 0)
+    {
+        Serial.print("ESP2: Energie - ");
+        Serial.print(powerControl.mode());
+        Serial.print(", ");
+        Serial.println(idleScheduler.summary());
+    }
+}
+
+// Ein Empfänger auf TELEMETRY_PORT, ein neuer ersetzt den alten
+// Senden nur mit MSG_DONTWAIT, bei Rückstau dünnt der Stream aus statt die Messung aufzuhalten
+void serviceTelemetry()
+{
+    WiFiClient incoming = telemetryServer.available();
+    if (incoming)
+    {
+        telemetryClient.stop();
+        telemetryClient = incoming;
+        telemetryClient.setNoDelay(true);
+        telemetry.reset();
+        telemetry.enabled = true;
+        Serial.println("ESP2: Telemetrie-Empfänger verbunden");
+    }
+    if (!telemetry.enabled)
+    {
+        return;
+    }
+    if (!telemetryClient.connected())
+    {
+        telemetryClient.stop();
+        telemetry.enabled = false;
+        Serial.print("ESP2: Telemetrie-Empfänger getrennt - ");
+        Serial.println(telemetry.summary());
+        return;
+    }
+
+    telemetry.flushIfDue(micros());
+    const uint8_t *data;
+    int len;
+    while (telemetry.pending(data, len))
+    {
+        int sent = send(telemetryClient.fd(), data, len, MSG_DONTWAIT);
+        if (sent <= 0)
+        {
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                telemetryClient.stop(); // Wird im nächsten Durchlauf als getrennt erkannt
+            }
+            return;
+        }
+        telemetry.consumed(sent);
+    }
+}
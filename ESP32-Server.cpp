@@ -5,6 +5,18 @@
 #include <WiFiClient.h>
 #include <WiFiAP.h>
 #include <SPIFFS.h>
+#include <Preferences.h>
+#include <lwip/sockets.h>
+#include <esp_timer.h>
+#include "Lichtschranke-Treiber.h"
+#include "Lichtschranke-Detektor.h"
+#include "Lichtschranke-Speicher.h"
+#include "Lichtschranke-Protokoll.h"
+#include "Lichtschranke-Zustand.h"
+#include "Lichtschranke-Energie.h"
+#include "Lichtschranke-Geschwindigkeit.h"
+#include "Lichtschranke-Telemetrie.h"
+#include "Lichtschranke-Verbindung.h"
 
 // WiFi-Konfiguration als Access Point
 // Der Server erstellt sein eigenes Netzwerk, damit die Verbindung
@@ -20,23 +32,64 @@ WiFiClient client;
 // HC-SR04 Ultraschallsensor
 const int trigPin1 = 5;
 const int echoPin1 = 18;
-#define SOUND_SPEED 0.034f  // cm/µs bei 20°C
+
+// Mehrere HC-SR04 pro Schranke, z.B. mit -DSENSOR_COUNT=3 übersetzen
+// Sensor 0 liegt auf den bisherigen Pins, weitere Sensoren auf freien GPIOs
+// (GPIO 34/35 sind reine Eingänge - ideal für Echo)
+#ifndef SENSOR_COUNT
+#define SENSOR_COUNT 1
+#endif
+#if SENSOR_COUNT == 1
+typedef SensorGroup<UltrasonicSensor<trigPin1, echoPin1>> GateSensors;
+#elif SENSOR_COUNT == 2
+typedef SensorGroup<UltrasonicSensor<trigPin1, echoPin1>, UltrasonicSensor<32, 34>> GateSensors;
+#elif SENSOR_COUNT == 3
+typedef SensorGroup<UltrasonicSensor<trigPin1, echoPin1>, UltrasonicSensor<32, 34>, UltrasonicSensor<33, 35>> GateSensors;
+#else
+#error "SENSOR_COUNT: 1 bis 3 Sensoren pro Schranke"
+#endif
 
 // Ampel-LEDs
 const int rledPin = 25;
 const int yledPin = 26;
 const int gledPin = 27;
+typedef TrafficLightDriver<rledPin, yledPin, gledPin> TrafficLight;
 
 // Timing-Konstanten für Ampelsequenz und Systemverhalten
 const unsigned long YELLOW_PENDING_DELAY_MS = 500;              // Verzögerung nach Objekterkennung bis Gelb angeht
 const unsigned long RED_PENDING_DELAY_AFTER_YELLOW_MS = 2000;   // Gelb-Phase Dauer vor Rot
 const unsigned long LOOP_DELAY_MS = 20;                         // Kurze Loop-Verzögerung für ~50Hz Abtastrate
 const unsigned long CLIENT_TIMEOUT_MS = 10000;                  // Timeout wenn Client nicht antwortet
-const float MIN_VALID_DISTANCE = 2.0f;                          // HC-SR04 Minimum (technisches Limit)
-const float MAX_VALID_DISTANCE = 400.0f;                        // HC-SR04 Maximum (technisches Limit)
-const float HYSTERESIS_FACTOR = 1.15f;                         // Verhindert Prellen beim Objektverlassen (15% Puffer)
+const float HYSTERESIS_FACTOR = 1.15f;                         // Schwellwert-Detektor: Verlassen mit 15% Puffer gegen Prellen
 const int REFERENCE_SAMPLES = 15;                              // Anzahl Kalibrierungsmessungen für stabilen Mittelwert
 const unsigned long MAX_TIMING_DURATION_MS = 30000;            // Maximale Messzeit als Sicherheitsmechanismus
+const int GATE_PINGS_PER_READING = 5;                          // Pings pro fusioniertem Messwert (über alle Sensoren)
+const unsigned long ECHO_TIMEOUT_US = 30000;                   // 30ms = ~5m Reichweite
+const float ECHO_RANGE_MARGIN = 1.5f;                          // Echo-Timeout nach Kalibrierung = 1.5x Referenz
+const unsigned long LED_TEST_FAST_MS = 200;                    // Verkürzter LED-Test beim Schnellstart
+const int CAL_VALIDATION_SAMPLES = 5;                          // Prüfmessungen für gespeicherte Kalibrierung
+const float CAL_TOLERANCE_CM = 3.0f;                           // Erlaubte Abweichung zur gespeicherten Referenz...
+const float CAL_TOLERANCE_FACTOR = 0.05f;                      // ...oder 5% davon, je nachdem was größer ist
+
+// Objekterkennung: CUSUM-Änderungstest (1) oder bisheriger fester Schwellwert (0)
+#ifndef CUSUM_DETECTOR
+#define CUSUM_DETECTOR 1
+#endif
+const float DETECTOR_FALSE_ALARM_RATE = 1e-4f;                 // Fehlalarme pro Messwert, Schwelle h = ln(1/alpha)
+const int DETECTOR_MIN_SAMPLES = 2;                            // Ein einzelner Ausreißer löst nie aus
+const float DETECTOR_MIN_SIGMA_CM = 1.0f;                      // Untergrenze für das Rauschen aus der Kalibrierung
+const float APPROACH_WAKE_SIGMAS = 4.0f;                       // Sparbetrieb: ein Ping so weit unter der Referenz weckt auf
+
+// TDMA-Zeitplan gegen Übersprechen zwischen den Schranken
+// Beide Knoten teilen sich einen Rahmen aus zwei Slots, jede Schranke pingt nur in ihrem Slot.
+// Der Server liefert die gemeinsame Zeitbasis (micros()), der Client gleicht sich per TIME_REQ an.
+#ifndef TDMA_ENABLED
+#define TDMA_ENABLED 1
+#endif
+const unsigned long TDMA_SLOT_US = 40000;                      // Slot-Länge, muss einen vollen Echo-Timeout fassen
+const unsigned long TDMA_FRAME_US = 2 * TDMA_SLOT_US;          // Slot 0 = Server, Slot 1 = Client
+const unsigned long TDMA_GUARD_US = 2000;                      // Schutzabstand an beiden Slot-Rändern
+const unsigned long TDMA_SLOT_INDEX = 0;
 
 // State Machine für präzise Ablaufsteuerung
 // Jeder Zustand hat eine klar definierte Aufgabe und Übergangsbedingung
@@ -49,13 +102,41 @@ enum State
     RED_ON_WAITING_FOR_OBJECT_LEAVE,    // Rot an, wartet bis Objekt die Schranke verlässt
     TIMING_STARTED_ALL_ON,              // Zeitmessung läuft (alle LEDs an als Signal)
     WAITING_FOR_TIMING_COMPLETE,        // Cooldown nach Messung
-    ERROR_STATE                         // Fehlerbehandlung mit Blink-Pattern
+    ERROR_STATE,                        // Fehlerbehandlung mit Blink-Pattern
+    STATE_COUNT
+};
+
+// Ereignisse, auf die die Zustandsmaschine reagiert - die Übergänge stehen in serverTransitions
+enum Event
+{
+    EV_CALIBRATED,                      // Kalibrierung abgeschlossen (Boot oder Wiederherstellung)
+    EV_OBJECT_ENTERED,                  // Detektor meldet belegt
+    EV_YELLOW_ON,                       // Sequenzer hat Gelb geschaltet
+    EV_RED_ON,                          // Sequenzer hat Rot geschaltet
+    EV_OBJECT_LEFT,                     // Detektor meldet frei
+    EV_STOP_RECEIVED,                   // STOP_TIMER vom Client
+    EV_COOLDOWN_DONE,
+    EV_TIMEOUT,                         // Keine Antwort innerhalb MAX_TIMING_DURATION_MS
+    EV_LINK_LOST,                       // Ausfallerkennung hat den Client getrennt
+    EV_FAULT,                           // Sensor, Access Point oder Kalibrierung ausgefallen
+    EVENT_COUNT
 };
-State currentState = SYSTEM_INIT;
 
 // Sensor-Kalibrierung und Schwellwerte
 float referenceDistance1 = -1.0f;       // Gemessene Referenzdistanz beim Start (leerer Messbereich)
+float currentDistance1 = -1.0f;         // Letzte Abtastung, für die Meldungen der Übergangsaktionen
+SpeedWindow gateSpeed;                  // Letzte Abstände für die Momentangeschwindigkeit an Schranke 1
+uint32_t startSpeed = 0;                // cm/s beim Verlassen, gilt für den laufenden Lauf
 float triggerThreshold1 = -1.0f;        // Auslöseschwelle = Referenz / 2
+float noiseSigma1 = DETECTOR_MIN_SIGMA_CM;  // Standardabweichung der Kalibriermessungen
+
+#if CUSUM_DETECTOR
+CusumDetector cusumDetector(DETECTOR_FALSE_ALARM_RATE, DETECTOR_MIN_SAMPLES, DETECTOR_MIN_SIGMA_CM);
+CrossingDetector &gateDetector = cusumDetector;
+#else
+ThresholdDetector thresholdDetector(HYSTERESIS_FACTOR);
+CrossingDetector &gateDetector = thresholdDetector;
+#endif
 
 // Zeitstempel für State-Übergänge
 unsigned long objectDetectedTime = 0;
@@ -66,15 +147,336 @@ unsigned long displayStartTime = 0;
 
 // Verbindungs- und Zustandsmanagement
 bool clientConnected = false;
+bool clientTimeSynced = false;          // Client hat sich auf unsere Zeitbasis synchronisiert (TDMA aktiv)
+unsigned long echoTimeoutUs = ECHO_TIMEOUT_US;  // Wird nach Kalibrierung an die Referenz angepasst
 int consecutiveInvalidReadings = 0;
 const int MAX_INVALID_READINGS = 10;    // Nach 10 Fehlmessungen → Sensor-Fehler
-bool timingInProgress = false;          // Kritisches Flag: Verhindert Mehrfach-Messungen
 
 // Timing-Sicherheit und Heartbeat
 const unsigned long MIN_TIME_BETWEEN_MEASUREMENTS_MS = 2000;  // Verhindert zu schnelle Messfolgen
-const unsigned long HEARTBEAT_INTERVAL_MS = 5000;            // Prüft Verbindung alle 5s
 unsigned long lastHeartbeatSent = 0;
-unsigned long lastHeartbeatReceived = 0;
+bool clientReady = false;               // CLIENT_READY empfangen, Ausfallerkennung aktiv
+
+// Phi-Accrual-Ausfallerkennung der Client-Verbindung (Lichtschranke-Verbindung.h)
+LinkMonitor linkMonitor;
+
+// Round-Robin-Zeitplan und Median-Fusion der Sensoren (Lichtschranke-Treiber.h)
+GateSensors gateSensors("ESP1");
+
+// Persistente Kalibrierung im NVS - erlaubt Schnellstart nach Brownout/Reset
+// Ohne Echtzeituhr dienen Boot-Zähler und Uptime als Zeitstempel
+const uint32_t CALIBRATION_VERSION = 2;     // Bei Formatänderung erhöhen, alte Daten werden verworfen
+struct CalibrationCache {
+    uint32_t version = 0;
+    float referenceDistance = -1.0f;
+    float triggerThreshold = -1.0f;
+    uint8_t sensorCount = 0;                // Konfiguration bei der Kalibrierung
+    uint8_t healthySensors = 0;             // Sensoren mit Echo zum Kalibrierzeitpunkt
+    uint8_t validSamples = 0;               // Gültige Kalibriermessungen von REFERENCE_SAMPLES
+    uint32_t bootCount = 0;                 // Boot, in dem kalibriert wurde
+    uint32_t uptimeMs = 0;                  // millis() beim Speichern
+    float noiseSigma = 0;                   // Rauschen der Kalibriermessungen für den Detektor
+};
+Preferences preferences;
+uint32_t bootCount = 0;
+
+// Kooperativer Scheduler: Hashed Timer Wheel statt delay()
+// LED-Muster, Cooldowns, Timeouts und Wiederholversuche laufen als Timer-Callbacks,
+// damit loop() nie blockiert und Nachrichten, Heartbeats und Durchgänge immer bedient werden.
+// Einfügen und Abbrechen in O(1), pro Tick wird nur ein Bucket geprüft.
+const unsigned long TIMER_TICK_MS = 10;
+const int TIMER_WHEEL_SLOTS = 64;           // 640ms pro Umlauf, längere Timer zählen Runden
+const int MAX_TIMERS = 16;
+const int NO_TIMER = -1;
+
+typedef void (*TimerCallback)();
+
+struct TimerWheel {
+    struct Timer {
+        TimerCallback callback = nullptr;
+        unsigned long rounds = 0;           // Verbleibende volle Umläufe bis zum Ablauf
+        int next = NO_TIMER;                // Verkettung innerhalb des Buckets bzw. der Freiliste
+        uint8_t generation = 0;             // Macht alte Handles nach Wiederverwendung ungültig
+        bool cancelled = false;
+    };
+    Timer timers[MAX_TIMERS];
+    int buckets[TIMER_WHEEL_SLOTS];
+    int freeList = NO_TIMER;
+    unsigned long currentTick = 0;
+    unsigned long lastTickMs = 0;
+
+    void begin(unsigned long now) {
+        for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) buckets[i] = NO_TIMER;
+        for (int i = 0; i < MAX_TIMERS; i++) timers[i].next = (i + 1 < MAX_TIMERS) ? i + 1 : NO_TIMER;
+        freeList = 0;
+        lastTickMs = now;
+    }
+
+    // Liefert ein Handle für cancel() oder NO_TIMER wenn alle Timer belegt sind
+    int schedule(unsigned long delayMs, TimerCallback callback) {
+        if (freeList == NO_TIMER) {
+            Serial.println("ESP1: WARNUNG - Keine freien Timer");
+            return NO_TIMER;
+        }
+        int index = freeList;
+        Timer &timer = timers[index];
+        freeList = timer.next;
+
+        unsigned long ticks = max(1UL, (delayMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS);
+        int slot = (currentTick + ticks) % TIMER_WHEEL_SLOTS;
+        timer.callback = callback;
+        timer.rounds = (ticks - 1) / TIMER_WHEEL_SLOTS;
+        timer.cancelled = false;
+        timer.generation++;
+        timer.next = buckets[slot];
+        buckets[slot] = index;
+        return (timer.generation << 8) | index;
+    }
+
+    // Abgebrochene Timer werden beim nächsten Besuch ihres Buckets freigegeben
+    void cancel(int &handle) {
+        if (handle == NO_TIMER) return;
+        Timer &timer = timers[handle & 0xFF];
+        if (timer.generation == (uint8_t)(handle >> 8)) {
+            timer.cancelled = true;
+        }
+        handle = NO_TIMER;
+    }
+
+    // Arbeitet alle seit dem letzten Aufruf vergangenen Ticks ab
+    void advance(unsigned long now) {
+        while (now - lastTickMs >= TIMER_TICK_MS) {
+            lastTickMs += TIMER_TICK_MS;
+            currentTick++;
+            int slot = currentTick % TIMER_WHEEL_SLOTS;
+
+            // Erst aushängen, dann aufrufen: Callbacks dürfen neue Timer einplanen
+            TimerCallback expired[MAX_TIMERS];
+            int expiredCount = 0;
+            int *link = &buckets[slot];
+            while (*link != NO_TIMER) {
+                int index = *link;
+                Timer &timer = timers[index];
+                if (!timer.cancelled && timer.rounds > 0) {
+                    timer.rounds--;
+                    link = &timer.next;
+                    continue;
+                }
+                *link = timer.next;
+                if (!timer.cancelled) {
+                    expired[expiredCount++] = timer.callback;
+                }
+                timer.generation++;
+                timer.next = freeList;
+                freeList = index;
+            }
+            for (int i = 0; i < expiredCount; i++) {
+                expired[i]();
+            }
+        }
+    }
+};
+TimerWheel timerWheel;
+
+// Handles der laufenden Timer
+int errorBlinkTimer = NO_TIMER;
+int recoveryTimer = NO_TIMER;
+int timingTimeoutTimer = NO_TIMER;
+int cooldownTimer = NO_TIMER;
+int errorBlinkStepsLeft = 0;
+bool recoveryStepDue = false;       // Kalibriermessung fällig, läuft mit dem nächsten eigenen TDMA-Slot
+
+// Startampel-Sequenz mit exakten Schaltzeitpunkten
+// Gelb und Rot werden bei der Objekterkennung per esp_timer fest eingeplant (+500ms, +2500ms) und
+// schalten dann unabhängig davon, wann loop() das nächste Mal vorbeikommt. Der Callback läuft im
+// esp_timer-Task und schreibt nur das GPIO-Register und einen Zeitstempel; Log und Zustandswechsel
+// folgen in loop(). Mit -DLIGHT_SEQUENCER_TIMER=0 schaltet wie bisher die Zustandsmaschine.
+#ifndef LIGHT_SEQUENCER_TIMER
+#define LIGHT_SEQUENCER_TIMER 1
+#endif
+const int LIGHT_EVENT_SLOTS = 8;                     // Ausstehende Schaltereignisse bis zur Abholung in loop()
+
+enum LightStep : uint8_t
+{
+    LIGHT_DARK,                          // Dunkelphase nach der Objekterkennung
+    LIGHT_YELLOW,
+    LIGHT_RED,
+    LIGHT_ALL_ON                         // Zeitmessung läuft
+};
+
+struct LightEvent
+{
+    LightStep step;
+    int64_t plannedUs;                   // Sollzeitpunkt (esp_timer_get_time)
+    int64_t actualUs;                    // Tatsächlicher Schaltzeitpunkt
+};
+
+struct LightSequencer
+{
+    esp_timer_handle_t yellowTimer = nullptr;
+    esp_timer_handle_t redTimer = nullptr;
+    int64_t startUs = 0;                 // Objekterkennung, Bezug aller Sollzeitpunkte
+    bool armed = false;                  // false = Sequenz abgebrochen, späte Callbacks schalten nicht (unter mux)
+    LightStep pending = LIGHT_DARK;      // Nächster Schritt im Loop-Modus
+    LightEvent events[LIGHT_EVENT_SLOTS];
+    volatile uint8_t head = 0;           // Schreibt Callback oder loop()
+    volatile uint8_t tail = 0;           // Liest loop()
+    unsigned long lostEvents = 0;
+    int64_t maxLateUs = 0;               // Größte Abweichung seit der letzten Statusausgabe
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    static int64_t offsetUs(LightStep step)
+    {
+        if (step == LIGHT_YELLOW) return YELLOW_PENDING_DELAY_MS * 1000LL;
+        if (step == LIGHT_RED) return (YELLOW_PENDING_DELAY_MS + RED_PENDING_DELAY_AFTER_YELLOW_MS) * 1000LL;
+        return 0;
+    }
+
+    static void apply(LightStep step)
+    {
+        switch (step)
+        {
+        case LIGHT_DARK: TrafficLight::set(false, false, false); break;
+        case LIGHT_YELLOW: TrafficLight::set(false, true, false); break;
+        case LIGHT_RED: TrafficLight::set(true, false, false); break;
+        case LIGHT_ALL_ON: TrafficLight::set(true, true, true); break;
+        }
+    }
+
+    static void onYellowDue(void *arg) { static_cast<LightSequencer *>(arg)->fire(LIGHT_YELLOW, true); }
+    static void onRedDue(void *arg) { static_cast<LightSequencer *>(arg)->fire(LIGHT_RED, true); }
+
+    void begin()
+    {
+        esp_timer_create_args_t args = {};
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.callback = onYellowDue;
+        args.name = "ampel_gelb";
+        esp_timer_create(&args, &yellowTimer);
+        args.callback = onRedDue;
+        args.name = "ampel_rot";
+        esp_timer_create(&args, &redTimer);
+    }
+
+    // Schaltet sofort und legt das Ereignis mit Soll- und Istzeit ab
+    // Prüfen und Schalten in einem kritischen Abschnitt: cancel() auf dem anderen Kern kommt
+    // entweder davor (nichts schaltet) oder danach (und überschreibt die Ampel). Ein später
+    // Callback der vorigen Sequenz ist nach start() noch nicht fällig und schaltet ebenfalls nicht.
+    void fire(LightStep step, bool planned, int64_t plannedUs = 0)
+    {
+        portENTER_CRITICAL(&mux);
+        int64_t now = esp_timer_get_time();
+        if (planned && (!armed || now - startUs < offsetUs(step)))
+        {
+            portEXIT_CRITICAL(&mux);
+            return;
+        }
+        apply(step);
+        uint8_t next = (head + 1) % LIGHT_EVENT_SLOTS;
+        if (next == tail)
+        {
+            lostEvents++;
+        }
+        else
+        {
+            LightEvent &e = events[head];
+            e.step = step;
+            e.plannedUs = planned ? startUs + offsetUs(step) : plannedUs;
+            e.actualUs = now;
+            head = next;
+        }
+        portEXIT_CRITICAL(&mux);
+    }
+
+    // Objekt erkannt: Dunkelphase sofort, Gelb und Rot fest eingeplant
+    void start(int64_t detectedUs)
+    {
+        portENTER_CRITICAL(&mux);
+        startUs = detectedUs;
+        armed = true;
+        portEXIT_CRITICAL(&mux);
+        fire(LIGHT_DARK, true);
+#if LIGHT_SEQUENCER_TIMER
+        int64_t elapsed = esp_timer_get_time() - startUs;
+        esp_timer_start_once(yellowTimer, max((int64_t)0, offsetUs(LIGHT_YELLOW) - elapsed));
+        esp_timer_start_once(redTimer, max((int64_t)0, offsetUs(LIGHT_RED) - elapsed));
+#endif
+        pending = LIGHT_YELLOW;
+    }
+
+    // Loop-Modus: schaltet erst, wenn die Zustandsmaschine den fälligen Schritt bemerkt
+    void poll()
+    {
+        if (armed && pending <= LIGHT_RED && esp_timer_get_time() - startUs >= offsetUs(pending))
+        {
+            fire(pending, true);
+            pending = pending == LIGHT_YELLOW ? LIGHT_RED : LIGHT_ALL_ON;
+        }
+    }
+
+    void cancel()
+    {
+        portENTER_CRITICAL(&mux);
+        armed = false;
+        portEXIT_CRITICAL(&mux);
+#if LIGHT_SEQUENCER_TIMER
+        esp_timer_stop(yellowTimer);
+        esp_timer_stop(redTimer);
+#endif
+    }
+
+    bool take(LightEvent &e)
+    {
+        portENTER_CRITICAL(&mux);
+        bool available = tail != head;
+        if (available)
+        {
+            e = events[tail];
+            tail = (tail + 1) % LIGHT_EVENT_SLOTS;
+        }
+        portEXIT_CRITICAL(&mux);
+        return available;
+    }
+};
+LightSequencer lightSequencer;
+int lastLightPattern = -1;                           // Zuletzt geloggtes LED-Muster
+
+// Kalibrierung als schrittweiser Job: beim Boot blockierend, bei der Wiederherstellung per Timer
+const unsigned long CALIBRATION_SAMPLE_INTERVAL_MS = 100;
+const unsigned long ERROR_RECOVERY_DELAY_MS = 5000;            // Selbstheilungsversuch nach 5 Sekunden
+const unsigned long ERROR_BLINK_INTERVAL_MS = 200;
+const int ERROR_BLINK_COUNT = 5;
+struct CalibrationJob {
+    int sample = 0;
+    int validSamples = 0;
+    float totalDist = 0;
+    float samples[REFERENCE_SAMPLES];       // Gültige Messungen für die Rauschschätzung
+};
+CalibrationJob calibrationJob;
+
+// Loop-Latenz: längster Durchlauf seit der letzten Statusausgabe
+unsigned long lastSampleTime = 0;
+unsigned long maxLoopDurationUs = 0;
+
+// Empfang vom Client, Teilzeilen bleiben bis zum nächsten Durchlauf im Puffer
+LineReader<PROTOCOL_LINE_MAX> clientLine;
+unsigned long maxMessagesPerLoop = 0;
+
+// Speicherbudget von Server und Client (Client meldet per "MEM:")
+MemoryTelemetry memoryTelemetry;
+MemoryTelemetry clientMemoryTelemetry;
+unsigned long lastMemorySample = 0;
+
+// Sparbetrieb in IDLE_GREEN: Anwesenheits-Ping statt 50Hz, niedriger Takt (Access Point sendet weiter)
+IdleScheduler idleScheduler(LOOP_DELAY_MS, IDLE_PING_INTERVAL_MS);
+PowerControl powerControl(false);
+unsigned long lastPowerReport = 0;
+
+// Rohdaten-Stream auf TELEMETRY_PORT, nur bei verbundenem Empfänger (siehe Lichtschranke-Telemetrie.h)
+WiFiServer telemetryServer(TELEMETRY_PORT);
+WiFiClient telemetryClient;
+TelemetryStream telemetry(1);
 
 // Interrupt-Variablen für präzisere Echo-Messung (noch nicht aktiv genutzt)
 volatile bool measurementReady = false;
@@ -87,6 +489,9 @@ struct Statistics {
     float minTime = 999999;
     float maxTime = 0;
     float avgTime = 0;
+    unsigned long speedRuns = 0;            // Läufe mit Durchschnittsgeschwindigkeit (Speed-Trap)
+    uint32_t maxSpeed = 0;                  // cm/s
+    float avgSpeed = 0;
     unsigned long lastResetTime = 0;
     
     void addMeasurement(float time) {
@@ -98,55 +503,822 @@ struct Statistics {
             avgTime = (avgTime * (successfulMeasurements - 1) + time) / successfulMeasurements;
         }
     }
+
+    void addSpeed(uint32_t cmPerS) {
+        if (cmPerS == 0) return;
+        speedRuns++;
+        maxSpeed = max(maxSpeed, cmPerS);
+        avgSpeed = (avgSpeed * (speedRuns - 1) + cmPerS) / speedRuns;
+    }
     
     String toJSON() {
         return String("{\"total\":") + totalMeasurements + 
                ",\"success\":" + successfulMeasurements +
                ",\"min\":" + minTime +
                ",\"max\":" + maxTime +
-               ",\"avg\":" + avgTime + "}";
+               ",\"avg\":" + avgTime +
+               (speedRuns > 0 ? String(",\"speed_max_cm_s\":") + maxSpeed +
+                                ",\"speed_avg_cm_s\":" + lroundf(avgSpeed) : String("")) + "}";
     }
 };
 Statistics stats;
 
+// Ergebnisspeicher mit Startnummern und Sessions, feste Größe im RAM
+// Läufe liegen in einem Ring (ältester wird überschrieben). Jeder Lauf verweist auf den
+// vorherigen Lauf derselben Startnummer bzw. Session, die Indizes halten nur den Kopf der Kette.
+// Bestenlisten sind Max-Heaps der Größe N: Einfügen O(log N), Abfrage ohne Log-Scan.
+const int RESULT_CAPACITY = 512;             // Läufe im RAM (je 20 Byte)
+const int MAX_ATHLETES = 256;                // Hash-Tabelle, offene Adressierung
+const int MAX_SESSIONS = 8;                  // Älteste Session wird bei Bedarf ersetzt
+const int LEADERBOARD_SIZE = 10;
+const int RECENT_RUNS_REPORTED = 10;
+
+struct RunRecord {
+    uint32_t seq = 0;                        // Laufende Nummer = Sequenznummer im Messprotokoll, 0 = leer
+    uint32_t timeMs = 0;
+    uint16_t bib = 0;                        // Startnummer, 0 = ohne Zuordnung
+    uint16_t session = 0;
+    uint32_t prevAthleteSeq = 0;             // Vorheriger Lauf derselben Startnummer
+    uint32_t prevSessionSeq = 0;             // Vorheriger Lauf derselben Session
+};
+
+// Geschwindigkeiten eines Laufs in cm/s, 0 = unbekannt (nicht im RunRecord, der bleibt bei 20 Byte)
+struct RunSpeeds {
+    uint32_t average = 0;                    // Schrankenabstand / Laufzeit
+    uint32_t start = 0;                      // Momentan an Schranke 1 beim Verlassen
+    uint32_t finish = 0;                     // Momentan an Schranke 2, vom Client gemeldet
+};
+
+struct LeaderEntry {
+    uint32_t timeMs;
+    uint32_t seq;
+    uint16_t bib;
+};
+
+struct Leaderboard {
+    LeaderEntry heap[LEADERBOARD_SIZE];      // Max-Heap: Wurzel = schlechteste Zeit der Liste
+    int size = 0;
+
+    // Gleiche Zeit: der frühere Lauf liegt vorn
+    static bool slower(const LeaderEntry &a, const LeaderEntry &b) {
+        return a.timeMs > b.timeMs || (a.timeMs == b.timeMs && a.seq > b.seq);
+    }
+
+    void offer(const LeaderEntry &entry) {
+        if (size < LEADERBOARD_SIZE) {
+            int i = size++;
+            heap[i] = entry;
+            while (i > 0 && slower(heap[i], heap[(i - 1) / 2])) {
+                LeaderEntry tmp = heap[i];
+                heap[i] = heap[(i - 1) / 2];
+                heap[(i - 1) / 2] = tmp;
+                i = (i - 1) / 2;
+            }
+            return;
+        }
+        if (!slower(heap[0], entry)) {
+            return; // Nicht besser als der Letzte der Liste
+        }
+        heap[0] = entry;
+        int i = 0;
+        while (true) {
+            int worst = i;
+            int left = 2 * i + 1;
+            int right = left + 1;
+            if (left < size && slower(heap[left], heap[worst])) worst = left;
+            if (right < size && slower(heap[right], heap[worst])) worst = right;
+            if (worst == i) break;
+            LeaderEntry tmp = heap[i];
+            heap[i] = heap[worst];
+            heap[worst] = tmp;
+            i = worst;
+        }
+    }
+
+    // Kopie aufsteigend nach Zeit, N ist klein genug für Insertion Sort
+    int sorted(LeaderEntry out[]) const {
+        for (int i = 0; i < size; i++) {
+            LeaderEntry e = heap[i];
+            int j = i;
+            while (j > 0 && slower(out[j - 1], e)) {
+                out[j] = out[j - 1];
+                j--;
+            }
+            out[j] = e;
+        }
+        return size;
+    }
+};
+
+struct AthleteIndex {
+    uint16_t bib = 0;                        // 0 = freier Platz
+    uint16_t runs = 0;
+    uint32_t bestMs = 0;
+    uint32_t bestSeq = 0;
+    uint32_t headSeq = 0;                    // Letzter Lauf
+};
+
+struct SessionIndex {
+    bool used = false;
+    uint16_t id = 0;
+    uint16_t runs = 0;
+    uint32_t headSeq = 0;
+    Leaderboard board;
+};
+
+struct ResultsStore {
+    RunRecord runs[RESULT_CAPACITY];
+    AthleteIndex athletes[MAX_ATHLETES];
+    SessionIndex sessions[MAX_SESSIONS];
+    Leaderboard overall;
+    uint32_t lastSeq = 0;
+    unsigned long unindexedAthleteRuns = 0;  // Startnummern-Tabelle war voll
+
+    // Lauf mit dieser Nummer, nullptr wenn er schon aus dem Ring verdrängt wurde
+    const RunRecord *get(uint32_t seq) const {
+        if (seq == 0) return nullptr;
+        const RunRecord &r = runs[seq % RESULT_CAPACITY];
+        return r.seq == seq ? &r : nullptr;
+    }
+
+    AthleteIndex *findAthlete(uint16_t bib, bool create) {
+        if (bib == 0) return nullptr;
+        for (int probe = 0; probe < MAX_ATHLETES; probe++) {
+            AthleteIndex &a = athletes[(bib + probe) % MAX_ATHLETES];
+            if (a.bib == bib) return &a;
+            if (a.bib == 0) {
+                if (!create) return nullptr;
+                a.bib = bib;
+                return &a;
+            }
+        }
+        return nullptr;
+    }
+
+    SessionIndex *findSession(uint16_t id, bool create) {
+        SessionIndex *oldest = nullptr;
+        for (int i = 0; i < MAX_SESSIONS; i++) {
+            SessionIndex &s = sessions[i];
+            if (s.used && s.id == id) return &s;
+            if (!oldest || !s.used || (oldest->used && s.headSeq < oldest->headSeq)) {
+                oldest = &s;
+            }
+        }
+        if (!create) return nullptr;
+        *oldest = SessionIndex();
+        oldest->used = true;
+        oldest->id = id;
+        return oldest;
+    }
+
+    // seq = 0 vergibt die nächste Nummer, beim Laden aus dem Protokoll gilt dessen Nummer
+    const RunRecord &add(uint32_t timeMs, uint16_t bib, uint16_t session, uint32_t seq = 0) {
+        lastSeq = seq > 0 ? seq : lastSeq + 1;
+        RunRecord &r = runs[lastSeq % RESULT_CAPACITY];
+        r = RunRecord();
+        r.seq = lastSeq;
+        r.timeMs = timeMs;
+        r.bib = bib;
+        r.session = session;
+
+        LeaderEntry entry = {timeMs, r.seq, bib};
+        overall.offer(entry);
+
+        SessionIndex *s = findSession(session, true);
+        r.prevSessionSeq = s->headSeq;
+        s->headSeq = r.seq;
+        s->runs++;
+        s->board.offer(entry);
+
+        if (bib != 0) {
+            AthleteIndex *a = findAthlete(bib, true);
+            if (a) {
+                r.prevAthleteSeq = a->headSeq;
+                a->headSeq = r.seq;
+                a->runs++;
+                if (a->bestSeq == 0 || timeMs < a->bestMs) {
+                    a->bestMs = timeMs;
+                    a->bestSeq = r.seq;
+                }
+            } else {
+                unindexedAthleteRuns++;
+            }
+        }
+        return r;
+    }
+};
+ResultsStore resultsStore;
+uint16_t nextAthlete = 0;                    // Startnummer für den nächsten Lauf (ATHLETE:<nr>)
+uint16_t currentSession = 0;                 // Bleibt bis zum nächsten SESSION:<nr> gesetzt
+
+// Deduplizierung der Client-Ergebnisse (Store-and-Forward): höchste angenommene
+// Sequenznummer pro Client-Kennung, im NVS gesichert
+uint32_t clientEpoch = 0;
+uint32_t lastClientResultSeq = 0;
+
+// Live-Anzeige für Zuschauer (Tablets, Anzeigetafel) per Server-Sent Events
+// Alle Abonnenten lesen aus einem gemeinsamen Ereignis-Ring mit eigenem Lesezeiger.
+// Gesendet wird nur nicht-blockierend: Wer zu langsam liest, verliert die ältesten
+// Ereignisse (bzw. wird getrennt) - die Zeitmessung wartet nie auf einen Zuschauer.
+const uint16_t LIVE_PORT = 81;
+const int MAX_LIVE_SUBSCRIBERS = 6;                  // lwIP hat nur ~10 Sockets, Port 80 braucht auch welche
+const int LIVE_EVENT_SLOTS = 16;                     // Maximal ausstehende Ereignisse pro Abonnent
+const int LIVE_EVENT_MAX_LEN = 384;                   // Ergebnis mit Geschwindigkeiten und Statistik: ~250 Byte
+const int LIVE_REQUEST_LINE_MAX = 160;               // Anfragezeile samt Query plus aktueller Header
+const int LIVE_IF_RANGE_MAX = 32;                    // ETag des Messprotokolls samt Anführungszeichen
+const unsigned long LIVE_REQUEST_TIMEOUT_MS = 2000;  // Vollständige HTTP-Anfrage muss bis dahin da sein
+const unsigned long LIVE_KEEPALIVE_MS = 15000;       // Kommentarzeile hält Proxies und Browser wach
+const unsigned long LIVE_STATS_INTERVAL_MS = 10000;
+WiFiServer liveServer(LIVE_PORT);
+
+// Längstes Ereignis: "result" mit allen Zahlen in voller Breite (32 Bit: 10 Stellen, Startnummer
+// und Session: 5, Zeiten bis zum Startwert 999999.00 von Statistics::minTime: 9)
+constexpr int LIVE_STATS_JSON_MAX =
+    sizeof("{\"total\":,\"success\":,\"min\":,\"max\":,\"avg\":,\"speed_max_cm_s\":,\"speed_avg_cm_s\":}") - 1 +
+    4 * 10 + 3 * 9;
+constexpr int LIVE_RESULT_JSON_MAX =
+    sizeof("{\"run\":,\"time_ms\":,\"bib\":,\"session\":,\"speed_cm_s\":,\"start_speed_cm_s\":,"
+           "\"finish_speed_cm_s\":,\"stats\":}") - 1 +
+    5 * 10 + 2 * 5 + LIVE_STATS_JSON_MAX;
+constexpr int LIVE_EVENT_LONGEST = sizeof("id: \nevent: result\ndata: \n\n") - 1 + 10 + LIVE_RESULT_JSON_MAX;
+static_assert(LIVE_EVENT_LONGEST < LIVE_EVENT_MAX_LEN, "Längstes Live-Ereignis passt nicht in einen Ring-Platz");
+
+struct LiveEvent {
+    uint32_t id = 0;
+    uint16_t len = 0;
+    char text[LIVE_EVENT_MAX_LEN];
+};
+
+struct LiveFeed {
+    LiveEvent events[LIVE_EVENT_SLOTS];
+    uint32_t nextId = 1;                 // Id des nächsten veröffentlichten Ereignisses
+    unsigned long lastPublish = 0;
+    unsigned long oversized = 0;         // Wegen LIVE_EVENT_MAX_LEN verworfene Ereignisse
+
+    // Ältestes noch im Ring liegendes Ereignis
+    uint32_t oldestId() const {
+        return nextId > (uint32_t)LIVE_EVENT_SLOTS ? nextId - LIVE_EVENT_SLOTS : 1;
+    }
+
+    const LiveEvent &get(uint32_t id) const { return events[id % LIVE_EVENT_SLOTS]; }
+
+    // Fertig formatierter SSE-Block, überschreibt das älteste Ereignis
+    void publishRaw(const char *text, int len) {
+        LiveEvent &e = events[nextId % LIVE_EVENT_SLOTS];
+        if (len >= LIVE_EVENT_MAX_LEN) {
+            len = LIVE_EVENT_MAX_LEN - 1;
+        }
+        memcpy(e.text, text, len);
+        e.len = len;
+        e.id = nextId++;
+        lastPublish = millis();
+    }
+
+    void publish(const char *type, const String &json) {
+        char buf[LIVE_EVENT_MAX_LEN];
+        int len = snprintf(buf, sizeof(buf), "id: %lu\nevent: %s\ndata: %s\n\n",
+                           (unsigned long)nextId, type, json.c_str());
+        if (len < 0 || len >= (int)sizeof(buf)) {
+            // Lieber verwerfen als ein abgeschnittenes JSON senden, aber nicht stillschweigend
+            oversized++;
+            Serial.print("ESP1: WARNUNG - Live-Ereignis '");
+            Serial.print(type);
+            Serial.print("' verworfen (");
+            Serial.print(len);
+            Serial.println(" Byte)");
+            return;
+        }
+        publishRaw(buf, len);
+    }
+};
+LiveFeed liveFeed;
+
+struct LiveSubscriber {
+    WiFiClient conn;
+    bool active = false;
+    bool streaming = false;              // false = HTTP-Anfrage wird noch gelesen
+    unsigned long acceptedAt = 0;
+    char requestLine[LIVE_REQUEST_LINE_MAX];
+    int lineLen = 0;
+    bool haveRequestLine = false;
+    uint32_t lastEventId = 0;            // Vom Browser bei Wiederverbindung mitgeschickt
+    uint32_t nextId = 0;                 // Nächstes zu sendendes Ereignis
+    uint16_t offset = 0;                 // Davon bereits gesendete Bytes
+    long rangeStart = -1;                // Range: bytes=<start>-<end> für fortgesetzte Downloads
+    long rangeEnd = -1;
+    long rangeSuffix = -1;               // Range: bytes=-<n> (letzte n Bytes)
+    char ifRange[LIVE_IF_RANGE_MAX] = "";  // If-Range: ETag des ersten Teils, leer = keiner
+    int exportJob = -1;                  // Laufender Download, -1 = keiner
+};
+LiveSubscriber liveSubscribers[MAX_LIVE_SUBSCRIBERS];
+unsigned long liveDroppedEvents = 0;
+unsigned long liveDroppedSubscribers = 0;
+State lastPublishedState = SYSTEM_INIT;
+unsigned long lastLiveStats = 0;
+
+// Binäres Messprotokoll in Blöcken fester Größe
+// Jeder Datensatz speichert nur die Differenz zum vorherigen Datensatz desselben Blocks als
+// Varint (ZigZag für negative Werte). Dadurch braucht er ~8 statt ~35 Byte wie eine CSV-Zeile.
+// Jeder Block beginnt ohne Vorgänger, trägt seinen eigenen CRC und ist damit einzeln lesbar.
+// Der RAM-Index hält pro Block nur erste Sequenznummer und Anzahl.
+const char *LOG_FILE = "/measurements.bin";
+const char *LEGACY_CSV_LOG = "/measurements.csv";    // Altes Format, wird beim Start übernommen
+const int LOG_BLOCK_SIZE = 256;
+const int LOG_MAX_BLOCKS = 512;                      // 128KB Obergrenze, Index 4KB
+const size_t LOG_ROTATE_BYTES = 100000;              // Rotation beim Start wie bisher
+const uint16_t LOG_MAGIC = 0x4C53;                   // "SL"
+const uint8_t LOG_VERSION = 1;
+const int LOG_RECORD_MAX = 36;                       // Flags + 7 Varints im ungünstigsten Fall
+const uint8_t LOG_FLAG_CLIENT_OK = 1;
+const uint8_t LOG_FLAG_SPEEDS = 2;                   // Zwei Varints mit Start-/Zielgeschwindigkeit folgen
+
+struct LogEntry {
+    uint32_t seq = 0;
+    uint32_t t = 0;                          // millis() beim Speichern
+    uint32_t timeMs = 0;
+    bool clientOk = false;
+    float reference = 0;
+    uint16_t bib = 0;
+    uint16_t session = 0;
+    uint32_t startSpeed = 0;                 // cm/s, 0 = unbekannt
+    uint32_t finishSpeed = 0;
+};
+
+struct LogBlockHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;                           // Datensätze im Block
+    uint32_t firstSeq;
+    uint32_t minT;
+    uint32_t maxT;
+    uint16_t used;                           // Belegte Nutzdaten-Bytes
+    uint16_t crc;                            // CRC-16/CCITT über Header (crc = 0) und Nutzdaten
+};
+
+struct LogBlock {
+    LogBlockHeader header;
+    uint8_t payload[LOG_BLOCK_SIZE - sizeof(LogBlockHeader)];
+};
+static_assert(sizeof(LogBlock) == LOG_BLOCK_SIZE, "LogBlock muss genau einen Block füllen");
+
+// Nur Sequenznummern: t zählt ab jedem Boot neu und taugt über Neustarts hinweg nicht zum Suchen
+struct LogIndexEntry {
+    uint32_t firstSeq = 0;                   // 0 = Block beschädigt
+    uint16_t count = 0;
+};
+
+uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+uint16_t logBlockCrc(const LogBlock &block) {
+    LogBlockHeader header = block.header;
+    header.crc = 0;
+    uint16_t crc = crc16((const uint8_t *)&header, sizeof(header));
+    return crc16(block.payload, min((size_t)block.header.used, sizeof(block.payload)), crc);
+}
+
+bool logBlockValid(const LogBlock &block) {
+    return block.header.magic == LOG_MAGIC && block.header.version == LOG_VERSION &&
+           block.header.used <= sizeof(block.payload) && block.header.crc == logBlockCrc(block);
+}
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+inline int putVarint(uint8_t *out, uint32_t v) {
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+inline bool getVarint(const uint8_t *data, int len, int &pos, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && pos < len; shift += 7) {
+        uint8_t b = data[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Liest die Datensätze eines Blocks der Reihe nach, Basis für jede Differenz ist der Vorgänger
+struct LogBlockReader {
+    const LogBlock *block = nullptr;
+    int pos = 0;
+    int index = 0;
+    LogEntry prev;
+    int32_t prevRefCenti = 0;
+
+    void start(const LogBlock &b) {
+        block = &b;
+        pos = 0;
+        index = 0;
+        prev = LogEntry();
+        prevRefCenti = 0;
+    }
+
+    bool next(LogEntry &e) {
+        if (!block || index >= block->header.count) return false;
+        const uint8_t *p = block->payload;
+        int len = block->header.used;
+        if (pos >= len) return false;
+        uint8_t flags = p[pos++];
+        uint32_t dt, dtime, dref, bib, dsession;
+        if (!getVarint(p, len, pos, dt) || !getVarint(p, len, pos, dtime) ||
+            !getVarint(p, len, pos, dref) || !getVarint(p, len, pos, bib) ||
+            !getVarint(p, len, pos, dsession)) {
+            return false;
+        }
+        e.seq = block->header.firstSeq + index++;
+        e.t = prev.t + unzigzag(dt);
+        e.timeMs = prev.timeMs + unzigzag(dtime);
+        prevRefCenti += unzigzag(dref);
+        e.reference = prevRefCenti / 100.0f;
+        e.clientOk = flags & LOG_FLAG_CLIENT_OK;
+        e.bib = bib;
+        e.session = prev.session + unzigzag(dsession);
+        e.startSpeed = 0;
+        e.finishSpeed = 0;
+        if ((flags & LOG_FLAG_SPEEDS) &&
+            (!getVarint(p, len, pos, e.startSpeed) || !getVarint(p, len, pos, e.finishSpeed))) {
+            return false;
+        }
+        prev = e;
+        return true;
+    }
+};
+
+// Schreibt Datensätze in den letzten Block (im RAM), der bei flush() an seine Position im File geht
+struct MeasurementLog {
+    LogIndexEntry index[LOG_MAX_BLOCKS];
+    int blockCount = 0;                      // Blöcke im File inkl. des gerade beschriebenen
+    LogBlock tail;
+    int tailBlock = 0;                       // Position des letzten Blocks
+    LogEntry tailLast;                       // Letzter Datensatz im Block, Basis der nächsten Differenz
+    int32_t tailRefCenti = 0;
+    bool dirty = false;
+    bool full = false;
+    uint32_t nextSeq = 1;
+    unsigned long corruptBlocks = 0;
+
+    void startBlock(int blockNo, uint32_t firstSeq) {
+        memset(&tail, 0, sizeof(tail));
+        tail.header.magic = LOG_MAGIC;
+        tail.header.version = LOG_VERSION;
+        tail.header.firstSeq = firstSeq;
+        tailBlock = blockNo;
+        tailLast = LogEntry();
+        tailRefCenti = 0;
+    }
+
+    // Index aus allen Block-Headern, den letzten Block zum Weiterschreiben laden
+    void begin() {
+        blockCount = 0;
+        corruptBlocks = 0;
+        nextSeq = 1;
+        dirty = false;
+        full = false;
+        startBlock(0, 1);
+        File file = SPIFFS.open(LOG_FILE, FILE_READ);
+        int blocks = file ? min((int)(file.size() / LOG_BLOCK_SIZE), LOG_MAX_BLOCKS) : 0;
+        bool lastValid = false;
+        LogBlock block;
+        for (int b = 0; b < blocks; b++) {
+            if (file.read((uint8_t *)&block, LOG_BLOCK_SIZE) != LOG_BLOCK_SIZE) break;
+            blockCount = b + 1;
+            lastValid = logBlockValid(block);
+            if (!lastValid) {
+                // Beschädigter Block bleibt als leerer Eintrag im Index, die Suche bleibt aufsteigend
+                index[b] = LogIndexEntry();
+                index[b].firstSeq = nextSeq;
+                corruptBlocks++;
+                continue;
+            }
+            index[b].firstSeq = block.header.firstSeq;
+            index[b].count = block.header.count;
+            nextSeq = block.header.firstSeq + block.header.count;
+            tail = block;
+            tailBlock = b;
+        }
+        if (file) {
+            file.close();
+        }
+
+        if (blockCount > 0 && lastValid) {
+            // Letzten Datensatz als Differenzbasis für den nächsten rekonstruieren
+            LogBlockReader reader;
+            reader.start(tail);
+            LogEntry e;
+            while (reader.next(e)) {}
+            tailLast = reader.prev;
+            tailRefCenti = reader.prevRefCenti;
+        } else if (blockCount < LOG_MAX_BLOCKS) {
+            // Leeres Log oder beschädigter letzter Block: dahinter neu beginnen
+            startBlock(blockCount, nextSeq);
+            index[blockCount] = LogIndexEntry();
+            index[blockCount].firstSeq = nextSeq;
+            blockCount++;
+        } else {
+            full = true;
+        }
+    }
+
+    uint32_t records() const { return nextSeq - 1; }
+
+    // Kennung des Dateistands für If-Range (nach flush()). Jedes Schreiben ändert den letzten Block
+    // an seiner Stelle, eine Rotation beginnt wieder bei Sequenznummer 1 - beides ändert den CRC
+    void etag(char *out, size_t len) const {
+        snprintf(out, len, "\"%lu-%d-%04x\"", (unsigned long)records(), blockCount, tail.header.crc);
+    }
+
+    bool append(const LogEntry &e) {
+        uint8_t record[LOG_RECORD_MAX];
+        int32_t refCenti = lroundf(e.reference * 100.0f);
+        int len = 0;
+        if (full) return false;
+        bool speeds = e.startSpeed > 0 || e.finishSpeed > 0;
+        record[len++] = (e.clientOk ? LOG_FLAG_CLIENT_OK : 0) | (speeds ? LOG_FLAG_SPEEDS : 0);
+        len += putVarint(record + len, zigzag((int32_t)(e.t - tailLast.t)));
+        len += putVarint(record + len, zigzag((int32_t)(e.timeMs - tailLast.timeMs)));
+        len += putVarint(record + len, zigzag(refCenti - tailRefCenti));
+        len += putVarint(record + len, e.bib);
+        len += putVarint(record + len, zigzag((int32_t)e.session - (int32_t)tailLast.session));
+        if (speeds) {
+            // Ohne Speed-Trap kostet das nichts, Lesen älterer Blöcke bleibt gleich
+            len += putVarint(record + len, e.startSpeed);
+            len += putVarint(record + len, e.finishSpeed);
+        }
+
+        bool gap = tail.header.count > 0 && e.seq != tail.header.firstSeq + tail.header.count;
+        if (tail.header.used + len > (int)sizeof(tail.payload) || tail.header.count == 255 || gap) {
+            // Block voll (oder Lücke in den Nummern): abschließen und einen neuen beginnen
+            if (!flush()) return false;
+            if (blockCount >= LOG_MAX_BLOCKS) {
+                full = true;
+                Serial.println("ESP1: Messprotokoll voll - Rotation beim nächsten Start");
+                return false;
+            }
+            startBlock(blockCount, e.seq);
+            blockCount++;
+            return append(e);
+        }
+
+        if (tail.header.count == 0) {
+            tail.header.firstSeq = e.seq;
+            tail.header.minT = e.t;
+            tail.header.maxT = e.t;
+        }
+        memcpy(tail.payload + tail.header.used, record, len);
+        tail.header.used += len;
+        tail.header.count++;
+        tail.header.minT = min(tail.header.minT, e.t);
+        tail.header.maxT = max(tail.header.maxT, e.t);
+        tailLast = e;
+        tailRefCenti = refCenti;
+        nextSeq = e.seq + 1;
+
+        LogIndexEntry &entry = index[tailBlock];
+        entry.firstSeq = tail.header.firstSeq;
+        entry.count = tail.header.count;
+        dirty = true;
+        return true;
+    }
+
+    // Letzten Block an seine Position schreiben ("r+" überschreibt, ohne das File zu kürzen)
+    bool flush() {
+        if (!dirty) return true;
+        tail.header.crc = logBlockCrc(tail);
+        if (!SPIFFS.exists(LOG_FILE)) {
+            File create = SPIFFS.open(LOG_FILE, FILE_WRITE);
+            if (!create) return false;
+            create.close();
+        }
+        File file = SPIFFS.open(LOG_FILE, "r+");
+        if (!file || !file.seek((size_t)tailBlock * LOG_BLOCK_SIZE)) {
+            return false;
+        }
+        bool ok = file.write((const uint8_t *)&tail, LOG_BLOCK_SIZE) == LOG_BLOCK_SIZE;
+        file.close();
+        dirty = !ok;
+        return ok;
+    }
+
+    // Block aus dem File, false bei Lesefehler oder falschem CRC
+    bool readBlock(File &file, int blockNo, LogBlock &block) const {
+        if (!file.seek((size_t)blockNo * LOG_BLOCK_SIZE)) return false;
+        if (file.read((uint8_t *)&block, LOG_BLOCK_SIZE) != LOG_BLOCK_SIZE) return false;
+        return logBlockValid(block);
+    }
+
+    // Erster Block, der Sequenznummern >= seq enthalten kann (binäre Suche, Index ist aufsteigend)
+    int findBlock(uint32_t seq) const {
+        int lo = 0;
+        int hi = blockCount;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (index[mid].firstSeq + index[mid].count <= seq) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+};
+MeasurementLog measurementLog;
+
+// Export der Messhistorie über denselben HTTP-Port, blockweise direkt aus dem Flash
+// /measurements.bin liefert das Binärprotokoll mit Range und If-Range (fortsetzbarer Download),
+// /export filtert nach Sequenzbereich und wandelt in CSV oder JSON,
+// /measurements.csv ist der ungefilterte CSV-Export. Der Blockindex findet den ersten Block des
+// Bereichs, ohne die Blöcke davor zu lesen.
+const int MAX_EXPORTS = 2;                           // Gleichzeitige Downloads, je ein offenes File + Puffer
+const int EXPORT_CHUNK = 512;                        // Sendepuffer pro Download
+const int EXPORT_RECORD_MAX = 224;                   // Platz für einen formatierten Datensatz (JSON mit Geschwindigkeiten)
+const int LEGACY_LINE_MAX = 64;                      // Längste Zeile im alten CSV-Log
+const int EXPORT_CHUNKS_PER_LOOP = 8;                // Flash-Lesezeit pro Loop-Durchlauf begrenzen
+
+struct ExportJob {
+    bool active = false;
+    File file;
+    bool raw = false;                    // Binärdatei statt gewandeltem Export
+    bool json = false;
+    bool eof = false;
+    size_t remaining = 0;                // Rohdatei: noch zu lesende Bytes
+    int block = 0;                       // Nächster zu lesender Block
+    bool haveBlock = false;
+    LogBlock current;
+    LogBlockReader reader;
+    unsigned long blocksSkipped = 0;     // Über den Index übersprungen oder beschädigt
+    uint32_t seqFrom = 0;
+    uint32_t seqTo = UINT32_MAX;
+    uint32_t records = 0;
+    char out[EXPORT_CHUNK];
+    int outLen = 0;
+    int outSent = 0;
+    unsigned long startedAt = 0;
+    unsigned long bytesSent = 0;
+};
+ExportJob exportJobs[MAX_EXPORTS];
+
+bool exportRunning() {
+    for (const ExportJob &job : exportJobs) {
+        if (job.active) return true;
+    }
+    return false;
+}
+
 // Function Prototypes
 void IRAM_ATTR echoISR();
-float measureDistance(int trigPin, int echoPin);
 void setTrafficLight(bool red, bool yellow, bool green);
+void handleLightEvents();
 void handleClientCommunication();
 bool establishInitialReferenceDistance();
 void handleSystemError(const String &errorMsg);
-void resetSystem();
-bool isValidDistance(float distance);
+void enterIdle();
+void startLightSequence();
+void startTiming();
+void enterCooldown();
+void enterError();
+void awaitClientResult();
+void traceTransition(State from, State to, Event event, unsigned long atUs);
 void updateClientStatus();
 void printSystemStatus();
-float measureDistanceWithMedianFilter(int trigPin, int echoPin, int samples = 5);
-void logMeasurement(unsigned long time);
+float measureGateDistance(int pings = GATE_PINGS_PER_READING);
+void logMeasurement(const RunRecord &run, const RunSpeeds &speeds);
+void loadResultsFromLog();
+const RunRecord &recordRun(unsigned long measuredTime, uint16_t bib, uint16_t session,
+                           uint32_t startSpeed = 0, uint32_t finishSpeed = 0);
+void acknowledgeClientResult(uint32_t seq);
+void handleResultBatch(const String &message);
 void initSPIFFS();
+unsigned long ownSlotWaitUs(unsigned long pingBudgetUs);
+unsigned long pingBudgetUs();
+void sleepUntilMessage(unsigned long ms);
+void updateEchoTimeout();
+void printTdmaBudget();
+void checkLinkHealth();
+bool loadCalibration(CalibrationCache &cache);
+void saveCalibration(int validSamples);
+bool validateCachedCalibration(const CalibrationCache &cache);
+void updateStateMachine();
+void beginCalibration();
+bool calibrationStep();
+bool finishCalibration();
+void onErrorBlinkStep();
+void onRecoveryDue();
+void onRecoveryCalibrationStep();
+void recoveryCalibrationStep();
+void onTimingTimeout();
+void onCooldownDone();
+void acceptLiveSubscribers();
+void serviceLiveSubscribers();
+void readLiveRequest(LiveSubscriber &sub);
+void routeLiveRequest(LiveSubscriber &sub);
+bool pumpLiveSubscriber(LiveSubscriber &sub);
+void closeLiveSubscriber(LiveSubscriber &sub);
+void startExport(LiveSubscriber &sub, bool raw);
+void fillExportChunk(ExportJob &job);
+void appendExportRecord(ExportJob &job, const LogEntry &e);
+void migrateLegacyLog();
+bool pumpExport(LiveSubscriber &sub);
+unsigned long queryValue(const char *request, const char *key, unsigned long fallback);
+void publishLiveState();
+void publishLiveStats();
+void publishLiveResult(const RunRecord &run, const RunSpeeds &speeds);
+void sendLeaderboard(LiveSubscriber &sub);
+void sendAthleteRuns(LiveSubscriber &sub);
+void sendJSONResponse(LiveSubscriber &sub, const String &body);
+void sampleMemory();
+void updatePowerMode();
+void wakeFromIdle(const char *reason);
+void reportPower();
+void serviceTelemetry();
+void handleClientMemory(const String &message);
+String leaderboardJSON(const Leaderboard &board);
+const char *stateName(State state);
+const char *eventName(Event event);
+String liveStateJSON();
+
+// Übergangstabelle: {von, Ereignis, nach, Bedingung, Aktion}
+// Nicht aufgeführte Paare werden ignoriert - z.B. ein zweites Objekt während der Zeitmessung
+constexpr Transition<State, Event> serverTransitions[] = {
+    {SYSTEM_INIT,                     EV_CALIBRATED,     IDLE_GREEN,                      nullptr, enterIdle},
+    {ERROR_STATE,                     EV_CALIBRATED,     IDLE_GREEN,                      nullptr, enterIdle},
+    {IDLE_GREEN,                      EV_OBJECT_ENTERED, OBJECT_DETECTED_YELLOW_PENDING,  nullptr, startLightSequence},
+    {OBJECT_DETECTED_YELLOW_PENDING,  EV_YELLOW_ON,      YELLOW_ON_RED_PENDING,           nullptr, nullptr},
+    {YELLOW_ON_RED_PENDING,           EV_RED_ON,         RED_ON_WAITING_FOR_OBJECT_LEAVE, nullptr, nullptr},
+    {RED_ON_WAITING_FOR_OBJECT_LEAVE, EV_OBJECT_LEFT,    TIMING_STARTED_ALL_ON,           nullptr, startTiming},
+    {TIMING_STARTED_ALL_ON,           EV_STOP_RECEIVED,  WAITING_FOR_TIMING_COMPLETE,     nullptr, enterCooldown},
+    {TIMING_STARTED_ALL_ON,           EV_TIMEOUT,        ERROR_STATE,                     nullptr, enterError},
+    {TIMING_STARTED_ALL_ON,           EV_LINK_LOST,      TIMING_STARTED_ALL_ON,           nullptr, awaitClientResult},
+    {WAITING_FOR_TIMING_COMPLETE,     EV_COOLDOWN_DONE,  IDLE_GREEN,                      nullptr, enterIdle},
+    {SYSTEM_INIT,                     EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {IDLE_GREEN,                      EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {OBJECT_DETECTED_YELLOW_PENDING,  EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {YELLOW_ON_RED_PENDING,           EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {RED_ON_WAITING_FOR_OBJECT_LEAVE, EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {TIMING_STARTED_ALL_ON,           EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {WAITING_FOR_TIMING_COMPLETE,     EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+    {ERROR_STATE,                     EV_FAULT,          ERROR_STATE,                     nullptr, enterError},
+};
+static_assert(transitionsUnique(serverTransitions), "Doppelter Übergang in serverTransitions");
+static_assert(transitionsInRange(serverTransitions, STATE_COUNT, EVENT_COUNT), "Ungültiger Wert in serverTransitions");
+static_assert(transitionsComplete(serverTransitions, STATE_COUNT, EVENT_COUNT, SYSTEM_INIT),
+              "Unerreichbarer Zustand, Sackgasse oder unbenutztes Ereignis in serverTransitions");
+static_assert(handledInStates(serverTransitions, EV_FAULT, (1u << STATE_COUNT) - 1),
+              "EV_FAULT muss aus jedem Zustand nach ERROR_STATE führen");
+constexpr TransitionTable<STATE_COUNT * EVENT_COUNT> serverTable =
+    buildTransitionTable<STATE_COUNT, EVENT_COUNT>(serverTransitions);
+StateMachine<State, Event, STATE_COUNT, EVENT_COUNT> machine(serverTransitions, serverTable, SYSTEM_INIT);
+const State &currentState = machine.state;   // Nur lesen - Zustandswechsel ausschließlich per dispatch()
+unsigned long lastTransitionUs = 0;
 
 void setup()
 {
     Serial.begin(115200);
     delay(100);
+    timerWheel.begin(millis());
+    machine.trace = traceTransition;
 
     // SPIFFS für persistente Datenspeicherung
     initSPIFFS();
 
-    pinMode(trigPin1, OUTPUT);
-    pinMode(echoPin1, INPUT);
-    pinMode(rledPin, OUTPUT);
-    pinMode(yledPin, OUTPUT);
-    pinMode(gledPin, OUTPUT);
+    // Boot-Zähler und letzte Kalibrierung aus dem NVS
+    preferences.begin("lichtschranke", false);
+    bootCount = preferences.getUInt("bootCount", 0) + 1;
+    preferences.putUInt("bootCount", bootCount);
+    currentSession = preferences.getUShort("session", 0);
+    clientEpoch = preferences.getUInt("clientEpoch", 0);
+    lastClientResultSeq = preferences.getUInt("clientSeq", 0);
+    loadResultsFromLog();
+    CalibrationCache cachedCalibration;
+    bool hasCachedCalibration = loadCalibration(cachedCalibration);
+
+    GateSensors::begin();
+    TrafficLight::begin();
+    lightSequencer.begin();
 
     // Interrupt-Setup für zukünftige Optimierung der Echo-Messung
     attachInterrupt(digitalPinToInterrupt(echoPin1), echoISR, CHANGE);
 
-    // LED-Funktionstest zeigt Betriebsbereitschaft
+    // LED-Funktionstest zeigt Betriebsbereitschaft, beim Schnellstart nur kurz
     Serial.println("\nESP1: LED Test...");
     setTrafficLight(true, true, true);
-    delay(1000);
+    delay(hasCachedCalibration ? LED_TEST_FAST_MS : 1000);
     setTrafficLight(false, false, false);
-    delay(500);
+    delay(hasCachedCalibration ? LED_TEST_FAST_MS : 500);
 
     // Access Point erstellen für direkte ESP-zu-ESP Kommunikation
     Serial.println("ESP1: Konfiguriere Access Point...");
@@ -168,10 +1340,24 @@ void setup()
 
     server.begin();
     Serial.println("ESP1: TCP Server gestartet auf Port 80");
+    liveServer.begin();
+    Serial.print("ESP1: Live-Anzeige auf http://");
+    Serial.print(WiFi.softAPIP());
+    Serial.print(":");
+    Serial.println(LIVE_PORT);
+    telemetryServer.begin();
     Serial.println("ESP1: Warte auf Client-Verbindungen...");
 
     // Kritisch: Sensor muss kalibriert werden um Umgebungsbedingungen zu kompensieren
-    if (!establishInitialReferenceDistance())
+    // Schnellstart: gespeicherte Werte übernehmen, wenn eine kurze Prüfmessung sie bestätigt
+    bool fastBoot = hasCachedCalibration && validateCachedCalibration(cachedCalibration);
+    if (fastBoot)
+    {
+        referenceDistance1 = cachedCalibration.referenceDistance;
+        noiseSigma1 = max(cachedCalibration.noiseSigma, DETECTOR_MIN_SIGMA_CM);
+        updateEchoTimeout();
+    }
+    else if (!establishInitialReferenceDistance())
     {
         Serial.println("ESP1: WARNUNG - Sensor-Kalibrierung fehlgeschlagen!");
         handleSystemError("Sensor-Kalibrierung fehlgeschlagen!");
@@ -179,48 +1365,84 @@ void setup()
     }
 
     triggerThreshold1 = referenceDistance1 / 2.0f;
+    gateDetector.configure(referenceDistance1, noiseSigma1);
     Serial.print("ESP1: System bereit - Referenz: ");
     Serial.print(referenceDistance1);
     Serial.print("cm, Trigger: ");
     Serial.print(triggerThreshold1);
-    Serial.println("cm");
+    Serial.print("cm, Rauschen: ");
+    Serial.print(noiseSigma1);
+    Serial.println(CUSUM_DETECTOR ? "cm (CUSUM)" : "cm (Schwellwert)");
 
-    setTrafficLight(false, false, true); // Start mit Grün
-    currentState = IDLE_GREEN;
+    machine.dispatch(EV_CALIBRATED); // Start mit Grün
+    powerControl.begin();
+    idleScheduler.lastActivityMs = millis();
     lastValidMeasurement = millis();
     stats.lastResetTime = millis();
+
+    Serial.print("ESP1: Bereit nach ");
+    Serial.print(millis());
+    Serial.print("ms (");
+    Serial.print(fastBoot ? "Schnellstart" : "Vollkalibrierung");
+    Serial.print(", Boot #");
+    Serial.print(bootCount);
+    Serial.println(")");
 }
 
 bool establishInitialReferenceDistance()
 {
-    Serial.println("ESP1: Kalibriere Sensor 1...");
-    setTrafficLight(true, true, false); // Rot+Gelb signalisiert Kalibrierung
+    beginCalibration();
+    while (!calibrationStep())
+    {
+        delay(CALIBRATION_SAMPLE_INTERVAL_MS);
+    }
+    return finishCalibration();
+}
 
-    float totalDist = 0;
-    int validSamples = 0;
+void beginCalibration()
+{
+    Serial.print("ESP1: Kalibriere Schranke 1 (");
+    Serial.print(SENSOR_COUNT);
+    Serial.println(" Sensoren)...");
+    setTrafficLight(true, true, false); // Rot+Gelb signalisiert Kalibrierung
+    echoTimeoutUs = ECHO_TIMEOUT_US;    // Volle Reichweite, solange die Referenz unbekannt ist
+    calibrationJob = CalibrationJob();
+}
 
-    // Mehrfachmessung mit Median-Filter für stabile Referenz
-    for (int i = 0; i < REFERENCE_SAMPLES; i++)
+// Eine Messung mit Median-Filter, true wenn alle Kalibriermessungen erfolgt sind
+// Außerhalb des eigenen TDMA-Slots zählt der Schritt nicht, der nächste Aufruf misst
+bool calibrationStep()
+{
+    if (ownSlotWaitUs(pingBudgetUs()) > 0)
     {
-        float dist = measureDistanceWithMedianFilter(trigPin1, echoPin1);
-        if (isValidDistance(dist))
-        {
-            totalDist += dist;
-            validSamples++;
-            Serial.print(".");
-        }
-        else
-        {
-            Serial.print("x");
-        }
-        delay(100);
+        return false;
     }
+    float dist = measureGateDistance();
+    if (isValidDistance(dist))
+    {
+        calibrationJob.totalDist += dist;
+        calibrationJob.samples[calibrationJob.validSamples++] = dist;
+        Serial.print(".");
+    }
+    else
+    {
+        Serial.print("x");
+    }
+    return ++calibrationJob.sample >= REFERENCE_SAMPLES;
+}
+
+bool finishCalibration()
+{
     Serial.println();
+    int validSamples = calibrationJob.validSamples;
 
     // Mindestens 50% gültige Messungen erforderlich für verlässliche Kalibrierung
     if (validSamples >= REFERENCE_SAMPLES / 2)
     {
-        referenceDistance1 = totalDist / validSamples;
+        referenceDistance1 = calibrationJob.totalDist / validSamples;
+        noiseSigma1 = max(robustNoiseSigma(calibrationJob.samples, validSamples), DETECTOR_MIN_SIGMA_CM);
+        updateEchoTimeout();
+        saveCalibration(validSamples);
         Serial.print("ESP1: Referenzdistanz: ");
         Serial.print(referenceDistance1);
         Serial.print("cm (");
@@ -240,38 +1462,13 @@ bool establishInitialReferenceDistance()
     }
 }
 
-bool isValidDistance(float distance)
-{
-    return (distance > MIN_VALID_DISTANCE && distance < MAX_VALID_DISTANCE);
-}
-
-float measureDistance(int trigPin, int echoPin)
-{
-    // HC-SR04 Trigger-Sequenz: 10µs HIGH-Puls startet Messung
-    digitalWrite(trigPin, LOW);
-    delayMicroseconds(2);
-    digitalWrite(trigPin, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(trigPin, LOW);
-
-    // Wartet auf Echo-Puls, Timeout verhindert Blockierung bei fehlendem Echo
-    long duration = pulseIn(echoPin, HIGH, 30000); // 30ms = ~5m Reichweite
-    if (duration == 0)
-    {
-        return -1.0f;
-    }
-    return (duration * SOUND_SPEED / 2.0f); // Hin- und Rückweg, daher /2
-}
-
 void setTrafficLight(bool red, bool yellow, bool green)
 {
-    digitalWrite(rledPin, red ? HIGH : LOW);
-    digitalWrite(yledPin, yellow ? HIGH : LOW);
-    digitalWrite(gledPin, green ? HIGH : LOW);
+    TrafficLight::set(red, yellow, green); // W1TC/W1TS, fremde Pins der Bank bleiben unberührt
 
-    // Reduziertes Logging verhindert Serial-Buffer-Überlauf
-    static unsigned long lastLEDLog = 0;
-    if (millis() - lastLEDLog > 1000)
+    // Logging nur bei geänderter Anzeige verhindert Serial-Buffer-Überlauf
+    int pattern = (red ? 4 : 0) | (yellow ? 2 : 0) | (green ? 1 : 0);
+    if (pattern != lastLightPattern)
     {
         Serial.print("ESP1: LEDs - R:");
         Serial.print(red ? "ON" : "OFF");
@@ -279,7 +1476,7 @@ void setTrafficLight(bool red, bool yellow, bool green)
         Serial.print(yellow ? "ON" : "OFF");
         Serial.print(" G:");
         Serial.println(green ? "ON" : "OFF");
-        lastLEDLog = millis();
+        lastLightPattern = pattern;
     }
 }
 
@@ -292,6 +1489,9 @@ void updateClientStatus()
         {
             Serial.println("ESP1: Client getrennt");
             clientConnected = false;
+            clientTimeSynced = false; // Ohne Nachbar wieder freie Ping-Folge
+            clientReady = false;
+            linkMonitor.armed = false;
         }
 
         WiFiClient newClient = server.available();
@@ -303,6 +1503,7 @@ void updateClientStatus()
                 client.stop();
             }
             client = newClient;
+            clientLine.reset(); // Rest einer Zeile der alten Verbindung verwerfen
             clientConnected = true;
             Serial.println("ESP1: Neuer Client verbunden!");
         }
@@ -317,28 +1518,117 @@ void handleSystemError(const String &errorMsg)
 {
     Serial.print("ESP1: SYSTEM FEHLER - ");
     Serial.println(errorMsg);
-    currentState = ERROR_STATE;
+    machine.dispatch(EV_FAULT);
+}
+
+// Aktion beim Eintritt in ERROR_STATE: laufende Abläufe abbrechen, Blinken und Wiederherstellung
+void enterError()
+{
+    lightSequencer.cancel();
+
+    timerWheel.cancel(timingTimeoutTimer);
+    timerWheel.cancel(cooldownTimer);
+
+    // Visuelles Fehlersignal: 5x rotes Blinken, als Timer statt delay()
+    timerWheel.cancel(errorBlinkTimer);
+    errorBlinkStepsLeft = 2 * ERROR_BLINK_COUNT;
+    onErrorBlinkStep();
+
+    // Selbstheilungsversuch nach 5 Sekunden
+    timerWheel.cancel(recoveryTimer);
+    recoveryStepDue = false;
+    recoveryTimer = timerWheel.schedule(ERROR_RECOVERY_DELAY_MS, onRecoveryDue);
+}
 
-    // Visuelles Fehlersignal: 5x rotes Blinken
-    for (int i = 0; i < 5; i++)
+// Ein Schritt des Fehler-Blinkmusters: gerade Schritte Rot an, ungerade aus
+void onErrorBlinkStep()
+{
+    errorBlinkTimer = NO_TIMER;
+    if (errorBlinkStepsLeft <= 0)
+    {
+        return;
+    }
+    errorBlinkStepsLeft--;
+    bool redOn = (errorBlinkStepsLeft % 2) == 1;
+    setTrafficLight(redOn, false, false);
+    if (errorBlinkStepsLeft > 0)
     {
-        setTrafficLight(true, false, false);
-        delay(200);
-        setTrafficLight(false, false, false);
-        delay(200);
+        errorBlinkTimer = timerWheel.schedule(ERROR_BLINK_INTERVAL_MS, onErrorBlinkStep);
     }
 }
 
-void resetSystem()
+// Wiederherstellung: Kalibrierung schrittweise, eine Messung pro Timer-Aufruf
+void onRecoveryDue()
+{
+    Serial.println("ESP1: Versuche System-Wiederherstellung...");
+    timerWheel.cancel(errorBlinkTimer);
+    beginCalibration();
+    recoveryTimer = timerWheel.schedule(CALIBRATION_SAMPLE_INTERVAL_MS, onRecoveryCalibrationStep);
+}
+
+// Der Timer macht die Messung nur fällig: das Slot-Fenster ist kürzer als ein Timer-Tick,
+// loop() misst erst, wenn der eigene Slot offen ist
+void onRecoveryCalibrationStep()
+{
+    recoveryTimer = NO_TIMER;
+    recoveryStepDue = true;
+}
+
+void recoveryCalibrationStep()
+{
+    recoveryStepDue = false;
+    if (!calibrationStep())
+    {
+        recoveryTimer = timerWheel.schedule(CALIBRATION_SAMPLE_INTERVAL_MS, onRecoveryCalibrationStep);
+        return;
+    }
+
+    recoveryTimer = NO_TIMER;
+    if (finishCalibration())
+    {
+        triggerThreshold1 = referenceDistance1 / 2.0f;
+        gateDetector.configure(referenceDistance1, noiseSigma1);
+        machine.dispatch(EV_CALIBRATED);
+    }
+    else
+    {
+        recoveryTimer = timerWheel.schedule(ERROR_RECOVERY_DELAY_MS, onRecoveryDue);
+    }
+}
+
+// Sicherheitstimeout falls Client nicht antwortet oder Objekt nie ankommt
+void onTimingTimeout()
+{
+    timingTimeoutTimer = NO_TIMER;
+    if (machine.dispatch(EV_TIMEOUT))
+    {
+        Serial.println("ESP1: Zeitmessung Timeout!");
+    }
+}
+
+// Erzwungene Pause verhindert zu schnelle Messfolgen
+void onCooldownDone()
+{
+    cooldownTimer = NO_TIMER;
+    if (machine.dispatch(EV_COOLDOWN_DONE))
+    {
+        Serial.println("ESP1: Bereit für nächste Messung");
+    }
+}
+
+// Aktion beim Eintritt in IDLE_GREEN: alle Abläufe der letzten Messung zurücksetzen
+void enterIdle()
 {
     Serial.println("ESP1: System Reset");
+    timerWheel.cancel(errorBlinkTimer);
+    timerWheel.cancel(timingTimeoutTimer);
+    timerWheel.cancel(cooldownTimer);
+    lightSequencer.cancel();
     objectDetectedTime = 0;
     yellowLightOnTime = 0;
     timingStartTime = 0;
     consecutiveInvalidReadings = 0;
-    timingInProgress = false;  // KRITISCH: Muss zurückgesetzt werden für nächste Messung
     setTrafficLight(false, false, true);
-    currentState = IDLE_GREEN;
 }
 
 void printSystemStatus()
@@ -351,20 +1641,158 @@ void printSystemStatus()
         Serial.print(", Client=");
         Serial.print(clientConnected ? "OK" : "NO");
         Serial.print(", Timing=");
-        Serial.print(timingInProgress ? "YES" : "NO");
+        Serial.print(currentState == TIMING_STARTED_ALL_ON ? "YES" : "NO");
+        if (clientReady)
+        {
+            Serial.print(", RTT=");
+            Serial.print(linkMonitor.srttMs);
+            Serial.print("±");
+            Serial.print(linkMonitor.rttVarMs);
+            Serial.print("ms, Phi=");
+            Serial.print(linkMonitor.phi(millis()));
+            Serial.print(", Verlust=");
+            Serial.print(linkMonitor.lostHeartbeats);
+        }
+        Serial.print(", Sensoren=");
+        Serial.print(gateSensors.healthySensors());
+        Serial.print("/");
+        Serial.print(SENSOR_COUNT);
+        Serial.print(", Live=");
+        int liveCount = 0;
+        for (int i = 0; i < MAX_LIVE_SUBSCRIBERS; i++)
+        {
+            liveCount += liveSubscribers[i].streaming ? 1 : 0;
+        }
+        Serial.print(liveCount);
+        Serial.print(" (verworfen ");
+        Serial.print(liveDroppedEvents);
+        Serial.print("/");
+        Serial.print(liveDroppedSubscribers);
+        if (liveFeed.oversized > 0)
+        {
+            Serial.print(", zu lang ");
+            Serial.print(liveFeed.oversized);
+        }
+        Serial.print(")");
+        if (memoryTelemetry.count > 0)
+        {
+            const MemorySample &mem = memoryTelemetry.latest();
+            Serial.print(", Heap=");
+            Serial.print(mem.freeHeap);
+            Serial.print(" (Block ");
+            Serial.print(mem.largestBlock);
+            Serial.print(", Stack ");
+            Serial.print(mem.stackFree);
+            Serial.print(")");
+        }
+        Serial.print(", Ampel max=");
+        Serial.print((long)lightSequencer.maxLateUs);
+        Serial.print("us");
+        lightSequencer.maxLateUs = 0;
+        Serial.print(", RX max=");
+        Serial.print(maxMessagesPerLoop);
+        Serial.print("/Loop");
+        if (clientLine.overflows > 0)
+        {
+            Serial.print(" (verworfen ");
+            Serial.print(clientLine.overflows);
+            Serial.print(")");
+        }
         Serial.print(", Ref=");
         Serial.print(referenceDistance1);
-        Serial.println("cm");
+        Serial.print("cm, Loop max=");
+        Serial.print(maxLoopDurationUs);
+        Serial.println("us");
+        if (telemetry.enabled)
+        {
+            Serial.print("ESP1: ");
+            Serial.println(telemetry.summary());
+        }
+        maxLoopDurationUs = 0;
+        maxMessagesPerLoop = 0;
         lastStatusPrint = millis();
     }
 }
 
 void loop()
 {
+    unsigned long loopStart = micros();
+
     updateClientStatus();
+    checkLinkHealth();
+    sampleMemory();
     printSystemStatus();
 
-    float currentDistance1 = measureDistanceWithMedianFilter(trigPin1, echoPin1);
+    // Fällige Timer: LED-Muster, Cooldown, Timeouts, Wiederherstellung
+    timerWheel.advance(millis());
+    handleLightEvents();
+    updatePowerMode();
+
+    // Sensorabtastung im festen Raster statt delay(), Nachrichten werden in jedem Durchlauf bedient
+    // Im Fehlerzustand misst nur der Wiederherstellungs-Job, im Sparbetrieb nur der Anwesenheits-Ping
+    // Außerhalb des eigenen TDMA-Slots bleibt die Abtastung fällig, bis der Slot beginnt
+    bool sampleDue = currentState != ERROR_STATE && idleScheduler.sampleDue(millis(), lastSampleTime);
+    if (sampleDue && ownSlotWaitUs(pingBudgetUs()) == 0)
+    {
+        lastSampleTime = millis();
+        bool ping = idleScheduler.saving;
+        unsigned long sampleStart = micros();
+        idleScheduler.sampled(sampleStart);
+        updateStateMachine();
+        if (ping)
+        {
+            idleScheduler.pinged(micros() - sampleStart);
+        }
+    }
+    if (recoveryStepDue && ownSlotWaitUs(pingBudgetUs()) == 0)
+    {
+        recoveryCalibrationStep();
+    }
+
+    handleClientCommunication();
+
+    // Zuschauer zuletzt bedienen: nur nicht-blockierende Sends, nie vor der Zeitmessung
+    publishLiveState();
+    publishLiveStats();
+    acceptLiveSubscribers();
+    serviceLiveSubscribers();
+    serviceTelemetry();
+
+    unsigned long loopDuration = micros() - loopStart;
+    if (loopDuration > maxLoopDurationUs)
+    {
+        maxLoopDurationUs = loopDuration;
+    }
+
+    // Rechenzeit für WiFi-Stack und Idle-Task, im Sparbetrieb bis zum nächsten Ping schlafen,
+    // bei fälliger Abtastung bis zum Beginn des eigenen Slots (höchstens ein Abtastraster)
+    unsigned long sleepMs = idleScheduler.sleepBudgetMs(millis(), lastSampleTime);
+    if (sleepMs == 0 && (sampleDue || recoveryStepDue))
+    {
+        sleepMs = min((ownSlotWaitUs(pingBudgetUs()) + 999) / 1000, LOOP_DELAY_MS);
+    }
+    sleepMs = max(sleepMs, 1UL);
+    unsigned long sleepStart = micros();
+    if (idleScheduler.saving)
+    {
+        delay(sleepMs);
+    }
+    else
+    {
+        sleepUntilMessage(sleepMs);
+    }
+    if (idleScheduler.saving)
+    {
+        idleScheduler.account(sleepStart - loopStart, micros() - sleepStart);
+    }
+}
+
+// Eine Abtastung der Schranke und ein Schritt der Hauptzustandsmaschine
+void updateStateMachine()
+{
+    unsigned long sampleUs = micros();
+    currentDistance1 = measureGateDistance();
+    telemetry.record(sampleUs, isValidDistance(currentDistance1) ? currentDistance1 : -1.0f, gateSensors.rawPings, gateSensors.rawCount);
 
     // Sensor-Gesundheitsüberwachung erkennt defekte/blockierte Sensoren
     if (!isValidDistance(currentDistance1))
@@ -373,7 +1801,6 @@ void loop()
         if (consecutiveInvalidReadings > MAX_INVALID_READINGS)
         {
             handleSystemError("Sensor ausgefallen - zu viele ungültige Messungen");
-            delay(1000);
             return;
         }
     }
@@ -381,194 +1808,310 @@ void loop()
     {
         consecutiveInvalidReadings = 0;
         lastValidMeasurement = millis();
+        if (speedTrapEnabled())
+        {
+            gateSpeed.push(millis(), currentDistance1);
+        }
     }
 
-    // Hauptzustandsmaschine steuert Messablauf
-    switch (currentState)
+    // Detektor sieht jede Abtastung, ungültige Messungen werden übergangen
+    if (gateDetector.update(isValidDistance(currentDistance1) ? currentDistance1 : -1.0f, millis()))
     {
-    case IDLE_GREEN:
-        // timingInProgress-Check verhindert Überlappung von Messungen
-        if (!timingInProgress && isValidDistance(currentDistance1) &&
-            currentDistance1 <= triggerThreshold1)
-        {
-            Serial.print("ESP1: Objekt erkannt! Distanz: ");
-            Serial.print(currentDistance1);
-            Serial.print("cm <= ");
-            Serial.print(triggerThreshold1);
-            Serial.println("cm");
-
-            objectDetectedTime = millis();
-            setTrafficLight(false, false, false); // Dunkelphase vor Gelb für klare Sequenz
-            currentState = OBJECT_DETECTED_YELLOW_PENDING;
-        }
-        else if (timingInProgress)
-        {
-            // Periodische Warnung bei versuchter Mehrfachmessung
-            static unsigned long lastWarning = 0;
-            if (millis() - lastWarning > 5000)
-            {
-                Serial.println("ESP1: WARNUNG - Zeitmessung läuft noch!");
-                lastWarning = millis();
-            }
-        }
-        break;
+        Serial.print("ESP1: Schranke ");
+        Serial.print(gateDetector.occupied() ? "belegt" : "frei");
+        Serial.print(" nach ");
+        Serial.print(gateDetector.confirmSamples());
+        Serial.println(" Messungen");
+    }
 
-    case OBJECT_DETECTED_YELLOW_PENDING:
-        if (millis() - objectDetectedTime >= YELLOW_PENDING_DELAY_MS)
-        {
-            Serial.println("ESP1: Gelb AN");
-            setTrafficLight(false, true, false);
-            yellowLightOnTime = millis();
-            currentState = YELLOW_ON_RED_PENDING;
-        }
-        break;
+    // Sparbetrieb: ein einzelner Ping deutlich vor der Referenz genügt, der Detektor bestätigt mit voller Rate
+    if (idleScheduler.saving && isValidDistance(currentDistance1) &&
+        referenceDistance1 - currentDistance1 > APPROACH_WAKE_SIGMAS * noiseSigma1)
+    {
+        wakeFromIdle("Annäherung");
+    }
 
-    case YELLOW_ON_RED_PENDING:
-        if (millis() - yellowLightOnTime >= RED_PENDING_DELAY_AFTER_YELLOW_MS)
-        {
-            Serial.println("ESP1: Rot AN - Warte auf Objektverlassen");
-            setTrafficLight(true, false, false);
-            currentState = RED_ON_WAITING_FOR_OBJECT_LEAVE;
-        }
-        break;
+    // Detektor-Zustand als Ereignis - ob es etwas auslöst, entscheidet die Übergangstabelle
+    // (belegt nur in IDLE_GREEN, frei nur bei Rot)
+    machine.dispatch(gateDetector.occupied() ? EV_OBJECT_ENTERED : EV_OBJECT_LEFT);
 
-    case RED_ON_WAITING_FOR_OBJECT_LEAVE:
-        // Hysterese verhindert Fehlauslösung durch Messrauschen
-        if (isValidDistance(currentDistance1) &&
-            currentDistance1 > triggerThreshold1 * HYSTERESIS_FACTOR)
-        {
-            Serial.print("ESP1: Objekt verlassen! Distanz: ");
-            Serial.print(currentDistance1);
-            Serial.print("cm > ");
-            Serial.print(triggerThreshold1 * HYSTERESIS_FACTOR);
-            Serial.println("cm");
+#if !LIGHT_SEQUENCER_TIMER
+    lightSequencer.poll(); // Bisheriges Verfahren: Gelb/Rot erst beim nächsten Abtastschritt
+#endif
+}
 
-            setTrafficLight(true, true, true); // Alle LEDs = Zeitmessung aktiv
+// Aktion IDLE_GREEN -> OBJECT_DETECTED: Dunkelphase sofort, Gelb und Rot über den Sequenzer
+void startLightSequence()
+{
+    Serial.print("ESP1: Objekt erkannt! Distanz: ");
+    Serial.print(currentDistance1);
+    Serial.print("cm, Referenz ");
+    Serial.print(referenceDistance1);
+    Serial.println("cm");
 
-            if (clientConnected)
-            {
-                client.println("START_TIMER");
-                Serial.println("ESP1: START_TIMER gesendet");
-                timingStartTime = millis();
-                timingInProgress = true; // KRITISCH: Blockiert neue Messungen bis Abschluss
-                currentState = TIMING_STARTED_ALL_ON;
-            }
-            else
-            {
-                Serial.println("ESP1: FEHLER - Kein Client verbunden!");
-                handleSystemError("Kein Client für Zeitmessung");
-            }
-        }
-        break;
+    objectDetectedTime = millis();
+    lightSequencer.start(esp_timer_get_time()); // Dunkelphase vor Gelb für klare Sequenz
 
-    case TIMING_STARTED_ALL_ON:
-        // Sicherheitstimeout falls Client nicht antwortet oder Objekt nie ankommt
-        if (millis() - timingStartTime > MAX_TIMING_DURATION_MS)
-        {
-            Serial.println("ESP1: Zeitmessung Timeout!");
-            handleSystemError("Zeitmessung Timeout");
-        }
-        // Wartet auf STOP_TIMER vom Client
-        break;
+    // Client verlässt seinen Sparbetrieb, bevor START_TIMER kommt (frühestens nach 2.5s)
+    if (clientConnected)
+    {
+        client.println("WAKE");
+    }
+}
 
-    case WAITING_FOR_TIMING_COMPLETE:
-        // Erzwungene Pause verhindert zu schnelle Messfolgen
-        if (millis() - displayStartTime >= MIN_TIME_BETWEEN_MEASUREMENTS_MS)
-        {
-            resetSystem();
-            Serial.println("ESP1: Bereit für nächste Messung");
-        }
-        break;
+// Aktion RED -> TIMING: Zeitmessung beim Client starten
+// Detektor bestätigt das Verlassen erst, wenn es sich vom Messrauschen abhebt
+void startTiming()
+{
+    Serial.print("ESP1: Objekt verlassen! Distanz: ");
+    Serial.print(currentDistance1);
+    Serial.println("cm");
+    if (speedTrapEnabled())
+    {
+        startSpeed = gateSpeed.speedCmS(millis());
+        Serial.print("ESP1: Start mit ");
+        Serial.println(formatSpeed(startSpeed));
+    }
 
-    case ERROR_STATE:
-        // Selbstheilungsversuch nach 5 Sekunden
-        delay(5000);
-        Serial.println("ESP1: Versuche System-Wiederherstellung...");
-        if (establishInitialReferenceDistance())
-        {
-            triggerThreshold1 = referenceDistance1 / 2.0f;
-            timingInProgress = false; // Muss explizit zurückgesetzt werden
-            resetSystem();
-        }
-        break;
+    // Alle LEDs = Zeitmessung aktiv, Abweichung = Verzögerung gegenüber dem Verlassen
+    lightSequencer.fire(LIGHT_ALL_ON, false, (int64_t)gateDetector.changeTime() * 1000);
 
-    default:
-        handleSystemError("Unbekannter Systemzustand");
-        break;
+    // Vor CLIENT_READY kalibriert der Client noch und würde START_TIMER ignorieren
+    if (!clientConnected || !clientReady)
+    {
+        Serial.println("ESP1: FEHLER - Kein Client verbunden!");
+        handleSystemError("Kein Client für Zeitmessung");
+        return;
     }
+    // Protokoll: "START_TIMER:<ms>" - so lange liegt der Beginn des Verlassens schon zurück, die
+    // Bestätigungsmessungen und die Übertragung gehen damit nicht in die Zeit ein
+    unsigned long sinceChange = millis() - gateDetector.changeTime();
+    client.print("START_TIMER:");
+    client.println(sinceChange);
+    Serial.print("ESP1: START_TIMER gesendet, Verlassen vor ");
+    Serial.print(sinceChange);
+    Serial.println("ms");
+    timingStartTime = millis();
+    timingTimeoutTimer = timerWheel.schedule(MAX_TIMING_DURATION_MS, onTimingTimeout);
+}
 
-    handleClientCommunication();
-    delay(LOOP_DELAY_MS);
+// Aktion TIMING -> COOLDOWN: erzwungene Pause vor der nächsten Messung
+void enterCooldown()
+{
+    displayStartTime = millis();
+    timerWheel.cancel(timingTimeoutTimer);
+    timerWheel.cancel(cooldownTimer);
+    cooldownTimer = timerWheel.schedule(MIN_TIME_BETWEEN_MEASUREMENTS_MS, onCooldownDone);
+
+    setTrafficLight(false, true, false); // Gelb = Ergebnis empfangen
+    Serial.println("ESP1: Cooldown-Phase gestartet");
 }
 
+// Verarbeitet alle vollständig empfangenen Nachrichten dieses Durchlaufs (mit Zeitbudget),
+// eine angefangene Zeile wird im nächsten Durchlauf fortgesetzt
 void handleClientCommunication()
 {
-    if (clientConnected && client.available())
+    unsigned long rxStart = micros();
+    unsigned long messages = 0;
+    while (clientConnected && clientLine.poll(client))
     {
-        String clientData = client.readStringUntil('\n');
+        messages++;
+        String clientData(clientLine.line());
         clientData.trim();
-        Serial.print("ESP1: Client: '");
-        Serial.print(clientData);
-        Serial.println("'");
+        if (!clientData.startsWith("HEARTBEAT"))
+        {
+            Serial.print("ESP1: Client: '");
+            Serial.print(clientData);
+            Serial.println("'");
+        }
 
         if (clientData.startsWith("STOP_TIMER"))
         {
             Serial.println("ESP1: STOP_TIMER empfangen");
 
-            // Protokoll: "STOP_TIMER:12345" mit Zeit in Millisekunden
+            // Protokoll: "STOP_TIMER:12345:<seq>[:<cm/s>]" mit Zeit in Millisekunden,
+            // Sequenznummer des Clients (ohne Sequenznummer: ältere Clients) und im Speed-Trap-Modus
+            // der Momentangeschwindigkeit an Schranke 2
             int colonIndex = clientData.indexOf(':');
             unsigned long measuredTime = 0;
             if (colonIndex != -1)
             {
                 String timeValue = clientData.substring(colonIndex + 1);
+                measuredTime = timeValue.toInt();
+                int seqIndex = clientData.indexOf(':', colonIndex + 1);
+                uint32_t seq = seqIndex != -1 ? strtoul(clientData.c_str() + seqIndex + 1, nullptr, 10) : 0;
+                int speedIndex = seqIndex != -1 ? clientData.indexOf(':', seqIndex + 1) : -1;
+                uint32_t finishSpeed = speedIndex != -1 ? strtoul(clientData.c_str() + speedIndex + 1, nullptr, 10) : 0;
                 Serial.print("ESP1: Gemessene Zeit: ");
-                Serial.print(timeValue);
+                Serial.print(measuredTime);
                 Serial.println("ms");
-                
-                measuredTime = timeValue.toInt();
-                stats.addMeasurement(measuredTime / 1000.0);
-                
-                // Persistente Speicherung für spätere Analyse
-                logMeasurement(measuredTime);
+
+                if (seq != 0 && seq <= lastClientResultSeq)
+                {
+                    Serial.println("ESP1: Duplikat ignoriert");
+                }
+                else if (currentState == TIMING_STARTED_ALL_ON)
+                {
+                    // Startnummer und Startgeschwindigkeit gehören nur zum gerade laufenden Lauf
+                    uint16_t bib = nextAthlete;
+                    nextAthlete = 0;
+                    recordRun(measuredTime, bib, currentSession, startSpeed, finishSpeed);
+                    machine.dispatch(EV_STOP_RECEIVED);
+                }
+                else
+                {
+                    // Nachzügler nach Timeout oder Fehler: gespeichert, aber ohne Startnummer und Cooldown
+                    recordRun(measuredTime, 0, currentSession, 0, finishSpeed);
+                }
+                if (seq != 0)
+                {
+                    acknowledgeClientResult(max(seq, lastClientResultSeq));
+                }
             }
-            
-            timingInProgress = false; // Gibt System für nächste Messung frei
-            currentState = WAITING_FOR_TIMING_COMPLETE;
-            displayStartTime = millis();
-            
-            setTrafficLight(false, true, false); // Gelb = Ergebnis empfangen
-            Serial.println("ESP1: Cooldown-Phase gestartet");
+
             Serial.print("ESP1: Statistik - ");
             Serial.println(stats.toJSON());
         }
+        else if (clientData.startsWith("TIME_REQ:"))
+        {
+            // Protokoll: "TIME_REQ:<t0>" -> "TIME_RESP:<t0>:<Server-micros>"
+            // Antwort so spät wie möglich stempeln, der Client wertet die Laufzeit aus
+            unsigned long clientStamp = strtoul(clientData.c_str() + 9, nullptr, 10);
+            client.print("TIME_RESP:");
+            client.print(clientStamp);
+            client.print(":");
+            client.println(micros());
+            if (!clientTimeSynced)
+            {
+                clientTimeSynced = true;
+                Serial.println("ESP1: Client synchronisiert - TDMA aktiv");
+                printTdmaBudget();
+            }
+        }
+        else if (clientData.startsWith("ATHLETE:"))
+        {
+            // Protokoll: "ATHLETE:<Startnummer>" vor dem Start, gilt für den nächsten Lauf
+            nextAthlete = (uint16_t)strtoul(clientData.c_str() + 8, nullptr, 10);
+            Serial.print("ESP1: Nächste Startnummer: ");
+            Serial.println(nextAthlete);
+        }
+        else if (clientData.startsWith("SESSION:"))
+        {
+            // Protokoll: "SESSION:<Nummer>" - bleibt gesetzt, auch über Neustarts
+            currentSession = (uint16_t)strtoul(clientData.c_str() + 8, nullptr, 10);
+            preferences.putUShort("session", currentSession);
+            Serial.print("ESP1: Session: ");
+            Serial.println(currentSession);
+        }
+        else if (clientData.startsWith("RESULTS:"))
+        {
+            handleResultBatch(clientData);
+        }
+        else if (clientData.startsWith("MEM:"))
+        {
+            handleClientMemory(clientData);
+        }
         else if (clientData.startsWith("CLIENT_READY"))
         {
             Serial.println("ESP1: Client bereit");
+            // Protokoll: "CLIENT_READY:<epoch>[:<seq>]" - neue Kennung = Client-NVS gelöscht, Zählung
+            // neu. seq = noch unbestätigter letzter Lauf, fehlt ohne einen solchen
+            if (clientData.length() > 13)
+            {
+                char *end;
+                uint32_t epoch = strtoul(clientData.c_str() + 13, &end, 10);
+                if (epoch != clientEpoch)
+                {
+                    clientEpoch = epoch;
+                    lastClientResultSeq = 0;
+                    preferences.putUInt("clientEpoch", clientEpoch);
+                    preferences.putUInt("clientSeq", lastClientResultSeq);
+                }
+                // Ohne ausstehenden Lauf hat der Client START_TIMER nie bekommen, Warten ist zwecklos
+                if (*end != ':' && currentState == TIMING_STARTED_ALL_ON)
+                {
+                    handleSystemError("Client hat die Zeitmessung nicht gestartet");
+                }
+            }
+            clientReady = true;
+            linkMonitor.arm(millis()); // Ab jetzt sendet der Client regelmäßig Heartbeats
+        }
+        else if (clientData.startsWith("HEARTBEAT:"))
+        {
+            // Protokoll: "HEARTBEAT:<seq>:<micros>" -> Echo als "HEARTBEAT_ACK:<seq>:<micros>"
+            client.print("HEARTBEAT_ACK");
+            client.println(clientData.substring(9));
+            linkMonitor.onHeartbeat(strtoul(clientData.c_str() + 10, nullptr, 10), millis());
         }
-        else if (clientData.startsWith("HEARTBEAT_ACK"))
+        else if (clientData.startsWith("HEARTBEAT_ACK:"))
         {
-            lastHeartbeatReceived = millis();
+            int secondColon = clientData.indexOf(':', 14);
+            if (secondColon != -1)
+            {
+                linkMonitor.onAck(strtoul(clientData.c_str() + secondColon + 1, nullptr, 10), micros());
+            }
         }
         else
         {
             Serial.print("ESP1: Unbekannte Nachricht: ");
             Serial.println(clientData);
         }
+
+        if (micros() - rxStart >= PROTOCOL_RX_BUDGET_US)
+        {
+            break; // Rest im nächsten Durchlauf, die Abtastung hat Vorrang
+        }
     }
+    maxMessagesPerLoop = max(maxMessagesPerLoop, messages);
     
-    // Heartbeat-Mechanismus erkennt stille Verbindungsabbrüche
-    if (clientConnected && millis() - lastHeartbeatSent > HEARTBEAT_INTERVAL_MS)
+    // Heartbeat mit Sequenznummer und Zeitstempel, das ACK liefert die Round-Trip-Time
+    if (clientReady && millis() - lastHeartbeatSent >= HEARTBEAT_INTERVAL_MS)
     {
-        client.println("HEARTBEAT");
+        client.print("HEARTBEAT:");
+        client.print(++linkMonitor.sentSeq);
+        client.print(":");
+        client.println(micros());
         lastHeartbeatSent = millis();
-        Serial.println("ESP1: Heartbeat gesendet");
     }
 }
 
+// Adaptive Ausfallerkennung: trennt den Client, sobald phi die Schwelle überschreitet
+// Eine laufende Messung wird sofort abgebrochen statt 30s auf STOP_TIMER zu warten
+void checkLinkHealth()
+{
+    if (!clientReady || !linkMonitor.suspected(millis()))
+    {
+        return;
+    }
+
+    Serial.print("ESP1: Verbindung verdächtig - Phi=");
+    Serial.print(linkMonitor.phi(millis()));
+    Serial.print(", Stille ");
+    Serial.print(millis() - linkMonitor.lastArrival);
+    Serial.print("ms (Mittel ");
+    Serial.print(linkMonitor.meanIntervalMs);
+    Serial.println("ms)");
+
+    client.stop();
+    clientConnected = false;
+    clientTimeSynced = false;
+    clientReady = false;
+    linkMonitor.armed = false;
+
+    machine.dispatch(EV_LINK_LOST);
+}
+
+// Aktion TIMING --LINK_LOST--> TIMING: der Client misst offline weiter und reicht sein Ergebnis
+// nach dem Wiederverbinden als STOP_TIMER nach, bis dahin läuft nur der Timeout
+void awaitClientResult()
+{
+    Serial.println("ESP1: Verbindung während Zeitmessung verloren - warte auf nachgereichtes Ergebnis");
+}
+
 // ISR für zukünftige präzisere Echo-Zeitmessung (vorbereitet, noch nicht aktiv)
 void IRAM_ATTR echoISR() {
     static unsigned long startTime = 0;
-    if (digitalRead(echoPin1)) {
+    if (FastPin<echoPin1>::read()) {
         startTime = micros();
     } else {
         pulseDuration = micros() - startTime;
@@ -576,32 +2119,10 @@ void IRAM_ATTR echoISR() {
     }
 }
 
-// Median-Filter eliminiert Ausreißer durch Ultraschall-Reflexionen
-float measureDistanceWithMedianFilter(int trigPin, int echoPin, int samples) {
-    float measurements[samples];
-    
-    for (int i = 0; i < samples; i++) {
-        measurements[i] = measureDistance(trigPin, echoPin);
-        if (measurements[i] < 0) {
-            measurements[i] = MAX_VALID_DISTANCE + 1; // Sortiert Fehler ans Ende
-        }
-        delayMicroseconds(500); // Verhindert Echo-Überlagerungen
-    }
-    
-    // Einfacher Bubble Sort reicht für kleine Datenmengen
-    for (int i = 0; i < samples - 1; i++) {
-        for (int j = 0; j < samples - i - 1; j++) {
-            if (measurements[j] > measurements[j + 1]) {
-                float temp = measurements[j];
-                measurements[j] = measurements[j + 1];
-                measurements[j + 1] = temp;
-            }
-        }
-    }
-    
-    // Median ist robuster als Mittelwert gegen Ausreißer
-    float median = measurements[samples / 2];
-    return (median > MAX_VALID_DISTANCE) ? -1.0f : median;
+// Ein Schranken-Messwert aus mehreren Round-Robin-Pings, -1 = ungültig
+// Der Aufrufer startet im eigenen TDMA-Slot, endet der Slot, zählen die Pings bis dahin
+float measureGateDistance(int pings) {
+    return gateSensors.measureFused(pings, echoTimeoutUs, ownSlotWaitUs);
 }
 
 // SPIFFS für persistente Datenspeicherung über Neustarts hinweg
@@ -614,32 +2135,1090 @@ void initSPIFFS() {
     Serial.println("ESP1: SPIFFS erfolgreich gemountet");
     
     // Automatische Rotation bei 100KB verhindert Speicherüberlauf
-    File file = SPIFFS.open("/measurements.csv");
-    if (file && file.size() > 100000) {
-        file.close();
-        SPIFFS.remove("/measurements.csv");
-        Serial.println("ESP1: Alte Logs gelöscht");
-    } else if (file) {
-        file.close();
+    const char *logs[] = {LOG_FILE, LEGACY_CSV_LOG};
+    for (const char *path : logs) {
+        File file = SPIFFS.open(path);
+        if (file && file.size() > LOG_ROTATE_BYTES) {
+            file.close();
+            SPIFFS.remove(path);
+            Serial.println("ESP1: Alte Logs gelöscht");
+        } else if (file) {
+            file.close();
+        }
+    }
+
+    measurementLog.begin();
+    migrateLegacyLog();
+    Serial.print("ESP1: Messprotokoll ");
+    Serial.print(measurementLog.records());
+    Serial.print(" Datensätze in ");
+    Serial.print(measurementLog.blockCount);
+    Serial.print(" Blöcken");
+    if (measurementLog.corruptBlocks > 0) {
+        Serial.print(", ");
+        Serial.print(measurementLog.corruptBlocks);
+        Serial.print(" beschädigt (CRC)");
     }
+    Serial.println();
 }
 
-// CSV-Logging für spätere Analyse und Qualitätssicherung
-void logMeasurement(unsigned long time) {
-    File file = SPIFFS.open("/measurements.csv", FILE_APPEND);
+// Übernimmt ein Protokoll im alten CSV-Format (millis,zeit,status,referenz[,startnummer,session])
+// einmalig ins Binärprotokoll und löscht es danach
+void migrateLegacyLog() {
+    File file = SPIFFS.open(LEGACY_CSV_LOG, FILE_READ);
     if (!file) {
-        Serial.println("ESP1: Fehler beim Öffnen der Log-Datei");
         return;
     }
-    
-    // CSV-Format ermöglicht einfache Analyse in Excel/Python
-    file.printf("%lu,%lu,%s,%.2f\n", 
-        millis(),                                   // Zeitstempel seit Boot
-        time,                                       // Gemessene Zeit in ms
-        clientConnected ? "OK" : "NO_CLIENT",      // Verbindungsstatus
-        referenceDistance1                          // Aktuelle Kalibrierung
-    );
-    
+    char line[LEGACY_LINE_MAX];
+    int len = 0;
+    uint32_t migrated = 0;
+    bool ok = true;
+    while (ok) {
+        int c = file.read();
+        if (c >= 0 && c != '\n') {
+            if (c != '\r' && len < LEGACY_LINE_MAX - 1) {
+                line[len++] = c;
+            }
+            continue;
+        }
+        if (len > 0) {
+            line[len] = '\0';
+            char *p;
+            LogEntry e;
+            e.seq = measurementLog.nextSeq;
+            e.t = strtoul(line, &p, 10);
+            if (*p == ',') {
+                e.timeMs = strtoul(p + 1, &p, 10);
+                e.clientOk = strncmp(p, ",OK,", 4) == 0;
+                char *field = strchr(p + 1, ',');
+                e.reference = field ? strtof(field + 1, &p) : 0;
+                if (field && *p == ',') {
+                    e.bib = strtoul(p + 1, &p, 10);
+                    if (*p == ',') {
+                        e.session = strtoul(p + 1, nullptr, 10);
+                    }
+                }
+                ok = measurementLog.append(e);
+                migrated += ok;
+            }
+        }
+        len = 0;
+        if (c < 0) {
+            break;
+        }
+    }
     file.close();
+    if (ok && measurementLog.flush()) {
+        SPIFFS.remove(LEGACY_CSV_LOG);
+    }
+    Serial.print("ESP1: ");
+    Serial.print(migrated);
+    Serial.println(" Zeilen aus dem CSV-Protokoll übernommen");
+}
+
+// Binär-Logging für spätere Analyse und Qualitätssicherung, CSV entsteht erst beim Export
+void logMeasurement(const RunRecord &run, const RunSpeeds &speeds) {
+    LogEntry e;
+    e.seq = run.seq;
+    e.t = millis();                                 // Zeitstempel seit Boot
+    e.timeMs = run.timeMs;                          // Gemessene Zeit in ms
+    e.clientOk = clientConnected;                   // Verbindungsstatus
+    e.reference = referenceDistance1;               // Aktuelle Kalibrierung
+    e.bib = run.bib;                                // Startnummer (0 = keine)
+    e.session = run.session;
+    e.startSpeed = speeds.start;                    // Durchschnitt folgt aus Laufzeit und Abstand
+    e.finishSpeed = speeds.finish;
+
+    // Der letzte Block wird sofort geschrieben - ein Reset verliert keinen Lauf
+    if (!measurementLog.append(e) || !measurementLog.flush()) {
+        Serial.println("ESP1: Fehler beim Schreiben der Log-Datei");
+        return;
+    }
     Serial.println("ESP1: Messung geloggt");
-}
\ No newline at end of file
+}
+
+// Begrenzt den Echo-Timeout auf die tatsächlich benötigte Reichweite,
+// dadurch passen mehr Pings in einen TDMA-Slot
+void updateEchoTimeout() {
+    unsigned long neededUs = (unsigned long)(referenceDistance1 * ECHO_RANGE_MARGIN * 2.0f / SOUND_SPEED);
+    echoTimeoutUs = min(ECHO_TIMEOUT_US, neededUs);
+}
+
+// Längster Ping samt Schutzabstand davor
+unsigned long pingBudgetUs() {
+    return GateSensors::pingBudgetUs(echoTimeoutUs);
+}
+
+// Wartezeit bis der eigene TDMA-Slot noch Platz für einen vollständigen Ping hat, 0 = sofort
+// Blockiert nie: der Loop bedient in der Zwischenzeit Nachrichten und Heartbeats
+unsigned long ownSlotWaitUs(unsigned long pingBudgetUs) {
+#if TDMA_ENABLED
+    if (!clientConnected || !clientTimeSynced) {
+        return 0; // Ohne synchronisierten Nachbarn gibt es niemanden zu stören
+    }
+
+    const unsigned long windowStart = TDMA_SLOT_INDEX * TDMA_SLOT_US + TDMA_GUARD_US;
+    const unsigned long windowEnd = (TDMA_SLOT_INDEX + 1) * TDMA_SLOT_US - TDMA_GUARD_US;
+    unsigned long phase = micros() % TDMA_FRAME_US;
+
+    if (phase >= windowStart && phase + pingBudgetUs <= windowEnd) {
+        return 0;
+    }
+    return (windowStart + TDMA_FRAME_US - phase) % TDMA_FRAME_US;
+#else
+    return 0;
+#endif
+}
+
+// Wartet höchstens ms, endet aber mit der ersten Nachricht des Clients: TIME_REQ wird so
+// ohne Loop-Verzögerung beantwortet und die Round-Trip-Time bleibt unter der Sync-Grenze
+void sleepUntilMessage(unsigned long ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms && !(clientConnected && client.available())) {
+        delay(1);
+    }
+}
+
+// Meldet die erreichbare Abtastrate pro Schranke im TDMA-Betrieb
+// Ein Messwert pro Slot aus so vielen Pings, wie im ungünstigsten Fall (kein Echo) hineinpassen
+void printTdmaBudget() {
+    unsigned long pingsPerSlot = (TDMA_SLOT_US - 2 * TDMA_GUARD_US) / pingBudgetUs();
+    Serial.print("ESP1: TDMA - ");
+    Serial.print(pingsPerSlot);
+    Serial.print(" Pings/Slot, ");
+    Serial.print(pingsPerSlot * 1000000UL / TDMA_FRAME_US);
+    Serial.print(" Pings/s, ");
+    Serial.print(1000000UL / TDMA_FRAME_US);
+    Serial.print(" Messwerte/s pro Schranke aus je ");
+    Serial.print(min(pingsPerSlot, (unsigned long)GATE_PINGS_PER_READING));
+    Serial.println(" Pings");
+}
+
+// Lädt die letzte Kalibrierung, verwirft fremde Formate und andere Sensor-Konfigurationen
+bool loadCalibration(CalibrationCache &cache) {
+    if (preferences.getBytesLength("calibration") != sizeof(CalibrationCache)) {
+        Serial.println("ESP1: Keine gespeicherte Kalibrierung");
+        return false;
+    }
+    preferences.getBytes("calibration", &cache, sizeof(CalibrationCache));
+    if (cache.version != CALIBRATION_VERSION || cache.sensorCount != SENSOR_COUNT ||
+        !isValidDistance(cache.referenceDistance)) {
+        Serial.println("ESP1: Gespeicherte Kalibrierung ungültig");
+        return false;
+    }
+
+    Serial.print("ESP1: Gespeicherte Kalibrierung: ");
+    Serial.print(cache.referenceDistance);
+    Serial.print("cm aus Boot #");
+    Serial.print(cache.bootCount);
+    Serial.print(" nach ");
+    Serial.print(cache.uptimeMs / 1000);
+    Serial.println("s");
+    return true;
+}
+
+// Speichert eine erfolgreiche Kalibrierung für den nächsten Start
+void saveCalibration(int validSamples) {
+    CalibrationCache cache;
+    cache.version = CALIBRATION_VERSION;
+    cache.referenceDistance = referenceDistance1;
+    cache.triggerThreshold = referenceDistance1 / 2.0f;
+    cache.sensorCount = SENSOR_COUNT;
+    cache.healthySensors = gateSensors.healthySensors();
+    cache.validSamples = validSamples;
+    cache.bootCount = bootCount;
+    cache.uptimeMs = millis();
+    cache.noiseSigma = noiseSigma1;
+
+    if (preferences.putBytes("calibration", &cache, sizeof(CalibrationCache)) != sizeof(CalibrationCache)) {
+        Serial.println("ESP1: Kalibrierung konnte nicht gespeichert werden");
+    }
+}
+
+// Kurze Prüfmessung: Gespeicherte Werte gelten nur, wenn die Umgebung unverändert ist
+bool validateCachedCalibration(const CalibrationCache &cache) {
+    Serial.print("ESP1: Prüfe gespeicherte Kalibrierung");
+    echoTimeoutUs = ECHO_TIMEOUT_US;
+
+    float totalDist = 0;
+    int validSamples = 0;
+    for (int i = 0; i < CAL_VALIDATION_SAMPLES; i++) {
+        float dist = measureGateDistance();
+        if (isValidDistance(dist)) {
+            totalDist += dist;
+            validSamples++;
+            Serial.print(".");
+        } else {
+            Serial.print("x");
+        }
+    }
+    Serial.println();
+
+    // Alle Prüfmessungen bis auf eine müssen gültig sein
+    if (validSamples < CAL_VALIDATION_SAMPLES - 1 ||
+        gateSensors.healthySensors() < cache.healthySensors) {
+        Serial.println("ESP1: Prüfmessung unvollständig - volle Kalibrierung");
+        return false;
+    }
+
+    float measured = totalDist / validSamples;
+    float tolerance = max(CAL_TOLERANCE_CM, cache.referenceDistance * CAL_TOLERANCE_FACTOR);
+    if (fabs(measured - cache.referenceDistance) > tolerance) {
+        Serial.print("ESP1: Referenz abweichend (");
+        Serial.print(measured);
+        Serial.print("cm statt ");
+        Serial.print(cache.referenceDistance);
+        Serial.println("cm) - volle Kalibrierung");
+        return false;
+    }
+
+    Serial.print("ESP1: Gespeicherte Kalibrierung bestätigt (");
+    Serial.print(measured);
+    Serial.println("cm)");
+    return true;
+}
+
+// Zustandsnamen für Live-Anzeige und Export
+const char *stateName(State state) {
+    switch (state) {
+    case SYSTEM_INIT: return "SYSTEM_INIT";
+    case IDLE_GREEN: return "IDLE_GREEN";
+    case OBJECT_DETECTED_YELLOW_PENDING: return "OBJECT_DETECTED";
+    case YELLOW_ON_RED_PENDING: return "YELLOW";
+    case RED_ON_WAITING_FOR_OBJECT_LEAVE: return "RED";
+    case TIMING_STARTED_ALL_ON: return "TIMING";
+    case WAITING_FOR_TIMING_COMPLETE: return "COOLDOWN";
+    case ERROR_STATE: return "ERROR";
+    default: break;
+    }
+    return "UNKNOWN";
+}
+
+const char *eventName(Event event) {
+    static const char *names[EVENT_COUNT] = {"CALIBRATED", "OBJECT_ENTERED", "YELLOW_ON", "RED_ON",
+                                             "OBJECT_LEFT", "STOP_RECEIVED", "COOLDOWN_DONE", "TIMEOUT",
+                                             "LINK_LOST", "FAULT"};
+    return event < EVENT_COUNT ? names[event] : "UNKNOWN";
+}
+
+// Trace-Hook der Zustandsmaschine: jeder Übergang mit Zeitabstand zum vorherigen
+void traceTransition(State from, State to, Event event, unsigned long atUs) {
+    Serial.print("ESP1: Zustand ");
+    Serial.print(stateName(from));
+    Serial.print(" -> ");
+    Serial.print(stateName(to));
+    Serial.print(" (");
+    Serial.print(eventName(event));
+    Serial.print(", +");
+    Serial.print(atUs - lastTransitionUs);
+    Serial.println("us)");
+    lastTransitionUs = atUs;
+}
+
+String liveStateJSON() {
+    return String("{\"state\":\"") + stateName(currentState) + "\",\"t\":" + millis() + "}";
+}
+
+// Zustandswechsel werden einmal pro Loop-Durchlauf erkannt statt an jeder Zuweisung
+void publishLiveState() {
+    if (currentState == lastPublishedState) {
+        return;
+    }
+    lastPublishedState = currentState;
+    liveFeed.publish("state", liveStateJSON());
+}
+
+void publishLiveResult(const RunRecord &run, const RunSpeeds &speeds) {
+    liveFeed.publish("result", String("{\"run\":") + run.seq +
+                               ",\"time_ms\":" + run.timeMs +
+                               ",\"bib\":" + run.bib +
+                               ",\"session\":" + run.session +
+                               ",\"speed_cm_s\":" + speeds.average +
+                               ",\"start_speed_cm_s\":" + speeds.start +
+                               ",\"finish_speed_cm_s\":" + speeds.finish +
+                               ",\"stats\":" + stats.toJSON() + "}");
+}
+
+// Rollierende Statistik; ohne andere Ereignisse zusätzlich ein Keepalive-Kommentar
+void publishLiveStats() {
+    if (millis() - lastLiveStats >= LIVE_STATS_INTERVAL_MS) {
+        lastLiveStats = millis();
+        liveFeed.publish("stats", stats.toJSON());
+    } else if (millis() - liveFeed.lastPublish >= LIVE_KEEPALIVE_MS) {
+        const char keepalive[] = ": keepalive\n\n";
+        liveFeed.publishRaw(keepalive, sizeof(keepalive) - 1);
+    }
+}
+
+// Neue Verbindung in einen freien Platz, sonst sofort mit 503 ablehnen
+void acceptLiveSubscribers() {
+    WiFiClient incoming = liveServer.available();
+    if (!incoming) {
+        return;
+    }
+    for (int i = 0; i < MAX_LIVE_SUBSCRIBERS; i++) {
+        LiveSubscriber &sub = liveSubscribers[i];
+        if (!sub.active) {
+            sub = LiveSubscriber();
+            sub.conn = incoming;
+            sub.conn.setNoDelay(true);
+            sub.active = true;
+            sub.acceptedAt = millis();
+            return;
+        }
+    }
+    const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 10\r\nConnection: close\r\n\r\n";
+    send(incoming.fd(), busy, sizeof(busy) - 1, MSG_DONTWAIT);
+    incoming.stop();
+    liveDroppedSubscribers++;
+}
+
+void serviceLiveSubscribers() {
+    for (int i = 0; i < MAX_LIVE_SUBSCRIBERS; i++) {
+        LiveSubscriber &sub = liveSubscribers[i];
+        if (!sub.active) {
+            continue;
+        }
+        if (!sub.conn.connected()) {
+            closeLiveSubscriber(sub);
+        } else if (sub.exportJob >= 0) {
+            if (!pumpExport(sub)) {
+                closeLiveSubscriber(sub);
+            }
+        } else if (!sub.streaming) {
+            readLiveRequest(sub);
+        } else if (!pumpLiveSubscriber(sub)) {
+            closeLiveSubscriber(sub);
+        }
+    }
+}
+
+// Liest die HTTP-Anfrage mit dem, was gerade im Puffer liegt - nie blockierend
+// Gemerkt werden nur die Anfragezeile, Last-Event-ID und Range/If-Range
+void readLiveRequest(LiveSubscriber &sub) {
+    while (sub.conn.available()) {
+        char c = sub.conn.read();
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            if (sub.lineLen < LIVE_REQUEST_LINE_MAX - 1) {
+                sub.requestLine[sub.lineLen++] = c;
+            }
+            continue;
+        }
+
+        sub.requestLine[sub.lineLen] = '\0';
+        if (!sub.haveRequestLine) {
+            sub.haveRequestLine = true;
+            // Anfragezeile bleibt im Puffer, Header werden dahinter gelesen
+            sub.lineLen = strlen(sub.requestLine) + 1;
+            continue;
+        }
+
+        char *header = sub.requestLine + strlen(sub.requestLine) + 1;
+        if (header[0] == '\0') {
+            routeLiveRequest(sub); // Leerzeile: Header vollständig
+            return;
+        }
+        if (strncasecmp(header, "Last-Event-ID:", 14) == 0) {
+            sub.lastEventId = strtoul(header + 14, nullptr, 10);
+        } else if (strncasecmp(header, "If-Range:", 9) == 0) {
+            const char *value = header + 9;
+            while (*value == ' ') value++;
+            strncpy(sub.ifRange, value, sizeof(sub.ifRange) - 1);
+            sub.ifRange[sizeof(sub.ifRange) - 1] = '\0';
+        } else if (strncasecmp(header, "Range:", 6) == 0) {
+            const char *spec = strstr(header, "bytes=");
+            if (spec) {
+                spec += 6;
+                if (*spec == '-') {
+                    sub.rangeSuffix = strtol(spec + 1, nullptr, 10);
+                } else {
+                    char *end;
+                    sub.rangeStart = strtol(spec, &end, 10);
+                    if (*end == '-' && isdigit((unsigned char)end[1])) {
+                        sub.rangeEnd = strtol(end + 1, nullptr, 10);
+                    }
+                }
+            }
+        }
+        sub.lineLen = strlen(sub.requestLine) + 1;
+    }
+
+    if (millis() - sub.acceptedAt > LIVE_REQUEST_TIMEOUT_MS) {
+        closeLiveSubscriber(sub);
+    }
+}
+
+void routeLiveRequest(LiveSubscriber &sub) {
+    if (strncmp(sub.requestLine, "GET /events", 11) == 0) {
+        const char headers[] = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/event-stream\r\n"
+                               "Cache-Control: no-cache\r\n"
+                               "Access-Control-Allow-Origin: *\r\n"
+                               "Connection: keep-alive\r\n\r\n"
+                               "retry: 2000\n\n";
+        if (send(sub.conn.fd(), headers, sizeof(headers) - 1, MSG_DONTWAIT) != (int)(sizeof(headers) - 1)) {
+            closeLiveSubscriber(sub);
+            return;
+        }
+        // Nach Wiederverbindung dort weitermachen, wo der Browser aufgehört hat
+        uint32_t resume = sub.lastEventId + 1;
+        sub.nextId = (sub.lastEventId > 0 && resume >= liveFeed.oldestId() && resume <= liveFeed.nextId)
+                         ? resume
+                         : liveFeed.nextId;
+        sub.offset = 0;
+        sub.streaming = true;
+        // Neue Zuschauer sehen sofort den aktuellen Stand
+        liveFeed.publish("state", liveStateJSON());
+        liveFeed.publish("stats", stats.toJSON());
+        return;
+    }
+
+    if (strncmp(sub.requestLine, "GET /measurements.bin", 21) == 0) {
+        startExport(sub, true);
+        return;
+    }
+    if (strncmp(sub.requestLine, "GET /export", 11) == 0 ||
+        strncmp(sub.requestLine, "GET /measurements.csv", 21) == 0) {
+        startExport(sub, false);
+        return;
+    }
+    if (strncmp(sub.requestLine, "GET /leaderboard", 16) == 0) {
+        sendLeaderboard(sub);
+        return;
+    }
+    if (strncmp(sub.requestLine, "GET /athlete", 12) == 0) {
+        sendAthleteRuns(sub);
+        return;
+    }
+    if (strncmp(sub.requestLine, "GET /memory", 11) == 0) {
+        sendJSONResponse(sub, String("{\"server\":") + memoryTelemetry.toJSON() +
+                              ",\"client\":" + clientMemoryTelemetry.toJSON() + "}");
+        return;
+    }
+
+    if (strncmp(sub.requestLine, "GET / ", 6) == 0) {
+        const char page[] = "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: text/html; charset=utf-8\r\n"
+                            "Connection: close\r\n\r\n"
+                            "<!DOCTYPE html><meta name=viewport content='width=device-width'>"
+                            "<title>Lichtschranke</title><body style='font-family:sans-serif;text-align:center'>"
+                            "<h1 id=t>--</h1><p id=s></p><p id=x></p><script>"
+                            "var e=new EventSource('/events');"
+                            "e.addEventListener('result',function(m){var d=JSON.parse(m.data);"
+                            "t.textContent=(d.time_ms/1000).toFixed(3)+' s';x.textContent='Lauf '+d.run+"
+                            "(d.speed_cm_s?' - '+(d.speed_cm_s*0.036).toFixed(1)+' km/h':'');});"
+                            "e.addEventListener('state',function(m){s.textContent=JSON.parse(m.data).state;});"
+                            "e.addEventListener('stats',function(m){var d=JSON.parse(m.data);"
+                            "x.textContent='Min '+d.min.toFixed(3)+' / Avg '+d.avg.toFixed(3)+' / Max '+d.max.toFixed(3);});"
+                            "</script>";
+        send(sub.conn.fd(), page, sizeof(page) - 1, MSG_DONTWAIT);
+    } else {
+        const char notFound[] = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+        send(sub.conn.fd(), notFound, sizeof(notFound) - 1, MSG_DONTWAIT);
+    }
+    closeLiveSubscriber(sub);
+}
+
+// Sendet ausstehende Ereignisse, so viel wie der Socket gerade annimmt
+// false = Verbindung trennen (Fehler oder unvollständiges Ereignis überschrieben)
+bool pumpLiveSubscriber(LiveSubscriber &sub) {
+    if (sub.nextId < liveFeed.oldestId()) {
+        if (sub.offset > 0) {
+            liveDroppedSubscribers++;
+            return false; // Halb gesendetes Ereignis ist weg - Browser verbindet neu
+        }
+        // Drop-Oldest: zu langsamer Zuschauer überspringt verpasste Ereignisse
+        liveDroppedEvents += liveFeed.oldestId() - sub.nextId;
+        sub.nextId = liveFeed.oldestId();
+    }
+
+    while (sub.nextId < liveFeed.nextId) {
+        const LiveEvent &e = liveFeed.get(sub.nextId);
+        int sent = send(sub.conn.fd(), e.text + sub.offset, e.len - sub.offset, MSG_DONTWAIT);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK; // Sendepuffer voll: nächster Durchlauf
+        }
+        sub.offset += sent;
+        if (sub.offset < e.len) {
+            return true;
+        }
+        sub.offset = 0;
+        sub.nextId++;
+    }
+    return true;
+}
+
+void closeLiveSubscriber(LiveSubscriber &sub) {
+    if (sub.exportJob >= 0) {
+        exportJobs[sub.exportJob].file.close();
+        exportJobs[sub.exportJob].active = false;
+        sub.exportJob = -1;
+    }
+    sub.conn.stop();
+    sub.active = false;
+    sub.streaming = false;
+}
+
+// Zahlenwert eines Query-Parameters, z.B. "seq_from" aus "GET /export?seq_from=10 HTTP/1.1"
+unsigned long queryValue(const char *request, const char *key, unsigned long fallback) {
+    const char *query = strchr(request, '?');
+    const char *end = strchr(request + 4, ' ');
+    size_t keyLen = strlen(key);
+    for (const char *p = query; p && (!end || p < end); p = strchr(p + 1, '&')) {
+        if (strncmp(p + 1, key, keyLen) == 0 && p[1 + keyLen] == '=') {
+            return strtoul(p + 2 + keyLen, nullptr, 10);
+        }
+    }
+    return fallback;
+}
+
+// Belegt einen Download-Platz und legt den HTTP-Header in den Sendepuffer,
+// Teil-Sends laufen damit über denselben Weg wie die Daten
+void startExport(LiveSubscriber &sub, bool raw) {
+    int slot = -1;
+    for (int i = 0; i < MAX_EXPORTS; i++) {
+        if (!exportJobs[i].active) {
+            slot = i;
+            break;
+        }
+    }
+    measurementLog.flush();
+    File file = SPIFFS.open(LOG_FILE, FILE_READ);
+    if (slot < 0 || !file) {
+        const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 5\r\nConnection: close\r\n\r\n";
+        send(sub.conn.fd(), busy, sizeof(busy) - 1, MSG_DONTWAIT);
+        if (file) {
+            file.close();
+        }
+        closeLiveSubscriber(sub);
+        return;
+    }
+
+    ExportJob &job = exportJobs[slot];
+    job = ExportJob();
+    job.active = true;
+    job.file = file;
+    job.raw = raw;
+    job.startedAt = millis();
+    sub.exportJob = slot;
+
+    if (raw) {
+        size_t size = file.size();
+        long start = 0;
+        long last = (long)size - 1;
+        bool partial = sub.rangeStart >= 0 || sub.rangeSuffix >= 0;
+        char etag[LIVE_IF_RANGE_MAX];
+        measurementLog.etag(etag, sizeof(etag));
+        if (partial && sub.ifRange[0] != '\0' && strcmp(sub.ifRange, etag) != 0) {
+            // Datei hat sich seit dem ersten Teil geändert: ganz neu statt falsch zusammengesetzt
+            partial = false;
+        }
+        if (partial && sub.rangeSuffix >= 0) {
+            start = max(0L, (long)size - sub.rangeSuffix);
+        } else if (partial) {
+            start = sub.rangeStart;
+            if (sub.rangeEnd >= 0 && sub.rangeEnd < last) {
+                last = sub.rangeEnd;
+            }
+        }
+
+        if (partial && (start >= (long)size || start > last)) {
+            job.outLen = snprintf(job.out, EXPORT_CHUNK,
+                                  "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%u\r\n"
+                                  "ETag: %s\r\nConnection: close\r\n\r\n", (unsigned)size, etag);
+            job.eof = true;
+            return;
+        }
+
+        job.remaining = size > 0 ? last - start + 1 : 0;
+        file.seek(start);
+        if (partial) {
+            job.outLen = snprintf(job.out, EXPORT_CHUNK,
+                                  "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+                                  "Content-Range: bytes %ld-%ld/%u\r\n",
+                                  start, last, (unsigned)size);
+        } else {
+            job.outLen = snprintf(job.out, EXPORT_CHUNK,
+                                  "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n");
+        }
+        job.outLen += snprintf(job.out + job.outLen, EXPORT_CHUNK - job.outLen,
+                               "Content-Length: %u\r\nAccept-Ranges: bytes\r\nETag: %s\r\nConnection: close\r\n\r\n",
+                               (unsigned)job.remaining, etag);
+        job.eof = job.remaining == 0;
+        return;
+    }
+
+    // Gefilterter Export: Länge vorab unbekannt, das Verbindungsende markiert das Ende
+    // Fortsetzen über seq_from = letzte empfangene Sequenznummer + 1
+    job.json = strstr(sub.requestLine, "format=json") != nullptr;
+    job.seqFrom = queryValue(sub.requestLine, "seq_from", 0);
+    job.seqTo = queryValue(sub.requestLine, "seq_to", UINT32_MAX);
+    job.block = measurementLog.findBlock(job.seqFrom);
+    job.blocksSkipped = job.block;
+    job.outLen = snprintf(job.out, EXPORT_CHUNK,
+                          "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+                          "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n%s",
+                          job.json ? "application/json" : "text/csv",
+                          job.json ? "[" : "seq,t_ms,time_ms,status,reference_cm,bib,session,speed_cm_s,start_speed_cm_s,finish_speed_cm_s\n");
+}
+
+// Nächsten Sendeblock aus dem Flash füllen - höchstens EXPORT_CHUNK Bytes im RAM
+void fillExportChunk(ExportJob &job) {
+    job.outLen = 0;
+    job.outSent = 0;
+
+    if (job.raw) {
+        int n = job.file.read((uint8_t *)job.out, min(job.remaining, (size_t)EXPORT_CHUNK));
+        if (n <= 0) {
+            job.eof = true;
+            return;
+        }
+        job.outLen = n;
+        job.remaining -= n;
+        job.eof = job.remaining == 0;
+        return;
+    }
+
+    while (!job.eof && job.outLen < EXPORT_CHUNK - EXPORT_RECORD_MAX) {
+        LogEntry e;
+        if (job.haveBlock && job.reader.next(e)) {
+            appendExportRecord(job, e);
+            continue;
+        }
+        job.haveBlock = false;
+        if (job.block >= measurementLog.blockCount) {
+            job.eof = true;
+            break;
+        }
+
+        // Nächsten Block nur laden, wenn er laut Index in den Bereich fällt
+        const LogIndexEntry &entry = measurementLog.index[job.block];
+        int blockNo = job.block++;
+        if (entry.firstSeq > job.seqTo) {
+            job.eof = true; // Sequenznummern steigen, der Rest der Datei ist uninteressant
+            break;
+        }
+        if (entry.count == 0 || !measurementLog.readBlock(job.file, blockNo, job.current)) {
+            job.blocksSkipped++;
+            continue;
+        }
+        job.reader.start(job.current);
+        job.haveBlock = true;
+    }
+    if (job.eof && job.json) {
+        job.outLen += snprintf(job.out + job.outLen, EXPORT_CHUNK - job.outLen, "\n]\n");
+    }
+}
+
+// Einen Datensatz filtern und im Zielformat anhängen
+void appendExportRecord(ExportJob &job, const LogEntry &e) {
+    if (e.seq < job.seqFrom) {
+        return;
+    }
+    if (e.seq > job.seqTo) {
+        job.eof = true;
+        return;
+    }
+
+    int room = EXPORT_CHUNK - job.outLen;
+    const char *status = e.clientOk ? "OK" : "NO_CLIENT";
+    if (job.json) {
+        job.outLen += snprintf(job.out + job.outLen, room,
+                               "%s\n{\"seq\":%lu,\"t\":%lu,\"time_ms\":%lu,\"status\":\"%s\",\"ref\":%.2f,"
+                               "\"bib\":%u,\"session\":%u,\"speed_cm_s\":%lu,\"start_speed_cm_s\":%lu,"
+                               "\"finish_speed_cm_s\":%lu}",
+                               job.records > 0 ? "," : "", (unsigned long)e.seq, (unsigned long)e.t,
+                               (unsigned long)e.timeMs, status, e.reference, e.bib, e.session,
+                               (unsigned long)averageSpeedCmS(e.timeMs), (unsigned long)e.startSpeed,
+                               (unsigned long)e.finishSpeed);
+    } else {
+        job.outLen += snprintf(job.out + job.outLen, room, "%lu,%lu,%lu,%s,%.2f,%u,%u,%lu,%lu,%lu\n",
+                               (unsigned long)e.seq, (unsigned long)e.t, (unsigned long)e.timeMs,
+                               status, e.reference, e.bib, e.session,
+                               (unsigned long)averageSpeedCmS(e.timeMs), (unsigned long)e.startSpeed,
+                               (unsigned long)e.finishSpeed);
+    }
+    job.records++;
+}
+
+// Sendet den Puffer nicht-blockierend und füllt ihn erst nach, wenn er ganz raus ist
+// false = Download beendet oder Verbindungsfehler
+bool pumpExport(LiveSubscriber &sub) {
+    ExportJob &job = exportJobs[sub.exportJob];
+    for (int chunk = 0; chunk < EXPORT_CHUNKS_PER_LOOP; chunk++) {
+        if (job.outSent >= job.outLen) {
+            if (job.eof) {
+                unsigned long duration = max(1UL, millis() - job.startedAt);
+                Serial.print("ESP1: Export fertig - ");
+                if (!job.raw) {
+                    Serial.print(job.records);
+                    Serial.print(" Datensätze, ");
+                    Serial.print(job.blocksSkipped);
+                    Serial.print(" Blöcke übersprungen, ");
+                }
+                Serial.print(job.bytesSent);
+                Serial.print(" Bytes in ");
+                Serial.print(duration);
+                Serial.print("ms (");
+                Serial.print(job.bytesSent / duration);
+                Serial.print(" kB/s), Heap min ");
+                Serial.println(ESP.getMinFreeHeap());
+                return false;
+            }
+            fillExportChunk(job);
+            if (job.outLen == 0) {
+                continue;
+            }
+        }
+
+        int sent = send(sub.conn.fd(), job.out + job.outSent, job.outLen - job.outSent, MSG_DONTWAIT);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        job.outSent += sent;
+        job.bytesSent += sent;
+        if (job.outSent < job.outLen) {
+            return true; // Sendepuffer voll, Rest im nächsten Durchlauf
+        }
+    }
+    return true;
+}
+
+// Ergebnisspeicher beim Start einmalig aus dem Messprotokoll aufbauen
+// Übernommene CSV-Zeilen ohne Startnummer/Session zählen als Startnummer 0, Session 0
+void loadResultsFromLog() {
+    File file = SPIFFS.open(LOG_FILE, FILE_READ);
+    if (file) {
+        LogBlock block;
+        LogBlockReader reader;
+        LogEntry e;
+        for (int b = 0; b < measurementLog.blockCount; b++) {
+            if (measurementLog.index[b].count == 0 || !measurementLog.readBlock(file, b, block)) {
+                continue;
+            }
+            reader.start(block);
+            while (reader.next(e)) {
+                resultsStore.add(e.timeMs, e.bib, e.session, e.seq);
+            }
+        }
+        file.close();
+    }
+    // Neue Läufe nummerieren hinter dem Protokoll weiter, auch wenn der letzte Block beschädigt ist
+    resultsStore.lastSeq = max(resultsStore.lastSeq, measurementLog.records());
+    Serial.print("ESP1: ");
+    Serial.print(resultsStore.lastSeq);
+    Serial.println(" Läufe aus dem Protokoll geladen");
+}
+
+String leaderboardJSON(const Leaderboard &board) {
+    LeaderEntry ranked[LEADERBOARD_SIZE];
+    int count = board.sorted(ranked);
+    String json = "[";
+    for (int i = 0; i < count; i++) {
+        json += String(i > 0 ? "," : "") + "{\"rank\":" + (i + 1) +
+                ",\"seq\":" + ranked[i].seq +
+                ",\"bib\":" + ranked[i].bib +
+                ",\"time_ms\":" + ranked[i].timeMs + "}";
+    }
+    return json + "]";
+}
+
+// Kleine Antworten (< 1KB) passen in den TCP-Sendepuffer und gehen in einem Send raus
+void sendJSONResponse(LiveSubscriber &sub, const String &body) {
+    String response = String("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                             "Access-Control-Allow-Origin: *\r\nConnection: close\r\n"
+                             "Content-Length: ") + body.length() + "\r\n\r\n" + body;
+    send(sub.conn.fd(), response.c_str(), response.length(), MSG_DONTWAIT);
+    closeLiveSubscriber(sub);
+}
+
+// /leaderboard?session=<nr> - ohne session die Gesamtbestenliste
+void sendLeaderboard(LiveSubscriber &sub) {
+    if (!strstr(sub.requestLine, "session=")) {
+        sendJSONResponse(sub, String("{\"session\":null,\"runs\":") + resultsStore.lastSeq +
+                              ",\"top\":" + leaderboardJSON(resultsStore.overall) + "}");
+        return;
+    }
+    uint16_t id = queryValue(sub.requestLine, "session", 0);
+    SessionIndex *session = resultsStore.findSession(id, false);
+    if (!session) {
+        sendJSONResponse(sub, String("{\"session\":") + id + ",\"runs\":0,\"top\":[]}");
+        return;
+    }
+    sendJSONResponse(sub, String("{\"session\":") + id + ",\"runs\":" + session->runs +
+                          ",\"top\":" + leaderboardJSON(session->board) + "}");
+}
+
+// /athlete?bib=<nr> - Bestzeit und die letzten Läufe entlang der Startnummern-Kette
+void sendAthleteRuns(LiveSubscriber &sub) {
+    uint16_t bib = queryValue(sub.requestLine, "bib", 0);
+    AthleteIndex *athlete = resultsStore.findAthlete(bib, false);
+    if (!athlete) {
+        sendJSONResponse(sub, String("{\"bib\":") + bib + ",\"runs\":0,\"recent\":[]}");
+        return;
+    }
+    String json = String("{\"bib\":") + bib + ",\"runs\":" + athlete->runs +
+                  ",\"best_ms\":" + athlete->bestMs + ",\"best_seq\":" + athlete->bestSeq +
+                  ",\"recent\":[";
+    const RunRecord *run = resultsStore.get(athlete->headSeq);
+    for (int i = 0; run && i < RECENT_RUNS_REPORTED; i++) {
+        json += String(i > 0 ? "," : "") + "{\"seq\":" + run->seq +
+                ",\"session\":" + run->session + ",\"time_ms\":" + run->timeMs + "}";
+        run = resultsStore.get(run->prevAthleteSeq);
+    }
+    sendJSONResponse(sub, json + "]}");
+}
+
+// Speichert einen Lauf: Statistik, Ergebnisspeicher, Protokoll und Live-Anzeige
+// bib = 0 für Läufe ohne Zuordnung, z.B. nachgereichte Ergebnisse einer früheren Messung
+const RunRecord &recordRun(unsigned long measuredTime, uint16_t bib, uint16_t session,
+                           uint32_t startSpeed, uint32_t finishSpeed) {
+    stats.addMeasurement(measuredTime / 1000.0);
+    RunSpeeds speeds;
+    speeds.average = averageSpeedCmS(measuredTime);
+    speeds.start = startSpeed;
+    speeds.finish = finishSpeed;
+    stats.addSpeed(speeds.average);
+
+    const RunRecord &run = resultsStore.add(measuredTime, bib, session);
+    Serial.print("ESP1: Lauf #");
+    Serial.print(run.seq);
+    Serial.print(" Startnummer ");
+    Serial.print(run.bib);
+    Serial.print(", Session ");
+    Serial.println(run.session);
+    if (speedTrapEnabled()) {
+        Serial.print("ESP1: Geschwindigkeit ");
+        Serial.print(formatSpeed(speeds.average));
+        Serial.print(" (Start ");
+        Serial.print(formatSpeed(speeds.start));
+        Serial.print(", Ziel ");
+        Serial.print(formatSpeed(speeds.finish));
+        Serial.println(")");
+    }
+
+    // Persistente Speicherung für spätere Analyse
+    logMeasurement(run, speeds);
+    publishLiveResult(run, speeds);
+    return run;
+}
+
+// Protokoll: "RESULT_ACK:<seq>" bestätigt alle Client-Ergebnisse bis einschließlich seq
+void acknowledgeClientResult(uint32_t seq) {
+    if (seq != lastClientResultSeq) {
+        lastClientResultSeq = seq;
+        preferences.putUInt("clientSeq", lastClientResultSeq);
+    }
+    client.print("RESULT_ACK:");
+    client.println(seq);
+}
+
+// Nachgereichte Ergebnisse aus der Warteschlange des Clients: "RESULTS:<seq>:<ms>,<seq>:<ms>,..."
+// Die Zustandsmaschine bleibt unberührt, die Läufe sind bereits vorbei. Die Startnummer des
+// nächsten Laufs gehört nicht zu ihnen, sie werden ohne Zuordnung gespeichert
+void handleResultBatch(const String &message) {
+    const char *p = message.c_str() + 8;
+    uint32_t highest = lastClientResultSeq;
+    int accepted = 0;
+    while (*p) {
+        char *end;
+        uint32_t seq = strtoul(p, &end, 10);
+        if (*end != ':') {
+            break;
+        }
+        unsigned long measuredTime = strtoul(end + 1, &end, 10);
+        if (seq > highest) {
+            recordRun(measuredTime, 0, currentSession);
+            highest = seq;
+            accepted++;
+        }
+        if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+
+    Serial.print("ESP1: Nachgereichte Ergebnisse: ");
+    Serial.print(accepted);
+    Serial.println(" neu");
+    acknowledgeClientResult(highest);
+}
+
+// Speicher-Messpunkt einmal pro Minute, Warnung nur beim Überschreiten der Schwelle
+void sampleMemory() {
+    if (memoryTelemetry.count > 0 && millis() - lastMemorySample < MEMORY_SAMPLE_INTERVAL_MS) {
+        return;
+    }
+    lastMemorySample = millis();
+    if (memoryTelemetry.record(readMemorySample(lastMemorySample))) {
+        Serial.print("ESP1: WARNUNG Speicher - ");
+        Serial.println(memoryTelemetry.toJSON());
+    }
+}
+
+// Protokoll: "MEM:<frei>,<minimum>,<größter Block>,<Stack-Reserve>" vom Client, einmal pro Minute
+void handleClientMemory(const String &message) {
+    MemorySample sample;
+    char *p;
+    sample.atMs = millis();
+    sample.freeHeap = strtoul(message.c_str() + 4, &p, 10);
+    if (*p != ',') {
+        return;
+    }
+    sample.minFreeHeap = strtoul(p + 1, &p, 10);
+    if (*p != ',') {
+        return;
+    }
+    sample.largestBlock = strtoul(p + 1, &p, 10);
+    if (*p != ',') {
+        return;
+    }
+    sample.stackFree = strtoul(p + 1, nullptr, 10);
+    if (clientMemoryTelemetry.record(sample)) {
+        Serial.print("ESP1: WARNUNG Speicher Client - ");
+        Serial.println(clientMemoryTelemetry.toJSON());
+    }
+}
+
+// Schaltereignisse des Sequenzers abholen: Zeitstempel loggen und Zustand nachführen
+void handleLightEvents()
+{
+    LightEvent e;
+    while (lightSequencer.take(e))
+    {
+        static const char *names[] = {"Dunkel", "Gelb AN", "Rot AN - Warte auf Objektverlassen", "Alle AN"};
+        static const int patterns[] = {0, 2, 4, 7};
+        int64_t lateUs = e.actualUs - e.plannedUs;
+        lightSequencer.maxLateUs = max(lightSequencer.maxLateUs, lateUs);
+        lastLightPattern = patterns[e.step];
+        Serial.print("ESP1: ");
+        Serial.print(names[e.step]);
+        Serial.print(" bei t=");
+        Serial.print((unsigned long)(e.actualUs / 1000));
+        Serial.print("ms (");
+        Serial.print((long)lateUs);
+        Serial.println("us nach Soll)");
+
+        if (e.step == LIGHT_YELLOW)
+        {
+            yellowLightOnTime = (unsigned long)(e.actualUs / 1000);
+            machine.dispatch(EV_YELLOW_ON);
+        }
+        else if (e.step == LIGHT_RED)
+        {
+            machine.dispatch(EV_RED_ON);
+        }
+    }
+    if (lightSequencer.lostEvents > 0)
+    {
+        Serial.print("ESP1: WARNUNG - ");
+        Serial.print(lightSequencer.lostEvents);
+        Serial.println(" Ampel-Ereignisse nicht abgeholt");
+        lightSequencer.lostEvents = 0;
+    }
+}
+
+// Sparbetrieb betreten, sobald IDLE_GREEN lange genug ohne Aktivität war, jeder andere Zustand weckt
+void updatePowerMode()
+{
+    if (currentState != IDLE_GREEN)
+    {
+        wakeFromIdle(stateName(currentState));
+    }
+    else if (telemetry.enabled)
+    {
+        wakeFromIdle("Telemetrie"); // Empfänger soll die volle Abtastrate sehen
+    }
+    else if (exportRunning())
+    {
+        wakeFromIdle("Export"); // Im Sparbetrieb käme nur ein Sendepuffer pro Beacon raus
+    }
+    else if (idleScheduler.update(millis(), true))
+    {
+        powerControl.enterSaving();
+        Serial.print("ESP1: Sparbetrieb (");
+        Serial.print(powerControl.mode());
+        Serial.print(") - Anwesenheits-Ping alle ");
+        Serial.print(IDLE_PING_INTERVAL_MS);
+        Serial.println("ms");
+    }
+    reportPower();
+}
+
+void wakeFromIdle(const char *reason)
+{
+    if (!idleScheduler.wake(millis(), micros()))
+    {
+        return;
+    }
+    powerControl.leaveSaving();
+    lastSampleTime = millis() - LOOP_DELAY_MS; // Nächste Abtastung sofort mit voller Rate
+    Serial.print("ESP1: Sparbetrieb beendet - ");
+    Serial.println(reason);
+}
+
+// Wachanteil und Aufwachlatenz einmal pro Minute, nur wenn es einen Sparbetrieb gab
+void reportPower()
+{
+    if (millis() - lastPowerReport < POWER_REPORT_INTERVAL_MS)
+    {
+        return;
+    }
+    lastPowerReport = millis();
+    if (idleScheduler.saving || idleScheduler.wakeUps > 0)
+    {
+        Serial.print("ESP1: Energie - ");
+        Serial.print(powerControl.mode());
+        Serial.print(", ");
+        Serial.println(idleScheduler.summary());
+    }
+}
+
+// Ein Empfänger auf TELEMETRY_PORT, ein neuer ersetzt den alten
+// Senden nur mit MSG_DONTWAIT - was der Socket nicht nimmt, bleibt in der Warteschlange,
+// läuft sie über, dünnt der Stream aus (die Abtastung selbst wartet nie)
+void serviceTelemetry()
+{
+    WiFiClient incoming = telemetryServer.available();
+    if (incoming)
+    {
+        telemetryClient.stop();
+        telemetryClient = incoming;
+        telemetryClient.setNoDelay(true);
+        telemetry.reset();
+        telemetry.enabled = true;
+        Serial.println("ESP1: Telemetrie-Empfänger verbunden");
+    }
+    if (!telemetry.enabled)
+    {
+        return;
+    }
+    if (!telemetryClient.connected())
+    {
+        telemetryClient.stop();
+        telemetry.enabled = false;
+        Serial.print("ESP1: Telemetrie-Empfänger getrennt - ");
+        Serial.println(telemetry.summary());
+        return;
+    }
+
+    telemetry.flushIfDue(micros());
+    const uint8_t *data;
+    int len;
+    while (telemetry.pending(data, len))
+    {
+        int sent = send(telemetryClient.fd(), data, len, MSG_DONTWAIT);
+        if (sent <= 0)
+        {
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                telemetryClient.stop(); // Wird im nächsten Durchlauf als getrennt erkannt
+            }
+            return;
+        }
+        telemetry.consumed(sent);
+    }
+}
@@ -0,0 +1,194 @@
+// Lichtschranke-Detektor - Erkennt Eintritt und Austritt eines Objekts aus der Distanz-Messreihe
+// Gemeinsam für Server und Client, die Implementierung ist austauschbar (CUSUM_DETECTOR)
+
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+// Schnittstelle: ein Messwert pro Abtastung, der Detektor entscheidet belegt/frei
+struct CrossingDetector
+{
+    virtual ~CrossingDetector() {}
+
+    // Referenz = freie Strecke, Rauschen = Standardabweichung der Kalibriermessungen
+    virtual void configure(float referenceCm, float noiseSigmaCm) = 0;
+
+    virtual void reset(bool occupied) = 0;
+
+    // Ungültige Messwerte (<= 0) werden übergangen
+    // true, wenn der Messwert den Zustand belegt/frei gewechselt hat
+    virtual bool update(float distanceCm, unsigned long nowMs) = 0;
+
+    virtual bool occupied() const = 0;
+
+    // Geschätzter Zeitpunkt des letzten Wechsels (bei CUSUM: Beginn der Änderung, nicht die Bestätigung)
+    virtual unsigned long changeTime() const = 0;
+
+    // Messwerte bis zur Bestätigung des letzten Wechsels
+    virtual int confirmSamples() const = 0;
+};
+
+// Bisheriges Verfahren: fester Schwellwert bei Referenz/2, beim Verlassen mit Hysterese
+struct ThresholdDetector : CrossingDetector
+{
+    float hysteresis;
+    float thresholdCm = -1.0f;
+    bool isOccupied = false;
+    unsigned long lastChange = 0;
+
+    explicit ThresholdDetector(float hysteresisFactor) : hysteresis(hysteresisFactor) {}
+
+    void configure(float referenceCm, float /* noiseSigmaCm */) override
+    {
+        thresholdCm = referenceCm / 2.0f;
+    }
+
+    void reset(bool occupied) override { isOccupied = occupied; }
+
+    bool update(float distanceCm, unsigned long nowMs) override
+    {
+        if (distanceCm <= 0)
+        {
+            return false;
+        }
+        bool next = isOccupied ? distanceCm <= thresholdCm * hysteresis : distanceCm <= thresholdCm;
+        if (next == isOccupied)
+        {
+            return false;
+        }
+        isOccupied = next;
+        lastChange = nowMs;
+        return true;
+    }
+
+    bool occupied() const override { return isOccupied; }
+    unsigned long changeTime() const override { return lastChange; }
+    int confirmSamples() const override { return 1; }
+};
+
+// Sequentieller Änderungstest (CUSUM) auf dem Log-Likelihood-Verhältnis zweier Normalverteilungen
+// Frei: Mittelwert = Referenz; belegt: Mittelwert = Referenz/2 beim Eintritt, beim Austritt der
+// beobachtete Objektabstand. Die Summe S wächst nur, solange die Messwerte eher zur anderen
+// Hypothese passen - bei geringem Rauschen reicht dafür ein Bruchteil der Samples.
+// Beim Eintritt liegt die Grenze wie beim Schwellwert-Detektor bei Referenz/2 (die Mitte zwischen
+// den Hypothesen wären 75% der Referenz), nur das Gewicht der Samples kommt aus dem Rauschen.
+// Schwelle h = ln(1/alpha): im Mittel höchstens ein Fehlalarm pro 1/alpha Messwerte.
+struct CusumDetector : CrossingDetector
+{
+    float falseAlarmRate;
+    int minSamples;                      // Untergrenze gegen einzelne Fehl-Echos
+    float minSigma;
+    float referenceCm = -1.0f;
+    float sigma = 1.0f;
+    float h = 0;
+    float sum = 0;
+    float occupiedMean = 0;              // Beobachteter Objektabstand, Basis für den Austrittstest
+    bool isOccupied = false;
+    int run = 0;                         // Messwerte seit S zuletzt 0 war
+    int lastConfirm = 0;
+    unsigned long runStart = 0;
+    unsigned long lastChange = 0;
+
+    static constexpr float OCCUPIED_MEAN_ALPHA = 0.2f;
+    static constexpr float MAX_OCCUPIED_FRACTION = 0.75f;  // Mindestabstand der Hypothesen zur Referenz
+
+    CusumDetector(float alpha, int confirmMin, float sigmaFloorCm)
+        : falseAlarmRate(alpha), minSamples(confirmMin), minSigma(sigmaFloorCm) {}
+
+    void configure(float reference, float noiseSigmaCm) override
+    {
+        referenceCm = reference;
+        sigma = max(noiseSigmaCm, minSigma);
+        h = logf(1.0f / falseAlarmRate);
+        reset(false);
+    }
+
+    void reset(bool occupied) override
+    {
+        isOccupied = occupied;
+        sum = 0;
+        run = 0;
+        occupiedMean = referenceCm / 2.0f;
+    }
+
+    bool update(float x, unsigned long nowMs) override
+    {
+        if (x <= 0)
+        {
+            return false;
+        }
+
+        // Aktuelle Hypothese gegen die des Zustandswechsels
+        float current = isOccupied ? occupiedMean : referenceCm;
+        float target = isOccupied ? referenceCm : referenceCm / 2.0f;
+        float boundary = isOccupied ? (current + target) / 2.0f : target;
+        float llr = (target - current) / (sigma * sigma) * (x - boundary);
+        llr = min(llr, h / minSamples); // Ein Ausreißer allein kann nie auslösen
+
+        if (sum == 0 && llr > 0)
+        {
+            runStart = nowMs; // Schätzung des Änderungszeitpunkts
+        }
+        sum = max(0.0f, sum + llr);
+        run = sum > 0 ? run + 1 : 0;
+
+        if (sum < h)
+        {
+            if (isOccupied && sum == 0)
+            {
+                // Objektabstand nur aus eindeutig belegten Messwerten nachführen
+                occupiedMean += OCCUPIED_MEAN_ALPHA * (x - occupiedMean);
+                occupiedMean = min(occupiedMean, referenceCm * MAX_OCCUPIED_FRACTION);
+            }
+            return false;
+        }
+
+        isOccupied = !isOccupied;
+        lastChange = runStart;
+        lastConfirm = run;
+        sum = 0;
+        run = 0;
+        if (isOccupied)
+        {
+            occupiedMean = min(x, referenceCm * MAX_OCCUPIED_FRACTION);
+        }
+        return true;
+    }
+
+    bool occupied() const override { return isOccupied; }
+    unsigned long changeTime() const override { return lastChange; }
+    int confirmSamples() const override { return lastConfirm; }
+};
+
+// Rauschen aus den Kalibriermessungen: 1,4826 * Median der Abweichungen vom Median
+// Ein Objekt, das während der Kalibrierung durch die Schranke geht, bläht die Standardabweichung
+// auf ein Vielfaches auf (und der Detektor bestätigt dann nichts mehr), den Median kaum.
+// Sortiert samples dabei um.
+inline float robustNoiseSigma(float *samples, int count)
+{
+    if (count <= 0)
+    {
+        return 0.0f;
+    }
+    auto median = [](float *v, int n) {
+        for (int i = 1; i < n; i++)
+        {
+            float value = v[i];
+            int j = i - 1;
+            while (j >= 0 && v[j] > value)
+            {
+                v[j + 1] = v[j];
+                j--;
+            }
+            v[j + 1] = value;
+        }
+        return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0f;
+    };
+    float center = median(samples, count);
+    for (int i = 0; i < count; i++)
+    {
+        samples[i] = fabsf(samples[i] - center);
+    }
+    return 1.4826f * median(samples, count);
+}
@@ -0,0 +1,225 @@
+// Lichtschranke-Energie - Sparbetrieb zwischen den Messungen für akkubetriebene Schranken
+// Gemeinsam für Server und Client: Nach IDLE_ENTER_AFTER_MS ohne Aktivität wird nur noch alle
+// IDLE_PING_INTERVAL_MS gemessen, dazwischen schläft der Loop in kurzen Scheiben. Eine erkannte
+// Annäherung oder ein empfangener Befehl schaltet sofort auf volle Abtastrate zurück.
+// Der IdleScheduler hängt nur an Zeitstempeln und läuft damit auch auf dem PC,
+// PowerControl ist die einzige ESP32-spezifische Stelle (Takt, Light-Sleep, Modem-Sleep).
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_pm.h>
+
+const unsigned long IDLE_ENTER_AFTER_MS = 30000;    // So lange ohne Aktivität bis zum Sparbetrieb
+const unsigned long IDLE_PING_INTERVAL_MS = 200;    // Anwesenheits-Ping im Sparbetrieb
+const unsigned long IDLE_SLEEP_SLICE_MS = 50;       // Längster Schlaf am Stück - begrenzt Befehlslatenz und Heartbeat-Jitter
+const unsigned long POWER_REPORT_INTERVAL_MS = 60000;
+
+struct IdleScheduler
+{
+    unsigned long activeIntervalMs;      // Abtastraster bei voller Rate
+    unsigned long idleIntervalMs;        // Abtastraster im Sparbetrieb
+    unsigned long lastActivityMs = 0;
+    bool saving = false;
+
+    // Auswertung, nur über Zeiten im Sparbetrieb
+    uint64_t awakeUs = 0;                // Loop lief
+    uint64_t asleepUs = 0;               // In sleep() verbracht
+    unsigned long wakeUps = 0;
+    unsigned long wakeAtUs = 0;          // Auslöser des letzten Aufwachens
+    bool wakePending = false;            // Erste Abtastung mit voller Rate steht noch aus
+    unsigned long maxWakeLatencyUs = 0;  // Auslöser bis erste Abtastung mit voller Rate
+    unsigned long maxPingLateUs = 0;     // Geplanter gegenüber tatsächlichem Ping im Sparbetrieb
+    unsigned long maxPingUs = 0;         // Dauer eines Anwesenheits-Pings (Echo-Wartezeit)
+
+    IdleScheduler(unsigned long activeMs, unsigned long idleMs) : activeIntervalMs(activeMs), idleIntervalMs(idleMs) {}
+
+    // Jeder Loop-Durchlauf: idle = Anwendung wartet (Grün bzw. bereit für Start)
+    // true beim Eintritt in den Sparbetrieb, der Aufrufer schaltet dann Takt und Funk herunter
+    bool update(unsigned long nowMs, bool idle)
+    {
+        if (!idle)
+        {
+            lastActivityMs = nowMs;
+            return false;
+        }
+        if (saving || nowMs - lastActivityMs < IDLE_ENTER_AFTER_MS)
+        {
+            return false;
+        }
+        saving = true;
+        return true;
+    }
+
+    // Annäherung, Befehl oder Zustandswechsel - true, wenn der Sparbetrieb verlassen wurde
+    bool wake(unsigned long nowMs, unsigned long nowUs)
+    {
+        lastActivityMs = nowMs;
+        if (!saving)
+        {
+            return false;
+        }
+        saving = false;
+        wakeUps++;
+        wakeAtUs = nowUs;
+        wakePending = true;
+        return true;
+    }
+
+    unsigned long sampleIntervalMs() const { return saving ? idleIntervalMs : activeIntervalMs; }
+
+    // Abtastung fällig? lastSampleMs ist die letzte Abtastung, ein verspäteter Ping wird mitgezählt
+    bool sampleDue(unsigned long nowMs, unsigned long lastSampleMs)
+    {
+        unsigned long interval = sampleIntervalMs();
+        if (nowMs - lastSampleMs < interval)
+        {
+            return false;
+        }
+        if (saving)
+        {
+            unsigned long lateUs = (nowMs - lastSampleMs - interval) * 1000UL;
+            maxPingLateUs = max(maxPingLateUs, lateUs);
+        }
+        return true;
+    }
+
+    // Direkt nach jeder Abtastung: misst die Aufwachlatenz bis zur ersten Abtastung mit voller Rate
+    void sampled(unsigned long nowUs)
+    {
+        if (wakePending && !saving)
+        {
+            wakePending = false;
+            maxWakeLatencyUs = max(maxWakeLatencyUs, nowUs - wakeAtUs);
+        }
+    }
+
+    // Nach einem Ping im Sparbetrieb: erst an seinem Ende ist eine Annäherung erkannt
+    void pinged(unsigned long tookUs)
+    {
+        maxPingUs = max(maxPingUs, tookUs);
+    }
+
+    // Wie lange der Loop jetzt schlafen darf (0 = gar nicht), nie über den nächsten Ping hinaus
+    unsigned long sleepBudgetMs(unsigned long nowMs, unsigned long lastSampleMs) const
+    {
+        if (!saving)
+        {
+            return 0;
+        }
+        unsigned long elapsed = nowMs - lastSampleMs;
+        if (elapsed >= idleIntervalMs)
+        {
+            return 0;
+        }
+        return min(idleIntervalMs - elapsed, IDLE_SLEEP_SLICE_MS);
+    }
+
+    // Ein Loop-Durchlauf im Sparbetrieb: so lange lief er, so lange hat er danach geschlafen
+    void account(unsigned long awakeForUs, unsigned long sleptUs)
+    {
+        awakeUs += awakeForUs;
+        asleepUs += sleptUs;
+    }
+
+    // Anteil der wachen Zeit im Sparbetrieb in Promille
+    int dutyCyclePermille() const
+    {
+        uint64_t total = awakeUs + asleepUs;
+        return total == 0 ? 1000 : (int)(awakeUs * 1000 / total);
+    }
+
+    String summary() const
+    {
+        return String("Sparbetrieb=") + (saving ? "AN" : "AUS") +
+               ", Wach=" + String(dutyCyclePermille() / 10.0f, 1) + "%" +
+               ", Aufwachen=" + wakeUps +
+               ", Latenz max=" + maxWakeLatencyUs + "us" +
+               ", Ping spät max=" + maxPingLateUs + "us" +
+               ", Grenze=" + wakeBoundMs() + "ms";
+    }
+
+    // Garantierte Obergrenze vom Auslöser bis zur vollen Abtastrate: das Objekt (der Befehl) kommt
+    // direkt nach einem Ping an, wird erst am Ende des nächsten (evtl. verspäteten) erkannt, dann
+    // höchstens ein Raster bis zur ersten vollen Abtastung
+    unsigned long wakeBoundMs() const
+    {
+        return idleIntervalMs + (maxPingLateUs + maxPingUs + 999) / 1000 + activeIntervalMs;
+    }
+};
+
+// Takt, automatischer Light-Sleep und Modem-Sleep auf dem ESP32
+// Mit Power-Management (Tickless-Idle im Arduino-Core) schläft jeder delay() im Sparbetrieb als
+// Light-Sleep, sonst nur dynamische Taktabsenkung bzw. fester 80MHz-Takt
+struct PowerControl
+{
+    bool modemSleep;                     // Nur als Station - der Access Point muss durchgehend senden
+    bool autoLightSleep = false;
+    bool managed = false;                // esp_pm aktiv, Takt über Locks
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t fullSpeed = nullptr;
+    esp_pm_lock_handle_t noSleep = nullptr;
+#endif
+
+    explicit PowerControl(bool station) : modemSleep(station) {}
+
+    // Nach WiFi.mode(), startet mit voller Leistung
+    void begin()
+    {
+#if CONFIG_PM_ENABLE
+        esp_pm_config_esp32_t config = {240, 80, true};
+        autoLightSleep = esp_pm_configure(&config) == ESP_OK;
+        if (!autoLightSleep)
+        {
+            config.light_sleep_enable = false;
+        }
+        managed = autoLightSleep || esp_pm_configure(&config) == ESP_OK;
+        if (managed)
+        {
+            esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "volle_rate", &fullSpeed);
+            esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "volle_rate", &noSleep);
+        }
+#endif
+        leaveSaving();
+    }
+
+    void enterSaving()
+    {
+        if (modemSleep)
+        {
+            WiFi.setSleep(WIFI_PS_MIN_MODEM); // Aufwachen zu jedem DTIM-Beacon, Verbindung bleibt bestehen
+        }
+#if CONFIG_PM_ENABLE
+        if (managed)
+        {
+            esp_pm_lock_release(noSleep);
+            esp_pm_lock_release(fullSpeed);
+            return;
+        }
+#endif
+        setCpuFrequencyMhz(80); // Tiefster Takt, bei dem das WLAN noch läuft
+    }
+
+    void leaveSaving()
+    {
+        if (modemSleep)
+        {
+            WiFi.setSleep(WIFI_PS_NONE); // START_TIMER ohne Beacon-Wartezeit empfangen
+        }
+#if CONFIG_PM_ENABLE
+        if (managed)
+        {
+            esp_pm_lock_acquire(fullSpeed);
+            esp_pm_lock_acquire(noSleep);
+            return;
+        }
+#endif
+        setCpuFrequencyMhz(240);
+    }
+
+    const char *mode() const
+    {
+        return autoLightSleep ? "Light-Sleep" : (managed ? "DFS" : "80MHz");
+    }
+};
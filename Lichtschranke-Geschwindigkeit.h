@@ -0,0 +1,123 @@
+// Lichtschranke-Geschwindigkeit - Geschwindigkeitsmessung (Speed-Trap)
+// Gemeinsam für Server und Client: Durchschnitt aus Schrankenabstand und Laufzeit, dazu die
+// Momentangeschwindigkeit an jeder Schranke als Steigung einer Regressionsgeraden über die
+// letzten Abstandswerte des Sensors. Alles in ganzen cm/s, 0 = unbekannt.
+// Die Momentangeschwindigkeit setzt einen Sensor voraus, der entlang der Bahn misst - quer zur
+// Bahn sieht er nur einen Sprung, die Schätzung bleibt dann 0.
+
+#pragma once
+
+#include <Arduino.h>
+
+// Abstand der beiden Schranken, in beiden Sketches gleich setzen (-DSPEED_TRAP_DISTANCE_CM=1000)
+#ifndef SPEED_TRAP_DISTANCE_CM
+#define SPEED_TRAP_DISTANCE_CM 0                // 0 = keine Geschwindigkeitsmessung
+#endif
+
+const int SPEED_WINDOW_SAMPLES = 8;             // Regressionsfenster (bei 50Hz 160ms)
+const int SPEED_MIN_SAMPLES = 4;
+const unsigned long SPEED_WINDOW_MAX_AGE_MS = 300; // Ältere Werte gehören nicht mehr zur Bewegung
+const float SPEED_MIN_CM_S = 5.0f;              // Darunter ist die Steigung Messrauschen
+const float SPEED_MAX_RESIDUAL_CM = 10.0f;       // Streuung um die Gerade, darüber keine gleichförmige Bewegung
+
+inline bool speedTrapEnabled() { return SPEED_TRAP_DISTANCE_CM > 0; }
+
+// Durchschnittsgeschwindigkeit zwischen den Schranken
+inline uint32_t averageSpeedCmS(unsigned long timeMs)
+{
+    if (!speedTrapEnabled() || timeMs == 0)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)SPEED_TRAP_DISTANCE_CM * 1000 + timeMs / 2) / timeMs);
+}
+
+// "3.45m/s 12.4km/h" - passt in eine LCD-Zeile
+inline String formatSpeed(uint32_t cmPerS)
+{
+    if (cmPerS == 0)
+    {
+        return "-";
+    }
+    return String(cmPerS / 100.0f, 2) + "m/s " + String(cmPerS * 0.036f, 1) + "km/h";
+}
+
+// Feste Anzahl (Zeit, Abstand)-Paare im Ring, Auswertung nur bei Bedarf (einmal pro Lauf)
+struct SpeedWindow
+{
+    unsigned long t[SPEED_WINDOW_SAMPLES];
+    float d[SPEED_WINDOW_SAMPLES];
+    int count = 0;
+    int next = 0;
+
+    void reset()
+    {
+        count = 0;
+        next = 0;
+    }
+
+    // Nur gültige Abstände eintragen
+    void push(unsigned long nowMs, float distanceCm)
+    {
+        t[next] = nowMs;
+        d[next] = distanceCm;
+        next = (next + 1) % SPEED_WINDOW_SAMPLES;
+        if (count < SPEED_WINDOW_SAMPLES)
+        {
+            count++;
+        }
+    }
+
+    // Steigung der Ausgleichsgeraden in cm/s (negativ = Objekt nähert sich dem Sensor)
+    // Zeiten relativ zum jüngsten Wert, damit float bei großen millis() genau bleibt. Liegen die Werte
+    // nicht auf einer Geraden (Sprung beim Eintritt in einen Strahl quer zur Bahn), gibt es keine Steigung
+    bool slope(unsigned long nowMs, float &cmPerS) const
+    {
+        float sx = 0, sd = 0, sxx = 0, sxd = 0;
+        int n = 0;
+        for (int i = 0; i < count; i++)
+        {
+            unsigned long age = nowMs - t[i];
+            if (age > SPEED_WINDOW_MAX_AGE_MS)
+            {
+                continue;
+            }
+            float x = -(float)age / 1000.0f;
+            sx += x;
+            sd += d[i];
+            sxx += x * x;
+            sxd += x * d[i];
+            n++;
+        }
+        float denom = n * sxx - sx * sx;
+        if (n < SPEED_MIN_SAMPLES || denom <= 0)
+        {
+            return false;
+        }
+        cmPerS = (n * sxd - sx * sd) / denom;
+
+        float offset = (sd - cmPerS * sx) / n;
+        float squares = 0;
+        for (int i = 0; i < count; i++)
+        {
+            unsigned long age = nowMs - t[i];
+            if (age <= SPEED_WINDOW_MAX_AGE_MS)
+            {
+                float r = d[i] - offset + cmPerS * (float)age / 1000.0f;
+                squares += r * r;
+            }
+        }
+        return squares <= n * SPEED_MAX_RESIDUAL_CM * SPEED_MAX_RESIDUAL_CM;
+    }
+
+    // Betrag der Momentangeschwindigkeit, 0 = zu wenige Werte oder nur Rauschen
+    uint32_t speedCmS(unsigned long nowMs) const
+    {
+        float v;
+        if (!slope(nowMs, v) || fabsf(v) < SPEED_MIN_CM_S)
+        {
+            return 0;
+        }
+        return (uint32_t)lroundf(fabsf(v));
+    }
+};
@@ -0,0 +1,69 @@
+// Lichtschranke-Protokoll - Zeilenweiser Empfang der Protokollnachrichten ohne Blockieren
+// Gemeinsam für Server und Client: readStringUntil() wartet bei halb empfangener Zeile bis zum
+// Stream-Timeout (1s). Der LineReader sammelt stattdessen, was gerade da ist, in einem festen
+// Puffer und liefert jede vollständige Zeile, sobald ihr '\n' angekommen ist.
+
+#pragma once
+
+#include <Arduino.h>
+
+const int PROTOCOL_LINE_MAX = 256;                   // RESULTS mit 8 Ergebnissen braucht ~190 Byte
+const unsigned long PROTOCOL_RX_BUDGET_US = 5000;    // Höchstens so lange Nachrichten pro Loop-Durchlauf
+
+template <int Capacity>
+struct LineReader
+{
+    char buf[Capacity];
+    int len = 0;
+    bool discarding = false;             // Zeile war zu lang, Rest bis '\n' verwerfen
+    unsigned long overflows = 0;
+
+    void reset()
+    {
+        len = 0;
+        discarding = false;
+    }
+
+    // Liest verfügbare Bytes bis zum nächsten Zeilenende, nie mehr
+    // true = vollständige Zeile (ohne '\r'/'\n') in buf, gültig bis zum nächsten Aufruf
+    // false = keine vollständige Zeile da, Teilzeile bleibt für den nächsten Aufruf im Puffer
+    bool poll(Stream &in)
+    {
+        while (in.available() > 0)
+        {
+            int c = in.read();
+            if (c < 0)
+            {
+                break;
+            }
+            if (c == '\n')
+            {
+                bool complete = !discarding && len > 0;
+                buf[complete ? len : 0] = '\0';
+                len = 0;
+                discarding = false;
+                if (complete)
+                {
+                    return true;
+                }
+                continue;
+            }
+            if (c == '\r' || discarding)
+            {
+                continue;
+            }
+            if (len >= Capacity - 1)
+            {
+                // Abgeschnittene Nachricht wäre gefährlicher als eine verlorene
+                discarding = true;
+                len = 0;
+                overflows++;
+                continue;
+            }
+            buf[len++] = c;
+        }
+        return false;
+    }
+
+    const char *line() const { return buf; }
+};
@@ -0,0 +1,136 @@
+// Lichtschranke-Speicher - Speicherbudget im Dauerbetrieb überwachen
+// Gemeinsam für Server und Client: freier Heap, Minimum seit Boot, größter zusammenhängender
+// Block (Fragmentierung) und Stack-Reserve des Loop-Tasks, als kleiner Trend-Ring
+// Die Auswertung (record) hängt nur an MemorySample und läuft damit auch auf dem PC,
+// readMemorySample() ist die einzige ESP32-spezifische Quelle.
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+const unsigned long MEMORY_SAMPLE_INTERVAL_MS = 60000;  // Ein Messpunkt pro Minute
+const int MEMORY_TREND_SLOTS = 16;                       // Letzte 16 Minuten
+const int MEMORY_FRAGMENTATION_WARN_PCT = 50;            // Größter Block < halber freier Heap
+const int MEMORY_FRAGMENTATION_CLEAR_PCT = 40;           // Hysterese gegen Flattern der Warnung
+const uint32_t MEMORY_STACK_WARN_BYTES = 1024;           // Stack-Reserve des Loop-Tasks
+
+struct MemorySample
+{
+    uint32_t atMs = 0;
+    uint32_t freeHeap = 0;
+    uint32_t minFreeHeap = 0;            // Tiefster Stand seit Boot
+    uint32_t largestBlock = 0;           // Größte am Stück allozierbare Menge
+    uint32_t stackFree = 0;              // High-Water-Mark: nie genutzte Bytes des Loop-Stacks
+
+    // 0 = ein einziger freier Block, nahe 100 = freier Speicher in viele kleine Stücke zerfallen
+    int fragmentationPct() const
+    {
+        if (freeHeap == 0)
+        {
+            return 0;
+        }
+        return 100 - (int)((uint64_t)largestBlock * 100 / freeHeap);
+    }
+};
+
+// Aktueller Stand auf dem ESP32 (Loop-Task = aufrufender Task)
+inline MemorySample readMemorySample(unsigned long nowMs)
+{
+    MemorySample s;
+    s.atMs = nowMs;
+    s.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    s.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    s.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    s.stackFree = uxTaskGetStackHighWaterMark(nullptr); // ESP-IDF zählt in Bytes
+    return s;
+}
+
+struct MemoryTelemetry
+{
+    MemorySample samples[MEMORY_TREND_SLOTS];
+    int count = 0;
+    int next = 0;
+    bool fragmented = false;             // Warnung aktiv (mit Hysterese)
+    bool stackLow = false;
+    unsigned long warnings = 0;
+
+    // Neuer Messpunkt, true beim Überschreiten einer Warnschwelle (Flanke, nicht Zustand)
+    bool record(const MemorySample &s)
+    {
+        samples[next] = s;
+        next = (next + 1) % MEMORY_TREND_SLOTS;
+        if (count < MEMORY_TREND_SLOTS)
+        {
+            count++;
+        }
+
+        bool raised = false;
+        int frag = s.fragmentationPct();
+        if (!fragmented && frag >= MEMORY_FRAGMENTATION_WARN_PCT)
+        {
+            fragmented = true;
+            raised = true;
+        }
+        else if (fragmented && frag < MEMORY_FRAGMENTATION_CLEAR_PCT)
+        {
+            fragmented = false;
+        }
+        if (!stackLow && s.stackFree < MEMORY_STACK_WARN_BYTES)
+        {
+            stackLow = true; // Die High-Water-Mark erholt sich nie, kein Zurücksetzen
+            raised = true;
+        }
+        warnings += raised ? 1 : 0;
+        return raised;
+    }
+
+    // Messpunkt i, 0 = ältester im Ring
+    const MemorySample &at(int i) const
+    {
+        return samples[(next - count + i + MEMORY_TREND_SLOTS) % MEMORY_TREND_SLOTS];
+    }
+
+    const MemorySample &latest() const { return at(count - 1); }
+
+    // Änderung des freien Heaps pro Stunde über den Ring - dauerhaft negativ deutet auf ein Leck
+    long heapTrendPerHour() const
+    {
+        if (count < 2)
+        {
+            return 0;
+        }
+        const MemorySample &first = at(0);
+        const MemorySample &last = latest();
+        unsigned long spanMs = last.atMs - first.atMs;
+        if (spanMs == 0)
+        {
+            return 0;
+        }
+        return (long)((int64_t)((int32_t)(last.freeHeap - first.freeHeap)) * 3600000LL / (int64_t)spanMs);
+    }
+
+    String toJSON() const
+    {
+        if (count == 0)
+        {
+            return "{}";
+        }
+        const MemorySample &s = latest();
+        String json = String("{\"free\":") + s.freeHeap +
+                      ",\"min_free\":" + s.minFreeHeap +
+                      ",\"largest\":" + s.largestBlock +
+                      ",\"frag_pct\":" + s.fragmentationPct() +
+                      ",\"stack_free\":" + s.stackFree +
+                      ",\"trend_per_h\":" + heapTrendPerHour() +
+                      ",\"warnings\":" + warnings +
+                      ",\"free_history\":[";
+        for (int i = 0; i < count; i++)
+        {
+            json += String(i > 0 ? "," : "") + at(i).freeHeap;
+        }
+        return json + "]}";
+    }
+};
@@ -0,0 +1,204 @@
+// Lichtschranke-Telemetrie - Live-Abstandssignal für Aufbau und Schwellwert-Einstellung
+// Gemeinsam für Server und Client: Jeder Knoten bietet auf TELEMETRY_PORT einen eigenen Socket an,
+// die Verbindung für die Zeitmessung bleibt davon unberührt. Nur solange ein Empfänger verbunden
+// ist, wird jede Abtastung (alle Einzel-Pings und der gefilterte Wert) in Batches kodiert.
+// Jeder Batch ist für sich dekodierbar: Header + pro Abtastung Zeit- und Abstandsdifferenz als Varint.
+// Staut sich der Versand, wird ausgedünnt (nur jede 2^k-te Abtastung) statt die Abtastung aufzuhalten.
+// Empfänger für den PC: tools/Telemetrie-Empfang.py
+
+#pragma once
+
+#include <Arduino.h>
+
+const uint16_t TELEMETRY_PORT = 82;
+const uint16_t TELEMETRY_MAGIC = 0x4C54;            // "TL"
+const int TELEMETRY_BATCH_BYTES = 480;              // Nutzdaten pro Batch, passt mit Header in ein TCP-Segment
+const int TELEMETRY_QUEUE_BATCHES = 4;              // Fertige Batches, die auf den Versand warten
+const unsigned long TELEMETRY_BATCH_US = 100000;    // Spätestens nach 100ms abschicken
+const int TELEMETRY_MAX_RAW = 16;                   // Einzel-Pings pro Abtastung (= MAX_GATE_PINGS)
+const int TELEMETRY_SAMPLE_MAX = 5 + 5 + 1 + TELEMETRY_MAX_RAW * 5; // Ungünstigste Länge einer Abtastung
+const uint8_t TELEMETRY_MAX_DECIMATION = 6;         // Höchstens jede 64. Abtastung
+
+struct TelemetryBatchHeader
+{
+    uint16_t magic;
+    uint8_t gate;                        // 1 = Start (Server), 2 = Ziel (Client)
+    uint8_t decimation;                  // Abstand der Abtastungen im Batch: 2^decimation
+    uint32_t firstSample;                // Laufende Nummer der ersten Abtastung, Lücken = verworfene Batches
+    uint32_t t0Us;                       // micros() der ersten Abtastung
+    uint16_t count;
+    uint16_t len;                        // Belegte Nutzdaten-Bytes
+};
+static_assert(sizeof(TelemetryBatchHeader) == 16, "Telemetrie-Header ist Teil des Protokolls");
+
+struct TelemetryBatch
+{
+    TelemetryBatchHeader header;
+    uint8_t payload[TELEMETRY_BATCH_BYTES];
+
+    int wireSize() const { return sizeof(header) + header.len; }
+};
+
+struct TelemetryStream
+{
+    uint8_t gate;
+    bool enabled = false;                // Empfänger verbunden
+    TelemetryBatch current;              // Wird gerade gefüllt
+    TelemetryBatch queue[TELEMETRY_QUEUE_BATCHES];
+    int head = 0;                        // Ältester wartender Batch
+    int queued = 0;
+    int sentBytes = 0;                   // Davon bereits gesendet
+    uint32_t sampleCounter = 0;
+    uint8_t decimation = 0;
+    uint32_t prevUs = 0;
+    int32_t prevMm = 0;
+
+    // Auswertung
+    unsigned long batchesSent = 0;
+    unsigned long droppedBatches = 0;    // Warteschlange voll
+    unsigned long skippedSamples = 0;    // Durch Ausdünnung nicht kodiert
+    unsigned long maxRecordUs = 0;       // Längste Zeit in record() - Last auf dem Abtastpfad
+
+    explicit TelemetryStream(uint8_t gateNo) : gate(gateNo) { current.header.count = 0; }
+
+    // Neuer Empfänger: Warteschlange leeren, mit voller Rate beginnen
+    void reset()
+    {
+        head = 0;
+        queued = 0;
+        sentBytes = 0;
+        decimation = 0;
+        current.header.count = 0;
+    }
+
+    // Abtastpfad: nur kodieren und kopieren, nie senden. raw < 0 = kein Echo, filtered < 0 = ungültig
+    void record(uint32_t nowUs, float filteredCm, const float *raw, int rawCount)
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        uint32_t started = micros();
+        // Zuerst abschließen: closeBatch() ändert die Ausdünnung, ein Batch hat nur eine Stufe
+        if (current.header.count > 0 &&
+            (current.header.len + TELEMETRY_SAMPLE_MAX > TELEMETRY_BATCH_BYTES ||
+             nowUs - current.header.t0Us >= TELEMETRY_BATCH_US))
+        {
+            closeBatch();
+        }
+        uint32_t n = sampleCounter++;
+        if (n & ((1UL << decimation) - 1))
+        {
+            skippedSamples++;
+            return;
+        }
+        if (current.header.count == 0)
+        {
+            current.header.magic = TELEMETRY_MAGIC;
+            current.header.gate = gate;
+            current.header.decimation = decimation;
+            current.header.firstSample = n;
+            current.header.t0Us = nowUs;
+            current.header.len = 0;
+            prevUs = nowUs;
+            prevMm = 0;
+        }
+
+        int32_t mm = filteredCm > 0 ? (int32_t)lroundf(filteredCm * 10.0f) : 0;
+        uint8_t *p = current.payload + current.header.len;
+        int len = putVarint(p, nowUs - prevUs);
+        len += putVarint(p + len, zigzag(mm - prevMm));
+        rawCount = min(rawCount, TELEMETRY_MAX_RAW);
+        p[len++] = (uint8_t)rawCount;
+        for (int i = 0; i < rawCount; i++)
+        {
+            // 0 = kein Echo, sonst Abstand zum gefilterten Wert + 1
+            uint32_t v = raw[i] > 0 ? zigzag((int32_t)lroundf(raw[i] * 10.0f) - mm) + 1 : 0;
+            len += putVarint(p + len, v);
+        }
+        current.header.len += len;
+        current.header.count++;
+        prevUs = nowUs;
+        prevMm = mm;
+        maxRecordUs = max(maxRecordUs, (unsigned long)(micros() - started));
+    }
+
+    // Loop: auch bei langsamer Abtastung spätestens nach TELEMETRY_BATCH_US abschicken
+    void flushIfDue(uint32_t nowUs)
+    {
+        if (current.header.count > 0 && nowUs - current.header.t0Us >= TELEMETRY_BATCH_US)
+        {
+            closeBatch();
+        }
+    }
+
+    // Nächstes Stück zum Senden, false = nichts da
+    bool pending(const uint8_t *&data, int &len) const
+    {
+        if (queued == 0)
+        {
+            return false;
+        }
+        const TelemetryBatch &b = queue[head];
+        data = (const uint8_t *)&b + sentBytes;
+        len = b.wireSize() - sentBytes;
+        return true;
+    }
+
+    // So viele Bytes hat der Socket angenommen
+    void consumed(int n)
+    {
+        sentBytes += n;
+        if (sentBytes >= queue[head].wireSize())
+        {
+            head = (head + 1) % TELEMETRY_QUEUE_BATCHES;
+            queued--;
+            sentBytes = 0;
+            batchesSent++;
+        }
+    }
+
+    void closeBatch()
+    {
+        if (queued == TELEMETRY_QUEUE_BATCHES)
+        {
+            // Rückstau: Batch verwerfen und ausdünnen, der Abtastpfad wartet nie
+            droppedBatches++;
+            decimation = min((uint8_t)(decimation + 1), TELEMETRY_MAX_DECIMATION);
+        }
+        else
+        {
+            if (queued == 0 && decimation > 0)
+            {
+                decimation--; // Versand kommt hinterher: wieder dichter abtasten
+            }
+            TelemetryBatch &slot = queue[(head + queued) % TELEMETRY_QUEUE_BATCHES];
+            memcpy(&slot, &current, current.wireSize());
+            queued++;
+        }
+        current.header.count = 0;
+    }
+
+    String summary() const
+    {
+        return String("Telemetrie: Batches=") + batchesSent +
+               ", verworfen=" + droppedBatches +
+               ", ausgedünnt=" + skippedSamples +
+               ", Rate=1/" + (1UL << decimation) +
+               ", record max=" + maxRecordUs + "us";
+    }
+
+    static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+    static int putVarint(uint8_t *out, uint32_t v)
+    {
+        int n = 0;
+        while (v >= 0x80)
+        {
+            out[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        out[n++] = (uint8_t)v;
+        return n;
+    }
+};
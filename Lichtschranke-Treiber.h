@@ -0,0 +1,274 @@
+// Lichtschranke-Treiber - Gemeinsame Hardware-Treiber für Server und Client
+// Die Pins sind Template-Parameter: jeder Zugriff wird zur Compile-Zeit zu einem
+// einzelnen Registerzugriff (GPIO_OUT_W1TS/W1TC) ohne Pin-Lookup wie bei digitalWrite()
+
+#pragma once
+
+#include <Arduino.h>
+#include <soc/gpio_reg.h>
+
+#define SOUND_SPEED 0.034f  // cm/µs bei 20°C
+
+const float MIN_VALID_DISTANCE = 2.0f;              // HC-SR04 Minimum (technisches Limit)
+const float MAX_VALID_DISTANCE = 400.0f;            // HC-SR04 Maximum (technisches Limit)
+const int MAX_GATE_PINGS = 16;                      // Obergrenze für den Ping-Puffer (kein VLA auf dem Stack)
+const unsigned long SENSOR_GUARD_US = 500;          // Pause nach jedem Ping, damit Nachhall abklingt
+const unsigned long SENSOR_REARM_US = 500;          // Mindestabstand zweier Pings desselben Sensors
+const int SENSOR_MISS_LIMIT = 20;                   // Ab so vielen Fehl-Echos in Folge gilt ein Sensor als stumm
+
+inline bool isValidDistance(float distance)
+{
+    return distance > MIN_VALID_DISTANCE && distance < MAX_VALID_DISTANCE;
+}
+
+// Einzelner GPIO mit direktem Registerzugriff
+// GPIO 0-31 liegen in Bank 0, GPIO 32-39 in Bank 1 (eigene Register)
+template <uint8_t Pin>
+struct FastPin
+{
+    static_assert(Pin < 40, "ESP32 hat nur GPIO 0-39");
+    static const uint32_t mask = 1UL << (Pin & 31);
+    static const bool highBank = Pin >= 32;
+
+    static void output()
+    {
+        static_assert(Pin < 34, "GPIO 34-39 sind reine Eingänge");
+        pinMode(Pin, OUTPUT);
+    }
+
+    static void input() { pinMode(Pin, INPUT); }
+
+    static inline void set() { REG_WRITE(highBank ? GPIO_OUT1_W1TS_REG : GPIO_OUT_W1TS_REG, mask); }
+
+    static inline void clear() { REG_WRITE(highBank ? GPIO_OUT1_W1TC_REG : GPIO_OUT_W1TC_REG, mask); }
+
+    static inline bool read() { return (REG_READ(highBank ? GPIO_IN1_REG : GPIO_IN_REG) & mask) != 0; }
+};
+
+// HC-SR04 Ultraschallsensor auf festen Pins
+template <uint8_t TrigPin, uint8_t EchoPin>
+struct UltrasonicSensor
+{
+    typedef FastPin<TrigPin> Trig;
+    typedef FastPin<EchoPin> Echo;
+
+    static void begin()
+    {
+        Trig::output();
+        Echo::input();
+    }
+
+    // Echo-Pulsdauer in µs, 0 bei Timeout
+    // Entspricht pulseIn(EchoPin, HIGH, timeoutUs): Timeout gilt für den gesamten Vorgang
+    static unsigned long ping(unsigned long timeoutUs)
+    {
+        // HC-SR04 Trigger-Sequenz: 10µs HIGH-Puls startet Messung
+        Trig::clear();
+        delayMicroseconds(2);
+        Trig::set();
+        delayMicroseconds(10);
+        Trig::clear();
+
+        unsigned long start = micros();
+        while (Echo::read())            // Rest eines vorherigen Pulses abwarten
+        {
+            if (micros() - start >= timeoutUs) return 0;
+        }
+        while (!Echo::read())           // Steigende Flanke
+        {
+            if (micros() - start >= timeoutUs) return 0;
+        }
+        unsigned long pulseStart = micros();
+        while (Echo::read())            // Fallende Flanke
+        {
+            if (micros() - start >= timeoutUs) return 0;
+        }
+        return micros() - pulseStart;
+    }
+
+    // Distanz in cm, -1 wenn kein Echo innerhalb des Timeouts
+    static float measureCm(unsigned long timeoutUs)
+    {
+        unsigned long duration = ping(timeoutUs);
+        if (duration == 0)
+        {
+            return -1.0f;
+        }
+        return (duration * SOUND_SPEED / 2.0f); // Hin- und Rückweg, daher /2
+    }
+};
+
+// Gruppe von Sensoren einer Schranke im Round-Robin-Betrieb
+// Die Sensoren feuern streng nacheinander, nie gleichzeitig, damit kein Sensor den Burst eines
+// Nachbarn als eigenes Echo liest. Der Laufzeit-Index wählt über eine Sprungtabelle die
+// pin-spezialisierte Messfunktion, measureFused() fasst die Pings einer Abtastung zusammen.
+template <typename... Sensors>
+struct SensorGroup
+{
+    static const int count = sizeof...(Sensors);
+
+    const char *node;                            // Präfix der Meldungen ("ESP1", "ESP2")
+    int nextSensor = 0;
+    unsigned long lastPingEnd = 0;               // micros() nach dem letzten Ping (egal welcher Sensor)
+    unsigned long lastPingStart[count] = {};     // micros() beim letzten Ping je Sensor
+    int consecutiveMisses[count] = {};           // Fehl-Echos in Folge je Sensor
+    float rawPings[MAX_GATE_PINGS];              // Einzel-Pings der letzten Abtastung, -1 = kein Echo
+    int rawCount = 0;
+
+    explicit SensorGroup(const char *nodeName) : node(nodeName) {}
+
+    static void begin()
+    {
+        int expand[] = {0, (Sensors::begin(), 0)...};
+        (void)expand;
+    }
+
+    static float measureCm(int index, unsigned long timeoutUs)
+    {
+        static float (*const table[])(unsigned long) = {&Sensors::measureCm...};
+        return table[index](timeoutUs);
+    }
+
+    // Zeitbedarf eines Pings im TDMA-Slot
+    static unsigned long pingBudgetUs(unsigned long timeoutUs) { return timeoutUs + SENSOR_GUARD_US; }
+
+    int healthySensors() const
+    {
+        int healthy = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (consecutiveMisses[i] < SENSOR_MISS_LIMIT) healthy++;
+        }
+        return healthy;
+    }
+
+    // Feuert den nächsten Sensor im Round-Robin und liefert dessen Rohdistanz
+    float pingNext(int &sensor, unsigned long timeoutUs)
+    {
+        sensor = nextSensor;
+        nextSensor = (sensor + 1) % count;
+
+        // Versatz zum vorherigen Ping verhindert Übersprechen zwischen den Sensoren
+        while (micros() - lastPingEnd < SENSOR_GUARD_US) {}
+        while (micros() - lastPingStart[sensor] < SENSOR_REARM_US) {}
+
+        lastPingStart[sensor] = micros();
+        float dist = measureCm(sensor, timeoutUs);
+        lastPingEnd = micros();
+
+        if (isValidDistance(dist))
+        {
+            if (consecutiveMisses[sensor] >= SENSOR_MISS_LIMIT)
+            {
+                Serial.print(node);
+                Serial.print(": Sensor ");
+                Serial.print(sensor);
+                Serial.println(" liefert wieder Echos");
+            }
+            consecutiveMisses[sensor] = 0;
+        }
+        else if (++consecutiveMisses[sensor] == SENSOR_MISS_LIMIT)
+        {
+            Serial.print(node);
+            Serial.print(": WARNUNG - Sensor ");
+            Serial.print(sensor);
+            Serial.println(" liefert keine Echos mehr");
+        }
+        return dist;
+    }
+
+    // Fusioniert mehrere Round-Robin-Pings per Median zu einem Schranken-Messwert, -1 = ungültig
+    // Der Aufrufer startet im eigenen TDMA-Slot. Meldet slotWaitUs(Budget) danach eine Wartezeit,
+    // ist der Slot zu Ende und es zählen die Pings bis dahin
+    float measureFused(int pings, unsigned long timeoutUs, unsigned long (*slotWaitUs)(unsigned long))
+    {
+        float measurements[MAX_GATE_PINGS];
+        int validCount = 0;
+        int pingsPerSensor[count] = {};
+        int echoesPerSensor[count] = {};
+
+        if (pings > MAX_GATE_PINGS) pings = MAX_GATE_PINGS;
+        for (int i = 0; i < pings; i++)
+        {
+            if (i > 0 && slotWaitUs(pingBudgetUs(timeoutUs)) > 0)
+            {
+                pings = i;
+                break;
+            }
+            int sensor;
+            float dist = pingNext(sensor, timeoutUs);
+            pingsPerSensor[sensor]++;
+            rawPings[i] = isValidDistance(dist) ? dist : -1.0f;
+            if (isValidDistance(dist))
+            {
+                measurements[validCount++] = dist;
+                echoesPerSensor[sensor]++;
+            }
+        }
+        rawCount = pings;
+
+        // Ein komplett stummer Sensor zählt nicht gegen die Mehrheit,
+        // so übersteht die Schranke den Ausfall einzelner Echos oder Sensoren
+        int countedMisses = 0;
+        for (int s = 0; s < count; s++)
+        {
+            if (echoesPerSensor[s] > 0)
+            {
+                countedMisses += pingsPerSensor[s] - echoesPerSensor[s];
+            }
+        }
+        if (validCount == 0 || validCount <= countedMisses)
+        {
+            return -1.0f;
+        }
+
+        // Insertion Sort reicht für wenige Werte, der Median ist robust gegen Reflexions-Ausreißer
+        for (int i = 1; i < validCount; i++)
+        {
+            float value = measurements[i];
+            int j = i - 1;
+            while (j >= 0 && measurements[j] > value)
+            {
+                measurements[j + 1] = measurements[j];
+                j--;
+            }
+            measurements[j + 1] = value;
+        }
+        return measurements[validCount / 2];
+    }
+};
+
+// Ampel mit drei LEDs - erst aus, dann an, jede LED ändert sich höchstens einmal
+// Nur W1TC/W1TS: ein Read-Modify-Write auf GPIO_OUT_REG würde Schreibzugriffe des anderen Kerns
+// auf dieselbe Bank (Trigger-Pins) zwischen Lesen und Schreiben überschreiben
+template <uint8_t RedPin, uint8_t YellowPin, uint8_t GreenPin>
+struct TrafficLightDriver
+{
+    static_assert(RedPin < 32 && YellowPin < 32 && GreenPin < 32,
+                  "Ampel-LEDs müssen in GPIO-Bank 0 liegen (gemeinsames Register)");
+    static const uint32_t allMask = FastPin<RedPin>::mask | FastPin<YellowPin>::mask | FastPin<GreenPin>::mask;
+    static portMUX_TYPE mux;
+
+    static void begin()
+    {
+        FastPin<RedPin>::output();
+        FastPin<YellowPin>::output();
+        FastPin<GreenPin>::output();
+    }
+
+    static void set(bool red, bool yellow, bool green)
+    {
+        uint32_t on = (red ? FastPin<RedPin>::mask : 0) |
+                      (yellow ? FastPin<YellowPin>::mask : 0) |
+                      (green ? FastPin<GreenPin>::mask : 0);
+
+        // Der Lock hält nur gleichzeitige set()-Aufrufe (Loop und esp_timer) auseinander
+        portENTER_CRITICAL(&mux);
+        REG_WRITE(GPIO_OUT_W1TC_REG, allMask & ~on);
+        REG_WRITE(GPIO_OUT_W1TS_REG, on);
+        portEXIT_CRITICAL(&mux);
+    }
+};
+
+template <uint8_t RedPin, uint8_t YellowPin, uint8_t GreenPin>
+portMUX_TYPE TrafficLightDriver<RedPin, YellowPin, GreenPin>::mux = portMUX_INITIALIZER_UNLOCKED;
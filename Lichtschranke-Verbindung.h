@@ -0,0 +1,116 @@
+// Lichtschranke-Verbindung - Adaptive Ausfallerkennung der TCP-Verbindung (Phi-Accrual)
+// Gemeinsam für Server und Client: Beide Seiten schicken sich alle HEARTBEAT_INTERVAL_MS einen
+// Heartbeat. Statt eines festen Timeouts wird aus Mittelwert und Streuung der Heartbeat-Abstände
+// berechnet, wie unwahrscheinlich die aktuelle Funkstille ist (phi = -log10 P).
+// phi = 8 entspricht einer Fehlalarm-Wahrscheinlichkeit von 1e-8 pro Prüfung.
+
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+const unsigned long HEARTBEAT_INTERVAL_MS = 200;             // Heartbeats in beide Richtungen, 5x pro Sekunde
+const float PHI_THRESHOLD = 8.0f;                            // Verdachtsschwelle der Ausfallerkennung
+const float PHI_MIN_STDDEV_MS = 25.0f;                       // Untergrenze der Streuung gegen Überempfindlichkeit
+const float PHI_ACCEPTABLE_PAUSE_MS = 200.0f;                // Eine TCP-Wiederholung (RTO) ist noch kein Ausfall
+const float PHI_EWMA_ALPHA = 0.1f;                           // Glättung der Ankunftsstatistik
+const unsigned long LINK_STARTUP_GRACE_MS = 2000;            // Frist bis zum ersten Heartbeat nach CLIENT_READY
+
+struct LinkMonitor
+{
+    bool armed = false;                     // Erst ab CLIENT_READY aktiv
+    bool started = false;                   // Erster Heartbeat da, ab dann gilt phi
+    unsigned long lastArrival = 0;          // millis() des letzten Heartbeats der Gegenseite
+    float meanIntervalMs = HEARTBEAT_INTERVAL_MS;
+    float varianceMs2 = 0;
+    float srttMs = 0;                       // Geglättete Round-Trip-Time (RFC 6298)
+    float rttVarMs = 0;                     // Jitter der Round-Trip-Time
+    bool hasRtt = false;
+    uint32_t sentSeq = 0;
+    uint32_t lastReceivedSeq = 0;
+    uint32_t lostHeartbeats = 0;
+
+    void arm(unsigned long now)
+    {
+        armed = true;
+        lastArrival = now;
+        meanIntervalMs = HEARTBEAT_INTERVAL_MS;
+        varianceMs2 = (HEARTBEAT_INTERVAL_MS / 4.0f) * (HEARTBEAT_INTERVAL_MS / 4.0f);
+        started = false;
+        hasRtt = false;
+        lastReceivedSeq = 0;
+        lostHeartbeats = 0;
+    }
+
+    // Gleitender Mittelwert und Varianz der Ankunftsabstände
+    void onHeartbeat(uint32_t seq, unsigned long now)
+    {
+        if (lastReceivedSeq != 0 && seq > lastReceivedSeq + 1)
+        {
+            lostHeartbeats += seq - lastReceivedSeq - 1;
+        }
+        lastReceivedSeq = seq;
+
+        // Der erste Heartbeat startet nur die Uhr, die Pause davor (Kalibrierung, Display) ist kein Intervall
+        if (!started)
+        {
+            started = true;
+            lastArrival = now;
+            return;
+        }
+
+        float interval = now - lastArrival;
+        lastArrival = now;
+        float diff = interval - meanIntervalMs;
+        float increment = PHI_EWMA_ALPHA * diff;
+        meanIntervalMs += increment;
+        varianceMs2 = (1.0f - PHI_EWMA_ALPHA) * (varianceMs2 + diff * increment);
+    }
+
+    void onAck(unsigned long sentMicros, unsigned long nowMicros)
+    {
+        float rttMs = (nowMicros - sentMicros) / 1000.0f;
+        if (!hasRtt)
+        {
+            srttMs = rttMs;
+            rttVarMs = rttMs / 2.0f;
+            hasRtt = true;
+        }
+        else
+        {
+            rttVarMs = 0.75f * rttVarMs + 0.25f * fabs(srttMs - rttMs);
+            srttMs = 0.875f * srttMs + 0.125f * rttMs;
+        }
+    }
+
+    // Logistische Näherung der Normalverteilung (wie in Akka/Cassandra)
+    // Die erwartete Pause enthält eine TCP-Wiederholung: ein verlorenes Segment oder ein kurzer
+    // WLAN-Hänger verzögert alle folgenden Heartbeats, die Verbindung lebt aber noch
+    float phi(unsigned long now) const
+    {
+        float elapsed = now - lastArrival;
+        float expected = meanIntervalMs + PHI_ACCEPTABLE_PAUSE_MS;
+        float sigma = max(sqrtf(varianceMs2), PHI_MIN_STDDEV_MS);
+        float y = (elapsed - expected) / sigma;
+        float e = expf(-y * (1.5976f + 0.070566f * y * y));
+        if (elapsed > expected)
+        {
+            return (e < 1e-30f) ? 99.0f : -log10f(e / (1.0f + e));
+        }
+        return -log10f(1.0f - 1.0f / (1.0f + e));
+    }
+
+    // Vor dem ersten Heartbeat gibt es keine Statistik, nur die feste Anlauffrist
+    bool suspected(unsigned long now) const
+    {
+        if (!armed)
+        {
+            return false;
+        }
+        if (!started)
+        {
+            return now - lastArrival > LINK_STARTUP_GRACE_MS;
+        }
+        return phi(now) > PHI_THRESHOLD;
+    }
+};
@@ -0,0 +1,202 @@
+// Lichtschranke-Zustand - Tabellengesteuerte Zustandsmaschine für Server und Client
+// Übergänge werden als Liste {von, Ereignis, nach, Bedingung, Aktion} deklariert. Daraus entsteht
+// zur Compile-Zeit eine dichte Tabelle [Zustand][Ereignis] -> Übergang, ein dispatch() ist damit
+// ein einziger Array-Zugriff. Nur die Maschine ändert den Zustand, der Rest des Sketches liest ihn.
+// Bewusst C++11 (Arduino-ESP32 2.x): Tabellenaufbau über rekursive constexpr-Funktionen.
+
+#pragma once
+
+#include <Arduino.h>
+
+typedef bool (*TransitionGuard)();
+typedef void (*TransitionAction)();
+
+template <typename State, typename Event>
+struct Transition
+{
+    State from;
+    Event event;
+    State to;
+    TransitionGuard guard;               // nullptr = immer erlaubt
+    TransitionAction action;             // Läuft nach dem Zustandswechsel, darf selbst dispatch() aufrufen
+};
+
+// Dichte Tabelle: Index+1 des Übergangs in der Liste, 0 = Ereignis wird im Zustand ignoriert
+template <int Cells>
+struct TransitionTable
+{
+    uint8_t slot[Cells];
+};
+
+namespace state_machine_detail
+{
+    template <int... I>
+    struct Indices {};
+
+    template <int N, int... I>
+    struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+    template <int... I>
+    struct MakeIndices<0, I...>
+    {
+        typedef Indices<I...> type;
+    };
+
+    template <typename Entry, int N>
+    constexpr uint8_t find(const Entry (&list)[N], int state, int event, int i)
+    {
+        return i == N ? 0
+               : ((int)list[i].from == state && (int)list[i].event == event) ? (uint8_t)(i + 1)
+                                                                          : find(list, state, event, i + 1);
+    }
+
+    template <typename Entry, int N, int... I>
+    constexpr TransitionTable<sizeof...(I)> build(const Entry (&list)[N], int eventCount, Indices<I...>)
+    {
+        return TransitionTable<sizeof...(I)>{{find(list, I / eventCount, I % eventCount, 0)...}};
+    }
+
+    template <typename Entry, int N>
+    constexpr int countPair(const Entry (&list)[N], int state, int event, int i)
+    {
+        return i == N ? 0
+                      : (((int)list[i].from == state && (int)list[i].event == event) ? 1 : 0) +
+                            countPair(list, state, event, i + 1);
+    }
+}
+
+// Tabelle aus der Übergangsliste, z.B. constexpr auto t = buildTransitionTable<STATE_COUNT, EVENT_COUNT>(list);
+template <int StateCount, int EventCount, typename Entry, int N>
+constexpr TransitionTable<StateCount * EventCount> buildTransitionTable(const Entry (&list)[N])
+{
+    static_assert(N < 255, "Höchstens 254 Übergänge pro Tabelle");
+    return state_machine_detail::build(list, EventCount,
+                                       typename state_machine_detail::MakeIndices<StateCount * EventCount>::type());
+}
+
+// Für static_assert: jedes Paar (Zustand, Ereignis) darf nur einmal vorkommen - damit ist jeder
+// Übergang eindeutig (deterministisch), die Bedingung entscheidet nur noch über ja/nein
+template <typename Entry, int N>
+constexpr bool transitionsUnique(const Entry (&list)[N], int i = 0)
+{
+    return i == N ? true
+                  : state_machine_detail::countPair(list, (int)list[i].from, (int)list[i].event, 0) == 1 &&
+                        transitionsUnique(list, i + 1);
+}
+
+// Für static_assert: alle Zustände und Ereignisse innerhalb der Aufzählung (kein *_COUNT)
+template <typename Entry, int N>
+constexpr bool transitionsInRange(const Entry (&list)[N], int stateCount, int eventCount, int i = 0)
+{
+    return i == N ? true
+                  : (int)list[i].from >= 0 && (int)list[i].from < stateCount && (int)list[i].to >= 0 &&
+                        (int)list[i].to < stateCount && (int)list[i].event >= 0 &&
+                        (int)list[i].event < eventCount && transitionsInRange(list, stateCount, eventCount, i + 1);
+}
+
+namespace state_machine_detail
+{
+    // Bitmaske der Zustände, die aus mask mit einem Übergang erreichbar sind
+    template <typename Entry, int N>
+    constexpr uint32_t step(const Entry (&list)[N], uint32_t mask, int i)
+    {
+        return i == N ? mask
+                      : step(list, (mask >> (int)list[i].from) & 1 ? mask | (1u << (int)list[i].to) : mask, i + 1);
+    }
+
+    template <typename Entry, int N>
+    constexpr uint32_t closure(const Entry (&list)[N], uint32_t mask, int rounds)
+    {
+        return rounds == 0 ? mask : closure(list, step(list, mask, 0), rounds - 1);
+    }
+
+    template <typename Entry, int N>
+    constexpr bool handled(const Entry (&list)[N], int state, int event, int i)
+    {
+        return i == N ? false
+                      : ((int)list[i].from == state && (event < 0 || (int)list[i].event == event)) ||
+                            handled(list, state, event, i + 1);
+    }
+
+    template <typename Entry, int N>
+    constexpr bool eventUsed(const Entry (&list)[N], int event, int i)
+    {
+        return i == N ? false : (int)list[i].event == event || eventUsed(list, event, i + 1);
+    }
+}
+
+// Für static_assert: jeder Zustand ist vom Anfangszustand aus erreichbar und hat einen Ausgang,
+// jedes Ereignis löst irgendwo etwas aus. Tote Zustände und vergessene Ereignisse fallen so schon
+// beim Übersetzen auf, nicht erst im Betrieb.
+template <typename Entry, int N>
+constexpr bool transitionsComplete(const Entry (&list)[N], int stateCount, int eventCount, int initial, int i = 0)
+{
+    return i == stateCount + eventCount
+               ? true
+           : i < stateCount
+               ? ((state_machine_detail::closure(list, 1u << initial, stateCount) >> i) & 1) &&
+                     state_machine_detail::handled(list, i, -1, 0) &&
+                     transitionsComplete(list, stateCount, eventCount, initial, i + 1)
+               : state_machine_detail::eventUsed(list, i - stateCount, 0) &&
+                     transitionsComplete(list, stateCount, eventCount, initial, i + 1);
+}
+
+// Für static_assert: das Ereignis hat in jedem Zustand aus stateMask einen Übergang
+// (z.B. ein Fehler muss aus jedem Zustand herausführen)
+template <typename Entry, int N>
+constexpr bool handledInStates(const Entry (&list)[N], int event, uint32_t stateMask, int state = 0)
+{
+    return state == 32 ? true
+                       : (!((stateMask >> state) & 1) || state_machine_detail::handled(list, state, event, 0)) &&
+                             handledInStates(list, event, stateMask, state + 1);
+}
+
+template <typename State, typename Event, int StateCount, int EventCount>
+struct StateMachine
+{
+    typedef Transition<State, Event> Entry;
+    // Wird bei jedem Übergang vor der Aktion aufgerufen (micros()), z.B. für Latenz-Traces
+    typedef void (*TraceHook)(State from, State to, Event event, unsigned long atUs);
+
+    const Entry *transitions;
+    const uint8_t *table;
+    State state;
+    TraceHook trace = nullptr;
+    unsigned long dispatched = 0;
+    unsigned long ignored = 0;           // Kein Übergang definiert oder Bedingung nicht erfüllt
+
+    StateMachine(const Entry *list, const TransitionTable<StateCount * EventCount> &cells, State initial)
+        : transitions(list), table(cells.slot), state(initial) {}
+
+    // true, wenn ein Übergang stattgefunden hat
+    bool dispatch(Event event)
+    {
+        dispatched++;
+        uint8_t slot = table[(int)state * EventCount + (int)event];
+        if (slot == 0)
+        {
+            ignored++;
+            return false;
+        }
+        const Entry &t = transitions[slot - 1];
+        if (t.guard && !t.guard())
+        {
+            ignored++;
+            return false;
+        }
+        State from = state;
+        state = t.to;
+        if (trace)
+        {
+            trace(from, t.to, event, micros());
+        }
+        if (t.action)
+        {
+            t.action();
+        }
+        return true;
+    }
+
+    // Ob das Ereignis im aktuellen Zustand überhaupt einen Übergang hat (ohne Bedingung)
+    bool accepts(Event event) const { return table[(int)state * EventCount + (int)event] != 0; }
+};
@@ -0,0 +1,187 @@
+// Ampel - Gelb/Rot-Sequenz über esp_timer, Abbruch vom anderen Kern, Abweichung vom Sollzeitpunkt
+// sim::Node::interleaveHook lässt den Loop-Kern an jeder Stelle dazwischenkommen, an der ein
+// Callback einen kritischen Abschnitt betritt. Die Abweichung wird gegen die Schaltung aus der
+// Loop heraus verglichen (wie mit -DLIGHT_SEQUENCER_TIMER=0).
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+typedef esp1::TrafficLight Ampel;
+
+static const uint32_t ROT = 1u << esp1::rledPin;
+static const uint32_t GELB = 1u << esp1::yledPin;
+static const uint32_t GRUEN = 1u << esp1::gledPin;
+static const uint32_t ALLE = ROT | GELB | GRUEN;
+
+// Frischer Knoten mit eigenem Sequenzer
+static sim::Node &knoten()
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    esp1::lightSequencer = esp1::LightSequencer();
+    esp1::lightSequencer.begin();
+    return n;
+}
+
+static std::vector<esp1::LightEvent> abholen()
+{
+    std::vector<esp1::LightEvent> v;
+    esp1::LightEvent e;
+    while (esp1::lightSequencer.take(e))
+    {
+        v.push_back(e);
+    }
+    return v;
+}
+
+// Fehler oder Reset auf dem Loop-Kern an jeder Stelle, an der ein Callback dazwischen kommen kann:
+// danach zeigt die Ampel, was der Abbruch gesetzt hat, und kein geplanter Schritt wird mehr gemeldet
+TEST(abbruch_an_jeder_unterbrechungsstelle)
+{
+    int gepruefte = 0;
+    for (int stelle = 1;; stelle++)
+    {
+        sim::Node &n = knoten();
+        sim::As als(n);
+        esp1::LightSequencer &seq = esp1::lightSequencer;
+        int punkt = 0;
+        int gemeldetBeimAbbruch = -1;
+        n.interleaveHook = [&](int) {
+            if (n.inTimer && ++punkt == stelle)
+            {
+                seq.cancel();
+                Ampel::set(true, false, false);      // Fehlersignal wie enterError()
+                gemeldetBeimAbbruch = (seq.head - seq.tail + esp1::LIGHT_EVENT_SLOTS) % esp1::LIGHT_EVENT_SLOTS;
+            }
+        };
+        seq.start(esp_timer_get_time());
+        sim::advance(us(3));
+        n.interleaveHook = nullptr;
+        if (gemeldetBeimAbbruch < 0)
+        {
+            break;                                   // Alle Stellen der Sequenz durchlaufen
+        }
+        gepruefte++;
+        CHECK_EQ(n.out[0] & ALLE, ROT);
+        CHECK_EQ((int)abholen().size(), gemeldetBeimAbbruch);
+    }
+    pruefung::bericht("Geprüfte Unterbrechungsstellen", gepruefte, "");
+    CHECK_GE(gepruefte, 2);
+}
+
+// Der Gelb-Callback der abgebrochenen Sequenz läuft erst nach dem Neustart (esp_timer_stop hält
+// einen schon ausgelösten Callback nicht mehr auf): er schaltet nicht, Gelb kommt pünktlich
+TEST(verspaeteter_callback_nach_neustart)
+{
+    sim::Node &n = knoten();
+    sim::As als(n);
+    esp1::LightSequencer &seq = esp1::lightSequencer;
+    seq.start(esp_timer_get_time());
+    sim::advance(esp1::YELLOW_PENDING_DELAY_MS * 1000 - 200);
+    seq.cancel();
+    int64_t neustart = esp_timer_get_time();
+    seq.start(neustart);
+    abholen();
+
+    esp1::LightSequencer::onYellowDue(&seq);
+    CHECK_EQ(n.out[0] & ALLE, 0u);                   // Dunkelphase bleibt
+    CHECK(abholen().empty());
+
+    sim::advance(esp1::YELLOW_PENDING_DELAY_MS * 1000);
+    std::vector<esp1::LightEvent> v = abholen();
+    REQUIRE(v.size() == 1);
+    CHECK_EQ(v[0].step, esp1::LIGHT_YELLOW);
+    CHECK_EQ(v[0].plannedUs, neustart + (int64_t)esp1::YELLOW_PENDING_DELAY_MS * 1000);
+    CHECK_EQ(n.out[0] & ALLE, GELB);
+}
+
+// 200 Sequenzen: Timer gegen Schaltung aus der Loop, die alle LOOP_DELAY_MS plus Messzeit
+// (1-25ms, je nach Echo) nachsieht
+TEST(abweichung_timer_gegen_loop)
+{
+    sim::Node &n = knoten();
+    sim::As als(n);
+    esp1::LightSequencer &seq = esp1::lightSequencer;
+    int64_t timerMax = 0, timerSumme = 0, loopMax = 0, loopSumme = 0;
+    int timerN = 0, loopN = 0;
+    for (int i = 0; i < 200; i++)
+    {
+        sim::advance((uint64_t)(n.rng.uniform() * 20000));
+        seq.start(esp_timer_get_time());
+        sim::advance(us(3));
+        for (const esp1::LightEvent &e : abholen())
+        {
+            if (e.step == esp1::LIGHT_YELLOW || e.step == esp1::LIGHT_RED)
+            {
+                timerMax = std::max(timerMax, e.actualUs - e.plannedUs);
+                timerSumme += e.actualUs - e.plannedUs;
+                timerN++;
+            }
+        }
+
+        seq.start(esp_timer_get_time());
+        esp_timer_stop(seq.yellowTimer);
+        esp_timer_stop(seq.redTimer);
+        while (seq.pending <= esp1::LIGHT_RED)
+        {
+            sim::advance(esp1::LOOP_DELAY_MS * 1000 + 1000 + (uint64_t)(n.rng.uniform() * 24000));
+            seq.poll();
+        }
+        for (const esp1::LightEvent &e : abholen())
+        {
+            if (e.step == esp1::LIGHT_YELLOW || e.step == esp1::LIGHT_RED)
+            {
+                loopMax = std::max(loopMax, e.actualUs - e.plannedUs);
+                loopSumme += e.actualUs - e.plannedUs;
+                loopN++;
+            }
+        }
+        seq.cancel();
+    }
+    REQUIRE(timerN == 400 && loopN == 400);
+    pruefung::bericht("Timer: Abweichung im Mittel", (double)timerSumme / timerN, "us");
+    pruefung::bericht("Timer: Abweichung schlechteste", timerMax, "us");
+    pruefung::bericht("Loop: Abweichung im Mittel", (double)loopSumme / loopN, "us");
+    pruefung::bericht("Loop: Abweichung schlechteste", loopMax, "us");
+    CHECK_LT(timerMax, 100);
+    CHECK_GT(loopSumme / loopN, 5000);
+}
+
+// Fünf Läufe mit Server und Client (Messung, Statuszeile, Heartbeats): Gelb und Rot bleiben auf dem Soll
+TEST(abweichung_im_betrieb)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+    uint64_t ab = sim::driverNow();
+    for (int i = 0; i < 5; i++)
+    {
+        REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+        double t = sekunden(sim::driverNow());
+        a.start.durchgang(t + 0.5, 3.0);
+        a.ziel.durchgang(t + 6.0, 0.5);
+        sim::runFor(us(7));
+    }
+    long schlechteste = 0;
+    int n = 0;
+    for (const sim::LogLine &l : a.server.console)
+    {
+        if (l.at < ab || (l.text.find("ESP1: Gelb AN") != 0 && l.text.find("ESP1: Rot AN") != 0))
+        {
+            continue;
+        }
+        size_t pos = l.text.find("ms (");
+        REQUIRE(pos != std::string::npos);
+        schlechteste = std::max(schlechteste, atol(l.text.c_str() + pos + 4));
+        n++;
+    }
+    pruefung::bericht("Gelb/Rot geschaltet", n, "");
+    pruefung::bericht("Abweichung schlechteste", schlechteste, "us");
+    CHECK_EQ(n, 10);
+    CHECK_LT(schlechteste, 1000);
+}
@@ -0,0 +1,130 @@
+// Aufbau - Gemeinsamer Versuchsaufbau für die Tests mit beiden Sketches
+// Server (ESP1) und Client (ESP2) laufen in eigenen Namensräumen, jede Schranke sieht einen
+// vorgegebenen Abstandsverlauf (Bahn). Die Anlage wird nie zerstört: die Knoten-Threads laufen,
+// bis der Testprozess endet.
+
+#pragma once
+
+#include "Sketche.h"
+
+namespace esp1
+{
+#include "../ESP32-Server.cpp"
+}
+
+namespace esp2
+{
+#include "../ESP32-Client.cpp"
+}
+
+#include "Testrahmen.h"
+
+#include <functional>
+#include <vector>
+
+// Abstandsverlauf an einer Schranke: leere Bahn bis zur Wand, dazwischen Durchgänge
+struct Bahn
+{
+    struct Durchgang
+    {
+        double von;
+        double bis;
+        float cm;
+    };
+
+    float leerCm = 150.0f;
+    std::vector<Durchgang> durchgaenge;
+    std::function<float(double)> verlauf;   // Ersetzt Wand und Durchgänge, wenn gesetzt
+
+    Bahn &durchgang(double von, double dauer, float cm = 60.0f)
+    {
+        durchgaenge.push_back(Durchgang{von, von + dauer, cm});
+        return *this;
+    }
+
+    float operator()(double t) const
+    {
+        if (verlauf)
+        {
+            return verlauf(t);
+        }
+        for (const Durchgang &d : durchgaenge)
+        {
+            if (t >= d.von && t < d.bis)
+            {
+                return d.cm;
+            }
+        }
+        return leerCm;
+    }
+};
+
+inline double sekunden(uint64_t us) { return us / 1e6; }
+inline uint64_t us(double sekunden) { return (uint64_t)(sekunden * 1e6); }
+
+struct Anlage
+{
+    sim::Node server;
+    sim::Node client;
+    Bahn start;                              // Schranke 1 am Server
+    Bahn ziel;                               // Schranke 2 am Client
+    std::vector<sim::Sensor *> startSensoren;
+    sim::Sensor *zielSensor;
+
+    static Anlage &neu(uint64_t seed = 1) { return *new Anlage(seed); }
+
+    // Bis cond() gilt oder maxUs vergangen sind, true = cond() erfüllt
+    static bool warte(const std::function<bool()> &cond, uint64_t maxUs, uint64_t schrittUs = 1000)
+    {
+        uint64_t ende = sim::driverNow() + maxUs;
+        while (!cond())
+        {
+            if (sim::driverNow() >= ende)
+            {
+                return false;
+            }
+            sim::runFor(schrittUs);
+        }
+        return true;
+    }
+
+    void starteServer()
+    {
+        sim::start(server);
+    }
+
+    void starteClient()
+    {
+        sim::start(client);
+    }
+
+    bool serverBereit(uint64_t maxUs = us(15))
+    {
+        return warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, maxUs);
+    }
+
+    bool clientBereit(uint64_t maxUs = us(20))
+    {
+        return warte([] { return esp2::clientState == esp2::IDLE_WAITING_FOR_START && esp1::clientReady; },
+                     maxUs);
+    }
+
+private:
+    explicit Anlage(uint64_t seed) : server("ESP1", 1, seed), client("ESP2", 2, seed)
+    {
+        server.setupFn = esp1::setup;
+        server.loopFn = esp1::loop;
+        client.setupFn = esp2::setup;
+        client.loopFn = esp2::loop;
+
+        static const uint8_t trig[] = {5, 32, 33};
+        static const uint8_t echo[] = {18, 34, 35};
+        for (int i = 0; i < SENSOR_COUNT; i++)
+        {
+            startSensoren.push_back(&server.addSensor(trig[i], echo[i], [this](double t) { return start(t); }));
+        }
+        zielSensor = &client.addSensor(12, 14, [this](double t) { return ziel(t); });
+
+        client.i2cDevices.insert(0x3F);      // LCD am PCF8574A
+    }
+};
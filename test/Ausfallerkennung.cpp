@@ -0,0 +1,121 @@
+// Ausfallerkennung - Phi-Accrual-Detektor beider Knoten auf gesunden, verlustbehafteten und
+// toten Verbindungen: Anlauf nach CLIENT_READY, Fehlalarme, Erkennungszeit
+
+#include "Aufbau.h"
+
+static bool verbunden(Anlage &a)
+{
+    return a.clientBereit();
+}
+
+// Anlauf: Kalibrierung und Display nach dem Verbindungsaufbau dürfen nicht als Ausfall zählen
+TEST(anlauf_nach_client_ready)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(verbunden(a));
+
+    uint64_t ab = sim::driverNow();
+    sim::runFor(us(60));
+    CHECK_EQ(a.server.countLog("Client bereit"), 1);
+    CHECK_EQ(a.server.countLog("Verbindung verdächtig", ab), 0);
+    CHECK_EQ(a.client.countLog("Verbindung verdächtig", ab), 0);
+    CHECK(esp1::linkMonitor.started);
+    CHECK(esp2::linkMonitor.started);
+    pruefung::bericht("Server: mittlerer Heartbeat-Abstand", esp1::linkMonitor.meanIntervalMs, "ms");
+    pruefung::bericht("Client: RTT", esp2::linkMonitor.srttMs, "ms");
+}
+
+// Client meldet sich und verstummt sofort: die Anlauffrist begrenzt die Wartezeit
+TEST(stiller_client_nach_anlauffrist)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(Anlage::warte([] { return esp1::clientReady; }, us(20), 100));
+    uint64_t bereit = sim::driverNow();
+    sim::world().nodeLink.blackhole = true;
+
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("Verbindung verdächtig", bereit) != nullptr; }, us(5)));
+    uint64_t erkannt = a.server.findLog("Verbindung verdächtig", bereit)->at - bereit;
+    pruefung::bericht("Erkannt nach CLIENT_READY ohne Heartbeat", erkannt / 1000.0, "ms");
+    CHECK_LE(erkannt, (LINK_STARTUP_GRACE_MS + 100) * 1000);   // Plus ein Loop-Durchlauf
+    CHECK_GE(erkannt, LINK_STARTUP_GRACE_MS * 1000);
+}
+
+// Fehlalarme pro Stunde auf einer schwankenden Strecke, lossRate = Anteil wiederholter Segmente
+static int fehlalarme(double lossRate, double minuten)
+{
+    Anlage &a = Anlage::neu();
+    sim::Link &link = sim::world().nodeLink;
+    link.jitterUs = 3000;
+    link.lossRate = lossRate;
+    link.rtoUs = 200000;
+    link.stallRate = 0.02;               // WLAN-Hänger durch Interferenz
+    link.stallMeanUs = 40000;
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(verbunden(a));
+
+    uint64_t ab = sim::driverNow();
+    sim::runFor(us(minuten * 60));
+    int server = a.server.countLog("Verbindung verdächtig", ab);
+    int client = a.client.countLog("Verbindung verdächtig", ab);
+    pruefung::bericht("Fehlalarme Server pro Stunde", server * 60 / minuten, "");
+    pruefung::bericht("Fehlalarme Client pro Stunde", client * 60 / minuten, "");
+    pruefung::bericht("Client: RTT", esp2::linkMonitor.srttMs, "ms");
+    pruefung::bericht("Client: RTT-Jitter", esp2::linkMonitor.rttVarMs, "ms");
+    return server + client;
+}
+
+// Jitter und kurze Hänger ohne Verluste
+TEST(fehlalarme_bei_jitter)
+{
+    CHECK_LE(fehlalarme(0.0, 30), 1);
+}
+
+// 1% der Segmente gehen verloren und kommen erst nach der TCP-Wiederholung (200ms), die
+// erwartete Pause deckt eine Wiederholung ab, erst eine zweite (400ms) kann Alarm auslösen
+TEST(fehlalarme_bei_verlusten)
+{
+    CHECK_LE(fehlalarme(0.01, 30), 5);
+}
+
+// Stiller Verbindungsverlust auf gesunder Strecke: beide Seiten erkennen ihn in unter einer Sekunde
+TEST(erkennung_unter_einer_sekunde)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(verbunden(a));
+
+    const int versuche = 10;
+    double summe = 0, schlechteste = 0;
+    for (int i = 0; i < versuche; i++)
+    {
+        // Zufälliger Abstand zum letzten Heartbeat
+        sim::runFor(us(20) + (uint64_t)(a.server.rng.uniform() * 200000));
+        uint64_t tot = sim::driverNow();
+        sim::world().nodeLink.blackhole = true;
+        REQUIRE(Anlage::warte([&] { return a.server.findLog("Verbindung verdächtig", tot) &&
+                                           a.client.findLog("Verbindung verdächtig", tot); },
+                              us(5)));
+        for (const sim::LogLine *l : {a.server.findLog("Verbindung verdächtig", tot),
+                                      a.client.findLog("Verbindung verdächtig", tot)})
+        {
+            double ms = (l->at - tot) / 1000.0;
+            summe += ms;
+            schlechteste = std::max(schlechteste, ms);
+        }
+        sim::world().nodeLink.blackhole = false;
+        REQUIRE(verbunden(a));
+    }
+    pruefung::bericht("Erkennungszeit im Mittel", summe / (2 * versuche), "ms");
+    pruefung::bericht("Erkennungszeit schlechteste", schlechteste, "ms");
+    CHECK_LT(schlechteste, 1000.0);
+}
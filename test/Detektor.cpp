@@ -0,0 +1,159 @@
+// Detektor - CUSUM gegen festen Schwellwert auf verrauschten Messreihen
+// Die Detektoren laufen direkt auf erzeugten Abständen: freie Strecke 150cm mit σ = 15cm, dazu
+// vereinzelte Fehl-Echos. Gezählt werden Fehlalarme, beim Eintritt die Messwerte bis zur
+// Bestätigung und der Fehler der geschätzten Änderungszeit.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+static const float REFERENZ_CM = 150.0f;
+static const float SIGMA_CM = 15.0f;
+static const float OBJEKT_CM = 60.0f;
+static const double FEHLECHO_RATE = 4e-4;   // Kurzes Echo von einem Nachbarobjekt, ~alle 3 min
+static const unsigned long RASTER_MS = 80;  // Abstand der Messwerte bei 12Hz
+
+static CusumDetector cusum()
+{
+    return CusumDetector(esp1::DETECTOR_FALSE_ALARM_RATE, esp1::DETECTOR_MIN_SAMPLES,
+                         esp1::DETECTOR_MIN_SIGMA_CM);
+}
+
+static float messwert(sim::Rng &rng, float mittelCm)
+{
+    if (rng.uniform() < FEHLECHO_RATE)
+    {
+        return 20.0f + (float)(rng.uniform() * 80.0);
+    }
+    return mittelCm + (float)(rng.gauss() * SIGMA_CM);
+}
+
+// Freie Strecke: jeder Wechsel auf belegt ist ein Fehlalarm, danach beginnt der Detektor frei
+static int fehlalarme(CrossingDetector &d, int messwerte, uint64_t seed)
+{
+    sim::Rng rng(seed);
+    d.configure(REFERENZ_CM, SIGMA_CM);
+    int n = 0;
+    for (int i = 0; i < messwerte; i++)
+    {
+        if (d.update(messwert(rng, REFERENZ_CM), i * RASTER_MS) && d.occupied())
+        {
+            n++;
+            d.reset(false);
+        }
+    }
+    return n;
+}
+
+TEST(fehlalarme_bei_rauschen)
+{
+    const int messwerte = 200000;
+    CusumDetector c = cusum();
+    ThresholdDetector s(esp1::HYSTERESIS_FACTOR);
+    int fehlCusum = fehlalarme(c, messwerte, 37);
+    int fehlSchwelle = fehlalarme(s, messwerte, 37);
+    pruefung::bericht("Fehlalarme CUSUM in 200000 Messwerten", fehlCusum, "");
+    pruefung::bericht("Fehlalarme Schwellwert in 200000 Messwerten", fehlSchwelle, "");
+    CHECK_LT(fehlCusum * 10, fehlSchwelle);
+    // Schwelle h = ln(1/alpha): höchstens ein Fehlalarm pro 1/alpha Messwerte
+    CHECK_LE(fehlCusum, messwerte * esp1::DETECTOR_FALSE_ALARM_RATE);
+}
+
+// Eintritt nach 50 freien Messwerten: Messwerte bis zur Bestätigung, Fehler der Änderungszeit
+TEST(bestaetigung_beim_eintritt)
+{
+    const int versuche = 5000;
+    const int vorlauf = 50;
+    sim::Rng rng(41);
+    CusumDetector c = cusum();
+    long messungen = 0, zeitfehlerMs = 0;
+    int verpasst = 0, schlechteste = 0;
+    for (int v = 0; v < versuche; v++)
+    {
+        c.configure(REFERENZ_CM, SIGMA_CM);
+        int i = 0;
+        bool erkannt = false;
+        for (; i < vorlauf + 20 && !erkannt; i++)
+        {
+            float mittel = i < vorlauf ? REFERENZ_CM : OBJEKT_CM;
+            erkannt = c.update(messwert(rng, mittel), i * RASTER_MS) && c.occupied();
+        }
+        if (!erkannt || i <= vorlauf)
+        {
+            verpasst++;
+            continue;
+        }
+        int bis = i - vorlauf;          // Messwerte im Objekt bis einschließlich der Bestätigung
+        messungen += bis;
+        schlechteste = std::max(schlechteste, bis);
+        zeitfehlerMs += labs((long)c.changeTime() - (long)(vorlauf * RASTER_MS));
+    }
+    int erkannt = versuche - verpasst;
+    double mittel = (double)messungen / erkannt;
+    pruefung::bericht("Eintritte erkannt", erkannt, "");
+    pruefung::bericht("Messwerte bis zur Bestätigung im Mittel", mittel, "");
+    pruefung::bericht("Zusätzlich gegenüber dem Schwellwert", mittel - 1.0, "");
+    pruefung::bericht("Messwerte bis zur Bestätigung schlechteste", schlechteste, "");
+    pruefung::bericht("Fehler der Änderungszeit im Mittel", (double)zeitfehlerMs / erkannt, "ms");
+    CHECK_EQ(verpasst, 0);
+    // Objekt nur 1σ unter der Grenze Referenz/2: der Schwellwert verpasst es in 16% der Messwerte
+    CHECK_LT(mittel - 1.0, 3.0);
+    // Gestoppt wird am Beginn der Änderung: im Mittel unter einem Raster daneben
+    CHECK_LT((double)zeitfehlerMs / erkannt, (double)RASTER_MS);
+}
+
+// Objekt ruhig bei 60-70% der Referenz (σ = 2cm): liegt über der Grenze Referenz/2 und löst wie beim
+// Schwellwert nie aus. Knapp darunter bestätigt der Detektor nach zwei Messwerten
+TEST(grenze_bei_halber_referenz)
+{
+    sim::Rng rng(42);
+    const float sigma = 2.0f;
+    int ausgeloest = 0;
+    for (float anteil : {0.60f, 0.65f, 0.70f})
+    {
+        CusumDetector c = cusum();
+        c.configure(REFERENZ_CM, sigma);
+        for (int i = 0; i < 20000; i++)
+        {
+            ausgeloest += c.update(REFERENZ_CM * anteil + (float)(rng.gauss() * sigma), i * RASTER_MS);
+        }
+    }
+    pruefung::bericht("Auslösungen bei 60-70% der Referenz", ausgeloest, "");
+    CHECK_EQ(ausgeloest, 0);
+
+    CusumDetector c = cusum();
+    c.configure(REFERENZ_CM, sigma);
+    float knapp = REFERENZ_CM * 0.45f;
+    CHECK(!c.update(knapp, 0));
+    CHECK(c.update(knapp, RASTER_MS));
+}
+
+// Ein Objekt in der Schranke während der Kalibrierung: das Rauschen bleibt beim Sensorrauschen,
+// der Detektor bestätigt den nächsten Eintritt weiter nach zwei Messwerten
+TEST(kalibrierung_mit_durchgang)
+{
+    sim::Rng rng(43);
+    float proben[esp1::REFERENCE_SAMPLES];
+    float summe = 0, quadrate = 0;
+    for (int i = 0; i < esp1::REFERENCE_SAMPLES; i++)
+    {
+        proben[i] = i >= 6 && i < 10 ? OBJEKT_CM : REFERENZ_CM + (float)(rng.gauss() * 0.5);
+        summe += proben[i];
+        quadrate += proben[i] * proben[i];
+    }
+    float mittel = summe / esp1::REFERENCE_SAMPLES;
+    float standardabweichung = sqrtf(quadrate / esp1::REFERENCE_SAMPLES - mittel * mittel);
+    float sigma = max(robustNoiseSigma(proben, esp1::REFERENCE_SAMPLES), esp1::DETECTOR_MIN_SIGMA_CM);
+    pruefung::bericht("Standardabweichung", standardabweichung, "cm");
+    pruefung::bericht("Robustes Rauschen (MAD)", sigma, "cm");
+    CHECK_GT(standardabweichung, 30.0f);
+    CHECK_LT(sigma, 2.0f);
+
+    CusumDetector c = cusum();
+    c.configure(mittel, sigma);
+    CHECK(!c.update(OBJEKT_CM, 0));
+    CHECK(c.update(OBJEKT_CM, RASTER_MS));
+    CHECK(c.occupied());
+}
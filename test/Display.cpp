@@ -0,0 +1,113 @@
+// Display - Start des Clients mit und ohne gespeicherte LCD-Adresse
+// Der I2C-Bus ist simuliert: Geräte antworten nur unter ihren Adressen in i2cDevices, jede
+// Transaktion kostet ihre Übertragungszeit. Die WLAN-Assoziation läuft parallel zum Display.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+static const char *NVS_BEREICH = "lichtschranke";
+
+static void merkeAdresse(Anlage &a, uint8_t adresse)
+{
+    a.client.nvs[NVS_BEREICH]["lcdAddr"] = {'C', adresse};
+}
+
+static int gemerkteAdresse(Anlage &a)
+{
+    const std::vector<uint8_t> &v = a.client.nvs[NVS_BEREICH]["lcdAddr"];
+    return v.size() == 2 && v[0] == 'C' ? v[1] : 0;
+}
+
+// Wert einer Boot-Phase aus "ESP2: Boot-Phasen - Display: <ms>ms (...), Setup: <ms>ms, ..."
+static double phaseMs(Anlage &a, const char *phase)
+{
+    const sim::LogLine *l = a.client.findLog("ESP2: Boot-Phasen");
+    REQUIRE(l != nullptr);
+    size_t pos = l->text.find(std::string(phase) + ": ");
+    REQUIRE(pos != std::string::npos);
+    return atof(l->text.c_str() + pos + strlen(phase) + 2);
+}
+
+// Startet beide Knoten, Rückgabe: I2C-Transaktionen bis das Display bereit war
+static uint64_t starte(Anlage &a)
+{
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(Anlage::warte([&a] { return a.client.findLog("ESP2: Client Setup gestartet") != nullptr; }, us(10), 200));
+    uint64_t transaktionen = a.client.i2cTransactions;
+    REQUIRE(a.clientBereit());
+    REQUIRE(Anlage::warte([&a] { return a.client.findLog("ESP2: Boot-Phasen") != nullptr; }, us(2)));
+    return transaktionen;
+}
+
+// Erster Start: voller Busscan, die gefundene Adresse wird gespeichert
+TEST(erster_start_scannt_und_merkt)
+{
+    Anlage &a = Anlage::neu();
+    uint64_t transaktionen = starte(a);
+
+    CHECK(a.client.findLog("ms (Scan)") != nullptr);
+    CHECK_EQ(gemerkteAdresse(a), 0x3F);
+    CHECK(a.client.lcdText().find("Bereit!") != std::string::npos);
+    pruefung::bericht("Scan: Display bereit nach", phaseMs(a, "Display"), "ms");
+    pruefung::bericht("Scan: Setup fertig nach", phaseMs(a, "Setup"), "ms");
+    pruefung::bericht("Scan: I2C-Transaktionen bis Display bereit", transaktionen, "");
+}
+
+// Gespeicherte Adresse: keine Suche, kein Begrüßungsbildschirm
+TEST(gemerkte_adresse_ohne_scan)
+{
+    Anlage &a = Anlage::neu();
+    merkeAdresse(a, 0x3F);
+    uint64_t transaktionen = starte(a);
+
+    CHECK(a.client.findLog("ms (Cache)") != nullptr);
+    CHECK(a.client.findLog("I2C-Scan") == nullptr);
+    CHECK(a.client.lcdText().find("Bereit!") != std::string::npos);
+    pruefung::bericht("Cache: Display bereit nach", phaseMs(a, "Display"), "ms");
+    pruefung::bericht("Cache: Setup fertig nach", phaseMs(a, "Setup"), "ms");
+    pruefung::bericht("Cache: I2C-Transaktionen bis Display bereit", transaktionen, "");
+    pruefung::bericht("Cache: WLAN verbunden nach", phaseMs(a, "WLAN"), "ms");
+    CHECK_LT(phaseMs(a, "Display"), 500.0);
+    CHECK_LT(transaktionen, 126u);                  // Weniger als ein einziger Scan
+}
+
+// Display getauscht: die alte Adresse antwortet nicht, Scan findet die neue und merkt sie
+TEST(veraltete_adresse_wird_ersetzt)
+{
+    Anlage &a = Anlage::neu();
+    merkeAdresse(a, 0x27);
+    starte(a);
+
+    CHECK(a.client.findLog("Gespeicherte Display-Adresse antwortet nicht") != nullptr);
+    CHECK(a.client.findLog("ms (Scan)") != nullptr);
+    CHECK_EQ(gemerkteAdresse(a), 0x3F);
+}
+
+// Kein Display am Bus: Ausgabe nur auf Serial, es wird nichts gespeichert
+TEST(ohne_display)
+{
+    Anlage &a = Anlage::neu();
+    a.client.i2cDevices.clear();
+    starte(a);
+
+    CHECK(a.client.findLog("Kein 5V-Display gefunden") != nullptr);
+    CHECK_EQ(gemerkteAdresse(a), 0);
+}
+
+// Die Assoziation beginnt vor dem Display und ist mit dem Ende von setup() abgeschlossen
+TEST(wlan_parallel_zum_display)
+{
+    Anlage &a = Anlage::neu();
+    starte(a);
+
+    double setup = phaseMs(a, "Setup");
+    double wlan = phaseMs(a, "WLAN");
+    pruefung::bericht("WLAN verbunden nach", wlan, "ms");
+    pruefung::bericht("Mit Server verbunden nach", phaseMs(a, "Server"), "ms");
+    CHECK_GT(wlan, 0.0);
+    // Nacheinander wären es Setup plus die ganze Assoziation
+    CHECK_LT(wlan, setup + sim::WIFI_ASSOC_US / 1000.0);
+}
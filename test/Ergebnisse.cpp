@@ -0,0 +1,274 @@
+// Ergebnisse - Ergebnisspeicher mit Startnummern, Sessions und Top-10-Listen
+// Zehntausende Läufe gegen eine Referenz, die jede Frage durch einen vollständigen Scan beantwortet.
+// Gemessen werden Einfügen und Abfragen auf dem Host, dazu der Neuaufbau aus dem Protokoll.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+typedef std::chrono::steady_clock Uhr;
+
+static double nsSeit(Uhr::time_point t0, int anzahl)
+{
+    return std::chrono::duration<double, std::nano>(Uhr::now() - t0).count() / anzahl;
+}
+
+struct Lauf
+{
+    uint32_t seq;
+    uint32_t timeMs;
+    uint16_t bib;
+    uint16_t session;
+};
+
+// Wettkampftage mit 200 Startnummern (ein Teil ohne Nummer), Zeiten 2-30s, 4000 Läufe pro Session
+static std::vector<Lauf> laeufe(sim::Node &n, int anzahl)
+{
+    std::vector<Lauf> v;
+    for (int i = 0; i < anzahl; i++)
+    {
+        Lauf l;
+        l.seq = i + 1;
+        l.timeMs = 2000 + (uint32_t)(n.rng.uniform() * 28000);
+        l.bib = n.rng.uniform() < 0.1 ? 0 : 1 + (uint16_t)(n.rng.uniform() * 200);
+        l.session = 1 + i / 4000;
+        v.push_back(l);
+    }
+    return v;
+}
+
+// Referenz: die besten zehn per Scan, gleiche Zeit -> früherer Lauf vorn
+static std::vector<uint32_t> top10(const std::vector<Lauf> &v, int session)
+{
+    std::vector<Lauf> passend;
+    for (const Lauf &l : v)
+    {
+        if (session < 0 || l.session == session)
+        {
+            passend.push_back(l);
+        }
+    }
+    std::sort(passend.begin(), passend.end(), [](const Lauf &a, const Lauf &b) {
+        return a.timeMs < b.timeMs || (a.timeMs == b.timeMs && a.seq < b.seq);
+    });
+    std::vector<uint32_t> seqs;
+    for (size_t i = 0; i < passend.size() && i < (size_t)esp1::LEADERBOARD_SIZE; i++)
+    {
+        seqs.push_back(passend[i].seq);
+    }
+    return seqs;
+}
+
+static std::vector<uint32_t> rangliste(const esp1::Leaderboard &board)
+{
+    esp1::LeaderEntry sortiert[esp1::LEADERBOARD_SIZE];
+    int n = board.sorted(sortiert);
+    std::vector<uint32_t> seqs;
+    for (int i = 0; i < n; i++)
+    {
+        seqs.push_back(sortiert[i].seq);
+    }
+    return seqs;
+}
+
+// 20000 Läufe: Bestenlisten, Bestzeiten und Laufketten stimmen mit dem vollständigen Scan überein
+TEST(indizes_gegen_vollstaendigen_scan)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    std::vector<Lauf> v = laeufe(n, 20000);
+    for (const Lauf &l : v)
+    {
+        esp1::resultsStore.add(l.timeMs, l.bib, l.session);
+    }
+    esp1::ResultsStore &s = esp1::resultsStore;
+    CHECK_EQ(s.lastSeq, 20000u);
+    CHECK(rangliste(s.overall) == top10(v, -1));
+    for (int session = 1; session <= 5; session++)
+    {
+        esp1::SessionIndex *idx = s.findSession(session, false);
+        REQUIRE(idx != nullptr);
+        CHECK_EQ(idx->runs, 4000);
+        CHECK(rangliste(idx->board) == top10(v, session));
+    }
+
+    std::map<uint16_t, const Lauf *> beste;
+    std::map<uint16_t, std::vector<uint32_t>> kette;
+    for (const Lauf &l : v)
+    {
+        if (l.bib == 0)
+        {
+            continue;
+        }
+        if (!beste[l.bib] || l.timeMs < beste[l.bib]->timeMs)
+        {
+            beste[l.bib] = &l;
+        }
+        kette[l.bib].push_back(l.seq);
+    }
+    for (const auto &b : beste)
+    {
+        esp1::AthleteIndex *a = s.findAthlete(b.first, false);
+        REQUIRE(a != nullptr);
+        CHECK_EQ(a->bestSeq, b.second->seq);
+        CHECK_EQ(a->runs, kette[b.first].size());
+        // Rückwärts entlang der Kette, solange die Läufe noch im Ring liegen
+        const std::vector<uint32_t> &seqs = kette[b.first];
+        size_t i = seqs.size();
+        for (const esp1::RunRecord *r = s.get(a->headSeq); r; r = s.get(r->prevAthleteSeq))
+        {
+            REQUIRE(i > 0);
+            CHECK_EQ(r->seq, seqs[--i]);
+        }
+        // Die Kette endet erst, wo der Ring den nächsten Lauf schon überschrieben hat
+        CHECK(i == 0 || seqs[i - 1] <= s.lastSeq - esp1::RESULT_CAPACITY);
+    }
+    CHECK_EQ(s.findAthlete(0, false), (esp1::AthleteIndex *)nullptr);
+    CHECK_EQ(s.unindexedAthleteRuns, 0u);
+    pruefung::bericht("Startnummern im Index", beste.size(), "");
+    pruefung::bericht("RAM des Ergebnisspeichers", sizeof(esp1::ResultsStore), "Byte");
+}
+
+// Mehr Sessions als Plätze: die am längsten unbenutzte wird ersetzt, die laufende bleibt
+TEST(sessions_lru)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    esp1::ResultsStore &s = esp1::resultsStore;
+    for (int session = 1; session <= esp1::MAX_SESSIONS + 3; session++)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            s.add(5000 + i, 1, session);
+        }
+        s.add(4000, 2, 1);                  // Session 1 bleibt in Gebrauch
+    }
+    CHECK(s.findSession(1, false) != nullptr);
+    CHECK(s.findSession(esp1::MAX_SESSIONS + 3, false) != nullptr);
+    CHECK(s.findSession(2, false) == nullptr);
+    CHECK(s.findSession(4, false) == nullptr);
+    CHECK_EQ(s.findSession(1, false)->board.size, esp1::LEADERBOARD_SIZE);
+}
+
+// Rechenzeit pro Einfügen und pro Abfrage bei 10k und 100k Läufen, Vergleich mit dem Scan
+TEST(benchmark_einfuegen_und_abfragen)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    for (int anzahl : {10000, 100000})
+    {
+        std::vector<Lauf> v = laeufe(n, anzahl);
+        esp1::resultsStore = esp1::ResultsStore();
+        Uhr::time_point t0 = Uhr::now();
+        for (const Lauf &l : v)
+        {
+            esp1::resultsStore.add(l.timeMs, l.bib, l.session);
+        }
+        double nsEinfuegen = nsSeit(t0, anzahl);
+
+        const int abfragen = 20000;
+        uint64_t summe = 0;
+        esp1::LeaderEntry sortiert[esp1::LEADERBOARD_SIZE];
+        t0 = Uhr::now();
+        for (int i = 0; i < abfragen; i++)
+        {
+            esp1::SessionIndex *s = esp1::resultsStore.findSession(1 + i % (anzahl / 4000), false);
+            summe += s ? s->board.sorted(sortiert) : 0;
+            esp1::AthleteIndex *a = esp1::resultsStore.findAthlete(1 + i % 200, false);
+            summe += a ? a->bestMs : 0;
+        }
+        double nsAbfrage = nsSeit(t0, abfragen);
+
+        t0 = Uhr::now();
+        const int scans = 20;
+        for (int i = 0; i < scans; i++)
+        {
+            summe += top10(v, 1 + i % 5).size();
+        }
+        double nsScan = nsSeit(t0, scans);
+        CHECK_GT(summe, 0u);
+
+        std::string was = std::to_string(anzahl) + " Läufe: Einfügen";
+        pruefung::bericht(was.c_str(), nsEinfuegen, "ns");
+        was = std::to_string(anzahl) + " Läufe: Top 10 + Bestzeit";
+        pruefung::bericht(was.c_str(), nsAbfrage, "ns");
+        was = std::to_string(anzahl) + " Läufe: Top 10 per Scan";
+        pruefung::bericht(was.c_str(), nsScan / 1000.0, "us");
+        CHECK_LT(nsEinfuegen, 2000.0);
+        CHECK_LT(nsAbfrage * 100, nsScan);
+    }
+}
+
+static std::string lade(Anlage &a, const std::string &pfad)
+{
+    sim::Peer p = sim::connectPeer(a.server, esp1::LIVE_PORT);
+    REQUIRE(p.ok());
+    p.write("GET " + pfad + " HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n");
+    REQUIRE(Anlage::warte([&] { return p.closedByNode(); }, us(5)));
+    std::string antwort = p.received();
+    size_t pos = antwort.find("\r\n\r\n");
+    REQUIRE(pos != std::string::npos);
+    return antwort.substr(pos + 4);
+}
+
+// Neuaufbau aus einem Protokoll mit 10000 Läufen, danach Abfragen über Port 81
+TEST(aufbau_aus_protokoll_und_abfrage)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    std::vector<Lauf> v = laeufe(a.server, 10000);
+    double ms;
+    {
+        sim::As als(a.server);
+        for (Lauf &l : v)
+        {
+            esp1::LogEntry e;
+            e.seq = esp1::measurementLog.nextSeq;
+            l.seq = e.seq;
+            e.t = l.seq * 30000;
+            e.timeMs = l.timeMs;
+            e.clientOk = true;
+            e.reference = 150.0f;
+            e.bib = l.bib;
+            e.session = l.session;
+            REQUIRE(esp1::measurementLog.append(e));
+        }
+        esp1::measurementLog.flush();
+        esp1::resultsStore = esp1::ResultsStore();
+        Uhr::time_point t0 = Uhr::now();
+        esp1::loadResultsFromLog();
+        ms = nsSeit(t0, 1) / 1e6;
+    }
+    pruefung::bericht("Neuaufbau aus 10000 Läufen (Host)", ms, "ms");
+    CHECK_EQ(esp1::resultsStore.lastSeq, v.back().seq);
+
+    std::string gesamt = lade(a, "/leaderboard");
+    std::vector<uint32_t> erwartet = top10(v, -1);
+    size_t pos = 0;
+    for (uint32_t seq : erwartet)
+    {
+        pos = gesamt.find("\"seq\":" + std::to_string(seq) + ",", pos);
+        CHECK(pos != std::string::npos);
+    }
+    CHECK(gesamt.find("\"runs\":10000") != std::string::npos);
+
+    std::string session = lade(a, "/leaderboard?session=2");
+    CHECK(session.find("\"runs\":4000") != std::string::npos);
+    CHECK(session.find("\"seq\":" + std::to_string(top10(v, 2)[0]) + ",") != std::string::npos);
+
+    std::string athlet = lade(a, "/athlete?bib=17");
+    uint32_t besteZeit = UINT32_MAX;
+    for (const Lauf &l : v)
+    {
+        if (l.bib == 17)
+        {
+            besteZeit = std::min(besteZeit, l.timeMs);
+        }
+    }
+    CHECK(athlet.find("\"best_ms\":" + std::to_string(besteZeit) + ",") != std::string::npos);
+}
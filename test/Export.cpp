@@ -0,0 +1,278 @@
+// Export - Download der Messhistorie über Port 81 bei vollem Messprotokoll
+// Das Protokoll wird bis LOG_MAX_BLOCKS gefüllt (so groß wird es vor der Rotation beim nächsten
+// Start). Gemessen werden Durchsatz, Loop-Dauer während des Downloads und die Heap-Nutzung der
+// Export-Pfade.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <new>
+
+// Heap-Anforderungen zählen, nur solange der eigene Thread es einschaltet
+static thread_local bool zaehleHeap = false;
+static size_t heapAnforderungen = 0;
+static size_t heapBytes = 0;
+
+void *operator new(size_t n)
+{
+    if (zaehleHeap)
+    {
+        heapAnforderungen++;
+        heapBytes += n;
+    }
+    void *p = malloc(n);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// Nicht inline: sonst sieht GCC an der Aufrufstelle new und free beieinander und warnt
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+// Läufe über einen langen Wettkampftag: Zeiten 2-30s, 200 Startnummern, 4 Sessions
+// Ohne bisSeq bis das Protokoll voll ist
+static uint32_t fuelleProtokoll(sim::Node &n, uint32_t bisSeq = UINT32_MAX)
+{
+    sim::As als(n);
+    uint32_t t = 600000;
+    for (uint32_t seq = esp1::measurementLog.nextSeq; seq <= bisSeq; seq++)
+    {
+        esp1::LogEntry e;
+        e.seq = seq;
+        t += 20000 + n.rng.uniform() * 40000;
+        e.t = t;
+        e.timeMs = 2000 + (uint32_t)(n.rng.uniform() * 28000);
+        e.clientOk = n.rng.uniform() > 0.02;
+        e.reference = 150.0f + (float)(n.rng.uniform() - 0.5);
+        e.bib = 1 + (uint16_t)(n.rng.uniform() * 200);
+        e.session = 1 + seq / 4000;
+        if (!esp1::measurementLog.append(e))
+        {
+            break;
+        }
+    }
+    esp1::measurementLog.flush();
+    esp1::resultsStore.lastSeq = esp1::measurementLog.records();
+    return esp1::measurementLog.records();
+}
+
+static Anlage &volleAnlage()
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    uint32_t datensaetze = fuelleProtokoll(a.server);
+    REQUIRE(esp1::measurementLog.full);
+    pruefung::bericht("Protokoll: Datensätze", datensaetze, "");
+    pruefung::bericht("Protokoll: Größe", a.server.files[esp1::LOG_FILE]->size(), "Byte");
+    return a;
+}
+
+struct Download
+{
+    std::string daten;
+    double dauerMs;
+};
+
+// Eine Anfrage bis zum Verbindungsende, abbrechenNach > 0: nach so vielen Bytes auflegen
+static Download lade(Anlage &a, const std::string &anfrage, size_t abbrechenNach = 0)
+{
+    sim::Peer p = sim::connectPeer(a.server, esp1::LIVE_PORT);
+    REQUIRE(p.ok());
+    uint64_t start = sim::driverNow();
+    p.write(anfrage + "\r\nHost: 192.168.4.1\r\n\r\n");
+    bool fertig = Anlage::warte([&] {
+        if (abbrechenNach > 0 && p.received().size() >= abbrechenNach)
+        {
+            return true;
+        }
+        return p.closedByNode();
+    }, us(300), 5000);
+    REQUIRE(fertig);
+    Download d;
+    d.daten = p.received();
+    d.dauerMs = (sim::driverNow() - start) / 1000.0;
+    if (abbrechenNach > 0)
+    {
+        p.close();
+        d.daten.resize(std::min(d.daten.size(), abbrechenNach));
+    }
+    return d;
+}
+
+static std::string koerper(const std::string &antwort)
+{
+    size_t pos = antwort.find("\r\n\r\n");
+    REQUIRE(pos != std::string::npos);
+    return antwort.substr(pos + 4);
+}
+
+static int zeilen(const std::string &text, const char *muster)
+{
+    int n = 0;
+    for (size_t pos = text.find(muster); pos != std::string::npos; pos = text.find(muster, pos + 1))
+    {
+        n++;
+    }
+    return n;
+}
+
+// Vollständiger JSON-Export: der Loop wird nicht länger als ohne Download
+// (längster Durchlauf samt Schlaf, dominiert von der Statuszeile alle 5s)
+TEST(json_export_volles_protokoll)
+{
+    Anlage &a = volleAnlage();
+    a.server.maxLoopUs = 0;
+    sim::runFor(us(30));
+    uint64_t ohneDownload = a.server.maxLoopUs;
+    a.server.maxLoopUs = 0;
+
+    Download d = lade(a, "GET /export?format=json HTTP/1.1");
+    std::string json = koerper(d.daten);
+    int datensaetze = zeilen(json, "{\"seq\":");
+    pruefung::bericht("JSON: Bytes", json.size(), "Byte");
+    pruefung::bericht("JSON: Dauer", d.dauerMs, "ms");
+    pruefung::bericht("JSON: Durchsatz", json.size() / d.dauerMs, "kB/s");
+    pruefung::bericht("Längster Loop-Durchlauf ohne Download", ohneDownload / 1000.0, "ms");
+    pruefung::bericht("Längster Loop-Durchlauf mit Download", a.server.maxLoopUs / 1000.0, "ms");
+    CHECK_EQ((uint32_t)datensaetze, esp1::measurementLog.records());
+    CHECK(json.compare(0, 2, "[\n") == 0);
+    CHECK(json.compare(json.size() - 3, 3, "\n]\n") == 0);
+    CHECK_LE(a.server.maxLoopUs, ohneDownload + 2000);
+}
+
+// Sequenzbereich mitten im Protokoll: der Blockindex überspringt alles davor
+TEST(csv_sequenzbereich)
+{
+    Anlage &a = volleAnlage();
+    uint64_t ab = sim::driverNow();
+
+    Download d = lade(a, "GET /export?seq_from=6000&seq_to=6099 HTTP/1.1");
+    std::string csv = koerper(d.daten);
+    CHECK_EQ(zeilen(csv, "\n"), 1 + 100);
+    CHECK(csv.find("\n6000,") != std::string::npos);
+    CHECK(csv.find("\n6099,") != std::string::npos);
+    CHECK(csv.find("\n6100,") == std::string::npos);
+    const sim::LogLine *l = a.server.findLog("ESP1: Export fertig", ab);
+    REQUIRE(l != nullptr);
+    pruefung::bericht("Bereich: Dauer", d.dauerMs, "ms");
+    CHECK(l->text.find("100 Datensätze") != std::string::npos);
+}
+
+// Abgebrochener Download der Binärdatei wird per Range fortgesetzt und ist danach vollständig
+TEST(binaerdownload_fortsetzen)
+{
+    Anlage &a = volleAnlage();
+    const std::vector<uint8_t> &datei = *a.server.files[esp1::LOG_FILE];
+
+    Download erster = lade(a, "GET /measurements.bin HTTP/1.1", 60000);
+    std::string teil = koerper(erster.daten);
+    REQUIRE(!teil.empty());
+    sim::runFor(us(1));
+
+    char range[64];
+    snprintf(range, sizeof(range), "\r\nRange: bytes=%u-", (unsigned)teil.size());
+    Download rest = lade(a, std::string("GET /measurements.bin HTTP/1.1") + range);
+    CHECK(rest.daten.compare(0, 15, "HTTP/1.1 206 Pa") == 0);
+    std::string ganz = teil + koerper(rest.daten);
+    pruefung::bericht("Binär: erster Teil", teil.size(), "Byte");
+    pruefung::bericht("Binär: Durchsatz Rest", (ganz.size() - teil.size()) / rest.dauerMs, "kB/s");
+    REQUIRE(ganz.size() == datei.size());
+    CHECK(memcmp(ganz.data(), datei.data(), datei.size()) == 0);
+}
+
+static std::string etag(const std::string &antwort)
+{
+    size_t pos = antwort.find("\r\nETag: ");
+    REQUIRE(pos != std::string::npos);
+    pos += 8;
+    return antwort.substr(pos, antwort.find("\r\n", pos) - pos);
+}
+
+// If-Range: Fortsetzen nur, solange die Datei unverändert ist. Ein neuer Lauf schreibt den letzten
+// Block an seiner Stelle neu, danach kommt die ganze Datei statt eines falsch zusammengesetzten Rests
+TEST(binaerdownload_if_range)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    fuelleProtokoll(a.server, 3000);
+    const std::vector<uint8_t> &datei = *a.server.files[esp1::LOG_FILE];
+
+    Download erster = lade(a, "GET /measurements.bin HTTP/1.1", 20000);
+    std::string kennung = etag(erster.daten);
+    std::string teil = koerper(erster.daten);
+    REQUIRE(!teil.empty());
+    sim::runFor(us(1));
+
+    char range[64];
+    snprintf(range, sizeof(range), "\r\nRange: bytes=%u-", (unsigned)teil.size());
+    Download rest = lade(a, std::string("GET /measurements.bin HTTP/1.1") + range + "\r\nIf-Range: " + kennung);
+    CHECK(rest.daten.compare(0, 15, "HTTP/1.1 206 Pa") == 0);
+    CHECK(etag(rest.daten) == kennung);
+    std::string ganz = teil + koerper(rest.daten);
+    REQUIRE(ganz.size() == datei.size());
+    CHECK(memcmp(ganz.data(), datei.data(), datei.size()) == 0);
+
+    // Ein weiterer Lauf ändert den letzten Block, die Größe bleibt gleich
+    size_t vorher = datei.size();
+    fuelleProtokoll(a.server, esp1::measurementLog.nextSeq);
+    REQUIRE(datei.size() == vorher);
+    Download neu = lade(a, std::string("GET /measurements.bin HTTP/1.1") + range + "\r\nIf-Range: " + kennung);
+    CHECK(neu.daten.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(etag(neu.daten) != kennung);
+    std::string inhalt = koerper(neu.daten);
+    REQUIRE(inhalt.size() == datei.size());
+    CHECK(memcmp(inhalt.data(), datei.data(), datei.size()) == 0);
+
+    // Ohne If-Range bleibt es beim Teil-Download wie bisher
+    Download ohne = lade(a, std::string("GET /measurements.bin HTTP/1.1") + range);
+    CHECK(ohne.daten.compare(0, 15, "HTTP/1.1 206 Pa") == 0);
+}
+
+// Der Export läuft vollständig ohne Heap: ein Block und ein Sendepuffer pro Download, statisch
+TEST(export_ohne_heap)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    {
+        sim::As als(n);
+        REQUIRE(SPIFFS.begin(true));
+        esp1::measurementLog.begin();
+    }
+    fuelleProtokoll(n);
+    sim::As als(n);
+
+    for (const char *anfrage : {"GET /export?format=json HTTP/1.1", "GET /export HTTP/1.1"})
+    {
+        esp1::LiveSubscriber sub;
+        snprintf(sub.requestLine, sizeof(sub.requestLine), "%s", anfrage);
+        esp1::startExport(sub, false);
+        REQUIRE(sub.exportJob >= 0);
+        esp1::ExportJob &job = esp1::exportJobs[sub.exportJob];
+
+        size_t bytes = 0;
+        heapAnforderungen = 0;
+        heapBytes = 0;
+        zaehleHeap = true;
+        while (!job.eof)
+        {
+            esp1::fillExportChunk(job);
+            bytes += job.outLen;
+        }
+        zaehleHeap = false;
+        CHECK_EQ(job.records, esp1::measurementLog.records());
+        CHECK_EQ(heapAnforderungen, 0u);
+        CHECK_GT(bytes, 100000u);
+        job.file.close();
+        job.active = false;
+    }
+    pruefung::bericht("RAM pro Download (ExportJob)", sizeof(esp1::ExportJob), "Byte");
+    pruefung::bericht("Heap-Anforderungen beim Export", heapAnforderungen, "");
+    CHECK_LT(sizeof(esp1::ExportJob), 1024u);
+}
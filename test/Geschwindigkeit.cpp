@@ -0,0 +1,173 @@
+// Geschwindigkeit - Speed-Trap: Regressionsfenster, Durchschnitt und Messprotokoll
+// Das Fenster bekommt erzeugte Abstandsverläufe bei 50Hz (Zeitstempel in ganzen ms mit Jitter,
+// 1cm Messrauschen). Dazu ein Sensor quer zur Bahn und Läufe mit Geschwindigkeiten im Protokoll.
+
+#include "Aufbau.h"
+
+#include <math.h>
+
+static const unsigned long RASTER_MS = 20;
+static const double RAUSCHEN_CM = 1.0;
+
+// Objekt nähert sich dem Sensor mit cmProS, Schätzung nach 12 Abtastungen. Mittlerer relativer Fehler
+static double mittlererFehler(sim::Rng &rng, double cmProS, int versuche)
+{
+    double summe = 0;
+    for (int v = 0; v < versuche; v++)
+    {
+        SpeedWindow w;
+        unsigned long start = 100000 + (unsigned long)(rng.uniform() * 1e6);
+        double d0 = 300.0;
+        unsigned long t = start;
+        for (int i = 0; i < 12; i++)
+        {
+            t = start + i * RASTER_MS + (unsigned long)(rng.uniform() * 2);
+            double wahr = d0 - cmProS * (t - start) / 1000.0;
+            w.push(t, (float)(wahr + rng.gauss() * RAUSCHEN_CM));
+        }
+        summe += fabs((double)w.speedCmS(t) - cmProS) / cmProS;
+    }
+    return summe / versuche;
+}
+
+TEST(momentangeschwindigkeit_50hz)
+{
+    sim::Rng rng(44);
+    double langsam = mittlererFehler(rng, 150.0, 5000);
+    double schnell = mittlererFehler(rng, 800.0, 5000);
+    pruefung::bericht("Mittlerer Fehler bei 1.5m/s", langsam * 100, "%");
+    pruefung::bericht("Mittlerer Fehler bei 8m/s", schnell * 100, "%");
+    CHECK_LT(langsam, 0.06);
+    CHECK_LT(schnell, 0.02);
+}
+
+// Ruhendes Objekt und zu alte Werte: 0 = unbekannt
+TEST(stillstand_und_alte_werte)
+{
+    sim::Rng rng(45);
+    SpeedWindow w;
+    for (int i = 0; i < 8; i++)
+    {
+        w.push(5000 + i * RASTER_MS, (float)(120.0 + rng.gauss() * RAUSCHEN_CM));
+    }
+    CHECK_EQ(w.speedCmS(5000 + 7 * RASTER_MS), 0u);
+    CHECK_EQ(w.speedCmS(5000 + 7 * RASTER_MS + SPEED_WINDOW_MAX_AGE_MS + 100), 0u);
+    w.reset();
+    CHECK_EQ(w.speedCmS(0), 0u);
+}
+
+// Sensor quer zur Bahn: freie Strecke, dann steht der Läufer im Strahl. Im Fenster liegt nur ein
+// Sprung, das ist keine Geschwindigkeit
+TEST(quer_zur_bahn_bleibt_null)
+{
+    sim::Rng rng(46);
+    int falsch = 0;
+    uint32_t schlechteste = 0;
+    for (int v = 0; v < 1000; v++)
+    {
+        SpeedWindow w;
+        int imStrahl = 1 + v % 7;                  // Abtastungen im Objekt bis zur Auswertung
+        unsigned long t = 0;
+        for (int i = 0; i < 12; i++)
+        {
+            t = 10000 + i * RASTER_MS;
+            double d = i >= 12 - imStrahl ? 60.0 : 150.0;
+            w.push(t, (float)(d + rng.gauss() * RAUSCHEN_CM));
+        }
+        uint32_t v0 = w.speedCmS(t);
+        falsch += v0 != 0;
+        schlechteste = std::max(schlechteste, v0);
+    }
+    pruefung::bericht("Scheinbare Geschwindigkeit schlechteste", schlechteste, "cm/s");
+    CHECK_EQ(falsch, 0);
+}
+
+// Schranken 10m auseinander (-DSPEED_TRAP_DISTANCE_CM=1000 im Makefile)
+TEST(durchschnitt)
+{
+    CHECK_EQ(averageSpeedCmS(0), 0u);
+    CHECK_EQ(averageSpeedCmS(4000), 250u);
+    CHECK_EQ(averageSpeedCmS(3), 333333u);
+    CHECK(formatSpeed(0) == "-");
+    CHECK(formatSpeed(345) == "3.45m/s 12.4km/h");
+}
+
+// 2000 Läufe, alle mit Start- und Zielgeschwindigkeit: nach einem Neustart kommt jeder Wert zurück
+TEST(protokoll_mit_geschwindigkeiten)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    REQUIRE(SPIFFS.begin(true));
+    esp1::measurementLog.begin();
+    std::vector<esp1::LogEntry> geschrieben;
+    uint32_t t = 600000;
+    for (int i = 0; i < 2000; i++)
+    {
+        esp1::LogEntry e;
+        e.seq = esp1::measurementLog.nextSeq;
+        t += 20000 + (uint32_t)(n.rng.uniform() * 40000);
+        e.t = t;
+        e.timeMs = 1200 + (uint32_t)(n.rng.uniform() * 5000);
+        e.clientOk = true;
+        e.reference = 150.0f + (float)(n.rng.uniform() - 0.5);
+        e.bib = 1 + (uint16_t)(n.rng.uniform() * 200);
+        e.session = 1;
+        e.startSpeed = 150 + (uint32_t)(n.rng.uniform() * 650);
+        e.finishSpeed = 150 + (uint32_t)(n.rng.uniform() * 650);
+        geschrieben.push_back(e);
+        REQUIRE(esp1::measurementLog.append(e));
+    }
+    REQUIRE(esp1::measurementLog.flush());
+
+    esp1::measurementLog = esp1::MeasurementLog();
+    esp1::measurementLog.begin();
+    REQUIRE(esp1::measurementLog.records() == 2000u);
+    File file = SPIFFS.open(esp1::LOG_FILE, FILE_READ);
+    esp1::LogBlock block;
+    esp1::LogBlockReader reader;
+    esp1::LogEntry e;
+    size_t i = 0;
+    int abweichend = 0;
+    for (int b = 0; b < esp1::measurementLog.blockCount; b++)
+    {
+        REQUIRE(esp1::measurementLog.readBlock(file, b, block));
+        reader.start(block);
+        while (reader.next(e) && i < geschrieben.size())
+        {
+            const esp1::LogEntry &w = geschrieben[i++];
+            abweichend += e.seq != w.seq || e.timeMs != w.timeMs || e.bib != w.bib ||
+                          e.startSpeed != w.startSpeed || e.finishSpeed != w.finishSpeed;
+        }
+    }
+    file.close();
+    double proDatensatz = (double)n.files[esp1::LOG_FILE]->size() / 2000;
+    pruefung::bericht("Abweichende Datensätze", abweichend, "");
+    pruefung::bericht("Datei pro Datensatz (mit Headern)", proDatensatz, "Byte");
+    CHECK_EQ(i, geschrieben.size());
+    CHECK_EQ(abweichend, 0);
+    CHECK_LT(proDatensatz, 16.0);
+}
+
+// Ein Lauf mit den Schranken der Anlage (quer zur Bahn): Durchschnitt aus der Laufzeit, Start und Ziel
+// bleiben unbekannt
+TEST(lauf_quer_zur_bahn)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+    uint64_t ab = sim::driverNow();
+    double t = sekunden(ab);
+    a.start.durchgang(t + 0.5, 3.0);
+    a.ziel.durchgang(t + 6.0, 0.5);
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("ESP1: Geschwindigkeit", ab) != nullptr; }, us(10)));
+    const esp1::RunRecord *lauf = esp1::resultsStore.get(esp1::resultsStore.lastSeq);
+    REQUIRE(lauf != nullptr);
+    std::string erwartet = std::string("ESP1: Geschwindigkeit ") + formatSpeed(averageSpeedCmS(lauf->timeMs)).c_str() +
+                           " (Start -, Ziel -)";
+    pruefung::bericht("Laufzeit", lauf->timeMs, "ms");
+    pruefung::bericht("Durchschnitt", averageSpeedCmS(lauf->timeMs), "cm/s");
+    CHECK(a.server.findLog(erwartet, ab) != nullptr);
+}
@@ -0,0 +1,153 @@
+// Kalibrierung - Schnellstart mit der im NVS gespeicherten Kalibrierung
+// Der Speicher eines früheren Boots wird vor dem Start in das simulierte NVS geschrieben, der
+// Server prüft ihn mit einer kurzen Messung und übernimmt ihn oder kalibriert neu.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *NVS_BEREICH = "lichtschranke";
+
+// Kalibrierung, wie sie ein früherer Boot gespeichert hätte
+static esp1::CalibrationCache frueher(float referenzCm)
+{
+    esp1::CalibrationCache c;
+    c.version = esp1::CALIBRATION_VERSION;
+    c.referenceDistance = referenzCm;
+    c.triggerThreshold = referenzCm / 2.0f;
+    c.sensorCount = SENSOR_COUNT;
+    c.healthySensors = SENSOR_COUNT;
+    c.validSamples = esp1::REFERENCE_SAMPLES;
+    c.bootCount = 7;
+    c.uptimeMs = 3600000;
+    c.noiseSigma = 1.0f;
+    return c;
+}
+
+// Einträge im simulierten NVS: Typkennung (wie im Stub) gefolgt von den Bytes
+static void speichere(Anlage &a, const esp1::CalibrationCache &c)
+{
+    const uint8_t *p = (const uint8_t *)&c;
+    std::vector<uint8_t> &eintrag = a.server.nvs[NVS_BEREICH]["calibration"];
+    eintrag.assign(1, 'B');
+    eintrag.insert(eintrag.end(), p, p + sizeof(c));
+    a.server.nvs[NVS_BEREICH]["bootCount"] = {'I', 7, 0, 0, 0};
+}
+
+static bool gespeichert(Anlage &a, esp1::CalibrationCache &c)
+{
+    const std::vector<uint8_t> &v = a.server.nvs[NVS_BEREICH]["calibration"];
+    if (v.size() != 1 + sizeof(c) || v[0] != 'B')
+    {
+        return false;
+    }
+    memcpy(&c, v.data() + 1, sizeof(c));
+    return true;
+}
+
+// Bis setup() durch ist: IDLE_GREEN wird schon vor der Meldung der Startzeit gesetzt
+static bool gestartet(Anlage &a)
+{
+    return Anlage::warte([&a] { return a.server.findLog("ESP1: Bereit nach ") != nullptr; }, us(15));
+}
+
+// Zeit bis IDLE_GREEN laut "Bereit nach <ms>ms" im Serial Monitor
+static double bereitNachMs(Anlage &a)
+{
+    const sim::LogLine *l = a.server.findLog("ESP1: Bereit nach ");
+    REQUIRE(l != nullptr);
+    return atof(l->text.c_str() + l->text.find("nach ") + 5);
+}
+
+TEST(erster_start_kalibriert_und_speichert)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(gestartet(a));
+
+    CHECK(a.server.findLog("Keine gespeicherte Kalibrierung") != nullptr);
+    CHECK(a.server.findLog("Vollkalibrierung, Boot #1") != nullptr);
+    esp1::CalibrationCache c;
+    REQUIRE(gespeichert(a, c));
+    CHECK_EQ(c.version, esp1::CALIBRATION_VERSION);
+    CHECK_LT(fabs(c.referenceDistance - 150.0f), 1.0f);
+    CHECK_EQ(c.healthySensors, SENSOR_COUNT);
+    CHECK_EQ(c.bootCount, 1u);
+    pruefung::bericht("Bereit nach Vollkalibrierung", bereitNachMs(a), "ms");
+}
+
+// Unveränderte Bahn: die Prüfmessung bestätigt, Kalibrierung und langer LED-Test entfallen
+TEST(gleiche_bahn_schnellstart)
+{
+    Anlage &a = Anlage::neu();
+    speichere(a, frueher(150.0f));
+    a.starteServer();
+    REQUIRE(gestartet(a));
+
+    CHECK(a.server.findLog("Gespeicherte Kalibrierung bestätigt") != nullptr);
+    CHECK(a.server.findLog("Schnellstart, Boot #8") != nullptr);
+    CHECK_LT(fabs(esp1::referenceDistance1 - 150.0f), 0.01f);
+    pruefung::bericht("Bereit nach Schnellstart", bereitNachMs(a), "ms");
+    CHECK_LT(bereitNachMs(a), 2000.0);
+}
+
+// Abweichung innerhalb der Toleranz (max(3cm, 5%)): gespeicherter Wert wird übernommen
+TEST(kleine_abweichung_wird_uebernommen)
+{
+    Anlage &a = Anlage::neu();
+    speichere(a, frueher(155.0f));
+    a.starteServer();
+    REQUIRE(gestartet(a));
+
+    CHECK(a.server.findLog("Schnellstart") != nullptr);
+    CHECK_LT(fabs(esp1::referenceDistance1 - 155.0f), 0.01f);
+}
+
+// Schranke wurde umgestellt: Referenz weicht ab, volle Kalibrierung und neuer Speicherstand
+TEST(umgestellte_bahn_kalibriert_neu)
+{
+    Anlage &a = Anlage::neu();
+    speichere(a, frueher(120.0f));
+    a.starteServer();
+    REQUIRE(gestartet(a));
+
+    CHECK(a.server.findLog("Referenz abweichend") != nullptr);
+    CHECK(a.server.findLog("Vollkalibrierung, Boot #8") != nullptr);
+    CHECK_LT(fabs(esp1::referenceDistance1 - 150.0f), 1.0f);
+    esp1::CalibrationCache c;
+    REQUIRE(gespeichert(a, c));
+    CHECK_LT(fabs(c.referenceDistance - 150.0f), 1.0f);
+    CHECK_EQ(c.bootCount, 8u);
+    pruefung::bericht("Bereit nach abgelehntem Speicherstand", bereitNachMs(a), "ms");
+}
+
+// Person in der Schranke während der Prüfmessung: keine Übernahme, sie geht vor der Kalibrierung
+TEST(hindernis_bei_pruefung_kalibriert_neu)
+{
+    Anlage &a = Anlage::neu();
+    speichere(a, frueher(150.0f));
+    a.start.verlauf = [&a](double) {
+        return a.server.findLog("Referenz abweichend") ? 150.0f : 60.0f;
+    };
+    a.starteServer();
+    REQUIRE(gestartet(a));
+
+    CHECK(a.server.findLog("Gespeicherte Kalibrierung bestätigt") == nullptr);
+    CHECK(a.server.findLog("Vollkalibrierung") != nullptr);
+    CHECK_LT(fabs(esp1::referenceDistance1 - 150.0f), 1.0f);
+}
+
+// Älteres Format oder andere Sensorzahl: Daten werden verworfen
+TEST(fremdes_format_wird_verworfen)
+{
+    Anlage &a = Anlage::neu();
+    esp1::CalibrationCache c = frueher(150.0f);
+    c.version = esp1::CALIBRATION_VERSION - 1;
+    speichere(a, c);
+    a.starteServer();
+    REQUIRE(gestartet(a));
+
+    CHECK(a.server.findLog("Gespeicherte Kalibrierung ungültig") != nullptr);
+    CHECK(a.server.findLog("Vollkalibrierung") != nullptr);
+}
@@ -0,0 +1,225 @@
+// Messprotokoll - Blockweises Binärprotokoll mit Varint-Differenzen und CRC
+// Zufällige Läufe werden geschrieben, nach einem simulierten Neustart wieder gelesen und Feld
+// für Feld verglichen. Dazu beschädigte Blöcke, die Suche im Blockindex und die Übernahme des
+// alten CSV-Protokolls.
+
+#include "Aufbau.h"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock Uhr;
+
+// Knoten mit leerem Flash, Protokoll geöffnet
+static sim::Node &knoten()
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    REQUIRE(SPIFFS.begin(true));
+    esp1::measurementLog.begin();
+    return n;
+}
+
+// Läufe wie an einem Wettkampftag: Zeiten 2-30s, 200 Startnummern, ab und zu Geschwindigkeiten
+static esp1::LogEntry lauf(sim::Node &n, uint32_t seq, uint32_t &t)
+{
+    esp1::LogEntry e;
+    e.seq = seq;
+    t += 20000 + n.rng.uniform() * 40000;
+    e.t = t;
+    e.timeMs = 2000 + (uint32_t)(n.rng.uniform() * 28000);
+    e.clientOk = n.rng.uniform() > 0.02;
+    e.reference = 150.0f + (float)(n.rng.uniform() - 0.5);
+    e.bib = n.rng.uniform() < 0.1 ? 0 : 1 + (uint16_t)(n.rng.uniform() * 200);
+    e.session = 1 + seq / 4000;
+    if (n.rng.uniform() < 0.2)
+    {
+        e.startSpeed = 300 + (uint32_t)(n.rng.uniform() * 500);
+        e.finishSpeed = 300 + (uint32_t)(n.rng.uniform() * 500);
+    }
+    return e;
+}
+
+// Alle lesbaren Datensätze in Reihenfolge, so wie der Export sie aus dem Flash holt
+static std::vector<esp1::LogEntry> alleLesen()
+{
+    std::vector<esp1::LogEntry> v;
+    File file = SPIFFS.open(esp1::LOG_FILE, FILE_READ);
+    REQUIRE(file);
+    esp1::LogBlock block;
+    esp1::LogBlockReader reader;
+    esp1::LogEntry e;
+    for (int b = 0; b < esp1::measurementLog.blockCount; b++)
+    {
+        if (!esp1::measurementLog.readBlock(file, b, block))
+        {
+            continue;
+        }
+        reader.start(block);
+        while (reader.next(e))
+        {
+            v.push_back(e);
+        }
+    }
+    file.close();
+    return v;
+}
+
+static bool gleich(const esp1::LogEntry &a, const esp1::LogEntry &b)
+{
+    return a.seq == b.seq && a.t == b.t && a.timeMs == b.timeMs && a.clientOk == b.clientOk &&
+           lroundf(a.reference * 100.0f) == lroundf(b.reference * 100.0f) && a.bib == b.bib &&
+           a.session == b.session && a.startSpeed == b.startSpeed && a.finishSpeed == b.finishSpeed;
+}
+
+// 5000 Läufe, Neustart, 1000 weitere: alles kommt unverändert zurück
+TEST(rundreise_und_weiterschreiben)
+{
+    sim::Node &n = knoten();
+    sim::As als(n);
+    std::vector<esp1::LogEntry> geschrieben;
+    uint32_t t = 600000;
+    for (int i = 0; i < 5000; i++)
+    {
+        geschrieben.push_back(lauf(n, esp1::measurementLog.nextSeq, t));
+        REQUIRE(esp1::measurementLog.append(geschrieben.back()));
+    }
+    REQUIRE(esp1::measurementLog.flush());
+
+    // Neustart: Index aus den Block-Headern, letzter Block wird weiterbeschrieben
+    esp1::measurementLog = esp1::MeasurementLog();
+    esp1::measurementLog.begin();
+    CHECK_EQ(esp1::measurementLog.records(), 5000u);
+    CHECK_EQ(esp1::measurementLog.corruptBlocks, 0u);
+    for (int i = 0; i < 1000; i++)
+    {
+        geschrieben.push_back(lauf(n, esp1::measurementLog.nextSeq, t));
+        REQUIRE(esp1::measurementLog.append(geschrieben.back()));
+    }
+    REQUIRE(esp1::measurementLog.flush());
+
+    std::vector<esp1::LogEntry> gelesen = alleLesen();
+    REQUIRE(gelesen.size() == geschrieben.size());
+    int abweichend = 0;
+    for (size_t i = 0; i < gelesen.size(); i++)
+    {
+        abweichend += !gleich(gelesen[i], geschrieben[i]);
+    }
+    CHECK_EQ(abweichend, 0);
+
+    size_t nutzdaten = 0;
+    File file = SPIFFS.open(esp1::LOG_FILE, FILE_READ);
+    esp1::LogBlock block;
+    for (int b = 0; b < esp1::measurementLog.blockCount; b++)
+    {
+        REQUIRE(esp1::measurementLog.readBlock(file, b, block));
+        nutzdaten += block.header.used;
+    }
+    file.close();
+    double proDatensatz = (double)n.files[esp1::LOG_FILE]->size() / gelesen.size();
+    pruefung::bericht("Blöcke", esp1::measurementLog.blockCount, "");
+    pruefung::bericht("Nutzdaten pro Datensatz", (double)nutzdaten / gelesen.size(), "Byte");
+    pruefung::bericht("Datei pro Datensatz (mit Headern)", proDatensatz, "Byte");
+    CHECK_LT(proDatensatz, 14.0);
+}
+
+// Ein gekipptes Byte kostet nur die Datensätze seines Blocks, der Rest bleibt lesbar
+TEST(crc_begrenzt_schaden_auf_einen_block)
+{
+    sim::Node &n = knoten();
+    sim::As als(n);
+    uint32_t t = 600000;
+    for (int i = 0; i < 2000; i++)
+    {
+        REQUIRE(esp1::measurementLog.append(lauf(n, esp1::measurementLog.nextSeq, t)));
+    }
+    REQUIRE(esp1::measurementLog.flush());
+    const int kaputt = 10;
+    int imBlock = esp1::measurementLog.index[kaputt].count;
+    std::vector<uint8_t> &datei = *n.files[esp1::LOG_FILE];
+    datei[kaputt * esp1::LOG_BLOCK_SIZE + sizeof(esp1::LogBlockHeader) + 17] ^= 0x04;
+
+    esp1::measurementLog = esp1::MeasurementLog();
+    esp1::measurementLog.begin();
+    CHECK_EQ(esp1::measurementLog.corruptBlocks, 1u);
+    CHECK_EQ(esp1::measurementLog.records(), 2000u);
+    std::vector<esp1::LogEntry> gelesen = alleLesen();
+    CHECK_EQ((int)gelesen.size(), 2000 - imBlock);
+    pruefung::bericht("Verlorene Datensätze", 2000 - gelesen.size(), "");
+
+    // Sequenznummern bleiben über den beschädigten Block hinweg aufsteigend
+    bool aufsteigend = true;
+    for (size_t i = 1; i < gelesen.size(); i++)
+    {
+        aufsteigend = aufsteigend && gelesen[i].seq > gelesen[i - 1].seq;
+    }
+    CHECK(aufsteigend);
+}
+
+// Volles Protokoll (512 Blöcke): jeder Lauf liegt in dem Block, den die binäre Suche liefert
+TEST(index_suche_volles_protokoll)
+{
+    sim::Node &n = knoten();
+    sim::As als(n);
+    uint32_t t = 600000;
+    while (esp1::measurementLog.append(lauf(n, esp1::measurementLog.nextSeq, t)))
+    {
+    }
+    REQUIRE(esp1::measurementLog.full);
+    REQUIRE(esp1::measurementLog.blockCount == esp1::LOG_MAX_BLOCKS);
+    uint32_t datensaetze = esp1::measurementLog.records();
+
+    int falsch = 0;
+    for (uint32_t seq = 1; seq <= datensaetze; seq++)
+    {
+        int b = esp1::measurementLog.findBlock(seq);
+        const esp1::LogIndexEntry &e = esp1::measurementLog.index[b];
+        falsch += seq < e.firstSeq || seq >= e.firstSeq + e.count;
+    }
+    CHECK_EQ(falsch, 0);
+    CHECK_EQ(esp1::measurementLog.findBlock(datensaetze + 1), esp1::LOG_MAX_BLOCKS);
+
+    const int suchen = 1000000;
+    std::vector<uint32_t> seqs;
+    for (int i = 0; i < suchen; i++)
+    {
+        seqs.push_back(1 + (uint32_t)(n.rng.uniform() * datensaetze));
+    }
+    uint32_t summe = 0;
+    Uhr::time_point t0 = Uhr::now();
+    for (uint32_t seq : seqs)
+    {
+        summe += esp1::measurementLog.findBlock(seq);
+    }
+    double ns = std::chrono::duration<double, std::nano>(Uhr::now() - t0).count() / suchen;
+    CHECK_GT(summe, 0u);
+    pruefung::bericht("Datensätze im vollen Protokoll", datensaetze, "");
+    pruefung::bericht("RAM des Blockindex", sizeof(esp1::measurementLog.index), "Byte");
+    pruefung::bericht("Suche im Blockindex (Host)", ns, "ns");
+    CHECK_LT(ns, 1000.0);
+}
+
+// Das alte CSV-Protokoll wird beim Start übernommen und danach gelöscht
+TEST(csv_protokoll_uebernehmen)
+{
+    sim::Node &n = knoten();
+    sim::As als(n);
+    const char *csv = "1000,4123,OK,150.21\r\n"
+                      "2000,5321,FEHLER,150.19,17,2\n"
+                      "\n"
+                      "kaputt\n"
+                      "3000,6001,OK,149.98,0,2\n";
+    n.files[esp1::LEGACY_CSV_LOG] = std::make_shared<std::vector<uint8_t> >(csv, csv + strlen(csv));
+    esp1::migrateLegacyLog();
+    CHECK(!SPIFFS.exists(esp1::LEGACY_CSV_LOG));
+
+    std::vector<esp1::LogEntry> gelesen = alleLesen();
+    REQUIRE(gelesen.size() == 3);
+    CHECK_EQ(gelesen[0].timeMs, 4123u);
+    CHECK(gelesen[0].clientOk);
+    CHECK_EQ(lroundf(gelesen[0].reference * 100.0f), 15021);
+    CHECK_EQ(gelesen[1].bib, 17);
+    CHECK_EQ(gelesen[1].session, 2);
+    CHECK(!gelesen[1].clientOk);
+    CHECK_EQ(gelesen[2].seq, 3u);
+    CHECK_EQ(gelesen[2].t, 3000u);
+}
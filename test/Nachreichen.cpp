@@ -0,0 +1,183 @@
+// Nachreichen - Ergebnisse des Clients über Verbindungsabbrüche hinweg
+// Die Strecke zwischen den ESPs fällt zu zufälligen Zeiten aus (sim::Link::outages). Kein Lauf,
+// den der Client gemessen hat, darf beim Server fehlen oder doppelt ankommen, und nur der
+// laufende Lauf bekommt die Startnummer.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+static const double LAUF_S = 2.5;
+
+static void verbinde(Anlage &a)
+{
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+}
+
+static void startnummer(Anlage &a, uint16_t bib)
+{
+    sim::As als(a.server);
+    esp1::nextAthlete = bib;
+}
+
+// Ein Durchgang durch beide Schranken ab t, das Ziel wird nach LAUF_S erreicht
+static void durchgang(Anlage &a, double t)
+{
+    a.start.durchgang(t + 0.5, 3.0);
+    a.ziel.durchgang(t + 3.5 + LAUF_S, 0.5);
+}
+
+static const esp1::RunRecord &letzterLauf()
+{
+    const esp1::RunRecord *r = esp1::resultsStore.get(esp1::resultsStore.lastSeq);
+    REQUIRE(r != nullptr);
+    return *r;
+}
+
+// Die Verbindung bricht mitten in der Messung ab: der Server wartet, der Client misst offline
+// zu Ende und reicht das Ergebnis nach dem Wiederverbinden nach, mit Startnummer
+TEST(abbruch_waehrend_messung)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    startnummer(a, 17);
+
+    uint64_t ab = sim::driverNow();
+    double t = sekunden(ab);
+    durchgang(a, t);
+    sim::world().nodeLink.outages.push_back({us(t + 4.5), us(t + 8.0)});
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::TIMING_STARTED_ALL_ON; }, us(6)));
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("warte auf nachgereichtes Ergebnis", ab) != nullptr; },
+                          us(4)));
+    CHECK_EQ(esp1::currentState, esp1::TIMING_STARTED_ALL_ON);
+
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("ESP1: Lauf #1", ab) != nullptr; }, us(20)));
+    CHECK(a.client.findLog("Messung läuft offline weiter", ab) != nullptr);
+    const sim::LogLine *verbunden = a.server.findLog("ESP1: Client bereit", ab);
+    const sim::LogLine *gespeichert = a.server.findLog("ESP1: Lauf #1", ab);
+    REQUIRE(verbunden && gespeichert);
+    pruefung::bericht("Wiederverbunden nach dem Ende des Ausfalls", (verbunden->at - us(t + 8.0)) / 1000.0, "ms");
+    pruefung::bericht("Ergebnis gespeichert nach CLIENT_READY", (gespeichert->at - verbunden->at) / 1000.0, "ms");
+    pruefung::bericht("Gemessene Zeit", letzterLauf().timeMs, "ms");
+    CHECK_EQ(letzterLauf().bib, 17);
+    CHECK_EQ(esp1::nextAthlete, 0);
+    CHECK_LT(fabs(letzterLauf().timeMs - LAUF_S * 1000), 2 * esp1::TDMA_FRAME_US / 1000.0);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(8)));
+    CHECK_EQ(a.server.countLog("SYSTEM FEHLER", ab), 0);
+}
+
+// Der Ausfall dauert länger als der Timeout des Servers: der Lauf kommt als Nachzügler ohne
+// Startnummer an, die bleibt für den nächsten Lauf stehen
+TEST(nachzuegler_nach_timeout)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    startnummer(a, 17);
+
+    uint64_t ab = sim::driverNow();
+    double t = sekunden(ab);
+    durchgang(a, t);
+    sim::world().nodeLink.outages.push_back({us(t + 4.5), us(t + 40.0)});
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("Zeitmessung Timeout!", ab) != nullptr; }, us(40)));
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("ESP1: Lauf #1", ab) != nullptr; }, us(20)));
+    CHECK_EQ(letzterLauf().bib, 0);
+    CHECK_EQ(esp1::nextAthlete, 17);
+
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+    sim::runFor(us(2));
+    durchgang(a, sekunden(sim::driverNow()));
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("ESP1: Lauf #2", ab) != nullptr; }, us(12)));
+    CHECK_EQ(letzterLauf().bib, 17);
+    CHECK_EQ(esp1::nextAthlete, 0);
+}
+
+// Nachgereichte RESULTS einer früheren Messung während eines neuen Laufs: ohne Startnummer,
+// die Messung läuft weiter
+TEST(rueckstand_waehrend_messung)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    startnummer(a, 17);
+    durchgang(a, sekunden(sim::driverNow()));
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::TIMING_STARTED_ALL_ON; }, us(6)));
+    {
+        // Als hätte der Client zwei ältere Läufe nachgereicht
+        sim::As als(a.client);
+        esp2::resultQueue.nextSeq = 3;
+    }
+    {
+        sim::As als(a.server);
+        esp1::handleResultBatch(String("RESULTS:1:4100,2:4200"));
+    }
+    CHECK_EQ(esp1::resultsStore.lastSeq, 2u);
+    CHECK_EQ(letzterLauf().bib, 0);
+    CHECK_EQ(esp1::currentState, esp1::TIMING_STARTED_ALL_ON);
+    CHECK_EQ(esp1::nextAthlete, 17);
+
+    REQUIRE(Anlage::warte([&] { return a.server.findLog("ESP1: Lauf #3") != nullptr; }, us(8)));
+    CHECK_EQ(letzterLauf().bib, 17);
+}
+
+// Viele Läufe mit zufälligen Ausfällen von 0,2 bis 5s: jede Messung des Clients kommt genau
+// einmal beim Server an
+TEST(zufaellige_abbrueche)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    sim::Link &link = sim::world().nodeLink;
+    sim::Rng &rng = a.server.rng;
+
+    const int laeufe = 30;
+    uint64_t ab = sim::driverNow();
+    for (int i = 0; i < laeufe; i++)
+    {
+        REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(60)));
+        REQUIRE(Anlage::warte([] { return esp2::clientState == esp2::IDLE_WAITING_FOR_START; }, us(20)));
+        sim::runFor(us(1));
+        double t = sekunden(sim::driverNow());
+        durchgang(a, t);
+        double von = t + 3.0 + rng.uniform() * 5.0;
+        link.outages.push_back({us(von), us(von + 0.2 + rng.uniform() * 4.8)});
+        sim::runFor(us(12));
+    }
+    link.outages.clear();
+    sim::runFor(us(40));
+
+    // Gemessen hat der Client, gespeichert der Server: gleich viele, keine doppelt
+    int gemessen = a.client.countLog("ESP2: Objekt erkannt!", ab);
+    int offline = a.client.countLog("Ergebnis gespeichert,", ab);
+    pruefung::bericht("Läufe mit Ausfall", laeufe, "");
+    pruefung::bericht("Vom Client gemessen", gemessen, "");
+    pruefung::bericht("Davon offline beendet", offline, "");
+    pruefung::bericht("Beim Server gespeichert", esp1::resultsStore.lastSeq, "");
+    pruefung::bericht("Duplikate verworfen", a.server.countLog("Duplikat ignoriert", ab), "");
+    pruefung::bericht("Timeouts beim Server", a.server.countLog("Zeitmessung Timeout!", ab), "");
+    pruefung::bericht("Läufe mit Fehler beim Server", a.server.countLog("SYSTEM FEHLER", ab), "");
+    CHECK_GT(offline, 0);
+    CHECK_EQ((int)esp1::resultsStore.lastSeq, gemessen);
+    CHECK_EQ(gemessen + a.server.countLog("SYSTEM FEHLER", ab), laeufe);
+    CHECK_EQ(esp2::resultQueue.count, 0);
+
+    // Wie schnell der Rückstand nach dem Wiederverbinden abfließt
+    double summe = 0, schlechteste = 0;
+    int n = 0;
+    for (const sim::LogLine &l : a.client.console)
+    {
+        size_t pos = l.text.find("Rückstand übertragen in ");
+        if (l.at < ab || pos == std::string::npos)
+        {
+            continue;
+        }
+        double ms = atof(l.text.c_str() + pos + strlen("Rückstand übertragen in "));
+        summe += ms;
+        schlechteste = std::max(schlechteste, ms);
+        n++;
+    }
+    pruefung::bericht("Rückstand übertragen im Mittel", summe / std::max(n, 1), "ms");
+    pruefung::bericht("Rückstand übertragen schlechteste", schlechteste, "ms");
+}
@@ -0,0 +1,113 @@
+// Schleifenlatenz - Längster loop()-Durchlauf des Servers auf allen Fehler- und Wiederherstellungs-
+// pfaden. Gemessen wird die volle Dauer eines Durchlaufs einschließlich des Schlafs am Ende: so
+// lange bleiben Nachrichten, Heartbeats und Durchgänge im ungünstigsten Fall liegen.
+
+#include "Aufbau.h"
+
+#include <algorithm>
+
+// Schlaf am Ende (LOOP_DELAY_MS), eine Schranken-Abtastung ohne Echo und die Statuszeile über UART
+static const uint64_t GRENZE_US = 100000;
+
+static void messeAb(Anlage &a)
+{
+    a.server.maxLoopUs = 0;
+    a.server.loopDurations.clear();
+    a.server.recordLoops = true;
+}
+
+static void berichte(Anlage &a, const char *pfad)
+{
+    std::vector<uint64_t> d = a.server.loopDurations;
+    REQUIRE(!d.empty());
+    std::sort(d.begin(), d.end());
+    std::string was = std::string(pfad) + ": längster Durchlauf";
+    pruefung::bericht(was.c_str(), a.server.maxLoopUs / 1000.0, "ms");
+    was = std::string(pfad) + ": 99. Perzentil";
+    pruefung::bericht(was.c_str(), d[d.size() * 99 / 100] / 1000.0, "ms");
+    CHECK_LE(a.server.maxLoopUs, GRENZE_US);
+}
+
+static void verbinde(Anlage &a)
+{
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+}
+
+// Alle Sensoren fallen aus: Fehler, Blinkmuster, erfolglose Wiederherstellung, Sensor kommt zurück
+TEST(sensorausfall_und_wiederherstellung)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    messeAb(a);
+    uint64_t ab = sim::driverNow();
+
+    for (sim::Sensor *s : a.startSensoren)
+    {
+        s->dead = true;
+    }
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::ERROR_STATE; }, us(5)));
+    sim::runFor(us(25));                       // Mehrere Wiederherstellungsversuche scheitern
+    CHECK_GE(a.server.countLog("Versuche System-Wiederherstellung", ab), 2);
+    for (sim::Sensor *s : a.startSensoren)
+    {
+        s->dead = false;
+    }
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+
+    berichte(a, "Sensorausfall");
+    // Heartbeats wurden die ganze Zeit bedient
+    CHECK_EQ(a.client.countLog("Verbindung verdächtig", ab), 0);
+    CHECK_EQ(a.server.countLog("Verbindung verdächtig", ab), 0);
+}
+
+// Niemand kommt am Ziel an: Timeout nach 30s, Fehler, Wiederherstellung
+TEST(zeitmessung_timeout)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    messeAb(a);
+
+    a.start.durchgang(sekunden(sim::driverNow()) + 0.5, 3.0);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::TIMING_STARTED_ALL_ON; }, us(8)));
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::ERROR_STATE; }, us(35)));
+    CHECK(a.server.findLog("Zeitmessung Timeout!") != nullptr);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+
+    berichte(a, "Timeout");
+}
+
+// Start ohne Client: sofortiger Fehler und Wiederherstellung
+TEST(start_ohne_client)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    messeAb(a);
+
+    a.start.durchgang(sekunden(sim::driverNow()) + 0.5, 3.0);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::ERROR_STATE; }, us(8)));
+    CHECK(a.server.findLog("Kein Client verbunden") != nullptr);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+
+    berichte(a, "Ohne Client");
+}
+
+// Regulärer Lauf mit Ampelfolge, Messung und Abkühlpause
+TEST(lauf_mit_abkuehlpause)
+{
+    Anlage &a = Anlage::neu();
+    verbinde(a);
+    messeAb(a);
+
+    double t = sekunden(sim::driverNow());
+    a.start.durchgang(t + 0.5, 3.0);
+    a.ziel.durchgang(t + 6.0, 0.5);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::WAITING_FOR_TIMING_COMPLETE; }, us(10)));
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(5)));
+    CHECK_EQ(esp1::resultsStore.lastSeq, 1u);
+
+    berichte(a, "Lauf");
+}
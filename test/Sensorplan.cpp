@@ -0,0 +1,257 @@
+// Sensorplan - Round-Robin mehrerer HC-SR04 an Schranke 1 (übersetzt mit SENSOR_COUNT=3)
+// Die Sensoren hören das Wand-Echo ihrer Nachbarn: wer zu früh feuert, misst einen fremden Burst.
+// Dazu die Median-Fusion der Pings, die Server und Client gemeinsam nutzen.
+
+#include "Aufbau.h"
+
+#include <algorithm>
+
+// Nachbar-Burst kommt über die Wand zurück, gleicher Weg wie das eigene Echo
+static void nachbarnHoerenSich(Anlage &a)
+{
+    sim::world().crossPathCm = [&a](const sim::Sensor &, const sim::Sensor &, double t) {
+        return 2.0f * a.start(t);
+    };
+}
+
+// Alle Pings aller Sensoren in zeitlicher Reihenfolge
+static std::vector<std::pair<const sim::Sensor *, sim::Ping> > allePings(Anlage &a, uint64_t ab)
+{
+    std::vector<std::pair<const sim::Sensor *, sim::Ping> > pings;
+    for (sim::Sensor *s : a.startSensoren)
+    {
+        for (const sim::Ping &p : s->pings)
+        {
+            if (p.trigAt >= ab)
+            {
+                pings.push_back(std::make_pair(s, p));
+            }
+        }
+    }
+    std::sort(pings.begin(), pings.end(), [](const std::pair<const sim::Sensor *, sim::Ping> &x,
+                                             const std::pair<const sim::Sensor *, sim::Ping> &y) {
+        return x.second.trigAt < y.second.trigAt;
+    });
+    return pings;
+}
+
+TEST(pings_ueberlappen_nie)
+{
+    Anlage &a = Anlage::neu();
+    nachbarnHoerenSich(a);
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+
+    uint64_t ab = sim::driverNow();
+    sim::runFor(us(10));
+    auto pings = allePings(a, ab);
+    REQUIRE(pings.size() > 100);
+
+    int foreign = 0;
+    int reihenfolgeFalsch = 0;
+    uint64_t kleinsterAbstand = sim::NEVER;
+    for (size_t i = 0; i < pings.size(); i++)
+    {
+        foreign += pings[i].second.foreign;
+        if (i == 0)
+        {
+            continue;
+        }
+        const sim::Ping &vorher = pings[i - 1].second;
+        const sim::Ping &jetzt = pings[i].second;
+        // Zuhören endet mit der fallenden Echo-Flanke, erst danach darf der nächste Trigger kommen
+        CHECK_GE(jetzt.trigAt, vorher.fallAt);
+        kleinsterAbstand = std::min(kleinsterAbstand, jetzt.trigAt - vorher.fallAt);
+        reihenfolgeFalsch += pings[i].first->id != (pings[i - 1].first->id + 1) % SENSOR_COUNT;
+    }
+    CHECK_EQ(foreign, 0);
+    CHECK_EQ(reihenfolgeFalsch, 0);
+    CHECK_GE(kleinsterAbstand, SENSOR_GUARD_US);
+
+    double dauer = 10.0;
+    pruefung::bericht("Pings gesamt pro Sekunde", pings.size() / dauer, "1/s");
+    pruefung::bericht("Pings pro Sensor und Sekunde", pings.size() / dauer / SENSOR_COUNT, "1/s");
+    pruefung::bericht("Fusionierte Messwerte pro Sekunde", pings.size() / dauer / esp1::GATE_PINGS_PER_READING, "1/s");
+    pruefung::bericht("Kleinster Abstand Echo-Ende -> nächster Trigger", kleinsterAbstand, "us");
+}
+
+// Ohne Versatz (alle Sensoren zugleich) liest jeder Sensor die Nachbar-Bursts: Vergleichswert
+TEST(gleichzeitig_feuern_stoert)
+{
+    Anlage &a = Anlage::neu();
+    sim::As als(a.server);
+    // Wand bei 150cm, Nachbarn 2cm versetzt: ihr Burst ist minimal früher da als das eigene Echo
+    sim::world().crossPathCm = [](const sim::Sensor &, const sim::Sensor &, double) { return 296.0f; };
+    int gestoert = 0;
+    const int runden = 200;
+    for (int r = 0; r < runden; r++)
+    {
+        uint64_t t = sim::now();
+        for (sim::Sensor *s : a.startSensoren)
+        {
+            s->trigger(true, t);
+        }
+        for (sim::Sensor *s : a.startSensoren)
+        {
+            s->trigger(false, t + 10);
+        }
+        sim::advance(40000);
+        for (sim::Sensor *s : a.startSensoren)
+        {
+            s->settle(sim::now());
+            gestoert += s->pings.back().foreign;
+        }
+    }
+    pruefung::bericht("Gleichzeitig: Anteil fremder Echos", 100.0 * gestoert / (runden * SENSOR_COUNT), "%");
+    CHECK_GT(gestoert, runden);
+}
+
+// Ein komplett stummer Sensor: die Schranke misst mit den beiden anderen weiter
+TEST(toter_sensor_wird_ueberbrueckt)
+{
+    Anlage &a = Anlage::neu();
+    nachbarnHoerenSich(a);
+    a.startSensoren[1]->dead = true;
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+
+    a.start.durchgang(sekunden(sim::driverNow()) + 1.0, 4.0);
+    uint64_t ab = sim::driverNow();
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::TIMING_STARTED_ALL_ON ||
+                                      esp1::currentState == esp1::ERROR_STATE; },
+                          us(8)));
+    CHECK_EQ(esp1::currentState, esp1::TIMING_STARTED_ALL_ON);
+    CHECK(a.server.findLog("ESP1: WARNUNG - Sensor 1 liefert keine Echos mehr") != nullptr);
+    CHECK_EQ(a.server.countLog("SYSTEM FEHLER", ab), 0);
+    CHECK_EQ(esp1::gateSensors.healthySensors(), SENSOR_COUNT - 1);
+}
+
+// Einzelne Echo-Ausfälle auf allen Sensoren: der Median der übrigen Pings bleibt gültig.
+// Ungültig wird ein Messwert erst, wenn die Mehrheit der 5 Pings fehlt (bei 15%: 2,7%)
+TEST(einzelne_echoausfaelle)
+{
+    Anlage &a = Anlage::neu();
+    nachbarnHoerenSich(a);
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    for (sim::Sensor *s : a.startSensoren)
+    {
+        s->dropRate = 0.15;
+    }
+
+    int messwerte = 0, ungueltig = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        sim::runFor(20000);
+        messwerte++;
+        ungueltig += !isValidDistance(esp1::currentDistance1);
+    }
+    pruefung::bericht("Ungültige Messwerte bei 15% Echo-Verlust", 100.0 * ungueltig / messwerte, "%");
+    CHECK_LE(ungueltig, messwerte * 4 / 100);
+    CHECK_NE(esp1::currentState, esp1::ERROR_STATE);
+}
+
+// ---- Fusion (SensorGroup::measureFused, dieselbe für Server und Client) ----
+
+typedef SensorGroup<UltrasonicSensor<5, 18>, UltrasonicSensor<32, 34>, UltrasonicSensor<33, 35> > Gruppe;
+
+static unsigned long slotFrei(unsigned long) { return 0; }
+
+static int slotAbfragen = 0;
+static unsigned long slotEndetNachDreiPings(unsigned long)
+{
+    return ++slotAbfragen >= 3 ? 1000 : 0;
+}
+
+// Drei Sensoren an einem Knoten, Entfernung je Sensor ab dem Zeitpunkt umschaltbar
+struct Gestell
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    float cm[3] = {150.0f, 150.0f, 150.0f};
+    float spaeterCm[3] = {150.0f, 150.0f, 150.0f};
+    double umschaltenBei = 1e9;              // Sekunden
+
+    Gestell()
+    {
+        static const uint8_t trig[] = {5, 32, 33};
+        static const uint8_t echo[] = {18, 34, 35};
+        for (int i = 0; i < 3; i++)
+        {
+            n.addSensor(trig[i], echo[i], [this, i](double t) { return t < umschaltenBei ? cm[i] : spaeterCm[i]; });
+        }
+    }
+};
+
+// Fünf Pings in der Reihenfolge 0, 1, 2, 0, 1: eine Reflexion an Sensor 2 verschiebt den Median nicht,
+// ein stummer Sensor zählt nicht gegen die Mehrheit, fehlende Echos der übrigen schon
+TEST(fusion_median_und_mehrheit)
+{
+    {
+        Gestell g;
+        sim::As als(g.n);
+        g.cm[2] = 40.0f;
+        Gruppe gruppe("ESP1");
+        float d = gruppe.measureFused(5, esp1::ECHO_TIMEOUT_US, slotFrei);
+        CHECK_EQ(gruppe.rawCount, 5);
+        CHECK_LT(fabs(gruppe.rawPings[2] - 40.0f), 1.0f);
+        CHECK_LT(fabs(d - 150.0f), 1.0f);
+    }
+    {
+        Gestell g;
+        sim::As als(g.n);
+        g.n.sensors[2]->dead = true;
+        Gruppe gruppe("ESP1");
+        float d = gruppe.measureFused(5, esp1::ECHO_TIMEOUT_US, slotFrei);
+        CHECK_EQ(gruppe.rawPings[2], -1.0f);
+        CHECK_LT(fabs(d - 150.0f), 1.0f);
+    }
+    {
+        // Sensor 0 und 1 verlieren nach ihrem ersten Ping das Ziel: 2 Echos gegen 2 gezählte Fehl-Echos
+        Gestell g;
+        sim::As als(g.n);
+        g.n.sensors[2]->dead = true;
+        g.spaeterCm[0] = g.spaeterCm[1] = -1.0f;
+        g.umschaltenBei = sekunden(sim::now()) + 0.025;
+        Gruppe gruppe("ESP1");
+        float d = gruppe.measureFused(5, esp1::ECHO_TIMEOUT_US, slotFrei);
+        CHECK(gruppe.rawPings[0] > 0 && gruppe.rawPings[1] > 0);
+        CHECK(gruppe.rawPings[3] < 0 && gruppe.rawPings[4] < 0);
+        CHECK_EQ(d, -1.0f);
+    }
+}
+
+// Endet der TDMA-Slot, zählen die Pings bis dahin
+TEST(fusion_endet_mit_dem_slot)
+{
+    Gestell g;
+    sim::As als(g.n);
+    Gruppe gruppe("ESP1");
+    slotAbfragen = 0;
+    float d = gruppe.measureFused(5, esp1::ECHO_TIMEOUT_US, slotEndetNachDreiPings);
+    CHECK_EQ(gruppe.rawCount, 3);
+    CHECK_EQ(gruppe.nextSensor, 0);
+    CHECK_LT(fabs(d - 150.0f), 1.0f);
+    CHECK_EQ(Gruppe::pingBudgetUs(esp1::ECHO_TIMEOUT_US), esp1::ECHO_TIMEOUT_US + SENSOR_GUARD_US);
+}
+
+// Der Client fusioniert genauso: an der Zielschranke ist Sensor 1 stumm, er wird während des Laufs
+// gemeldet und der Lauf trotzdem gestoppt
+TEST(ziel_mit_stummem_sensor)
+{
+    Anlage &a = Anlage::neu();
+    a.client.addSensor(32, 34, [&a](double t) { return a.ziel(t); }).dead = true;
+    a.client.addSensor(33, 35, [&a](double t) { return a.ziel(t); });
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+
+    uint64_t ab = sim::driverNow();
+    double t = sekunden(ab);
+    a.start.durchgang(t + 0.5, 3.0);
+    a.ziel.durchgang(t + 12.0, 0.5);
+    REQUIRE(Anlage::warte([] { return esp2::clientState == esp2::DISPLAYING_RESULT; }, us(18)));
+    CHECK(a.client.findLog("ESP2: WARNUNG - Sensor 1 liefert keine Echos mehr") != nullptr);
+    CHECK_EQ(esp2::gateSensors.healthySensors(), SENSOR_COUNT - 1);
+    CHECK_EQ(a.client.countLog("SYSTEM FEHLER", ab), 0);
+}
@@ -0,0 +1,36 @@
+// Sketche - Alle Plattform- und Lichtschranke-Header auf oberster Ebene einbinden, damit die
+// Sketches danach in einen eigenen Namensraum eingebunden werden können:
+//
+//   namespace esp1 {
+//   #include "../ESP32-Server.cpp"
+//   }
+//
+// Die Includes in den Sketches sind dann wirkungslos (#pragma once).
+
+#pragma once
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <WiFiAP.h>
+#include <WiFiClient.h>
+#include <Wire.h>
+#include <esp_heap_caps.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include <soc/gpio_reg.h>
+
+#include "../Lichtschranke-Detektor.h"
+#include "../Lichtschranke-Energie.h"
+#include "../Lichtschranke-Geschwindigkeit.h"
+#include "../Lichtschranke-Protokoll.h"
+#include "../Lichtschranke-Speicher.h"
+#include "../Lichtschranke-Telemetrie.h"
+#include "../Lichtschranke-Treiber.h"
+#include "../Lichtschranke-Verbindung.h"
+#include "../Lichtschranke-Zustand.h"
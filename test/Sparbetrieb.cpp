@@ -0,0 +1,123 @@
+// Sparbetrieb - Anwesenheits-Ping, Schlafscheiben und Aufwachen aus dem Sparbetrieb
+// Der IdleScheduler läuft erst allein gegen ein Loop-Modell (zufällige Echo- und Loop-Zeiten,
+// zufällige Annäherungen), danach der Server und der Client in der Simulation.
+
+#include "Aufbau.h"
+
+#include <algorithm>
+
+// Eine simulierte Stunde Server-Loop: Ping 1-25ms je nach Echo, Rest des Loops 0.2-1ms, alle
+// 1-3 Minuten eine Annäherung, danach 10s Lauf. Gemessen wird von der Ankunft des Objekts bis zur
+// ersten Abtastung mit voller Rate
+TEST(planer_eine_stunde)
+{
+    sim::Rng rng(43);
+    IdleScheduler s(esp1::LOOP_DELAY_MS, IDLE_PING_INTERVAL_MS);
+    const uint64_t ende = 3600ull * 1000000;
+    uint64_t jetzt = 0, letzteAbtastung = 0;
+    uint64_t ankunft = 0, laufBis = 0;
+    uint64_t naechsteAnnaeherung = 60000000;
+    uint64_t schlechteste = 0;
+    int annaeherungen = 0;
+    bool wartet = false;
+    while (jetzt < ende)
+    {
+        uint64_t loopStart = jetzt;
+        unsigned long ms = (unsigned long)(jetzt / 1000);
+        if (!wartet && jetzt >= naechsteAnnaeherung)
+        {
+            ankunft = naechsteAnnaeherung;
+            wartet = true;
+        }
+        s.update(ms, !wartet && jetzt >= laufBis);
+
+        if (s.sampleDue(ms, (unsigned long)(letzteAbtastung / 1000)))
+        {
+            letzteAbtastung = jetzt;
+            s.sampled((unsigned long)jetzt);
+            bool objekt = wartet && jetzt >= ankunft;
+            bool ping = s.saving;
+            jetzt += 1000 + (uint64_t)(rng.uniform() * 24000);
+            if (ping)
+            {
+                s.pinged((unsigned long)(jetzt - letzteAbtastung));
+            }
+            if (objekt && s.saving)
+            {
+                s.wake((unsigned long)(jetzt / 1000), (unsigned long)jetzt);
+                letzteAbtastung = jetzt - esp1::LOOP_DELAY_MS * 1000; // wie wakeFromIdle()
+            }
+            else if (objekt)
+            {
+                schlechteste = std::max(schlechteste, letzteAbtastung - ankunft);
+                annaeherungen++;
+                wartet = false;
+                laufBis = jetzt + 10000000;
+                naechsteAnnaeherung = jetzt + 60000000 + (uint64_t)(rng.uniform() * 120000000);
+            }
+        }
+        jetzt += 200 + (uint64_t)(rng.uniform() * 800);
+
+        unsigned long schlaf = s.sleepBudgetMs((unsigned long)(jetzt / 1000), (unsigned long)(letzteAbtastung / 1000));
+        uint64_t schlafStart = jetzt;
+        jetzt += std::max(schlaf, 1UL) * 1000;
+        if (s.saving)
+        {
+            s.account((unsigned long)(schlafStart - loopStart), (unsigned long)(jetzt - schlafStart));
+        }
+    }
+    pruefung::bericht("Annäherungen", annaeherungen, "");
+    pruefung::bericht("Wach im Sparbetrieb", s.dutyCyclePermille() / 10.0, "%");
+    pruefung::bericht("Ankunft bis volle Rate schlechteste", schlechteste / 1000.0, "ms");
+    pruefung::bericht("Garantierte Grenze", s.wakeBoundMs(), "ms");
+    pruefung::bericht("Ping verspätet schlechteste", s.maxPingLateUs, "us");
+    CHECK_GE(annaeherungen, 20);
+    CHECK_EQ(s.wakeUps, (unsigned long)annaeherungen);
+    CHECK_LE(schlechteste / 1000, (uint64_t)s.wakeBoundMs());
+    CHECK_LT(s.dutyCyclePermille(), 150);
+}
+
+// Beide Knoten nach 30s Ruhe im Sparbetrieb, zwei Minuten Anwesenheits-Ping, dann ein Läufer:
+// der Server wacht beim ersten Ping auf, der Client mit WAKE vor START_TIMER
+TEST(anlage_schlaeft_und_wacht_auf)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+    REQUIRE(Anlage::warte([] { return esp1::idleScheduler.saving && esp2::idleScheduler.saving; },
+                          us(IDLE_ENTER_AFTER_MS / 1000.0 + 10)));
+    CHECK(a.server.findLog("ESP1: Sparbetrieb (") != nullptr);
+    CHECK(a.client.findLog("ESP2: Sparbetrieb (") != nullptr);
+    sim::runFor(us(120));
+    REQUIRE(esp1::idleScheduler.saving);
+    pruefung::bericht("Server wach im Sparbetrieb", esp1::idleScheduler.dutyCyclePermille() / 10.0, "%");
+    pruefung::bericht("Client wach im Sparbetrieb", esp2::idleScheduler.dutyCyclePermille() / 10.0, "%");
+    CHECK_LT(esp1::idleScheduler.dutyCyclePermille(), 150);
+
+    uint64_t ankunft = sim::driverNow() + us(0.5) + (uint64_t)(a.server.rng.uniform() * 200000);
+    a.start.durchgang(sekunden(ankunft), 3.0);
+    a.ziel.durchgang(sekunden(ankunft) + 5.5, 0.5);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::OBJECT_DETECTED_YELLOW_PENDING; }, us(2)));
+    const sim::LogLine *wach = a.server.findLog("ESP1: Sparbetrieb beendet - Annäherung", ankunft);
+    REQUIRE(wach != nullptr);
+    pruefung::bericht("Ankunft bis Aufwachen", (wach->at - ankunft) / 1000.0, "ms");
+    pruefung::bericht("Aufwachen bis volle Rate", esp1::idleScheduler.maxWakeLatencyUs / 1000.0, "ms");
+    pruefung::bericht("Garantierte Grenze", esp1::idleScheduler.wakeBoundMs(), "ms");
+    CHECK_LE((wach->at - ankunft) / 1000 + esp1::idleScheduler.maxWakeLatencyUs / 1000,
+             (uint64_t)esp1::idleScheduler.wakeBoundMs());
+
+    REQUIRE(Anlage::warte([] { return esp2::clientState == esp2::TIMING_IN_PROGRESS; }, us(5)));
+    const sim::LogLine *clientWach = a.client.findLog("ESP2: Sparbetrieb beendet", ankunft);
+    const sim::LogLine *start = a.client.findLog("ESP2: Zustand IDLE -> TIMING", ankunft);
+    REQUIRE(clientWach != nullptr && start != nullptr);
+    pruefung::bericht("Client wach vor START_TIMER", (start->at - clientWach->at) / 1000.0, "ms");
+    CHECK_GE(start->at - clientWach->at, us(2.5));
+    // Nach dem Aufwachen sofort nachsynchronisiert, noch vor START_TIMER
+    const sim::LogLine *sync = a.server.findLog("Client: 'TIME_REQ:", clientWach->at);
+    REQUIRE(sync != nullptr);
+    pruefung::bericht("Aufwachen bis Nachsynchronisation", (sync->at - clientWach->at) / 1000.0, "ms");
+    CHECK_LT(sync->at, start->at);
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+}
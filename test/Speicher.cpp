@@ -0,0 +1,132 @@
+// Speicher - Heap-, Fragmentierungs- und Stack-Telemetrie beider Knoten
+// Die Auswertung bekommt erzeugte Messpunkte, die Anlage simulierte heap_caps-Werte, die der Test
+// Minute für Minute verändert: ein Leck beim Client, danach ein zerstückelter Heap.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+static MemorySample punkt(uint32_t minute, uint32_t frei, uint32_t groessterBlock, uint32_t stack = 4000)
+{
+    MemorySample s;
+    s.atMs = minute * MEMORY_SAMPLE_INTERVAL_MS;
+    s.freeHeap = frei;
+    s.minFreeHeap = frei;
+    s.largestBlock = groessterBlock;
+    s.stackFree = stack;
+    return s;
+}
+
+// Warnung nur an der Flanke, erst unter 40% wieder scharf
+TEST(fragmentierung_mit_hysterese)
+{
+    MemoryTelemetry m;
+    CHECK(!m.record(punkt(0, 100000, 60000)));      // 40%
+    CHECK(m.record(punkt(1, 100000, 50000)));       // 50%: Warnung
+    CHECK(!m.record(punkt(2, 100000, 30000)));      // bleibt gewarnt
+    CHECK(!m.record(punkt(3, 100000, 55000)));      // 45%: noch in der Hysterese
+    CHECK(m.fragmented);
+    CHECK(!m.record(punkt(4, 100000, 61000)));      // 39%: zurückgesetzt
+    CHECK(!m.fragmented);
+    CHECK(m.record(punkt(5, 100000, 49000)));       // erneut
+    CHECK_EQ(m.warnings, 2ul);
+    CHECK_EQ(punkt(0, 0, 0).fragmentationPct(), 0);
+}
+
+// Die High-Water-Mark erholt sich nie: eine Warnung, auch wenn spätere Werte wieder höher sind
+TEST(stack_warnung_einmal)
+{
+    MemoryTelemetry m;
+    CHECK(!m.record(punkt(0, 100000, 90000, 2000)));
+    CHECK(m.record(punkt(1, 100000, 90000, 900)));
+    CHECK(!m.record(punkt(2, 100000, 90000, 800)));
+    CHECK(!m.record(punkt(3, 100000, 90000, 3000)));
+    CHECK(m.stackLow);
+    CHECK_EQ(m.warnings, 1ul);
+}
+
+// 40 Minuten mit 200 Byte Verlust pro Minute: Trend über die letzten 16 Punkte, JSON in Reihenfolge
+TEST(trend_ueber_den_ring)
+{
+    MemoryTelemetry m;
+    CHECK_EQ(m.heapTrendPerHour(), 0l);
+    CHECK(m.toJSON() == "{}");
+    for (uint32_t minute = 0; minute < 40; minute++)
+    {
+        m.record(punkt(minute, 150000 - minute * 200, 100000));
+    }
+    CHECK_EQ(m.count, MEMORY_TREND_SLOTS);
+    CHECK_EQ(m.at(0).atMs, (40u - MEMORY_TREND_SLOTS) * MEMORY_SAMPLE_INTERVAL_MS);
+    CHECK_EQ(m.latest().freeHeap, 150000u - 39 * 200);
+    CHECK_EQ(m.heapTrendPerHour(), -12000l);
+    pruefung::bericht("Trend bei 200 Byte/min Verlust", m.heapTrendPerHour(), "Byte/h");
+
+    String json = m.toJSON();
+    std::string erwartet = "\"free_history\":[" + std::to_string(150000 - 24 * 200) + ",";
+    CHECK(strstr(json.c_str(), erwartet.c_str()) != nullptr);
+    CHECK(strstr(json.c_str(), "\"trend_per_h\":-12000,") != nullptr);
+
+    // Wachsender Heap (z.B. nach dem Schließen eines Downloads): positiver Trend
+    MemoryTelemetry w;
+    w.record(punkt(0, 100000, 90000));
+    w.record(punkt(30, 103000, 90000));
+    CHECK_EQ(w.heapTrendPerHour(), 6000l);
+}
+
+static std::string speicherJson(Anlage &a)
+{
+    sim::Peer p = sim::connectPeer(a.server, esp1::LIVE_PORT);
+    REQUIRE(p.ok());
+    p.write("GET /memory HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n");
+    REQUIRE(Anlage::warte([&] { return p.closedByNode(); }, us(5)));
+    std::string antwort = p.received();
+    size_t pos = antwort.find("\r\n\r\n");
+    REQUIRE(pos != std::string::npos);
+    return antwort.substr(pos + 4);
+}
+
+static long feld(const std::string &json, const std::string &teil, const char *name)
+{
+    size_t pos = json.find("\"" + teil + "\":");
+    REQUIRE(pos != std::string::npos);
+    pos = json.find(std::string("\"") + name + "\":", pos);
+    REQUIRE(pos != std::string::npos);
+    return atol(json.c_str() + pos + strlen(name) + 3);
+}
+
+// Client verliert 500 Byte pro Minute, danach zerfällt sein Heap: der Server zeigt beides unter
+// /memory und warnt einmal
+TEST(client_meldet_leck_und_fragmentierung)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+    uint64_t ab = sim::driverNow();
+
+    for (int minute = 0; minute < 6; minute++)
+    {
+        sim::runFor(us(60));
+        a.client.heapFree -= 500;
+        a.client.heapMinFree = std::min(a.client.heapMinFree, a.client.heapFree);
+    }
+    std::string json = speicherJson(a);
+    pruefung::bericht("Client-Trend laut /memory", feld(json, "client", "trend_per_h"), "Byte/h");
+    // Zeitstempel beim Empfang: die Abstände schwanken um die Laufzeit der Meldung
+    CHECK_LT(labs(feld(json, "client", "trend_per_h") + 30000), 300l);
+    CHECK_EQ(feld(json, "client", "free"), (long)a.client.heapFree + 500);
+    CHECK_EQ(feld(json, "server", "free"), (long)a.server.heapFree);
+    CHECK_EQ(feld(json, "server", "stack_free"), (long)a.server.stackHighWater);
+    CHECK_EQ(a.server.countLog("WARNUNG Speicher", ab), 0);
+
+    a.client.heapLargest = a.client.heapFree / 3;
+    sim::runFor(us(130));
+    CHECK_EQ(a.client.countLog("ESP2: WARNUNG Speicher", ab), 1);
+    CHECK_EQ(a.server.countLog("ESP1: WARNUNG Speicher Client", ab), 1);
+    json = speicherJson(a);
+    CHECK_GE(feld(json, "client", "frag_pct"), (long)MEMORY_FRAGMENTATION_WARN_PCT);
+    CHECK_EQ(feld(json, "client", "warnings"), 1l);
+}
@@ -0,0 +1,188 @@
+// TDMA - Abstimmung der Pings zwischen Start- und Zielschranke
+// Beide Schranken stehen so, dass jede den Burst der anderen über die Wand hört. Mit Telemetrie-
+// Empfänger messen beide dauernd (kein Sparbetrieb), der Client hält seine Zeitbasis per
+// Nachsynchronisation gegen die Quarz-Drift.
+
+#include "Aufbau.h"
+
+#include <algorithm>
+
+// Burst der anderen Schranke kommt kurz vor dem eigenen Wand-Echo (150cm) an
+static void schrankenHoerenSich()
+{
+    sim::world().crossPathCm = [](const sim::Sensor &von, const sim::Sensor &an, double) {
+        return von.node != an.node ? 280.0f : 0.0f;
+    };
+}
+
+// Beide Schranken verbunden, synchronisiert und mit Telemetrie-Empfänger
+static Anlage &messbereit(double clientDriftPpm = 0)
+{
+    Anlage &a = Anlage::neu();
+    schrankenHoerenSich();
+    a.client.driftPpm = clientDriftPpm;
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+    // Empfänger bleiben wie die Anlage bis zum Prozessende verbunden
+    REQUIRE((new sim::Peer(sim::connectPeer(a.server, TELEMETRY_PORT)))->ok());
+    REQUIRE((new sim::Peer(sim::connectPeer(a.client, TELEMETRY_PORT)))->ok());
+    REQUIRE(Anlage::warte([] { return esp1::telemetry.enabled && esp2::telemetry.enabled; }, us(1)));
+    return a;
+}
+
+struct Pingzahl
+{
+    size_t pings = 0;
+    size_t fremd = 0;
+};
+
+static Pingzahl zaehle(const sim::Sensor &s, uint64_t ab)
+{
+    Pingzahl z;
+    for (const sim::Ping &p : s.pings)
+    {
+        if (p.trigAt >= ab)
+        {
+            z.pings++;
+            z.fremd += p.foreign;
+        }
+    }
+    return z;
+}
+
+// Abgestimmt: kein Ping hört den Burst der anderen Schranke, beide messen mit voller Slot-Rate
+TEST(abgestimmt_keine_fremden_echos)
+{
+    Anlage &a = messbereit();
+    REQUIRE(esp1::clientTimeSynced);
+    REQUIRE(esp2::timeBase.synced);
+
+    uint64_t ab = sim::driverNow();
+    uint32_t serverMesswerte = esp1::telemetry.sampleCounter;
+    uint32_t clientMesswerte = esp2::telemetry.sampleCounter;
+    // maxLoopDurationUs wird mit jeder Statuszeile zurückgesetzt, daher laufend mitlesen
+    unsigned long laengsterLoop = 0;
+    const double dauer = 20.0;
+    for (int ms = 0; ms < dauer * 1000; ms++)
+    {
+        sim::runFor(1000);
+        laengsterLoop = std::max(laengsterLoop, esp1::maxLoopDurationUs);
+    }
+
+    Pingzahl server = zaehle(*a.startSensoren[0], ab);
+    Pingzahl client = zaehle(*a.zielSensor, ab);
+    double serverRate = (esp1::telemetry.sampleCounter - serverMesswerte) / dauer;
+    double clientRate = (esp2::telemetry.sampleCounter - clientMesswerte) / dauer;
+    pruefung::bericht("Server: Pings pro Sekunde", server.pings / dauer, "1/s");
+    pruefung::bericht("Client: Pings pro Sekunde", client.pings / dauer, "1/s");
+    pruefung::bericht("Server: Messwerte pro Sekunde", serverRate, "1/s");
+    pruefung::bericht("Client: Messwerte pro Sekunde", clientRate, "1/s");
+    pruefung::bericht("Fremde Echos", server.fremd + client.fremd, "");
+    pruefung::bericht("Server: längster Loop-Durchlauf", laengsterLoop / 1000.0, "ms");
+    CHECK_EQ(server.fremd + client.fremd, 0u);
+    // Ein Messwert pro Frame und Schranke, ein blockierender Slot-Wartevorgang würde ihn halbieren
+    CHECK_GE(serverRate, 0.9e6 / esp1::TDMA_FRAME_US);
+    CHECK_GE(clientRate, 0.9e6 / esp2::TDMA_FRAME_US);
+    // Der Loop wartet nie auf den Slot, nur auf Nachrichten und seine Abtastung
+    CHECK_LT(laengsterLoop, esp1::TDMA_SLOT_US);
+}
+
+// Vergleich ohne Abstimmung: beide feuern nach ihrem eigenen Takt und hören sich gegenseitig
+TEST(ohne_abstimmung_fremde_echos)
+{
+    Anlage &a = messbereit();
+    {
+        sim::As als(a.client);
+        esp2::timeBase.synced = false;
+        esp2::lastTimeSyncRequest = millis();   // Keine Nachsynchronisation im Messfenster
+    }
+    esp1::clientTimeSynced = false;
+
+    uint64_t ab = sim::driverNow();
+    sim::runFor(us(5));
+    REQUIRE(!esp1::clientTimeSynced);
+
+    Pingzahl server = zaehle(*a.startSensoren[0], ab);
+    Pingzahl client = zaehle(*a.zielSensor, ab);
+    double anteil = 100.0 * (server.fremd + client.fremd) / (server.pings + client.pings);
+    pruefung::bericht("Ohne Abstimmung: Anteil fremder Echos", anteil, "%");
+    CHECK_GT(server.fremd + client.fremd, 0u);
+}
+
+// Uhr eines Knotens zur globalen Simulationszeit t (die Knoten halten nicht exakt gleichzeitig an)
+static uint64_t lokaleZeit(const sim::Node &n, uint64_t t)
+{
+    double vergangen = (double)(t - n.bootAt);
+    return n.localStartUs + (uint64_t)(vergangen + vergangen * n.driftPpm * 1e-6);
+}
+
+// Client-Quarz 40ppm zu schnell: jede Nachsynchronisation muss innerhalb von TIME_SYNC_MAX_RTT_US
+// beantwortet werden, sonst wächst die Unsicherheit um 50us/s, bis der Sicherheitsabstand das
+// Fenster auf die Hälfte verkleinert (nach etwa zwei Minuten)
+TEST(nachsynchronisation_gegen_drift)
+{
+    Anlage &a = messbereit(40);
+
+    uint64_t ab = sim::driverNow();
+    int uebernommen = 0;
+    uint64_t letzteUebernahme = esp2::timeBase.syncedAt;
+    unsigned long groessteUnsicherheit = 0;
+    long groessterFehler = 0;
+    int ausserhalb = 0;
+    const int sekunden = 120;
+    for (int i = 0; i < sekunden * 10; i++)
+    {
+        sim::runFor(100000);
+        if (esp2::timeBase.syncedAt != letzteUebernahme)
+        {
+            uebernommen++;
+            letzteUebernahme = esp2::timeBase.syncedAt;
+        }
+        sim::As als(a.client);
+        unsigned long unsicherheit = esp2::timeBase.uncertaintyUs();
+        // Tatsächliche Abweichung der Client-Zeitbasis von der Server-Uhr zum selben Zeitpunkt
+        long fehler = (long)(int32_t)((uint32_t)a.client.localUs() + (uint32_t)esp2::timeBase.offsetUs -
+                                      (uint32_t)lokaleZeit(a.server, a.client.time));
+        groessteUnsicherheit = std::max(groessteUnsicherheit, unsicherheit);
+        groessterFehler = std::max(groessterFehler, labs(fehler));
+        ausserhalb += (unsigned long)labs(fehler) > unsicherheit;
+    }
+
+    int anfragen = a.server.countLog("Client: 'TIME_REQ:", ab);
+    pruefung::bericht("Nachsynchronisationen angefragt", anfragen, "");
+    pruefung::bericht("Nachsynchronisationen übernommen", uebernommen, "");
+    pruefung::bericht("Größte Unsicherheit", groessteUnsicherheit, "us");
+    pruefung::bericht("Größter tatsächlicher Fehler", groessterFehler, "us");
+    CHECK_GE(uebernommen, sekunden * 1000 / (int)esp2::TIME_SYNC_INTERVAL_MS / 2);
+    CHECK_EQ(ausserhalb, 0);
+    // Der Sicherheitsabstand (Schutzzeit + Unsicherheit) erreicht nie seine Obergrenze
+    CHECK_LT(groessteUnsicherheit + esp2::TDMA_GUARD_US, esp2::TDMA_SLOT_US / 4);
+    CHECK_EQ(a.client.countLog("Keine Zeitsynchronisation", ab), 0);
+    CHECK_EQ(zaehle(*a.startSensoren[0], ab).fremd + zaehle(*a.zielSensor, ab).fremd, 0u);
+}
+
+// Über eine Stunde im Sparbetrieb ohne Nachsynchronisation: micros() läuft nach 71,6 Minuten über,
+// die Unsicherheit wächst trotzdem weiter und der Sicherheitsabstand bleibt an seiner Obergrenze
+TEST(unsicherheit_ueber_micros_ueberlauf)
+{
+    sim::Node &n = *new sim::Node("ESP2", 2);
+    sim::As als(n);
+    esp2::TimeBase basis;
+    unsigned long gesendet = micros();
+    REQUIRE(basis.accept(gesendet, 5000000, gesendet + 2000));
+    unsigned long letzte = basis.uncertaintyUs();
+    int gesunken = 0;
+    for (int minute = 1; minute <= 80; minute++)
+    {
+        sim::advance(60000000ull);
+        unsigned long unsicherheit = basis.uncertaintyUs();
+        gesunken += unsicherheit < letzte;
+        letzte = unsicherheit;
+    }
+    pruefung::bericht("Unsicherheit nach 80 Minuten", letzte, "us");
+    CHECK_EQ(gesunken, 0);
+    CHECK_GE(letzte, 1000ul + 80 * 60 * esp2::CLOCK_DRIFT_PPM);
+    CHECK_GT(esp2::TDMA_GUARD_US + letzte, esp2::TDMA_SLOT_US / 4);
+}
@@ -0,0 +1,190 @@
+// Telemetrie - Rohdaten-Stream: Kodierung, Empfänger auf dem PC und Rückstau
+// Der Stream wird mit erzeugten Abtastungen gefüllt und von einem langsamen Empfänger geleert. Die
+// Bytes dekodiert tools/Telemetrie-Empfang.py (--datei), verglichen wird dessen CSV-Ausgabe.
+// Die Zeitstempel laufen dabei über 2^32 (micros()-Überlauf nach ~71 Minuten).
+
+#include "Aufbau.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+typedef std::chrono::steady_clock Uhr;
+
+struct Abtastung
+{
+    uint64_t us;                         // Fortgezählt, ohne Überlauf
+    float gefiltert;
+    std::vector<float> roh;
+};
+
+// Wie der Empfänger formatiert: eine Nachkommastelle, leer = kein Wert
+static std::string zehntel(int32_t mm)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%.1f", mm / 10.0);
+    return text;
+}
+
+static std::string erwarteteZeile(uint32_t nr, uint64_t t, const Abtastung &a)
+{
+    int32_t mm = a.gefiltert > 0 ? (int32_t)lroundf(a.gefiltert * 10.0f) : 0;
+    std::string zeile = "2," + std::to_string(nr) + "," + std::to_string(t) + "," + (mm > 0 ? zehntel(mm) : "") + ",";
+    for (size_t i = 0; i < a.roh.size(); i++)
+    {
+        zeile += (i ? ";" : "") + (a.roh[i] > 0 ? zehntel((int32_t)lroundf(a.roh[i] * 10.0f)) : std::string());
+    }
+    return zeile;
+}
+
+static const char *empfaenger()
+{
+    for (const char *pfad : {"../tools/Telemetrie-Empfang.py", "tools/Telemetrie-Empfang.py"})
+    {
+        if (access(pfad, R_OK) == 0)
+        {
+            return pfad;
+        }
+    }
+    return nullptr;
+}
+
+// Zwei Knotenminuten bei 50Hz über den Überlauf hinweg, der Empfänger nimmt pro Loop nur 0-300 Byte
+// ab und hängt zwischendurch mehrfach eine Sekunde
+TEST(rundreise_durch_den_empfaenger)
+{
+    const char *skript = empfaenger();
+    REQUIRE(skript != nullptr);
+    sim::Node &n = *new sim::Node("ESP2", 2);
+    sim::As als(n);
+    TelemetryStream stream(2);
+    stream.enabled = true;
+
+    std::vector<Abtastung> abtastungen;
+    std::string strom;
+    uint64_t t = 0xFFFFFFFFull - 60000000;   // Überlauf nach einer Minute
+    uint64_t haengtBis = 0;
+    for (int i = 0; i < 6000; i++)
+    {
+        t += 20000 + (uint64_t)(n.rng.uniform() * 500);
+        Abtastung a;
+        a.us = t;
+        a.gefiltert = n.rng.uniform() < 0.02 ? -1.0f : (float)(40.0 + n.rng.uniform() * 360.0);
+        int pings = 1 + (int)(n.rng.next() % 4);
+        for (int p = 0; p < pings; p++)
+        {
+            a.roh.push_back(n.rng.uniform() < 0.1 ? -1.0f : (float)(a.gefiltert + n.rng.gauss() * 3.0));
+        }
+        abtastungen.push_back(a);
+        stream.record((uint32_t)t, a.gefiltert, a.roh.data(), (int)a.roh.size());
+        stream.flushIfDue((uint32_t)t);
+
+        if (i % 1000 == 500)
+        {
+            haengtBis = t + 1000000;
+        }
+        const uint8_t *daten;
+        int len;
+        if (t >= haengtBis && stream.pending(daten, len))
+        {
+            len = std::min(len, (int)(n.rng.next() % 300));
+            strom.append((const char *)daten, len);
+            stream.consumed(len);
+        }
+    }
+    const uint8_t *daten;
+    int len;
+    stream.flushIfDue((uint32_t)(t + TELEMETRY_BATCH_US));
+    while (stream.pending(daten, len))
+    {
+        strom.append((const char *)daten, len);
+        stream.consumed(len);
+    }
+
+    char roh[] = "/tmp/telemetrie-XXXXXX";
+    int fd = mkstemp(roh);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, strom.data(), strom.size()) == (ssize_t)strom.size());
+    close(fd);
+    std::string csv = std::string(roh) + ".csv";
+    std::string befehl = std::string("python3 ") + skript + " --datei " + roh + " -o " + csv + " 2>/dev/null";
+    REQUIRE(system(befehl.c_str()) == 0);
+
+    // Laufende Nummer = Index, Zeit relativ zur ersten gesendeten Abtastung plus deren micros()
+    std::ifstream ein(csv);
+    std::string zeile;
+    REQUIRE(std::getline(ein, zeile) && zeile == "schranke,abtastung,zeit_us,gefiltert_cm,roh_cm");
+    int empfangen = 0, abweichend = 0;
+    uint64_t erste = 0;
+    while (std::getline(ein, zeile))
+    {
+        uint32_t nr = (uint32_t)strtoul(zeile.c_str() + 2, nullptr, 10);
+        REQUIRE(nr < abtastungen.size());
+        if (empfangen == 0)
+        {
+            erste = abtastungen[nr].us;
+        }
+        uint64_t zeit = (uint32_t)erste + (abtastungen[nr].us - erste);
+        abweichend += zeile != erwarteteZeile(nr, zeit, abtastungen[nr]);
+        empfangen++;
+    }
+    unlink(roh);
+    unlink(csv.c_str());
+    pruefung::bericht("Bytes", strom.size(), "");
+    pruefung::bericht("Byte pro Abtastung", (double)strom.size() / empfangen, "");
+    pruefung::bericht("Abtastungen empfangen", empfangen, "");
+    pruefung::bericht("Verworfene Batches", stream.droppedBatches, "");
+    pruefung::bericht("Abweichend", abweichend, "");
+    CHECK_EQ(abweichend, 0);
+    CHECK_GT(stream.droppedBatches, 0ul);             // Die Hänger haben den Rückstau ausgelöst
+    CHECK_GT(empfangen, 3000);
+    CHECK_GT(abtastungen.back().us, 0xFFFFFFFFull);
+}
+
+// Empfänger liest nie: höchstens TELEMETRY_QUEUE_BATCHES warten, die Rate fällt bis 1/64.
+// Sobald er wieder liest, geht sie zurück auf volle Rate
+TEST(rueckstau_empfaenger_liest_nicht)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    TelemetryStream stream(1);
+    stream.enabled = true;
+    float roh[4] = {150.1f, 149.8f, -1.0f, 150.4f};
+    uint32_t t = 1000;
+    int meisteWartend = 0;
+    std::vector<double> ns;
+    for (int i = 0; i < 50000; i++)
+    {
+        t += 20000;
+        Uhr::time_point t0 = Uhr::now();
+        stream.record(t, 150.0f, roh, 4);
+        ns.push_back(std::chrono::duration<double, std::nano>(Uhr::now() - t0).count());
+        stream.flushIfDue(t);
+        meisteWartend = std::max(meisteWartend, stream.queued);
+    }
+    std::sort(ns.begin(), ns.end());
+    pruefung::bericht("Wartende Batches höchstens", meisteWartend, "");
+    pruefung::bericht("Rate zuletzt: jede n-te Abtastung", 1 << stream.decimation, "");
+    pruefung::bericht("Verworfene Batches", stream.droppedBatches, "");
+    pruefung::bericht("record() p99 (Host)", ns[ns.size() * 99 / 100] / 1000.0, "us");
+    CHECK_EQ(meisteWartend, TELEMETRY_QUEUE_BATCHES);
+    CHECK_EQ(stream.decimation, TELEMETRY_MAX_DECIMATION);
+
+    const uint8_t *daten;
+    int len;
+    for (int i = 0; i < 20000 && stream.decimation > 0; i++)
+    {
+        t += 20000;
+        stream.record(t, 150.0f, roh, 4);
+        stream.flushIfDue(t);
+        while (stream.pending(daten, len))
+        {
+            stream.consumed(len);
+        }
+    }
+    CHECK_EQ(stream.decimation, 0);
+}
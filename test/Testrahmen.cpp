@@ -0,0 +1,112 @@
+// Testrahmen - Ablauf: ./Test [Name...], Rückgabe 0 = alle bestanden
+
+#include "Testrahmen.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace pruefung
+{
+
+static const int TEST_TIMEOUT_S = 300;
+
+struct Fall
+{
+    const char *name;
+    Testfunktion fn;
+};
+
+static std::vector<Fall> &faelle()
+{
+    static std::vector<Fall> f;
+    return f;
+}
+
+static int fehler = 0;
+
+Anmeldung::Anmeldung(const char *name, Testfunktion fn)
+{
+    faelle().push_back(Fall{name, fn});
+}
+
+void fehlschlag(const char *datei, int zeile, const std::string &text)
+{
+    printf("    FEHLER %s:%d: %s\n", datei, zeile, text.c_str());
+    fflush(stdout);
+    fehler++;
+}
+
+void abbruch(const char *datei, int zeile, const std::string &text)
+{
+    fehlschlag(datei, zeile, text);
+    _exit(1);
+}
+
+void bericht(const char *was, double wert, const char *einheit)
+{
+    printf("    %-56s %12.4g %s\n", was, wert, einheit);
+    fflush(stdout);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    using namespace pruefung;
+    int fehlgeschlagen = 0, gelaufen = 0;
+    for (const Fall &f : faelle())
+    {
+        bool gewaehlt = argc < 2;
+        for (int i = 1; i < argc; i++)
+        {
+            gewaehlt = gewaehlt || strcmp(argv[i], f.name) == 0;
+        }
+        if (!gewaehlt)
+        {
+            continue;
+        }
+        printf("  %s\n", f.name);
+        fflush(stdout);
+        timespec start, ende;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            alarm(TEST_TIMEOUT_S);
+            f.fn();
+            fflush(stdout);
+            _exit(fehler ? 1 : 0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        clock_gettime(CLOCK_MONOTONIC, &ende);
+        double s = (ende.tv_sec - start.tv_sec) + (ende.tv_nsec - start.tv_nsec) / 1e9;
+        gelaufen++;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            printf("  OK      %s (%.1fs)\n", f.name, s);
+        }
+        else
+        {
+            fehlgeschlagen++;
+            if (WIFSIGNALED(status))
+            {
+                printf("  FEHLER  %s: Signal %d%s\n", f.name, WTERMSIG(status),
+                       WTERMSIG(status) == SIGALRM ? " (Zeitüberschreitung)" : "");
+            }
+            else
+            {
+                printf("  FEHLER  %s (%.1fs)\n", f.name, s);
+            }
+        }
+        fflush(stdout);
+    }
+    printf("%s: %d von %d bestanden\n", argv[0], gelaufen - fehlgeschlagen, gelaufen);
+    return fehlgeschlagen ? 1 : 0;
+}
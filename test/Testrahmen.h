@@ -0,0 +1,71 @@
+// Testrahmen - Minimaler Testlauf für die Host-Tests
+// Jeder TEST läuft in einem eigenen Prozess (fork): frische globale Sketch-Variablen, frische
+// Simulation, ein hängender Test bricht nach TEST_TIMEOUT_S ab. Kennzahlen mit bericht() ausgeben,
+// sie stehen in den Commit-Beschreibungen.
+
+#pragma once
+
+#include <stdio.h>
+
+#include <sstream>
+#include <string>
+
+namespace pruefung
+{
+
+typedef void (*Testfunktion)();
+
+struct Anmeldung
+{
+    Anmeldung(const char *name, Testfunktion fn);
+};
+
+void fehlschlag(const char *datei, int zeile, const std::string &text);
+void abbruch(const char *datei, int zeile, const std::string &text);
+void bericht(const char *was, double wert, const char *einheit = "");
+
+template <typename A, typename B>
+std::string vergleich(const char *ausdruck, const A &a, const B &b)
+{
+    std::ostringstream s;
+    s << ausdruck << " (" << a << " gegen " << b << ")";
+    return s.str();
+}
+
+}
+
+#define TEST(name)                                                        \
+    static void name();                                                   \
+    static pruefung::Anmeldung name##_anmeldung(#name, name);             \
+    static void name()
+
+#define CHECK(cond)                                                       \
+    do                                                                    \
+    {                                                                     \
+        if (!(cond))                                                      \
+            pruefung::fehlschlag(__FILE__, __LINE__, #cond);              \
+    } while (0)
+
+#define REQUIRE(cond)                                                     \
+    do                                                                    \
+    {                                                                     \
+        if (!(cond))                                                      \
+            pruefung::abbruch(__FILE__, __LINE__, #cond);                 \
+    } while (0)
+
+#define CHECK_OP(a, op, b)                                                \
+    do                                                                    \
+    {                                                                     \
+        auto va_ = (a);                                                   \
+        auto vb_ = (b);                                                   \
+        if (!(va_ op vb_))                                                \
+            pruefung::fehlschlag(__FILE__, __LINE__,                      \
+                                 pruefung::vergleich(#a " " #op " " #b, va_, vb_)); \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK_OP(a, ==, b)
+#define CHECK_NE(a, b) CHECK_OP(a, !=, b)
+#define CHECK_LT(a, b) CHECK_OP(a, <, b)
+#define CHECK_LE(a, b) CHECK_OP(a, <=, b)
+#define CHECK_GT(a, b) CHECK_OP(a, >, b)
+#define CHECK_GE(a, b) CHECK_OP(a, >=, b)
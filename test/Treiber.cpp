@@ -0,0 +1,208 @@
+// Treiber - Pin-spezialisierte GPIO-Treiber gegen die simulierte Registerdatei
+// Jeder REG_WRITE/REG_READ landet in sim::regWrite/regRead und wird gezählt, gpioLog hält jede
+// sichtbare Änderung der Ampel-Pins fest. Vergleich mit dem früheren digitalWrite()-Pfad.
+
+#include "Aufbau.h"
+
+#include <chrono>
+
+typedef esp1::TrafficLight Ampel;
+
+static const uint32_t ROT = 1u << esp1::rledPin;
+static const uint32_t GELB = 1u << esp1::yledPin;
+static const uint32_t GRUEN = 1u << esp1::gledPin;
+
+// Früherer Weg: drei einzelne Schreibzugriffe über die Pin-Nummer, dazu die millis()-Drossel
+static void ampelDigital(bool red, bool yellow, bool green)
+{
+    digitalWrite(esp1::rledPin, red ? HIGH : LOW);
+    digitalWrite(esp1::yledPin, yellow ? HIGH : LOW);
+    digitalWrite(esp1::gledPin, green ? HIGH : LOW);
+    static unsigned long lastLog = 0;
+    if (millis() - lastLog > 1000)
+    {
+        lastLog = millis();
+    }
+}
+
+static uint32_t muster(int i)
+{
+    return (i & 4 ? ROT : 0) | (i & 2 ? GELB : 0) | (i & 1 ? GRUEN : 0);
+}
+
+// Alle Übergänge zwischen zwei Ampelbildern, fremde Bits im Register bleiben erhalten
+TEST(ampel_alle_uebergaenge)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    const uint32_t fremd = (1u << 2) | (1u << 5);
+    n.out[0] = fremd;
+
+    for (int von = 0; von < 8; von++)
+    {
+        for (int nach = 0; nach < 8; nach++)
+        {
+            Ampel::set(von & 4, von & 2, von & 1);
+            uint64_t zugriffe = n.regAccesses;
+            Ampel::set(nach & 4, nach & 2, nach & 1);
+            CHECK_EQ(n.out[0], fremd | muster(nach));
+            CHECK_EQ(n.regAccesses - zugriffe, 2u);     // W1TC und W1TS
+        }
+    }
+}
+
+// Jede LED ändert sich höchstens einmal, das Zwischenbild zeigt nur LEDs, die vorher und nachher
+// an sind (Rot -> Grün: kurz dunkel, nie Rot und Grün zusammen)
+TEST(ampel_jede_led_hoechstens_einmal)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+
+    for (int von = 0; von < 8; von++)
+    {
+        for (int nach = 0; nach < 8; nach++)
+        {
+            Ampel::set(von & 4, von & 2, von & 1);
+            size_t vorher = n.gpioLog.size();
+            Ampel::set(nach & 4, nach & 2, nach & 1);
+            uint32_t bild = muster(von);
+            for (size_t i = vorher; i < n.gpioLog.size(); i++)
+            {
+                uint32_t neu = n.gpioLog[i].second;
+                CHECK_EQ(neu & ~(muster(von) | muster(nach)), 0u);
+                CHECK_EQ((neu ^ bild) & ~(muster(von) ^ muster(nach)), 0u);
+                bild = neu;
+            }
+            CHECK_LE(n.gpioLog.size() - vorher, 2u);
+        }
+    }
+
+    Ampel::set(true, false, false);
+    size_t vorher = n.gpioLog.size();
+    Ampel::set(false, false, true);
+    REQUIRE(n.gpioLog.size() == vorher + 2);
+    CHECK_EQ(n.gpioLog[vorher].second, 0u);
+    CHECK_EQ(n.gpioLog.back().second, GRUEN);
+}
+
+// Früherer Weg: Read-Modify-Write auf GPIO_OUT_REG unter dem Ampel-Lock
+static void ampelLesenSchreiben(bool red, bool yellow, bool green)
+{
+    uint32_t on = (red ? ROT : 0) | (yellow ? GELB : 0) | (green ? GRUEN : 0);
+    portENTER_CRITICAL(&Ampel::mux);
+    REG_WRITE(GPIO_OUT_REG, (REG_READ(GPIO_OUT_REG) & ~Ampel::allMask) | on);
+    portEXIT_CRITICAL(&Ampel::mux);
+}
+
+// Der Loop-Kern schaltet den Trigger-Pin (gleiche Bank) zwischen zwei Registerzugriffen eines
+// set() auf dem Timer-Kern: der Trigger-Pin behält den Wert, den die Loop geschrieben hat
+static int verloreneTriggerwechsel(void (*set)(bool, bool, bool))
+{
+    int verloren = 0;
+    for (int stelle = 1; stelle <= 2; stelle++)
+    {
+        for (int trigger = 0; trigger < 2; trigger++)
+        {
+            sim::Node &n = *new sim::Node("ESP1", 1);
+            sim::As als(n);
+            n.out[0] = trigger ? 0 : 1u << esp1::trigPin1;
+            uint64_t ab = n.regAccesses;
+            n.regHook = [&](uint64_t zugriff) {
+                if (zugriff - ab == (uint64_t)stelle)
+                {
+                    trigger ? FastPin<esp1::trigPin1>::set() : FastPin<esp1::trigPin1>::clear();
+                }
+            };
+            set(true, false, false);
+            n.regHook = nullptr;
+            verloren += n.pin(esp1::trigPin1) != (trigger != 0);
+            CHECK_EQ(n.out[0] & (ROT | GELB | GRUEN), ROT);
+        }
+    }
+    return verloren;
+}
+
+TEST(triggerpin_waehrend_ampelwechsel)
+{
+    int treiber = verloreneTriggerwechsel(Ampel::set);
+    int frueher = verloreneTriggerwechsel(ampelLesenSchreiben);
+    pruefung::bericht("Treiber: verlorene Triggerwechsel", treiber, "");
+    pruefung::bericht("Read-Modify-Write: verlorene Triggerwechsel", frueher, "");
+    CHECK_EQ(treiber, 0);
+    CHECK_EQ(frueher, 2);                             // Wechsel zwischen Lesen und Schreiben
+}
+
+// Einzelner Pin in beiden Registerbänken
+TEST(fastpin_beide_baenke)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+
+    FastPin<5>::set();
+    FastPin<33>::set();
+    CHECK(n.pin(5));
+    CHECK(n.pin(33));
+    CHECK_EQ(n.out[0], 1u << 5);
+    CHECK_EQ(n.out[1], 1u << 1);
+    FastPin<33>::clear();
+    CHECK(n.pin(5));
+    CHECK(!n.pin(33));
+    FastPin<5>::clear();
+    CHECK_EQ(n.out[0], 0u);
+}
+
+// HC-SR04 an festen Pins: Triggerpuls, Echo-Flanken, Timeout
+TEST(ultraschall_entfernung_und_timeout)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    float cm = 150.0f;
+    sim::Sensor &s = n.addSensor(5, 18, [&cm](double) { return cm; });
+    sim::As als(n);
+    typedef UltrasonicSensor<5, 18> Sensor;
+
+    float gemessen = Sensor::measureCm(esp1::ECHO_TIMEOUT_US);
+    pruefung::bericht("Gemessen bei 150cm", gemessen, "cm");
+    CHECK_LT(fabs(gemessen - 150.0f), 1.0f);
+
+    s.dead = true;
+    unsigned long start = micros();
+    CHECK_EQ(Sensor::measureCm(esp1::ECHO_TIMEOUT_US), -1.0f);
+    unsigned long dauer = micros() - start;
+    CHECK_GE(dauer, esp1::ECHO_TIMEOUT_US);
+    CHECK_LT(dauer, esp1::ECHO_TIMEOUT_US + 1000);
+}
+
+// Rechenzeit pro Ampelwechsel auf dem Host, Registerzugriffe pro Wechsel
+TEST(mikrobenchmark_gegen_digitalwrite)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    const int wechsel = 200000;
+    typedef std::chrono::steady_clock Uhr;
+
+    uint64_t zugriffe = n.regAccesses;
+    Uhr::time_point t0 = Uhr::now();
+    for (int i = 0; i < wechsel; i++)
+    {
+        Ampel::set(i & 4, i & 2, i & 1);
+    }
+    double nsTreiber = std::chrono::duration<double, std::nano>(Uhr::now() - t0).count() / wechsel;
+    double zugriffeTreiber = (double)(n.regAccesses - zugriffe) / wechsel;
+
+    zugriffe = n.regAccesses;
+    t0 = Uhr::now();
+    for (int i = 0; i < wechsel; i++)
+    {
+        ampelDigital(i & 4, i & 2, i & 1);
+    }
+    double nsDigital = std::chrono::duration<double, std::nano>(Uhr::now() - t0).count() / wechsel;
+    double zugriffeDigital = (double)(n.regAccesses - zugriffe) / wechsel;
+
+    pruefung::bericht("Treiber: Registerzugriffe pro Wechsel", zugriffeTreiber, "");
+    pruefung::bericht("digitalWrite: Registerzugriffe pro Wechsel", zugriffeDigital, "");
+    pruefung::bericht("Treiber: Host-Zeit pro Wechsel", nsTreiber, "ns");
+    pruefung::bericht("digitalWrite: Host-Zeit pro Wechsel", nsDigital, "ns");
+    CHECK_EQ(zugriffeTreiber, 2.0);
+    CHECK_EQ(zugriffeDigital, 3.0);
+    CHECK_LT(nsTreiber, nsDigital);
+}
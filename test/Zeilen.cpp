@@ -0,0 +1,184 @@
+// Zeilen - LineReader gegen zerstückelte und zusammengefasste TCP-Segmente
+// Ein Stream liefert vorgegebene Segmente, available() sieht immer nur das gerade angekommene.
+// Geprüft werden Zeilengrenzen, CRLF, leere und überlange Zeilen.
+
+#include "Aufbau.h"
+
+#include <deque>
+
+typedef LineReader<PROTOCOL_LINE_MAX> Leser;
+
+// Stream aus Segmenten: das nächste Segment kommt erst mit liefere() an
+class Segmente : public Stream
+{
+public:
+    std::deque<std::string> ausstehend;
+    std::string da;
+
+    bool liefere()
+    {
+        if (ausstehend.empty())
+        {
+            return false;
+        }
+        da += ausstehend.front();
+        ausstehend.pop_front();
+        return true;
+    }
+    int available() override { return (int)da.size(); }
+    int read() override
+    {
+        if (da.empty())
+        {
+            return -1;
+        }
+        int c = (uint8_t)da[0];
+        da.erase(0, 1);
+        return c;
+    }
+    int peek() override { return da.empty() ? -1 : (uint8_t)da[0]; }
+    size_t write(uint8_t) override { return 1; }
+};
+
+// Alle Segmente zustellen, nach jedem so lange lesen, wie vollständige Zeilen da sind
+static std::vector<std::string> empfange(Leser &leser, Segmente &s)
+{
+    std::vector<std::string> zeilen;
+    while (s.liefere())
+    {
+        while (leser.poll(s))
+        {
+            zeilen.push_back(leser.line());
+        }
+    }
+    return zeilen;
+}
+
+// Nachrichten, wie sie zwischen den ESPs laufen
+static std::string nachricht(sim::Rng &rng, int i)
+{
+    switch (rng.next() % 5)
+    {
+    case 0:
+        return "HEARTBEAT";
+    case 1:
+        return "START_TIMER:" + std::to_string(rng.next() % 400);
+    case 2:
+        return "STOP_TIMER:" + std::to_string(i) + ":" + std::to_string(2000 + rng.next() % 28000);
+    case 3:
+        return "MEM:180000,170000,110000," + std::to_string(rng.next() % 6000);
+    default:
+    {
+        std::string r = "RESULTS:";
+        for (int k = 0; k < 8; k++)
+        {
+            r += (k ? "," : "") + std::to_string(i + k) + ":" + std::to_string(rng.next() % 100000);
+        }
+        return r;
+    }
+    }
+}
+
+// 5000 Nachrichten in Segmenten zu 1-7 Byte, jede zweite mit CRLF
+TEST(zerstueckelt_1_bis_7_byte)
+{
+    sim::Rng rng(40);
+    std::vector<std::string> gesendet;
+    std::string strom;
+    for (int i = 0; i < 5000; i++)
+    {
+        gesendet.push_back(nachricht(rng, i));
+        strom += gesendet.back() + (i % 2 ? "\r\n" : "\n");
+    }
+    Segmente s;
+    for (size_t pos = 0; pos < strom.size();)
+    {
+        size_t n = 1 + rng.next() % 7;
+        s.ausstehend.push_back(strom.substr(pos, n));
+        pos += n;
+    }
+    size_t segmente = s.ausstehend.size();
+    Leser leser;
+    std::vector<std::string> empfangen = empfange(leser, s);
+    pruefung::bericht("Bytes", strom.size(), "");
+    pruefung::bericht("Segmente", segmente, "");
+    CHECK(empfangen == gesendet);
+    CHECK_EQ(leser.overflows, 0ul);
+    CHECK_EQ(leser.len, 0);
+}
+
+// Viele Zeilen in einem Segment: poll() liest nur bis zum ersten '\n', der Rest bleibt im Stream
+TEST(zusammengefasst_eine_zeile_pro_aufruf)
+{
+    Segmente s;
+    s.ausstehend.push_back("HEARTBEAT\nSTOP_TIMER:3:4711\nMEM:1,2,3,4\nSTART_TI");
+    s.ausstehend.push_back("MER:12\n");
+    Leser leser;
+    REQUIRE(s.liefere());
+    REQUIRE(leser.poll(s));
+    CHECK(strcmp(leser.line(), "HEARTBEAT") == 0);
+    CHECK(s.da == "STOP_TIMER:3:4711\nMEM:1,2,3,4\nSTART_TI");
+    REQUIRE(leser.poll(s));
+    CHECK(strcmp(leser.line(), "STOP_TIMER:3:4711") == 0);
+    REQUIRE(leser.poll(s));
+    CHECK(strcmp(leser.line(), "MEM:1,2,3,4") == 0);
+    CHECK(!leser.poll(s));                          // Teilzeile bleibt im Puffer
+    CHECK_EQ(leser.len, 8);
+    REQUIRE(s.liefere());
+    REQUIRE(leser.poll(s));
+    CHECK(strcmp(leser.line(), "START_TIMER:12") == 0);
+}
+
+// Leere Zeilen und einzelne CR erzeugen keine Nachricht
+TEST(leere_zeilen_und_crlf)
+{
+    Segmente s;
+    s.ausstehend.push_back("\n\r\n\r\r\nA\r\n\n");
+    s.ausstehend.push_back("\r");
+    s.ausstehend.push_back("\nB\n");
+    Leser leser;
+    std::vector<std::string> empfangen = empfange(leser, s);
+    REQUIRE(empfangen.size() == 2);
+    CHECK(empfangen[0] == "A");
+    CHECK(empfangen[1] == "B");
+}
+
+// Überlange Zeile wird ganz verworfen und gezählt, die Nachbarn kommen an, auch zerstückelt.
+// Genau PROTOCOL_LINE_MAX - 1 Zeichen passen noch
+TEST(ueberlange_zeile)
+{
+    std::string passt(PROTOCOL_LINE_MAX - 1, 'x');
+    std::string zuLang(PROTOCOL_LINE_MAX + 44, 'y');
+    std::string strom = "HEARTBEAT\n" + zuLang + "\r\nSTOP_TIMER:1:2500\n" + passt + "\n" + zuLang + "\n";
+    for (int segment : {1, 3, 7, 64, 1000})
+    {
+        Segmente s;
+        for (size_t pos = 0; pos < strom.size(); pos += segment)
+        {
+            s.ausstehend.push_back(strom.substr(pos, segment));
+        }
+        Leser leser;
+        std::vector<std::string> empfangen = empfange(leser, s);
+        REQUIRE(empfangen.size() == 3);
+        CHECK(empfangen[0] == "HEARTBEAT");
+        CHECK(empfangen[1] == "STOP_TIMER:1:2500");
+        CHECK(empfangen[2] == passt);
+        CHECK_EQ(leser.overflows, 2ul);
+        CHECK(!leser.discarding);
+    }
+}
+
+// Neue Verbindung: eine halbe Zeile der alten darf nicht vor die erste der neuen geraten
+TEST(reset_verwirft_teilzeile)
+{
+    Segmente s;
+    s.ausstehend.push_back("STOP_TI");
+    Leser leser;
+    REQUIRE(s.liefere());
+    CHECK(!leser.poll(s));
+    leser.reset();
+    s.ausstehend.push_back("HEARTBEAT\n");
+    REQUIRE(s.liefere());
+    REQUIRE(leser.poll(s));
+    CHECK(strcmp(leser.line(), "HEARTBEAT") == 0);
+}
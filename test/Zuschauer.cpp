@@ -0,0 +1,224 @@
+// Zuschauer - Live-Ergebnisse per Server-Sent Events unter Last
+// Hunderte Tablets versuchen sich während laufender Messungen zu verbinden, die freien Plätze
+// belegen schnelle und hängende Leser. Gemessen werden die Verzögerung bis zum Zuschauer und
+// ob die Zeitmessung davon etwas merkt.
+
+#include "Aufbau.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+static const char *ANFRAGE = "GET /events HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n";
+static const double LAUF_S = 2.5;                  // Start verlassen bis Ziel erreicht
+// Beide Schranken zählen ab dem geschätzten Beginn der Änderung (START_TIMER trägt den Abstand
+// zum Verlassen mit), es bleibt das Abtastraster. Zulässig sind zwei Raster
+static const double TOLERANZ_MS = 2 * esp1::TDMA_FRAME_US / 1000.0;
+
+// maxLoopDurationUs (ohne Schlaf) wird mit jeder Statuszeile zurückgesetzt, daher laufend mitlesen
+static unsigned long laengsterLoop = 0;
+
+static bool beobachte()
+{
+    laengsterLoop = std::max(laengsterLoop, esp1::maxLoopDurationUs);
+    return false;
+}
+
+static sim::Peer *zuschauer(Anlage &a, double leseRate = 1e12)
+{
+    sim::Peer *p = new sim::Peer(sim::connectPeer(a.server, esp1::LIVE_PORT));
+    REQUIRE(p->ok());
+    p->setReadRate(leseRate);
+    p->write(ANFRAGE);
+    return p;
+}
+
+// Ein Lauf über beide Schranken, Rückgabe: vom Server gemeldete Zeit in ms
+static double lauf(Anlage &a)
+{
+    uint64_t ab = sim::driverNow();
+    double t = sekunden(ab);
+    a.start.durchgang(t + 0.5, 3.0);
+    a.ziel.durchgang(t + 3.5 + LAUF_S, 0.5);
+    REQUIRE(Anlage::warte([&] { return beobachte() || a.server.findLog("ESP1: Gemessene Zeit: ", ab); }, us(12)));
+    REQUIRE(Anlage::warte([] { return beobachte() || esp1::currentState == esp1::IDLE_GREEN; }, us(8)));
+    const sim::LogLine *l = a.server.findLog("ESP1: Gemessene Zeit: ", ab);
+    return atof(l->text.c_str() + l->text.find(": ", 6) + 2);
+}
+
+// Zeitpunkt, zu dem der Zuschauer das n-te Ergebnis vollständig gelesen hat, 0 = nie
+static uint64_t ergebnisGelesen(sim::Peer &p, int n)
+{
+    std::string daten = p.received();
+    size_t pos = 0;
+    for (int i = 0; i <= n; i++)
+    {
+        pos = daten.find("event: result\n", pos);
+        if (pos == std::string::npos)
+        {
+            return 0;
+        }
+        pos++;
+    }
+    size_t ende = daten.find("\n\n", pos);
+    for (const auto &m : p.marks())
+    {
+        if (ende != std::string::npos && m.second >= ende + 2)
+        {
+            return m.first;
+        }
+    }
+    return 0;
+}
+
+// Jede Zahl in voller Breite: das formatierte Ereignis ist genau so lang wie die Schranke
+// LIVE_EVENT_LONGEST, gegen die der static_assert im Sketch prüft
+TEST(laengstes_ereignis_passt)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    esp1::stats.totalMeasurements = 4294967295UL;
+    esp1::stats.successfulMeasurements = 4294967295UL;
+    esp1::stats.maxTime = 999999.0f;
+    esp1::stats.avgTime = 999999.0f;
+    esp1::stats.speedRuns = 1;
+    esp1::stats.maxSpeed = 4294967295UL;
+    esp1::stats.avgSpeed = 4.0e9f;
+    esp1::RunRecord run;
+    run.seq = 4294967295UL;
+    run.timeMs = 4294967295UL;
+    run.bib = 65535;
+    run.session = 65535;
+    esp1::RunSpeeds speeds;
+    speeds.average = speeds.start = speeds.finish = 4294967295UL;
+    esp1::liveFeed.nextId = 4000000000UL;
+
+    esp1::publishLiveResult(run, speeds);
+    CHECK_EQ(esp1::liveFeed.oversized, 0u);
+    REQUIRE(esp1::liveFeed.nextId == 4000000001UL);
+    const esp1::LiveEvent &e = esp1::liveFeed.get(4000000000UL);
+    pruefung::bericht("Längstes Ergebnis-Ereignis", e.len, "Byte");
+    pruefung::bericht("Platz im Ring", esp1::LIVE_EVENT_MAX_LEN, "Byte");
+    CHECK_EQ((int)e.len, esp1::LIVE_EVENT_LONGEST);
+}
+
+// Vergleichswert: dieselben Läufe ohne Zuschauer
+TEST(laeufe_ohne_zuschauer)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+
+    for (int i = 0; i < 3; i++)
+    {
+        double ms = lauf(a);
+        pruefung::bericht("Gemessene Zeit", ms, "ms");
+        CHECK_LT(fabs(ms - LAUF_S * 1000), TOLERANZ_MS);
+    }
+    pruefung::bericht("Server: längster Loop-Durchlauf", laengsterLoop / 1000.0, "ms");
+}
+
+// 4 schnelle und 2 hängende Zuschauer belegen alle Plätze, 300 weitere werden abgewiesen
+TEST(hunderte_zuschauer)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+
+    std::vector<sim::Peer *> schnell;
+    for (int i = 0; i < 4; i++)
+    {
+        schnell.push_back(zuschauer(a));
+        sim::runFor(50000);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        zuschauer(a, 0);                    // Tablet im Standby: liest nie
+        sim::runFor(50000);
+    }
+    REQUIRE(Anlage::warte([] {
+        int streaming = 0;
+        for (const esp1::LiveSubscriber &s : esp1::liveSubscribers)
+        {
+            streaming += s.streaming;
+        }
+        return streaming == esp1::MAX_LIVE_SUBSCRIBERS;
+    }, us(2)));
+
+    // Während der Läufe kommen laufend neue Verbindungsversuche dazu
+    std::vector<sim::Peer *> abgewiesen;
+    uint64_t naechster = sim::driverNow();
+    laengsterLoop = 0;
+    std::vector<uint64_t> stopEmpfangen;
+    std::vector<double> zeiten;
+    for (int i = 0; i < 3; i++)
+    {
+        uint64_t ab = sim::driverNow();
+        double t = sekunden(ab);
+        a.start.durchgang(t + 0.5, 3.0);
+        a.ziel.durchgang(t + 3.5 + LAUF_S, 0.5);
+        while (esp1::currentState != esp1::IDLE_GREEN || !a.server.findLog("ESP1: Gemessene Zeit: ", ab))
+        {
+            REQUIRE(sim::driverNow() - ab < us(20));
+            if (sim::driverNow() >= naechster && abgewiesen.size() < 300)
+            {
+                for (int k = 0; k < 10; k++)
+                {
+                    abgewiesen.push_back(zuschauer(a));
+                }
+                naechster += 300000;
+            }
+            sim::runFor(1000);
+            beobachte();
+        }
+        const sim::LogLine *l = a.server.findLog("ESP1: Gemessene Zeit: ", ab);
+        zeiten.push_back(atof(l->text.c_str() + l->text.find(": ", 6) + 2));
+        stopEmpfangen.push_back(a.server.findLog("ESP1: STOP_TIMER empfangen", ab)->at);
+    }
+    sim::runFor(us(2));
+
+    // Verzögerung vom STOP_TIMER beim Server bis zum vollständig gelesenen Ergebnis
+    double summe = 0, schlechteste = 0;
+    int gelesen = 0;
+    for (sim::Peer *p : schnell)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            uint64_t at = ergebnisGelesen(*p, i);
+            if (at == 0)
+            {
+                continue;
+            }
+            double ms = (at - stopEmpfangen[i]) / 1000.0;
+            summe += ms;
+            schlechteste = std::max(schlechteste, ms);
+            gelesen++;
+        }
+    }
+    int mit503 = 0;
+    for (sim::Peer *p : abgewiesen)
+    {
+        mit503 += p->received().find("HTTP/1.1 503") == 0;
+    }
+
+    pruefung::bericht("Verbindungsversuche abgewiesen (503)", mit503, "");
+    pruefung::bericht("Ergebnisse bei schnellen Zuschauern", gelesen, "");
+    pruefung::bericht("Push-Verzögerung im Mittel", summe / std::max(gelesen, 1), "ms");
+    pruefung::bericht("Push-Verzögerung schlechteste", schlechteste, "ms");
+    pruefung::bericht("Server: längster Loop-Durchlauf", laengsterLoop / 1000.0, "ms");
+    CHECK_EQ(gelesen, 4 * 3);
+    CHECK_EQ(mit503, (int)abgewiesen.size());
+    CHECK_GE(abgewiesen.size(), 200u);
+    CHECK_LT(schlechteste, 100.0);
+    // Die Zeitmessung merkt nichts: gleiche Zeiten wie ohne Zuschauer, Loop bleibt im Slot
+    for (double ms : zeiten)
+    {
+        pruefung::bericht("Gemessene Zeit", ms, "ms");
+        CHECK_LT(fabs(ms - LAUF_S * 1000), TOLERANZ_MS);
+    }
+    CHECK_LT(laengsterLoop, esp1::TDMA_SLOT_US);
+}
@@ -0,0 +1,242 @@
+// Zustand - Übergangstabellen beider Sketches und die Maschine dahinter
+// Jedes Paar (Zustand, Ereignis) wird gegen die Liste geprüft, die Compile-Zeit-Prüfungen gegen
+// absichtlich kaputte Listen. Dazu ein Lauf im Betrieb und die Kosten eines dispatch() gegen eine
+// Suche in der Liste und einen switch.
+
+#include "Aufbau.h"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock Uhr;
+
+// Jede Zelle der Tabelle zeigt auf den einzigen passenden Eintrag der Liste, oder es gibt keinen
+template <typename Entry, int N>
+static int gegenListePruefen(const Entry (&list)[N], const uint8_t *slot, int states, int events)
+{
+    int falsch = 0;
+    for (int s = 0; s < states; s++)
+    {
+        for (int e = 0; e < events; e++)
+        {
+            int erwartet = 0;
+            for (int i = 0; i < N; i++)
+            {
+                if ((int)list[i].from == s && (int)list[i].event == e)
+                {
+                    erwartet = i + 1;
+                }
+            }
+            falsch += slot[s * events + e] != erwartet;
+        }
+    }
+    return falsch;
+}
+
+TEST(tabellen_gegen_listen)
+{
+    CHECK_EQ(gegenListePruefen(esp1::serverTransitions, esp1::serverTable.slot, esp1::STATE_COUNT,
+                               esp1::EVENT_COUNT), 0);
+    CHECK_EQ(gegenListePruefen(esp2::clientTransitions, esp2::clientTable.slot, esp2::CLIENT_STATE_COUNT,
+                               esp2::CLIENT_EVENT_COUNT), 0);
+    pruefung::bericht("Server: Paare", esp1::STATE_COUNT * esp1::EVENT_COUNT, "");
+    pruefung::bericht("Client: Paare", esp2::CLIENT_STATE_COUNT * esp2::CLIENT_EVENT_COUNT, "");
+}
+
+// Kleine Maschine für die Prüfungen: A -> B -> C -> A, Fehler aus jedem Zustand nach C
+enum Z { ZA, ZB, ZC, ZD, Z_COUNT };
+enum E { WEITER, ZURUECK, FEHLER, E_COUNT };
+typedef Transition<Z, E> T;
+
+constexpr T gut[] = {
+    {ZA, WEITER, ZB, nullptr, nullptr}, {ZB, WEITER, ZC, nullptr, nullptr}, {ZC, ZURUECK, ZA, nullptr, nullptr},
+    {ZA, FEHLER, ZC, nullptr, nullptr}, {ZB, FEHLER, ZC, nullptr, nullptr}, {ZC, FEHLER, ZC, nullptr, nullptr},
+};
+constexpr T unerreichbar[] = {{ZA, WEITER, ZB, nullptr, nullptr}, {ZB, ZURUECK, ZA, nullptr, nullptr},
+                              {ZC, FEHLER, ZA, nullptr, nullptr}};
+constexpr T sackgasse[] = {{ZA, WEITER, ZB, nullptr, nullptr}, {ZB, FEHLER, ZC, nullptr, nullptr},
+                           {ZB, ZURUECK, ZA, nullptr, nullptr}};
+constexpr T ohneZurueck[] = {{ZA, WEITER, ZB, nullptr, nullptr}, {ZB, WEITER, ZC, nullptr, nullptr},
+                             {ZC, FEHLER, ZA, nullptr, nullptr}};
+constexpr T doppelt[] = {{ZA, WEITER, ZB, nullptr, nullptr}, {ZA, WEITER, ZC, nullptr, nullptr}};
+constexpr T ausserhalb[] = {{ZA, WEITER, Z_COUNT, nullptr, nullptr}};
+
+static_assert(transitionsUnique(gut) && transitionsInRange(gut, 3, E_COUNT), "gut");
+static_assert(transitionsComplete(gut, 3, E_COUNT, ZA), "gut");
+static_assert(handledInStates(gut, FEHLER, 0x7), "gut");
+static_assert(!transitionsComplete(unerreichbar, 3, E_COUNT, ZA), "ZC ist nicht erreichbar");
+static_assert(!transitionsComplete(sackgasse, 3, E_COUNT, ZA), "ZC hat keinen Ausgang");
+static_assert(!transitionsComplete(ohneZurueck, 3, E_COUNT, ZA), "ZURUECK wird nie benutzt");
+static_assert(!transitionsUnique(doppelt), "ZA/WEITER doppelt");
+static_assert(!transitionsInRange(ausserhalb, Z_COUNT, E_COUNT), "Z_COUNT ist kein Zustand");
+static_assert(!handledInStates(sackgasse, FEHLER, 0x7), "FEHLER fehlt in ZA und ZC");
+static_assert(!transitionsComplete(gut, Z_COUNT, E_COUNT, ZA), "ZD kommt in der Liste nicht vor");
+
+TEST(pruefungen_zur_laufzeit_gleich)
+{
+    // Dieselben Funktionen, diesmal nicht konstant ausgewertet
+    volatile int zustaende = 3;
+    CHECK(transitionsComplete(gut, zustaende, E_COUNT, ZA));
+    CHECK(!transitionsComplete(unerreichbar, zustaende, E_COUNT, ZA));
+    CHECK(!transitionsComplete(sackgasse, zustaende, E_COUNT, ZA));
+    CHECK(!transitionsComplete(ohneZurueck, zustaende, E_COUNT, ZA));
+}
+
+static bool erlaubt = true;
+static int aktionen = 0;
+static std::vector<int> spur;
+static StateMachine<Z, E, 3, E_COUNT> *kleine = nullptr;
+
+static bool darf() { return erlaubt; }
+static void zaehle() { aktionen++; }
+static void weiterDirekt() { kleine->dispatch(WEITER); }
+static void merke(Z from, Z to, E, unsigned long) { spur.push_back(from * 10 + to); }
+
+constexpr T mitAktionen[] = {
+    {ZA, WEITER, ZB, darf, zaehle}, {ZB, WEITER, ZC, nullptr, zaehle}, {ZC, ZURUECK, ZA, nullptr, weiterDirekt},
+    {ZA, FEHLER, ZC, nullptr, nullptr}, {ZB, FEHLER, ZC, nullptr, nullptr}, {ZC, FEHLER, ZC, nullptr, nullptr},
+};
+static_assert(transitionsComplete(mitAktionen, 3, E_COUNT, ZA), "mitAktionen");
+constexpr TransitionTable<3 * E_COUNT> mitAktionenTabelle = buildTransitionTable<3, E_COUNT>(mitAktionen);
+
+// Bedingung, Aktion mit eigenem dispatch(), Trace und Zähler
+TEST(maschine_bedingung_und_aktion)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    StateMachine<Z, E, 3, E_COUNT> m(mitAktionen, mitAktionenTabelle, ZA);
+    kleine = &m;
+    m.trace = merke;
+
+    erlaubt = false;
+    CHECK(m.accepts(WEITER));
+    CHECK(!m.dispatch(WEITER));                       // Bedingung verweigert
+    CHECK_EQ((int)m.state, (int)ZA);
+    CHECK(!m.dispatch(ZURUECK));                      // Kein Übergang in ZA
+    CHECK(!m.accepts(ZURUECK));
+    erlaubt = true;
+    CHECK(m.dispatch(WEITER));
+    CHECK(m.dispatch(WEITER));
+    CHECK_EQ((int)m.state, (int)ZC);
+    CHECK(m.dispatch(ZURUECK));                       // Aktion löst gleich WEITER aus: ZC -> ZA -> ZB
+    CHECK_EQ((int)m.state, (int)ZB);
+    CHECK_EQ(aktionen, 3);
+    CHECK_EQ(m.dispatched, 6ul);
+    CHECK_EQ(m.ignored, 2ul);
+    CHECK(spur == std::vector<int>({1, 12, 20, 1}));   // ZA->ZB, ZB->ZC, ZC->ZA, ZA->ZB
+    kleine = nullptr;
+}
+
+// Zustandswechsel eines Knotens ab einem Zeitpunkt, z.B. "IDLE_GREEN -> OBJECT_DETECTED"
+static std::vector<std::string> wechsel(const sim::Node &n, uint64_t ab)
+{
+    std::vector<std::string> v;
+    for (const sim::LogLine &l : n.console)
+    {
+        size_t pos = l.text.find(": Zustand ");
+        if (l.at >= ab && pos != std::string::npos)
+        {
+            v.push_back(l.text.substr(pos + 10, l.text.find(" (") - pos - 10));
+        }
+    }
+    return v;
+}
+
+// Ein Lauf im Betrieb: beide Knoten gehen genau die vorgesehenen Zustände durch
+TEST(ablauf_im_betrieb)
+{
+    Anlage &a = Anlage::neu();
+    a.starteServer();
+    REQUIRE(a.serverBereit());
+    a.starteClient();
+    REQUIRE(a.clientBereit());
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+    uint64_t ab = sim::driverNow();
+    double t = sekunden(ab);
+    a.start.durchgang(t + 0.5, 3.0);
+    a.ziel.durchgang(t + 6.0, 0.5);
+    sim::runFor(us(7));
+    REQUIRE(Anlage::warte([] { return esp1::currentState == esp1::IDLE_GREEN; }, us(20)));
+    REQUIRE(Anlage::warte([] { return esp2::clientState == esp2::IDLE_WAITING_FOR_START; }, us(20)));
+
+    std::vector<std::string> server = wechsel(a.server, ab);
+    std::vector<std::string> client = wechsel(a.client, ab);
+    CHECK(server == std::vector<std::string>({"IDLE_GREEN -> OBJECT_DETECTED", "OBJECT_DETECTED -> YELLOW",
+                                              "YELLOW -> RED", "RED -> TIMING", "TIMING -> COOLDOWN",
+                                              "COOLDOWN -> IDLE_GREEN"}));
+    CHECK(client == std::vector<std::string>({"IDLE -> TIMING", "TIMING -> DISPLAY", "DISPLAY -> IDLE"}));
+}
+
+// Kosten eines dispatch(): Tabelle gegen Suche in der Liste und gegen einen switch, alle ohne Aktion
+static const int EREIGNISSE = 1 << 16;
+
+constexpr T nurUebergaenge[] = {
+    {ZA, WEITER, ZB, nullptr, nullptr}, {ZB, WEITER, ZC, nullptr, nullptr}, {ZC, ZURUECK, ZA, nullptr, nullptr},
+    {ZA, FEHLER, ZC, nullptr, nullptr}, {ZB, FEHLER, ZC, nullptr, nullptr}, {ZC, FEHLER, ZC, nullptr, nullptr},
+};
+constexpr TransitionTable<3 * E_COUNT> nurUebergaengeTabelle = buildTransitionTable<3, E_COUNT>(nurUebergaenge);
+
+__attribute__((noinline)) static Z perSuche(Z z, E e)
+{
+    for (const T &t : nurUebergaenge)
+    {
+        if (t.from == z && t.event == e)
+        {
+            return t.to;
+        }
+    }
+    return z;
+}
+
+__attribute__((noinline)) static Z perSwitch(Z z, E e)
+{
+    switch (z)
+    {
+    case ZA:
+        return e == WEITER ? ZB : e == FEHLER ? ZC : z;
+    case ZB:
+        return e == WEITER || e == FEHLER ? ZC : z;
+    case ZC:
+        return e == ZURUECK ? ZA : z;
+    default:
+        return z;
+    }
+}
+
+template <typename F>
+static double nsProEreignis(const std::vector<E> &ereignisse, int runden, F schritt)
+{
+    Uhr::time_point t0 = Uhr::now();
+    for (int r = 0; r < runden; r++)
+    {
+        for (E e : ereignisse)
+        {
+            schritt(e);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(Uhr::now() - t0).count() / ((double)runden * ereignisse.size());
+}
+
+TEST(kosten_pro_dispatch)
+{
+    sim::Node &n = *new sim::Node("ESP1", 1);
+    sim::As als(n);
+    std::vector<E> ereignisse;
+    for (int i = 0; i < EREIGNISSE; i++)
+    {
+        ereignisse.push_back((E)(n.rng.next() % E_COUNT));
+    }
+    StateMachine<Z, E, 3, E_COUNT> m(nurUebergaenge, nurUebergaengeTabelle, ZA);
+    Z suche = ZA, sw = ZA;
+    double tabelle = nsProEreignis(ereignisse, 50, [&](E e) { m.dispatch(e); });
+    double liste = nsProEreignis(ereignisse, 50, [&](E e) { suche = perSuche(suche, e); });
+    double verzweigung = nsProEreignis(ereignisse, 50, [&](E e) { sw = perSwitch(sw, e); });
+    // Alle drei landen im selben Zustand
+    CHECK_EQ((int)m.state, (int)suche);
+    CHECK_EQ((int)m.state, (int)sw);
+    pruefung::bericht("dispatch() über die Tabelle (Host)", tabelle, "ns");
+    pruefung::bericht("Suche in der Liste (Host)", liste, "ns");
+    pruefung::bericht("switch (Host)", verzweigung, "ns");
+    pruefung::bericht("Server: Einträge, die eine Suche durchgehen müsste",
+                      sizeof(esp1::serverTransitions) / sizeof(esp1::serverTransitions[0]), "");
+    CHECK_LT(tabelle, 100.0);
+}
@@ -0,0 +1,862 @@
+// Simulation - Ablaufsteuerung, Sensor-, Netz- und Peripheriemodell (siehe Simulation.h)
+
+#include "Simulation.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <soc/gpio_reg.h>
+
+namespace sim
+{
+
+static thread_local Node *tlsNode = nullptr;    // Für diesen Knoten wird gerade gerechnet
+static thread_local Node *tlsOwner = nullptr;   // Thread gehört diesem Knoten
+
+World::World()
+{
+    running = &driver;
+    participants.push_back(&driver);
+    peerLink.baseUs = 2500;
+    peerLink.jitterUs = 1500;
+    peerLink.rng = Rng(11);
+}
+
+World &world()
+{
+    static World *w = new World(); // Nie zerstören: Knoten-Threads laufen bis _exit()
+    return *w;
+}
+
+Node *current() { return tlsNode; }
+void bind(Node *n) { tlsNode = n; }
+
+uint64_t now() { return tlsNode ? tlsNode->time : world().driver.time; }
+uint64_t driverNow() { return world().driver.time; }
+
+// ---- Ablaufsteuerung ----
+
+static uint64_t minOthers(World &w, Participant *p)
+{
+    uint64_t m = NEVER;
+    for (Participant *q : w.participants)
+    {
+        if (q != p && q->time < m)
+        {
+            m = q->time;
+        }
+    }
+    return m;
+}
+
+// Gibt ab, bis p der Teilnehmer mit der kleinsten Zeit ist
+static void schedule(Participant *p)
+{
+    World &w = world();
+    std::unique_lock<std::mutex> lock(w.mutex);
+    for (;;)
+    {
+        Participant *next = w.participants.front();
+        for (Participant *q : w.participants)
+        {
+            if (q->time < next->time)
+            {
+                next = q;
+            }
+        }
+        if (next == p)
+        {
+            break;
+        }
+        w.running = next;
+        next->cv.notify_one();
+        p->cv.wait(lock, [&] { return w.running == p; });
+    }
+    uint64_t m = minOthers(w, p);
+    p->limit = m == NEVER ? NEVER : m + QUANTUM_US;
+}
+
+static void fireTimers(Node *n, uint64_t until)
+{
+    while (!n->inTimer && n->critical == 0)
+    {
+        EspTimer *next = nullptr;
+        for (auto &t : n->timers)
+        {
+            if (t->due <= until && (!next || t->due < next->due))
+            {
+                next = t.get();
+            }
+        }
+        if (!next)
+        {
+            return;
+        }
+        if (next->due > n->time)
+        {
+            n->time = next->due;
+        }
+        next->due = NEVER;
+        next->fired++;
+        n->inTimer = true;
+        next->callback(next->arg);
+        n->inTimer = false;
+    }
+}
+
+void advance(uint64_t us)
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        return;
+    }
+    uint64_t target = n->time + us;
+    fireTimers(n, target);
+    if (n->time < target)
+    {
+        n->time = target;
+    }
+    if (tlsOwner == n && n->time > n->part.limit)
+    {
+        schedule(&n->part);
+    }
+}
+
+void driverSleep(uint64_t us)
+{
+    world().driver.time += us;
+}
+
+static void nodeMain(Node *n)
+{
+    tlsNode = n;
+    tlsOwner = n;
+    World &w = world();
+    {
+        std::unique_lock<std::mutex> lock(w.mutex);
+        n->part.cv.wait(lock, [&] { return w.running == &n->part; });
+        uint64_t m = minOthers(w, &n->part);
+        n->part.limit = m == NEVER ? NEVER : m + QUANTUM_US;
+    }
+    n->setupFn();
+    for (;;)
+    {
+        uint64_t started = n->time;
+        n->loopFn();
+        uint64_t took = n->time - started;
+        n->loops++;
+        n->maxLoopUs = std::max(n->maxLoopUs, took);
+        if (n->recordLoops)
+        {
+            n->loopDurations.push_back(took);
+        }
+    }
+}
+
+void start(Node &n)
+{
+    World &w = world();
+    n.time = std::max(n.time, w.driver.time);
+    n.bootAt = n.time;
+    n.threaded = true;
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.participants.push_back(&n.part);
+    }
+    n.thread = std::thread(nodeMain, &n);
+}
+
+void runUntil(uint64_t t)
+{
+    World &w = world();
+    if (t > w.driver.time)
+    {
+        w.driver.time = t;
+    }
+    Node *bound = tlsNode;
+    tlsNode = nullptr;
+    schedule(&w.driver);
+    tlsNode = bound;
+}
+
+// ---- Knoten ----
+
+Node::Node(const std::string &nodeName, int lastOctet, uint64_t seed)
+    : name(nodeName), rng(seed * 7919 + std::hash<std::string>()(nodeName))
+{
+    ip[0] = 192;
+    ip[1] = 168;
+    ip[2] = 4;
+    ip[3] = (uint8_t)lastOctet;
+    for (auto &line : lcd)
+    {
+        line.assign(20, ' ');
+    }
+    echo = getenv("SIM_LOG") != nullptr;
+    world().nodes.push_back(this);
+}
+
+Node::~Node()
+{
+    if (thread.joinable())
+    {
+        thread.detach();
+    }
+}
+
+uint64_t Node::localUs() const
+{
+    double elapsed = (double)(time - bootAt);
+    return localStartUs + (uint64_t)(elapsed + elapsed * driftPpm * 1e-6);
+}
+
+uint64_t Node::toGlobal(uint64_t local) const
+{
+    if (local <= localStartUs)
+    {
+        return bootAt;
+    }
+    double elapsed = (double)(local - localStartUs) / (1.0 + driftPpm * 1e-6);
+    return bootAt + (uint64_t)(elapsed + 0.999);
+}
+
+Sensor &Node::addSensor(uint8_t trigPin, uint8_t echoPin, std::function<float(double)> distance)
+{
+    sensors.emplace_back(new Sensor());
+    Sensor &s = *sensors.back();
+    s.node = this;
+    s.trigPin = trigPin;
+    s.echoPin = echoPin;
+    s.distanceCm = distance;
+    s.id = (int)sensors.size() - 1;
+    return s;
+}
+
+uint32_t Node::gpioAt(uint64_t t) const
+{
+    uint32_t v = 0;
+    for (auto &e : gpioLog)
+    {
+        if (e.first > t)
+        {
+            break;
+        }
+        v = e.second;
+    }
+    return v;
+}
+
+int Node::countLog(const std::string &needle, uint64_t from) const
+{
+    int n = 0;
+    for (auto &l : console)
+    {
+        if (l.at >= from && l.text.find(needle) != std::string::npos)
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+const LogLine *Node::findLog(const std::string &needle, uint64_t from) const
+{
+    for (auto &l : console)
+    {
+        if (l.at >= from && l.text.find(needle) != std::string::npos)
+        {
+            return &l;
+        }
+    }
+    return nullptr;
+}
+
+std::string Node::lcdText() const
+{
+    return lcd[0] + "|" + lcd[1] + "|" + lcd[2] + "|" + lcd[3];
+}
+
+void Node::dumpLog(size_t lastLines) const
+{
+    size_t from = console.size() > lastLines ? console.size() - lastLines : 0;
+    for (size_t i = from; i < console.size(); i++)
+    {
+        printf("    [%9.3f %s] %s\n", console[i].at / 1e6, name.c_str(), console[i].text.c_str());
+    }
+}
+
+// ---- HC-SR04 ----
+
+uint64_t Sensor::effectiveFall()
+{
+    uint64_t fall = cur.ownFallAt;
+    World &w = world();
+    if (w.crossPathCm)
+    {
+        for (const Burst &b : w.bursts)
+        {
+            if (b.from == this)
+            {
+                continue;
+            }
+            float path = w.crossPathCm(*b.from, *this, b.at / 1e6);
+            if (path <= 0)
+            {
+                continue;
+            }
+            uint64_t arrival = b.at + (uint64_t)(path / SOUND_CM_PER_US);
+            if (arrival >= cur.riseAt + HCSR04_BLANK_US && arrival < fall)
+            {
+                fall = arrival;
+            }
+        }
+    }
+    return fall;
+}
+
+bool Sensor::level(uint64_t t)
+{
+    if (!active || t < cur.riseAt)
+    {
+        return false;
+    }
+    return t < effectiveFall();
+}
+
+uint64_t Sensor::nextEdge(uint64_t t)
+{
+    if (!active)
+    {
+        return NEVER;
+    }
+    if (t < cur.riseAt)
+    {
+        return cur.riseAt;
+    }
+    uint64_t fall = effectiveFall();
+    return t < fall ? fall : NEVER;
+}
+
+void Sensor::settle(uint64_t t)
+{
+    if (!active)
+    {
+        return;
+    }
+    uint64_t fall = effectiveFall();
+    if (t < fall)
+    {
+        return;
+    }
+    cur.fallAt = fall;
+    cur.foreign = fall < cur.ownFallAt;
+    pings.push_back(cur);
+    active = false;
+}
+
+void Sensor::trigger(bool high, uint64_t t)
+{
+    if (high)
+    {
+        if (!trigHigh)
+        {
+            trigHigh = true;
+            trigRiseAt = t;
+        }
+        return;
+    }
+    if (!trigHigh)
+    {
+        return;
+    }
+    trigHigh = false;
+    if (t - trigRiseAt < 8)
+    {
+        return; // Zu kurzer Triggerpuls
+    }
+    settle(t);
+    if (active)
+    {
+        pingsIgnored++; // Misst noch, Trigger wird ignoriert
+        return;
+    }
+
+    active = true;
+    cur = Ping();
+    cur.trigAt = t;
+    cur.riseAt = t + HCSR04_RISE_US;
+    float d = distanceCm ? distanceCm(t / 1e6) : -1.0f;
+    cur.trueCm = d;
+    uint64_t own = NEVER;
+    if (!dead && d > 2.0f && d < 400.0f && node->rng.uniform() >= dropRate)
+    {
+        double measured = d + noiseCm * node->rng.gauss();
+        own = cur.riseAt + (uint64_t)std::max(60.0, 2.0 * measured / SOUND_CM_PER_US);
+    }
+    cur.ownFallAt = std::min(own, cur.riseAt + HCSR04_MAX_PULSE_US);
+
+    World &w = world();
+    w.bursts.push_back(Burst{this, cur.riseAt});
+    size_t keep = 0;
+    while (keep < w.bursts.size() && w.bursts[keep].at + 100000 < t)
+    {
+        keep++;
+    }
+    w.bursts.erase(w.bursts.begin(), w.bursts.begin() + keep);
+}
+
+// ---- Register ----
+
+static void afterRegAccess(Node *n)
+{
+    if (n->regHook && !n->inHook)
+    {
+        n->inHook = true;
+        n->regHook(n->regAccesses);
+        n->inHook = false;
+    }
+}
+
+static void setOut(Node *n, int bank, uint32_t value)
+{
+    uint32_t changed = n->out[bank] ^ value;
+    if (!changed)
+    {
+        return;
+    }
+    n->out[bank] = value;
+    for (auto &s : n->sensors)
+    {
+        if (s->trigPin / 32 == bank && (changed & (1u << (s->trigPin % 32))))
+        {
+            s->trigger(value & (1u << (s->trigPin % 32)), n->time);
+        }
+    }
+    if (bank == 0 && (changed & n->watchMask))
+    {
+        n->gpioLog.push_back(std::make_pair(n->time, value & n->watchMask));
+    }
+}
+
+void regWrite(uint32_t addr, uint32_t value)
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        return;
+    }
+    n->regAccesses++;
+    switch (addr)
+    {
+    case GPIO_OUT_REG: setOut(n, 0, value); break;
+    case GPIO_OUT_W1TS_REG: setOut(n, 0, n->out[0] | value); break;
+    case GPIO_OUT_W1TC_REG: setOut(n, 0, n->out[0] & ~value); break;
+    case GPIO_OUT1_REG: setOut(n, 1, value); break;
+    case GPIO_OUT1_W1TS_REG: setOut(n, 1, n->out[1] | value); break;
+    case GPIO_OUT1_W1TC_REG: setOut(n, 1, n->out[1] & ~value); break;
+    default: break;
+    }
+    afterRegAccess(n);
+}
+
+uint32_t regRead(uint32_t addr)
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        return 0;
+    }
+    n->regAccesses++;
+    if (addr == GPIO_OUT_REG || addr == GPIO_OUT1_REG)
+    {
+        uint32_t value = n->out[addr == GPIO_OUT1_REG];
+        afterRegAccess(n);
+        return value;
+    }
+    int bank = addr == GPIO_IN1_REG ? 1 : 0;
+    // Polling bis zur nächsten Flanke vorziehen, höchstens GPIO_POLL_US
+    uint64_t edge = NEVER;
+    for (auto &s : n->sensors)
+    {
+        edge = std::min(edge, s->nextEdge(n->time));
+    }
+    uint64_t step = GPIO_POLL_US;
+    if (edge != NEVER && edge >= n->time && edge - n->time < step)
+    {
+        step = edge - n->time;
+    }
+    advance(step);
+    uint32_t value = 0;
+    for (auto &s : n->sensors)
+    {
+        if (s->echoPin / 32 == bank && s->level(n->time))
+        {
+            value |= 1u << (s->echoPin % 32);
+        }
+    }
+    return value;
+}
+
+// ---- Kerne ----
+
+void enterCritical()
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        return;
+    }
+    if (n->critical == 0 && !n->inHook)
+    {
+        int point = ++n->interleavePoints;
+        if (n->interleaveHook)
+        {
+            n->inHook = true;
+            n->interleaveHook(point);
+            n->inHook = false;
+        }
+    }
+    n->critical++;
+}
+
+void exitCritical()
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        return;
+    }
+    n->critical--;
+    if (n->critical == 0)
+    {
+        fireTimers(n, n->time);
+    }
+}
+
+// ---- UART, I2C ----
+
+void uartWrite(const uint8_t *data, size_t len)
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        fwrite(data, 1, len, stdout);
+        return;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        double t = (double)n->time;
+        if (n->uartFreeAt > t)
+        {
+            double queued = (n->uartFreeAt - t) / UART_US_PER_BYTE;
+            if (queued >= UART_FIFO_BYTES)
+            {
+                advance((uint64_t)((queued - UART_FIFO_BYTES + 1) * UART_US_PER_BYTE) + 1);
+            }
+        }
+        n->uartFreeAt = std::max(n->uartFreeAt, (double)n->time) + UART_US_PER_BYTE;
+        char c = (char)data[i];
+        if (c == '\n')
+        {
+            if (n->echo)
+            {
+                printf("    [%9.3f %s] %s\n", n->time / 1e6, n->name.c_str(), n->partial.c_str());
+            }
+            n->console.push_back(LogLine{n->time, n->partial});
+            n->partial.clear();
+        }
+        else if (c != '\r')
+        {
+            n->partial += c;
+        }
+    }
+}
+
+void i2cTransfer(int bytes)
+{
+    Node *n = tlsNode;
+    if (!n)
+    {
+        return;
+    }
+    uint64_t us = (uint64_t)((bytes * 9 + 2) * 1e6 / n->i2cClock) + I2C_OVERHEAD_US;
+    n->i2cTransactions++;
+    n->i2cBusyUs += us;
+    advance(us);
+}
+
+// ---- Netz ----
+
+uint64_t Link::deliver(uint64_t sentAt)
+{
+    if (blackhole)
+    {
+        return NEVER;
+    }
+    uint64_t t = sentAt;
+    for (auto &o : outages)
+    {
+        if (t >= o.first && t < o.second)
+        {
+            t = o.second;
+        }
+    }
+    double d = baseUs + rng.exponential(jitterUs);
+    if (stallRate > 0 && rng.uniform() < stallRate)
+    {
+        d += rng.exponential(stallMeanUs);
+    }
+    uint64_t rto = rtoUs;
+    while (lossRate > 0 && rng.uniform() < lossRate)
+    {
+        d += rto;
+        rto *= 2;
+    }
+    return t + (uint64_t)d;
+}
+
+void Pipe::drain(uint64_t now)
+{
+    if (receiver)
+    {
+        return;
+    }
+    while (!segs.empty() && segs.front().consumedAt <= now)
+    {
+        received += segs.front().data.substr(segs.front().offset);
+        marks.push_back(std::make_pair(segs.front().consumedAt, received.size()));
+        segs.pop_front();
+    }
+}
+
+void Pipe::redrain()
+{
+    drainFreeAt = now();
+    for (auto &s : segs)
+    {
+        if (s.at == NEVER || drainBytesPerSec <= 0)
+        {
+            s.consumedAt = NEVER;
+            continue;
+        }
+        uint64_t startAt = std::max(s.at, drainFreeAt);
+        s.consumedAt = startAt + (uint64_t)((s.data.size() - s.offset) * 1e6 / drainBytesPerSec);
+        drainFreeAt = s.consumedAt;
+    }
+}
+
+size_t Pipe::unread(uint64_t now)
+{
+    drain(now);
+    size_t n = 0;
+    for (auto &s : segs)
+    {
+        n += s.data.size() - s.offset;
+    }
+    return n;
+}
+
+size_t Pipe::deliverable(uint64_t now) const
+{
+    size_t n = 0;
+    for (auto &s : segs)
+    {
+        if (s.at > now)
+        {
+            break;
+        }
+        n += s.data.size() - s.offset;
+    }
+    return n;
+}
+
+size_t Pipe::push(uint64_t now, const uint8_t *data, size_t len, Link &link)
+{
+    size_t used = unread(now);
+    if (used >= capacity || len == 0)
+    {
+        return 0;
+    }
+    size_t n = std::min(len, capacity - used);
+    uint64_t at = lastAt == NEVER ? NEVER : link.deliver(now);
+    if (at != NEVER && receiver && receiver->wifiSleep != 0)
+    {
+        at = (at / BEACON_US + 1) * BEACON_US + 300; // AP puffert bis zum nächsten Beacon
+    }
+    if (at != NEVER && at < lastAt)
+    {
+        at = lastAt; // TCP liefert in Reihenfolge
+    }
+    lastAt = at;
+    Segment s{at, NEVER, std::string((const char *)data, n), 0};
+    if (!receiver && at != NEVER && drainBytesPerSec > 0)
+    {
+        uint64_t startAt = std::max(at, drainFreeAt);
+        s.consumedAt = startAt + (uint64_t)(n * 1e6 / drainBytesPerSec);
+        drainFreeAt = s.consumedAt;
+    }
+    segs.push_back(s);
+    totalBytes += n;
+    return n;
+}
+
+size_t Pipe::read(uint64_t now, uint8_t *out, size_t len, bool peek)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < segs.size() && n < len; i++)
+    {
+        Segment &s = segs[i];
+        if (s.at > now)
+        {
+            break;
+        }
+        size_t take = std::min(len - n, s.data.size() - s.offset);
+        memcpy(out + n, s.data.data() + s.offset, take);
+        n += take;
+        if (peek)
+        {
+            continue;
+        }
+        s.offset += take;
+    }
+    while (!peek && !segs.empty() && segs.front().offset == segs.front().data.size())
+    {
+        segs.pop_front();
+    }
+    return n;
+}
+
+Socket::~Socket()
+{
+    close();
+}
+
+void Socket::close()
+{
+    if (closed)
+    {
+        return;
+    }
+    closed = true;
+    conn->open[side] = false;
+    Pipe &o = out();
+    uint64_t at = o.lastAt == NEVER ? NEVER : conn->link->deliver(now());
+    o.finAt = at == NEVER ? NEVER : std::max(at, o.lastAt);
+}
+
+std::shared_ptr<Socket> socketFor(int fd)
+{
+    World &w = world();
+    int i = fd - FD_BASE;
+    if (i < 0 || i >= (int)w.sockets.size())
+    {
+        return nullptr;
+    }
+    return w.sockets[i].lock();
+}
+
+static std::shared_ptr<Socket> makeSocket(std::shared_ptr<Connection> conn, int side)
+{
+    World &w = world();
+    auto s = std::make_shared<Socket>();
+    s->conn = conn;
+    s->side = side;
+    int slot = -1;
+    for (size_t i = 0; i < w.sockets.size(); i++)
+    {
+        if (w.sockets[i].expired())
+        {
+            slot = (int)i;
+            break;
+        }
+    }
+    if (slot < 0)
+    {
+        slot = (int)w.sockets.size();
+        w.sockets.push_back(s);
+    }
+    else
+    {
+        w.sockets[slot] = s;
+    }
+    s->fd = FD_BASE + slot;
+    return s;
+}
+
+Node *nodeByIp(const uint8_t ip[4])
+{
+    for (Node *n : world().nodes)
+    {
+        if (memcmp(n->ip, ip, 4) == 0)
+        {
+            return n;
+        }
+    }
+    return nullptr;
+}
+
+// Verbindungsaufbau von from (nullptr = externes Gerät) zu ip:port
+std::shared_ptr<Socket> openConnection(Node *from, Node *target, uint16_t port, Link &link)
+{
+    if (!target)
+    {
+        return nullptr;
+    }
+    auto it = target->listeners.find(port);
+    if (it == target->listeners.end())
+    {
+        return nullptr;
+    }
+    auto conn = std::make_shared<Connection>();
+    conn->id = world().nextConnection++;
+    conn->link = &link;
+    conn->end[0] = from;
+    conn->end[1] = target;
+    conn->dir[0].receiver = target;
+    conn->dir[1].receiver = from;
+    auto mine = makeSocket(conn, 0);
+    auto theirs = makeSocket(conn, 1);
+    uint64_t synAt = link.deliver(now());
+    it->second->pending.push_back(std::make_pair(synAt, theirs));
+    return mine;
+}
+
+Peer connectPeer(Node &n, uint16_t port)
+{
+    Peer p;
+    p.sock = openConnection(nullptr, &n, port, world().peerLink);
+    return p;
+}
+
+void Peer::write(const std::string &data)
+{
+    sock->out().push(now(), (const uint8_t *)data.data(), data.size(), *sock->conn->link);
+}
+
+std::string Peer::received()
+{
+    sock->in().drain(now());
+    return sock->in().received;
+}
+
+void Peer::setReadRate(double bytesPerSec)
+{
+    sock->in().drain(now());
+    sock->in().drainBytesPerSec = bytesPerSec;
+    sock->in().redrain();
+}
+
+void Peer::close()
+{
+    sock->close();
+}
+
+bool Peer::closedByNode() const
+{
+    return sock->in().finAt <= now();
+}
+
+}
@@ -0,0 +1,394 @@
+// Simulation - Host-Nachbildung der ESP32-Umgebung für die Tests
+// Jeder Knoten (Server = ESP1, Client = ESP2) hat eine eigene simulierte Uhr, GPIOs mit
+// HC-SR04-Modell, UART, NVS, SPIFFS, I2C/LCD, esp_timer und Sockets. Die Stubs unter test/stubs
+// leiten alle Arduino-/ESP-IDF-Aufrufe hierher um.
+//
+// Zeit vergeht nur in den Stubs: micros()/millis() kosten CALL_COST_US, delay() schläft, Polling
+// eines Eingangs läuft bis zur nächsten Flanke vor, UART/I2C/Flash kosten ihre Übertragungszeit.
+//
+// Co-Simulation: jeder gestartete Knoten führt setup()/loop() in einem eigenen Thread aus, es
+// rechnet aber immer nur der Teilnehmer mit der kleinsten Uhrzeit (Vorlauf höchstens QUANTUM_US,
+// kleiner als die kürzeste Netzlatenz). Der Ablauf ist damit deterministisch, keine Nachricht
+// kommt vor ihrer Sendezeit an. Der Testtreiber ist selbst Teilnehmer und sieht die Knoten nur
+// angehalten (runUntil()).
+
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sim
+{
+
+const uint64_t QUANTUM_US = 200;           // Vorlauf eines Knotens vor dem langsamsten Teilnehmer
+const uint64_t CALL_COST_US = 1;           // micros(), millis(), esp_timer_get_time()
+const uint64_t YIELD_COST_US = 5;
+const uint64_t GPIO_POLL_US = 20;          // Polling-Schleife ohne Flanke: so weit pro Abfrage
+const uint64_t NEVER = ~0ULL;
+
+const double SOUND_CM_PER_US = 0.034;      // Wie SOUND_SPEED im Treiber
+const uint64_t HCSR04_RISE_US = 450;       // Trigger-Ende bis Burst gesendet, Echo-Pin HIGH
+const uint64_t HCSR04_BLANK_US = 150;      // Nach dem Anstieg noch taub für fremde Bursts
+const uint64_t HCSR04_MAX_PULSE_US = 38000;// Kein Echo: Pin fällt nach 38ms
+
+const double UART_US_PER_BYTE = 1e6 / 11520.0; // 115200 Baud, 8N1
+const int UART_FIFO_BYTES = 128;               // Arduino-ESP32 2.x: ohne TX-Puffer, nur FIFO
+const int I2C_OVERHEAD_US = 60;                // Treiber-Overhead pro Transaktion
+
+const uint64_t FLASH_OPEN_US = 300;
+const double FLASH_READ_US_PER_BYTE = 0.2;
+const double FLASH_WRITE_US_PER_BYTE = 2.0;
+const uint64_t FLASH_CALL_US = 60;
+const uint64_t NVS_WRITE_US = 2500;
+const uint64_t NVS_READ_US = 60;
+const size_t SPIFFS_CAPACITY = 1318001;   // Nutzbar bei der Standard-Partition (1,5MB)
+
+const uint64_t WIFI_ASSOC_US = 1200000;   // WiFi.begin() bis WL_CONNECTED
+const uint64_t BEACON_US = 102400;        // Modem-Sleep: Zustellung zum nächsten Beacon
+
+struct Node;
+struct Sensor;
+struct Connection;
+
+// ---- Zufall ----
+
+struct Rng
+{
+    std::mt19937_64 engine;
+    explicit Rng(uint64_t seed = 1) : engine(seed) {}
+    double uniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(engine); }
+    double gauss() { return std::normal_distribution<double>(0.0, 1.0)(engine); }
+    double exponential(double mean) { return mean <= 0 ? 0 : std::exponential_distribution<double>(1.0 / mean)(engine); }
+    uint32_t next() { return (uint32_t)engine(); }
+};
+
+// ---- Ablaufsteuerung ----
+
+struct Participant
+{
+    uint64_t time = 0;
+    uint64_t limit = NEVER;              // Darf bis hierher rechnen, ohne abzugeben
+    std::condition_variable cv;
+};
+
+// ---- HC-SR04 ----
+
+struct Ping
+{
+    uint64_t trigAt;
+    uint64_t riseAt;
+    uint64_t fallAt;                     // Tatsächliche fallende Flanke
+    uint64_t ownFallAt;                  // Ohne fremde Bursts
+    float trueCm;                        // <= 0: kein Ziel
+    bool foreign;                        // Durch einen fremden Burst verkürzt
+};
+
+struct Sensor
+{
+    Node *node;
+    uint8_t trigPin;
+    uint8_t echoPin;
+    std::function<float(double)> distanceCm;   // Wahre Entfernung zur Zeit t [s], <= 0 = kein Ziel
+    float noiseCm = 0.3f;
+    double dropRate = 0.0;               // Anteil Pings ohne Echo
+    bool dead = false;                   // Liefert nie ein Echo (abgezogenes Kabel)
+    int id = 0;
+
+    bool trigHigh = false;
+    uint64_t trigRiseAt = 0;
+    bool active = false;
+    Ping cur;
+    std::vector<Ping> pings;
+    size_t pingsIgnored = 0;             // Trigger während laufender Messung
+
+    bool level(uint64_t t);
+    uint64_t nextEdge(uint64_t t);
+    void trigger(bool high, uint64_t t);
+    void settle(uint64_t t);             // Abgeschlossenen Ping in pings übernehmen
+    uint64_t effectiveFall();
+};
+
+struct Burst
+{
+    const Sensor *from;
+    uint64_t at;
+};
+
+// ---- Netz ----
+
+// Übertragungsstrecke: Latenz, Jitter, Verluste (TCP-Wiederholung), Ausfälle
+struct Link
+{
+    double baseUs = 1500;
+    double jitterUs = 700;               // Exponentiell verteilt
+    double lossRate = 0;                 // Segment muss per TCP wiederholt werden
+    uint64_t rtoUs = 400000;
+    double stallRate = 0;                // Pro Segment: WLAN hängt (Interferenz)
+    double stallMeanUs = 0;
+    std::vector<std::pair<uint64_t, uint64_t> > outages;   // [von, bis): nichts kommt durch
+    bool blackhole = false;              // Verbindung still tot, nichts kommt mehr an
+    Rng rng{7};
+
+    uint64_t deliver(uint64_t sentAt);
+};
+
+struct Segment
+{
+    uint64_t at;
+    uint64_t consumedAt;                 // NEVER = noch nicht gelesen
+    std::string data;
+    size_t offset;
+};
+
+// Eine Richtung einer TCP-Verbindung
+struct Pipe
+{
+    std::deque<Segment> segs;
+    uint64_t lastAt = 0;
+    uint64_t finAt = NEVER;
+    size_t capacity = 5744 + 5744;       // TCP_SND_BUF + TCP_WND von lwIP
+    Node *receiver = nullptr;            // nullptr = externer Teilnehmer
+    // Externer Empfänger liest selbstständig mit dieser Rate (Bytes/s), 0 = liest gar nicht
+    double drainBytesPerSec = 1e12;
+    uint64_t drainFreeAt = 0;
+    std::string received;                // Vom externen Empfänger gelesen
+    std::vector<std::pair<uint64_t, size_t> > marks;   // (Lesezeit, Ende in received)
+    size_t totalBytes = 0;
+
+    size_t unread(uint64_t now);
+    size_t deliverable(uint64_t now) const;
+    size_t push(uint64_t now, const uint8_t *data, size_t len, Link &link);
+    size_t read(uint64_t now, uint8_t *out, size_t len, bool peek = false);
+    void drain(uint64_t now);
+    void redrain();
+};
+
+struct Connection
+{
+    int id;
+    Pipe dir[2];                         // dir[0]: Client -> Server, dir[1]: Server -> Client
+    Node *end[2];                        // end[0] = verbindende Seite, end[1] = annehmende Seite
+    bool open[2] = {true, true};
+    bool reset = false;
+    Link *link;
+};
+
+struct Socket
+{
+    std::shared_ptr<Connection> conn;
+    int side;                            // 0 = verbindende Seite
+    int fd;
+    bool closed = false;
+    ~Socket();
+    void close();
+    Pipe &in() { return conn->dir[1 - side]; }
+    Pipe &out() { return conn->dir[side]; }
+};
+
+struct Listener
+{
+    uint16_t port;
+    std::deque<std::pair<uint64_t, std::shared_ptr<Socket> > > pending;
+};
+
+// ---- Knoten ----
+
+struct LogLine
+{
+    uint64_t at;
+    std::string text;
+};
+
+struct EspTimer
+{
+    void (*callback)(void *);
+    void *arg;
+    std::string name;
+    uint64_t due = NEVER;                // Simulationszeit
+    int fired = 0;
+};
+
+struct Node
+{
+    std::string name;
+    uint8_t ip[4];
+    Participant part;
+    uint64_t &time = part.time;
+    Rng rng;
+
+    // Uhr: lokale Zeit = localStartUs + vergangene Zeit * (1 + driftPpm)
+    uint64_t bootAt = 0;
+    uint64_t localStartUs = 35000;       // Bootloader-Zeit bis setup()
+    double driftPpm = 0;
+
+    // Programm
+    std::function<void()> setupFn;
+    std::function<void()> loopFn;
+    std::thread thread;
+    bool threaded = false;
+    uint64_t loops = 0;
+    uint64_t loopStartedAt = 0;
+    uint64_t maxLoopUs = 0;
+    std::vector<uint64_t> loopDurations;  // Nur wenn recordLoops
+    bool recordLoops = false;
+
+    // UART
+    std::vector<LogLine> console;
+    std::string partial;
+    double uartFreeAt = 0;
+    bool echo = false;
+
+    // GPIO
+    uint32_t out[2] = {0, 0};
+    uint32_t watchMask = (1u << 25) | (1u << 26) | (1u << 27);
+    std::vector<std::pair<uint64_t, uint32_t> > gpioLog;   // Änderungen von out[0] & watchMask
+    uint64_t regAccesses = 0;            // REG_WRITE und REG_READ auf GPIO-Register
+    std::vector<std::unique_ptr<Sensor> > sensors;
+
+    // I2C
+    std::set<uint8_t> i2cDevices;
+    uint32_t i2cClock = 100000;
+    uint8_t i2cAddress = 0;
+    int i2cBytes = 0;
+    uint64_t i2cTransactions = 0;
+    uint64_t i2cBusyUs = 0;
+    std::string lcd[4];
+    int lcdCol = 0, lcdRow = 0;
+
+    // Flash
+    std::map<std::string, std::map<std::string, std::vector<uint8_t> > > nvs;
+    uint64_t nvsWrites = 0;
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t> > > files;
+    bool fsMounted = false;
+    bool fsBroken = false;
+
+    // esp_timer und Kernverschränkung
+    std::vector<std::unique_ptr<EspTimer> > timers;
+    int critical = 0;
+    bool inTimer = false;
+    bool inHook = false;
+    int interleavePoints = 0;
+    // Wird an jeder Stelle aufgerufen, an der der andere Kern dazwischenkommen kann
+    // (portENTER_CRITICAL ohne gehaltenen Lock), Argument = laufende Nummer der Stelle
+    std::function<void(int)> interleaveHook;
+    // Wird nach jedem GPIO-Registerzugriff aufgerufen, auch in kritischen Abschnitten: der
+    // andere Kern hält sich nur an Locks, die er selbst nimmt. Argument = regAccesses
+    std::function<void(uint64_t)> regHook;
+
+    // WLAN / Energie
+    bool apUp = false;
+    bool staWanted = false;
+    uint64_t staBeginAt = 0;
+    bool staLost = false;
+    int wifiSleep = 0;                   // wifi_ps_type_t
+    uint32_t cpuMhz = 240;
+    bool pmConfigured = false;
+    int pmLocksHeld = 0;
+    std::map<uint16_t, std::unique_ptr<Listener> > listeners;
+
+    // Heap-Kennzahlen (heap_caps_*), Tests setzen sie direkt
+    uint32_t heapFree = 180000;
+    uint32_t heapLargest = 110000;
+    uint32_t heapMinFree = 170000;
+    uint32_t stackHighWater = 5200;
+
+    Node(const std::string &nodeName, int lastOctet, uint64_t seed = 1);
+    ~Node();
+
+    uint64_t localUs() const;
+    uint64_t toGlobal(uint64_t local) const;
+
+    Sensor &addSensor(uint8_t trigPin, uint8_t echoPin, std::function<float(double)> distance);
+
+    // Auswertung
+    bool pin(uint8_t p) const { return out[p / 32] & (1u << (p % 32)); }
+    uint32_t gpioAt(uint64_t t) const;
+    int countLog(const std::string &needle, uint64_t from = 0) const;
+    const LogLine *findLog(const std::string &needle, uint64_t from = 0) const;
+    std::string lcdText() const;
+    void dumpLog(size_t lastLines = 40) const;
+};
+
+// ---- Welt ----
+
+struct World
+{
+    std::vector<Node *> nodes;
+    Participant driver;
+    std::mutex mutex;
+    Participant *running = nullptr;
+    std::vector<Participant *> participants;   // driver zuerst
+
+    Link nodeLink;                       // Zwischen den ESPs
+    Link peerLink;                       // Zu externen Geräten (Tablet, PC)
+    std::vector<std::weak_ptr<Socket> > sockets;   // Index = fd - FD_BASE
+    int nextConnection = 1;
+
+    std::vector<Burst> bursts;
+    // Weg eines Bursts von einem Sensor zu einem fremden Empfänger [cm], <= 0 = kommt nicht an
+    std::function<float(const Sensor &, const Sensor &, double)> crossPathCm;
+
+    World();
+};
+
+const int FD_BASE = 50;
+
+World &world();
+
+Node *current();
+void bind(Node *n);                      // Aufrufender Thread handelt als dieser Knoten
+uint64_t now();                          // Zeit des aktuellen Teilnehmers
+void advance(uint64_t us);
+void driverSleep(uint64_t us);           // Treiber ohne Knoten: eigene Zeit
+
+void start(Node &n);                     // setup()/loop() im eigenen Thread
+void runUntil(uint64_t t);
+inline void runFor(uint64_t us) { runUntil(world().driver.time + us); }
+uint64_t driverNow();
+
+// Binden an einen Knoten für die Dauer eines Blocks (Treiber greift auf Sketch-Funktionen zu)
+struct As
+{
+    Node *prev;
+    explicit As(Node &n) : prev(current()) { bind(&n); }
+    ~As() { bind(prev); }
+};
+
+// Von den Stubs benutzt
+void uartWrite(const uint8_t *data, size_t len);
+void regWrite(uint32_t addr, uint32_t value);
+uint32_t regRead(uint32_t addr);
+void enterCritical();
+void exitCritical();
+void i2cTransfer(int bytes);
+
+// Externe Gegenstelle (Tablet, PC) an einem Port eines Knotens
+struct Peer
+{
+    std::shared_ptr<Socket> sock;
+    bool ok() const { return sock != nullptr; }
+    void write(const std::string &data);
+    std::string received();              // Bisher gelesene Bytes
+    void setReadRate(double bytesPerSec);
+    void close();
+    bool closedByNode() const;
+    std::vector<std::pair<uint64_t, size_t> > &marks() { return sock->in().marks; }
+};
+Peer connectPeer(Node &n, uint16_t port);
+
+std::shared_ptr<Socket> socketFor(int fd);
+Node *nodeByIp(const uint8_t ip[4]);
+// Verbindungsaufbau von from (nullptr = externes Gerät), nullptr = niemand hört auf dem Port
+std::shared_ptr<Socket> openConnection(Node *from, Node *target, uint16_t port, Link &link);
+
+}
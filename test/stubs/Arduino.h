@@ -0,0 +1,481 @@
+// Arduino.h für den Host-Test - Arduino-ESP32 2.x API auf der Simulation (test/sim)
+// Nur was die Sketches und Lichtschranke-*.h benutzen. Achtung: der Host ist LP64, unsigned long
+// hat hier 64 Bit. micros()/millis() liefern trotzdem nur 32 Bit wie auf dem ESP32.
+
+#pragma once
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
+#include "Simulation.h"
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <soc/gpio_reg.h>
+
+using std::max;
+using std::min;
+
+#define IRAM_ATTR
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define REG_WRITE(reg, val) sim::regWrite((uint32_t)(reg), (uint32_t)(val))
+#define REG_READ(reg) sim::regRead((uint32_t)(reg))
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+// ---- Zeit ----
+
+inline unsigned long micros()
+{
+    sim::advance(sim::CALL_COST_US);
+    sim::Node *n = sim::current();
+    return n ? (uint32_t)n->localUs() : 0;
+}
+
+inline unsigned long millis()
+{
+    sim::advance(sim::CALL_COST_US);
+    sim::Node *n = sim::current();
+    return n ? (uint32_t)(n->localUs() / 1000) : 0;
+}
+
+inline void delay(uint32_t ms) { sim::advance((uint64_t)ms * 1000); }
+inline void delayMicroseconds(uint32_t us) { sim::advance(us); }
+inline void yield() { sim::advance(sim::YIELD_COST_US); }
+
+// ---- GPIO ----
+
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline void digitalWrite(uint8_t pin, uint8_t value)
+{
+    uint32_t bit = 1u << (pin % 32);
+    if (pin < 32)
+    {
+        REG_WRITE(value ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, bit);
+    }
+    else
+    {
+        REG_WRITE(value ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, bit);
+    }
+}
+
+inline int digitalRead(uint8_t pin)
+{
+    uint32_t in = REG_READ(pin < 32 ? GPIO_IN_REG : GPIO_IN1_REG);
+    return (in >> (pin % 32)) & 1;
+}
+
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+inline void attachInterrupt(uint8_t, void (*)(void), int) {} // ISR wird im Modell nicht ausgelöst
+inline void detachInterrupt(uint8_t) {}
+
+// ---- String ----
+
+class String
+{
+public:
+    String(const char *cstr = "") : s(cstr ? cstr : "") {}
+    String(const std::string &str) : s(str) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : s(number((unsigned long long)value, base)) {}
+    explicit String(int value, unsigned char base = 10) : s(signedNumber(value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : s(number(value, base)) {}
+    explicit String(long value, unsigned char base = 10) : s(signedNumber(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : s(number(value, base)) {}
+    explicit String(long long value, unsigned char base = 10) : s(signedNumber(value, base)) {}
+    explicit String(unsigned long long value, unsigned char base = 10) : s(number(value, base)) {}
+    explicit String(float value, unsigned char decimalPlaces = 2) : s(fixed(value, decimalPlaces)) {}
+    explicit String(double value, unsigned char decimalPlaces = 2) : s(fixed(value, decimalPlaces)) {}
+
+    unsigned int length() const { return (unsigned int)s.size(); }
+    const char *c_str() const { return s.c_str(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size)
+    {
+        s.reserve(size);
+        return true;
+    }
+
+    String &operator+=(const String &rhs)
+    {
+        s += rhs.s;
+        return *this;
+    }
+    String &operator+=(const char *rhs)
+    {
+        s += rhs;
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        s += c;
+        return *this;
+    }
+    template <typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value, String &>::type operator+=(T value)
+    {
+        s += String(value).s;
+        return *this;
+    }
+    template <typename T>
+    bool concat(const T &value)
+    {
+        *this += value;
+        return true;
+    }
+
+    bool equals(const String &rhs) const { return s == rhs.s; }
+    bool equalsIgnoreCase(const String &rhs) const { return strcasecmp(s.c_str(), rhs.s.c_str()) == 0; }
+    bool operator==(const String &rhs) const { return s == rhs.s; }
+    bool operator==(const char *rhs) const { return s == rhs; }
+    bool operator!=(const String &rhs) const { return s != rhs.s; }
+    bool operator!=(const char *rhs) const { return s != rhs; }
+    bool operator<(const String &rhs) const { return s < rhs.s; }
+    bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+    }
+
+    char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    int indexOf(char c, unsigned int from = 0) const { return pos(s.find(c, from)); }
+    int indexOf(const String &str, unsigned int from = 0) const { return pos(s.find(str.s, from)); }
+    int lastIndexOf(char c) const { return pos(s.rfind(c)); }
+    int lastIndexOf(const String &str) const { return pos(s.rfind(str.s)); }
+    String substring(unsigned int from) const { return from >= s.size() ? String() : String(s.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+        {
+            std::swap(from, to);
+        }
+        if (from >= s.size())
+        {
+            return String();
+        }
+        return String(s.substr(from, std::min<size_t>(to, s.size()) - from));
+    }
+
+    void trim()
+    {
+        size_t a = 0, b = s.size();
+        while (a < b && isspace((unsigned char)s[a]))
+        {
+            a++;
+        }
+        while (b > a && isspace((unsigned char)s[b - 1]))
+        {
+            b--;
+        }
+        s = s.substr(a, b - a);
+    }
+    void toUpperCase()
+    {
+        for (auto &c : s)
+        {
+            c = (char)toupper((unsigned char)c);
+        }
+    }
+    void toLowerCase()
+    {
+        for (auto &c : s)
+        {
+            c = (char)tolower((unsigned char)c);
+        }
+    }
+    void replace(const String &find, const String &with)
+    {
+        if (find.s.empty())
+        {
+            return;
+        }
+        size_t p = 0;
+        while ((p = s.find(find.s, p)) != std::string::npos)
+        {
+            s.replace(p, find.s.size(), with.s);
+            p += with.s.size();
+        }
+    }
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1)
+    {
+        if (index < s.size())
+        {
+            s.erase(index, count);
+        }
+    }
+
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return (float)atof(s.c_str()); }
+    double toDouble() const { return atof(s.c_str()); }
+
+    const std::string &str() const { return s; }
+
+private:
+    std::string s;
+
+    static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+
+    static std::string number(unsigned long long v, unsigned char base)
+    {
+        if (base < 2)
+        {
+            base = 10;
+        }
+        char buf[72];
+        char *p = buf + sizeof(buf) - 1;
+        *p = 0;
+        do
+        {
+            int d = (int)(v % base);
+            *--p = (char)(d < 10 ? '0' + d : 'a' + d - 10); // Arduino-String: Kleinbuchstaben
+            v /= base;
+        } while (v);
+        return p;
+    }
+    static std::string signedNumber(long long v, unsigned char base)
+    {
+        if (v < 0 && base == 10)
+        {
+            return "-" + number((unsigned long long)(-v), base);
+        }
+        // Andere Basen wie Arduino: Zweierkomplement in der Breite des Typs
+        return number((unsigned long long)v & (v < 0 && v >= INT32_MIN ? 0xFFFFFFFFULL : ~0ULL), base);
+    }
+    static std::string fixed(double v, unsigned char decimals)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        return buf;
+    }
+};
+
+inline String operator+(const String &a, const String &b)
+{
+    String r(a);
+    r += b;
+    return r;
+}
+inline String operator+(const String &a, const char *b)
+{
+    String r(a);
+    r += b;
+    return r;
+}
+inline String operator+(const char *a, const String &b)
+{
+    String r(a);
+    r += b;
+    return r;
+}
+inline String operator+(const String &a, char b)
+{
+    String r(a);
+    r += b;
+    return r;
+}
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, String>::type
+operator+(const String &a, T b)
+{
+    String r(a);
+    r += String(b);
+    return r;
+}
+inline bool operator==(const char *a, const String &b) { return b == a; }
+
+// ---- Print / Stream ----
+
+class Print;
+
+class Printable
+{
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+        {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual void flush() {}
+
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(const char *s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char v, int base = DEC) { return printNumber(v, base); }
+    size_t print(int v, int base = DEC) { return printSigned(v, base); }
+    size_t print(unsigned int v, int base = DEC) { return printNumber(v, base); }
+    size_t print(long v, int base = DEC) { return printSigned(v, base); }
+    size_t print(unsigned long v, int base = DEC) { return printNumber(v, base); }
+    size_t print(long long v, int base = DEC) { return printSigned(v, base); }
+    size_t print(unsigned long long v, int base = DEC) { return printNumber(v, base); }
+    size_t print(double v, int digits = 2) { return printFloat(v, digits); }
+    size_t print(const Printable &x) { return x.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &v)
+    {
+        size_t n = print(v);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(const T &v, int format)
+    {
+        size_t n = print(v, format);
+        return n + println();
+    }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buf[512];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        return len > 0 ? write(buf, std::min((size_t)len, sizeof(buf) - 1)) : 0;
+    }
+
+private:
+    size_t printNumber(unsigned long long v, int base)
+    {
+        if (base < 2)
+        {
+            return write((uint8_t)v);
+        }
+        char buf[72];
+        char *p = buf + sizeof(buf) - 1;
+        *p = 0;
+        do
+        {
+            int d = (int)(v % base);
+            *--p = (char)(d < 10 ? '0' + d : 'A' + d - 10);
+            v /= base;
+        } while (v);
+        return write(p);
+    }
+    size_t printSigned(long long v, int base)
+    {
+        if (base == DEC && v < 0)
+        {
+            return print('-') + printNumber((unsigned long long)(-v), base);
+        }
+        return printNumber((unsigned long long)v, base);
+    }
+    size_t printFloat(double v, int digits)
+    {
+        if (isnan(v))
+        {
+            return write("nan");
+        }
+        if (isinf(v))
+        {
+            return write("inf");
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", digits, v);
+        return write(buf);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long timeout) { timeoutMs = timeout; }
+
+protected:
+    unsigned long timeoutMs = 1000;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void end() {}
+    operator bool() const { return true; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t c) override
+    {
+        sim::uartWrite(&c, 1);
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        sim::uartWrite(buffer, size);
+        return size;
+    }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+// ---- ESP ----
+
+class EspClass
+{
+public:
+    uint32_t getHeapSize() { return 320000; }
+    uint32_t getFreeHeap() { return sim::current() ? sim::current()->heapFree : 0; }
+    uint32_t getMinFreeHeap() { return sim::current() ? sim::current()->heapMinFree : 0; }
+    uint32_t getMaxAllocHeap() { return sim::current() ? sim::current()->heapLargest : 0; }
+    void restart() { abort(); }
+};
+
+extern EspClass ESP;
+
+inline uint32_t esp_random() { return sim::current() ? sim::current()->rng.next() : 4; }
+
+inline bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    if (sim::current())
+    {
+        sim::current()->cpuMhz = mhz;
+        sim::advance(200); // PLL-Umschaltung
+    }
+    return true;
+}
+inline uint32_t getCpuFrequencyMhz() { return sim::current() ? sim::current()->cpuMhz : 240; }
@@ -0,0 +1,118 @@
+// LiquidCrystal_I2C für den Host-Test: HD44780 über PCF8574 im 4-Bit-Modus
+// Jedes Byte sind zwei Nibbles zu je drei Expander-Schreibzugriffen plus Enable-Puls wie in der
+// echten Bibliothek. Der Text landet im DDRAM-Modell des Knotens (sim::Node::lcd), inklusive des
+// HD44780-Zeilenumbruchs (Zeile 0 läuft in Zeile 2 weiter).
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+class LiquidCrystal_I2C : public Print
+{
+public:
+    LiquidCrystal_I2C(uint8_t address, uint8_t columns, uint8_t rows) : addr(address), cols(columns), lines(rows) {}
+
+    void init()
+    {
+        delay(50);
+        for (int i = 0; i < 4; i++)
+        {
+            nibble();
+            delayMicroseconds(4500);
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            command();
+        }
+        clear();
+    }
+    void begin() { init(); }
+    void backlight() { expanderWrite(); }
+    void noBacklight() { expanderWrite(); }
+    void clear()
+    {
+        command();
+        delayMicroseconds(2000);
+        address = 0;
+        if (present())
+        {
+            for (auto &line : sim::current()->lcd)
+            {
+                line.assign(20, ' ');
+            }
+        }
+    }
+    void home()
+    {
+        command();
+        delayMicroseconds(2000);
+        address = 0;
+    }
+    void setCursor(uint8_t col, uint8_t row)
+    {
+        static const uint8_t offsets[] = {0x00, 0x40, 0x14, 0x54};
+        command();
+        address = offsets[row % 4] + col;
+    }
+    size_t write(uint8_t c) override
+    {
+        command();
+        if (present())
+        {
+            int row, col;
+            if (address < 0x14)
+            {
+                row = 0, col = address;
+            }
+            else if (address < 0x28)
+            {
+                row = 2, col = address - 0x14;
+            }
+            else if (address < 0x40)
+            {
+                row = -1, col = 0; // Außerhalb der Anzeige
+            }
+            else if (address < 0x54)
+            {
+                row = 1, col = address - 0x40;
+            }
+            else if (address < 0x68)
+            {
+                row = 3, col = address - 0x54;
+            }
+            else
+            {
+                row = -1, col = 0;
+            }
+            if (row >= 0)
+            {
+                sim::current()->lcd[row][col] = (char)c;
+            }
+        }
+        address = address == 0x27 ? 0x40 : address == 0x67 ? 0x00 : address + 1;
+        return 1;
+    }
+    using Print::write;
+
+private:
+    uint8_t addr;
+    uint8_t cols;
+    uint8_t lines;
+    uint8_t address = 0;
+
+    bool present() const { return sim::current() && sim::current()->i2cDevices.count(addr); }
+    void expanderWrite() { sim::i2cTransfer(2); }
+    void nibble()
+    {
+        expanderWrite();
+        expanderWrite();
+        delayMicroseconds(1);
+        expanderWrite();
+        delayMicroseconds(50);
+    }
+    void command()
+    {
+        nibble();
+        nibble();
+    }
+};
@@ -0,0 +1,61 @@
+// Preferences (NVS) für den Host-Test: Schlüssel pro Knoten, mit Typ wie im echten NVS
+#pragma once
+
+#include <Arduino.h>
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false, const char * = NULL);
+    void end() { started = false; }
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+    size_t freeEntries() { return 300; }
+
+    size_t putUChar(const char *key, uint8_t value) { return put(key, 'C', &value, sizeof(value)); }
+    size_t putUShort(const char *key, uint16_t value) { return put(key, 'S', &value, sizeof(value)); }
+    size_t putUInt(const char *key, uint32_t value) { return put(key, 'I', &value, sizeof(value)); }
+    size_t putInt(const char *key, int32_t value) { return put(key, 'i', &value, sizeof(value)); }
+    size_t putULong(const char *key, uint32_t value) { return put(key, 'I', &value, sizeof(value)); }
+    size_t putBool(const char *key, bool value)
+    {
+        uint8_t v = value;
+        return put(key, 'C', &v, 1);
+    }
+    size_t putFloat(const char *key, float value) { return put(key, 'B', &value, sizeof(value)); }
+    size_t putBytes(const char *key, const void *value, size_t len) { return put(key, 'B', value, len); }
+    size_t putString(const char *key, const char *value) { return put(key, 's', value, strlen(value)); }
+
+    uint8_t getUChar(const char *key, uint8_t def = 0) { return get(key, 'C', def); }
+    uint16_t getUShort(const char *key, uint16_t def = 0) { return get(key, 'S', def); }
+    uint32_t getUInt(const char *key, uint32_t def = 0) { return get(key, 'I', def); }
+    int32_t getInt(const char *key, int32_t def = 0) { return get(key, 'i', def); }
+    uint32_t getULong(const char *key, uint32_t def = 0) { return get(key, 'I', def); }
+    bool getBool(const char *key, bool def = false) { return get(key, 'C', (uint8_t)def) != 0; }
+    float getFloat(const char *key, float def = NAN) { return get(key, 'B', def); }
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+    String getString(const char *key, const String &def = String());
+
+private:
+    std::string ns;
+    bool started = false;
+    bool readOnly = false;
+
+    std::vector<uint8_t> *find(const char *key, char type);
+    size_t put(const char *key, char type, const void *value, size_t len);
+
+    template <typename T>
+    T get(const char *key, char type, T def)
+    {
+        std::vector<uint8_t> *v = find(key, type);
+        if (!v || v->size() != sizeof(T) + 1)
+        {
+            return def;
+        }
+        T value;
+        memcpy(&value, v->data() + 1, sizeof(T));
+        return value;
+    }
+};
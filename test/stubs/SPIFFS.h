@@ -0,0 +1,74 @@
+// SPIFFS für den Host-Test: Dateien im Speicher des aktuellen Knotens, Flash-Zugriffe kosten Zeit
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+struct SimFile
+{
+    std::shared_ptr<std::vector<uint8_t> > data;
+    std::string path;
+    size_t pos = 0;
+    bool canRead = false;
+    bool canWrite = false;
+    bool append = false;
+    bool open = true;
+};
+
+class File : public Stream
+{
+public:
+    File() {}
+    explicit File(std::shared_ptr<SimFile> f) : file(f) {}
+
+    operator bool() const { return file && file->open; }
+    size_t size() const { return *this ? file->data->size() : 0; }
+    size_t position() const { return *this ? file->pos : 0; }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t read(uint8_t *buf, size_t size);
+    int read() override;
+    int peek() override;
+    int available() override { return *this ? (int)(file->data->size() - file->pos) : 0; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+    void flush() override {}
+    void close();
+    const char *path() const { return file ? file->path.c_str() : ""; }
+    const char *name() const;
+
+private:
+    std::shared_ptr<SimFile> file;
+};
+
+class SPIFFSClass
+{
+public:
+    bool begin(bool formatOnFail = false, const char * = "/spiffs", uint8_t = 10, const char * = NULL);
+    void end();
+    bool format();
+    File open(const char *path, const char *mode = FILE_READ, bool create = false);
+    File open(const String &path, const char *mode = FILE_READ, bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *from, const char *to);
+    size_t totalBytes();
+    size_t usedBytes();
+};
+
+extern SPIFFSClass SPIFFS;
@@ -0,0 +1,582 @@
+// Stubs.cpp - Nicht-inline Teile der Arduino-/ESP-IDF-Nachbildung für den Host-Test
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <lwip/sockets.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+SPIFFSClass SPIFFS;
+TwoWire Wire;
+
+static sim::Node &me()
+{
+    sim::Node *n = sim::current();
+    if (!n)
+    {
+        fprintf(stderr, "Stub ohne Knoten aufgerufen\n");
+        abort();
+    }
+    return *n;
+}
+
+// ---- WiFi ----
+
+bool WiFiClass::softAP(const char *, const char *, int, int, int)
+{
+    me().apUp = true;
+    sim::advance(100000);
+    return true;
+}
+
+IPAddress WiFiClass::softAPIP() { return IPAddress(me().ip); }
+IPAddress WiFiClass::localIP() { return IPAddress(me().ip); }
+
+wl_status_t WiFiClass::begin(const char *, const char *)
+{
+    sim::Node &n = me();
+    n.staWanted = true;
+    n.staBeginAt = n.time;
+    return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool)
+{
+    me().staWanted = false;
+    return true;
+}
+
+wl_status_t WiFiClass::status()
+{
+    sim::Node &n = me();
+    if (n.apUp)
+    {
+        return WL_IDLE_STATUS;
+    }
+    if (!n.staWanted)
+    {
+        return WL_IDLE_STATUS;
+    }
+    bool apAround = false;
+    for (sim::Node *other : sim::world().nodes)
+    {
+        apAround = apAround || (other != &n && other->apUp);
+    }
+    if (!apAround || n.staLost || n.time < n.staBeginAt + sim::WIFI_ASSOC_US)
+    {
+        return WL_DISCONNECTED;
+    }
+    return WL_CONNECTED;
+}
+
+bool WiFiClass::setSleep(wifi_ps_type_t type)
+{
+    me().wifiSleep = type;
+    return true;
+}
+
+// ---- TCP ----
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    sim::Node &n = me();
+    stop();
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        sim::advance(1000);
+        return 0;
+    }
+    sim::Link &link = sim::world().nodeLink;
+    sim::Node *target = sim::nodeByIp(ip.raw());
+    if (!target || link.blackhole)
+    {
+        sim::advance(3000000); // Verbindungs-Timeout
+        return 0;
+    }
+    auto s = sim::openConnection(&n, target, port, link);
+    if (!s)
+    {
+        sim::advance(2 * (uint64_t)link.baseUs); // RST
+        return 0;
+    }
+    uint64_t synAt = target->listeners[port]->pending.back().first;
+    uint64_t ackAt = link.deliver(synAt);
+    if (ackAt == sim::NEVER)
+    {
+        sim::advance(3000000);
+        return 0;
+    }
+    if (ackAt > n.time)
+    {
+        sim::advance(ackAt - n.time);
+    }
+    sock = s;
+    return 1;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (!sock || sock->closed || sock->conn->reset)
+    {
+        return 0;
+    }
+    uint64_t t = sim::now();
+    if (sock->in().deliverable(t) > 0)
+    {
+        return 1;
+    }
+    return sock->in().finAt > t;
+}
+
+void WiFiClient::stop()
+{
+    if (sock)
+    {
+        sock->close();
+        sock.reset();
+    }
+}
+
+IPAddress WiFiClient::remoteIP() const
+{
+    if (!sock || !sock->conn->end[1 - sock->side])
+    {
+        return IPAddress(192, 168, 4, 100);
+    }
+    return IPAddress(sock->conn->end[1 - sock->side]->ip);
+}
+
+int WiFiClient::available()
+{
+    if (!sock || sock->closed)
+    {
+        return 0;
+    }
+    return (int)sock->in().deliverable(sim::now());
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size)
+{
+    if (!sock || sock->closed)
+    {
+        return -1;
+    }
+    size_t n = sock->in().read(sim::now(), buf, size);
+    return n ? (int)n : -1;
+}
+
+int WiFiClient::peek()
+{
+    uint8_t c;
+    if (!sock || sock->closed || sock->in().read(sim::now(), &c, 1, true) != 1)
+    {
+        return -1;
+    }
+    return c;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+    if (!sock || sock->closed)
+    {
+        return 0;
+    }
+    // Blockiert wie lwIP, solange der Sendepuffer voll ist (Arduino: bis zu 10 Versuche à 1s)
+    size_t done = 0;
+    uint64_t deadline = sim::now() + 10000000;
+    while (done < size)
+    {
+        if (sock->conn->reset || sock->in().finAt <= sim::now())
+        {
+            break;
+        }
+        done += sock->out().push(sim::now(), buf + done, size - done, *sock->conn->link);
+        if (done < size)
+        {
+            if (sim::now() >= deadline)
+            {
+                break;
+            }
+            sim::advance(1000);
+        }
+    }
+    sim::advance(10 + size / 50);
+    return done;
+}
+
+void WiFiServer::begin(uint16_t p)
+{
+    if (p)
+    {
+        port = p;
+    }
+    sim::Node &n = me();
+    if (!n.listeners.count(port))
+    {
+        n.listeners[port].reset(new sim::Listener());
+        n.listeners[port]->port = port;
+    }
+    listening = true;
+}
+
+void WiFiServer::end()
+{
+    me().listeners.erase(port);
+    listening = false;
+}
+
+WiFiClient WiFiServer::accept()
+{
+    sim::Node &n = me();
+    auto it = n.listeners.find(port);
+    if (!listening || it == n.listeners.end())
+    {
+        return WiFiClient();
+    }
+    auto &pending = it->second->pending;
+    if (pending.empty() || pending.front().first > n.time)
+    {
+        return WiFiClient();
+    }
+    std::shared_ptr<sim::Socket> s = pending.front().second;
+    pending.pop_front();
+    sim::advance(50);
+    return WiFiClient(s);
+}
+
+ssize_t lwip_send(int fd, const void *data, size_t size, int)
+{
+    std::shared_ptr<sim::Socket> s = sim::socketFor(fd);
+    if (!s || s->closed)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    if (s->conn->reset || s->in().finAt <= sim::now())
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+    sim::advance(8);
+    size_t n = s->out().push(sim::now(), (const uint8_t *)data, size, *s->conn->link);
+    if (n == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (ssize_t)n;
+}
+
+// ---- SPIFFS ----
+
+static size_t fsUsed(sim::Node &n)
+{
+    size_t used = 0;
+    for (auto &f : n.files)
+    {
+        used += (f.second->size() + 255) / 256 * 256;
+    }
+    return used;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!*this)
+    {
+        return false;
+    }
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? file->pos : file->data->size();
+    if (base + pos > file->data->size())
+    {
+        return false;
+    }
+    file->pos = base + pos;
+    sim::advance(sim::FLASH_CALL_US);
+    return true;
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+    if (!*this || !file->canRead)
+    {
+        return 0;
+    }
+    size_t n = std::min(size, file->data->size() - file->pos);
+    memcpy(buf, file->data->data() + file->pos, n);
+    file->pos += n;
+    sim::advance(sim::FLASH_CALL_US + (uint64_t)(n * sim::FLASH_READ_US_PER_BYTE));
+    return n;
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek()
+{
+    if (!*this || !file->canRead || file->pos >= file->data->size())
+    {
+        return -1;
+    }
+    return (*file->data)[file->pos];
+}
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    if (!*this || !file->canWrite)
+    {
+        return 0;
+    }
+    sim::Node &n = me();
+    if (file->append)
+    {
+        file->pos = file->data->size();
+    }
+    size_t grow = file->pos + size > file->data->size() ? file->pos + size - file->data->size() : 0;
+    if (fsUsed(n) + grow > sim::SPIFFS_CAPACITY)
+    {
+        return 0; // Voll
+    }
+    if (grow)
+    {
+        file->data->resize(file->pos + size);
+    }
+    memcpy(file->data->data() + file->pos, buf, size);
+    file->pos += size;
+    sim::advance(sim::FLASH_CALL_US + (uint64_t)(size * sim::FLASH_WRITE_US_PER_BYTE));
+    return size;
+}
+
+void File::close()
+{
+    if (file)
+    {
+        file->open = false;
+        file.reset();
+    }
+}
+
+const char *File::name() const
+{
+    if (!file)
+    {
+        return "";
+    }
+    const char *slash = strrchr(file->path.c_str(), '/');
+    return slash ? slash + 1 : file->path.c_str();
+}
+
+bool SPIFFSClass::begin(bool formatOnFail, const char *, uint8_t, const char *)
+{
+    sim::Node &n = me();
+    sim::advance(20000);
+    if (n.fsBroken)
+    {
+        if (!formatOnFail)
+        {
+            return false;
+        }
+        format();
+    }
+    n.fsMounted = true;
+    return true;
+}
+
+void SPIFFSClass::end() { me().fsMounted = false; }
+
+bool SPIFFSClass::format()
+{
+    sim::Node &n = me();
+    n.files.clear();
+    n.fsBroken = false;
+    sim::advance(2000000);
+    return true;
+}
+
+File SPIFFSClass::open(const char *path, const char *mode, bool create)
+{
+    sim::Node &n = me();
+    if (!n.fsMounted)
+    {
+        return File();
+    }
+    sim::advance(sim::FLASH_OPEN_US);
+    std::string p(path);
+    auto it = n.files.find(p);
+    bool exists = it != n.files.end();
+    bool plus = strchr(mode, '+') != nullptr;
+    auto f = std::make_shared<SimFile>();
+    f->path = p;
+    switch (mode[0])
+    {
+    case 'r':
+        if (!exists && !create)
+        {
+            return File();
+        }
+        f->canRead = true;
+        f->canWrite = plus;
+        break;
+    case 'w':
+        f->canWrite = true;
+        f->canRead = plus;
+        if (exists)
+        {
+            it->second->clear();
+        }
+        break;
+    case 'a':
+        f->canWrite = true;
+        f->canRead = plus;
+        f->append = true;
+        break;
+    default:
+        return File();
+    }
+    if (!exists)
+    {
+        n.files[p] = std::make_shared<std::vector<uint8_t> >();
+    }
+    f->data = n.files[p];
+    f->pos = f->append ? f->data->size() : 0;
+    return File(f);
+}
+
+bool SPIFFSClass::exists(const char *path)
+{
+    sim::advance(sim::FLASH_CALL_US);
+    return me().files.count(path) > 0;
+}
+
+bool SPIFFSClass::remove(const char *path)
+{
+    sim::advance(sim::FLASH_OPEN_US);
+    return me().files.erase(path) > 0;
+}
+
+bool SPIFFSClass::rename(const char *from, const char *to)
+{
+    sim::Node &n = me();
+    auto it = n.files.find(from);
+    if (it == n.files.end())
+    {
+        return false;
+    }
+    n.files[to] = it->second;
+    n.files.erase(it);
+    sim::advance(sim::FLASH_OPEN_US);
+    return true;
+}
+
+size_t SPIFFSClass::totalBytes() { return sim::SPIFFS_CAPACITY; }
+size_t SPIFFSClass::usedBytes() { return fsUsed(me()); }
+
+// ---- Preferences ----
+
+bool Preferences::begin(const char *name, bool ro, const char *)
+{
+    sim::Node &n = me();
+    sim::advance(sim::NVS_READ_US);
+    if (ro && !n.nvs.count(name))
+    {
+        return false; // nvs_open im Lesemodus: Namensraum fehlt
+    }
+    n.nvs[name];
+    ns = name;
+    readOnly = ro;
+    started = true;
+    return true;
+}
+
+bool Preferences::clear()
+{
+    if (!started || readOnly)
+    {
+        return false;
+    }
+    me().nvs[ns].clear();
+    sim::advance(sim::NVS_WRITE_US);
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!started || readOnly)
+    {
+        return false;
+    }
+    sim::advance(sim::NVS_WRITE_US);
+    return me().nvs[ns].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return started && me().nvs[ns].count(key) > 0;
+}
+
+std::vector<uint8_t> *Preferences::find(const char *key, char type)
+{
+    if (!started)
+    {
+        return nullptr;
+    }
+    sim::advance(sim::NVS_READ_US);
+    auto &space = me().nvs[ns];
+    auto it = space.find(key);
+    if (it == space.end() || it->second.empty() || (char)it->second[0] != type)
+    {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+size_t Preferences::put(const char *key, char type, const void *value, size_t len)
+{
+    if (!started || readOnly)
+    {
+        return 0;
+    }
+    sim::Node &n = me();
+    std::vector<uint8_t> v(len + 1);
+    v[0] = (uint8_t)type;
+    memcpy(v.data() + 1, value, len);
+    n.nvs[ns][key] = v;
+    n.nvsWrites++;
+    sim::advance(sim::NVS_WRITE_US);
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    std::vector<uint8_t> *v = find(key, 'B');
+    return v ? v->size() - 1 : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+    std::vector<uint8_t> *v = find(key, 'B');
+    if (!v || v->size() - 1 > maxLen)
+    {
+        return 0;
+    }
+    memcpy(buf, v->data() + 1, v->size() - 1);
+    return v->size() - 1;
+}
+
+String Preferences::getString(const char *key, const String &def)
+{
+    std::vector<uint8_t> *v = find(key, 's');
+    return v ? String(std::string(v->begin() + 1, v->end())) : def;
+}
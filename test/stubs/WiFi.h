@@ -0,0 +1,50 @@
+// WiFi für den Host-Test: Access Point, Station und Modem-Sleep des aktuellen Knotens
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t) { return true; }
+    bool softAPConfig(IPAddress, IPAddress, IPAddress) { return true; }
+    bool softAP(const char *, const char * = NULL, int = 1, int = 0, int = 4);
+    IPAddress softAPIP();
+    wl_status_t begin(const char *ssid, const char *passphrase = NULL);
+    bool disconnect(bool = false);
+    wl_status_t status();
+    IPAddress localIP();
+    bool setSleep(bool enabled) { return setSleep(enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE); }
+    bool setSleep(wifi_ps_type_t type);
+    bool setAutoReconnect(bool) { return true; }
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,74 @@
+// WiFiClient/WiFiServer für den Host-Test: TCP über die simulierte Strecke (sim::Link)
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+
+class IPAddress : public Printable
+{
+public:
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    explicit IPAddress(const uint8_t *b) : bytes{b[0], b[1], b[2], b[3]} {}
+    uint8_t operator[](int i) const { return bytes[i]; }
+    const uint8_t *raw() const { return bytes; }
+    bool operator==(const IPAddress &o) const { return memcmp(bytes, o.bytes, 4) == 0; }
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return String(buf);
+    }
+    size_t printTo(Print &p) const override { return p.print(toString()); }
+
+private:
+    uint8_t bytes[4];
+};
+
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() {}
+    explicit WiFiClient(std::shared_ptr<sim::Socket> socket) : sock(socket) {}
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(IPAddress ip, uint16_t port, int32_t) { return connect(ip, port); }
+    uint8_t connected();
+    operator bool() { return connected(); }
+    bool operator==(const WiFiClient &o) const { return sock == o.sock; }
+    bool operator!=(const WiFiClient &o) const { return sock != o.sock; }
+    void stop();
+    int fd() const { return sock ? sock->fd : -1; }
+    int setNoDelay(bool) { return 0; }
+    IPAddress remoteIP() const;
+
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size);
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+
+    std::shared_ptr<sim::Socket> socket() const { return sock; }
+
+private:
+    std::shared_ptr<sim::Socket> sock;
+};
+
+class WiFiServer
+{
+public:
+    explicit WiFiServer(uint16_t p = 80, uint8_t = 4) : port(p) {}
+    void begin(uint16_t p = 0);
+    void end();
+    WiFiClient accept();
+    WiFiClient available() { return accept(); }
+    void setNoDelay(bool) {}
+    operator bool() const { return listening; }
+
+private:
+    uint16_t port;
+    bool listening = false;
+};
@@ -0,0 +1,64 @@
+// Wire für den Host-Test: Transaktionen kosten Buszeit, Adressen ohne Gerät antworten mit NACK
+#pragma once
+
+#include <Arduino.h>
+
+class TwoWire : public Stream
+{
+public:
+    bool begin(int = -1, int = -1, uint32_t frequency = 0)
+    {
+        if (frequency && sim::current())
+        {
+            sim::current()->i2cClock = frequency;
+        }
+        return true;
+    }
+    bool setClock(uint32_t frequency)
+    {
+        if (sim::current())
+        {
+            sim::current()->i2cClock = frequency;
+        }
+        return true;
+    }
+    void setTimeOut(uint16_t) {}
+    void setTimeout(uint16_t) {}
+    void beginTransmission(uint8_t address)
+    {
+        addr = address;
+        bytes = 1;
+    }
+    size_t write(uint8_t) override
+    {
+        bytes++;
+        return 1;
+    }
+    size_t write(const uint8_t *, size_t size) override
+    {
+        bytes += (int)size;
+        return size;
+    }
+    using Print::write;
+    uint8_t endTransmission(bool = true)
+    {
+        sim::i2cTransfer(bytes);
+        sim::Node *n = sim::current();
+        return n && n->i2cDevices.count(addr) ? 0 : 2; // 2 = NACK auf die Adresse
+    }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity)
+    {
+        addr = address;
+        sim::i2cTransfer(1 + quantity);
+        return 0;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+private:
+    uint8_t addr = 0;
+    int bytes = 0;
+};
+
+extern TwoWire Wire;
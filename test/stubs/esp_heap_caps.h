@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "Simulation.h"
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+inline size_t heap_caps_get_free_size(uint32_t) { return sim::current() ? sim::current()->heapFree : 0; }
+inline size_t heap_caps_get_minimum_free_size(uint32_t) { return sim::current() ? sim::current()->heapMinFree : 0; }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return sim::current() ? sim::current()->heapLargest : 0; }
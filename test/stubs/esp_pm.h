@@ -0,0 +1,61 @@
+// Power Management: Arduino-ESP32 baut ohne Tickless Idle, Light-Sleep meldet NOT_SUPPORTED
+#pragma once
+
+#include <esp_timer.h>
+
+#define CONFIG_PM_ENABLE 1
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+typedef struct
+{
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+typedef enum
+{
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP,
+} esp_pm_lock_type_t;
+
+typedef int *esp_pm_lock_handle_t;
+
+inline esp_err_t esp_pm_configure(const void *config)
+{
+    const esp_pm_config_esp32_t *c = (const esp_pm_config_esp32_t *)config;
+    if (c->light_sleep_enable)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (sim::current())
+    {
+        sim::current()->pmConfigured = true;
+    }
+    return ESP_OK;
+}
+
+inline esp_err_t esp_pm_lock_create(esp_pm_lock_type_t, int, const char *, esp_pm_lock_handle_t *handle)
+{
+    *handle = new int(0);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if ((*handle)++ == 0 && sim::current())
+    {
+        sim::current()->pmLocksHeld++;
+    }
+    return ESP_OK;
+}
+
+inline esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if (--(*handle) == 0 && sim::current())
+    {
+        sim::current()->pmLocksHeld--;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,66 @@
+// esp_timer für den Host-Test: Rückrufe laufen zur fälligen Simulationszeit, nie innerhalb
+// eines kritischen Abschnitts (wie der esp_timer-Task auf dem anderen Kern)
+#pragma once
+
+#include <stdint.h>
+
+#include "Simulation.h"
+
+#include <esp_err.h>
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef sim::EspTimer *esp_timer_handle_t;
+
+typedef enum
+{
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+inline int64_t esp_timer_get_time()
+{
+    sim::advance(sim::CALL_COST_US);
+    return sim::current() ? (int64_t)sim::current()->localUs() : 0;
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    sim::Node *n = sim::current();
+    n->timers.emplace_back(new sim::EspTimer());
+    sim::EspTimer *t = n->timers.back().get();
+    t->callback = args->callback;
+    t->arg = args->arg;
+    t->name = args->name ? args->name : "";
+    *out = t;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    sim::Node *n = sim::current();
+    if (timer->due != sim::NEVER)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due = n->toGlobal(n->localUs() + timeoutUs);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer->due == sim::NEVER)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due = sim::NEVER;
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+// FreeRTOS für den Host-Test: kritische Abschnitte als Verschränkungsstellen der Simulation
+#pragma once
+
+#include <stdint.h>
+
+#include "Simulation.h"
+
+typedef struct
+{
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(mux) (sim::enterCritical(), (void)(mux))
+#define portEXIT_CRITICAL(mux) (sim::exitCritical(), (void)(mux))
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+
+typedef void *TaskHandle_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+#define portTICK_PERIOD_MS 1
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return sim::current() ? sim::current()->stackHighWater : 0;
+}
+inline void vTaskDelay(TickType_t ticks) { sim::advance((uint64_t)ticks * 1000); }
@@ -0,0 +1,11 @@
+// lwIP-Sockets für den Host-Test: send() auf die simulierte Verbindung (wie lwIP als Makro)
+#pragma once
+
+#include <errno.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define MSG_DONTWAIT 0x08
+
+ssize_t lwip_send(int s, const void *data, size_t size, int flags);
+#define send(s, data, size, flags) lwip_send(s, data, size, flags)
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+# Telemetrie-Empfang - PC-Gegenstück zu Lichtschranke-Telemetrie.h
+# Verbindet sich mit einer oder beiden Schranken (Port 82), dekodiert die Batches und schreibt
+# jede Abtastung als CSV-Zeile oder zeichnet den Abstandsverlauf live (--plot, braucht matplotlib).
+#
+#   python3 tools/Telemetrie-Empfang.py 192.168.4.1                 # Schranke 1 (Server)
+#   python3 tools/Telemetrie-Empfang.py 192.168.4.1 192.168.4.2 -o aufbau.csv
+#   python3 tools/Telemetrie-Empfang.py 192.168.4.1 --roh start.bin  # Rohstrom mitschneiden
+#   python3 tools/Telemetrie-Empfang.py --datei start.bin            # Mitschnitt auswerten
+#
+# CSV: schranke,abtastung,zeit_us,gefiltert_cm,roh_cm
+#   zeit_us  - micros() der Schranke, über Überläufe hinweg fortgezählt
+#   roh_cm   - Einzel-Pings durch ';' getrennt, leer = kein Echo
+
+import argparse
+import selectors
+import socket
+import struct
+import sys
+
+TELEMETRY_PORT = 82
+MAGIC = 0x4C54
+HEADER = struct.Struct("<HBBIIHH")
+
+
+def varint(buf, pos):
+    value = shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if b < 0x80:
+            return value, pos
+        shift += 7
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+class Decoder:
+    """Setzt den Bytestrom einer Schranke wieder zu Abtastungen zusammen."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.next_sample = None
+        self.last_us = None
+        self.batches = 0
+        self.lost_samples = 0       # Lücken in den Abtastnummern: verworfene Batches, Wechsel der Ausdünnung
+        self.decimation = 0
+
+    def feed(self, data):
+        self.buf += data
+        while len(self.buf) >= HEADER.size:
+            magic, gate, decimation, first, t0, count, length = HEADER.unpack_from(self.buf)
+            if magic != MAGIC:
+                raise ValueError("Telemetrie-Strom nicht synchron (Magic %04x)" % magic)
+            if len(self.buf) < HEADER.size + length:
+                return
+            payload = bytes(self.buf[HEADER.size:HEADER.size + length])
+            del self.buf[:HEADER.size + length]
+            yield from self.batch(gate, decimation, first, t0, count, payload)
+
+    def batch(self, gate, decimation, first, t0, count, payload):
+        self.batches += 1
+        self.decimation = decimation
+        if self.next_sample is not None and first > self.next_sample:
+            self.lost_samples += first - self.next_sample
+        self.next_sample = first + (count << decimation)
+
+        t = self.unwrap(t0)
+        mm = 0
+        pos = 0
+        for i in range(count):
+            dt, pos = varint(payload, pos)
+            dmm, pos = varint(payload, pos)
+            t += dt
+            mm += unzigzag(dmm)
+            raw_count = payload[pos]
+            pos += 1
+            raw = []
+            for _ in range(raw_count):
+                v, pos = varint(payload, pos)
+                raw.append(None if v == 0 else (mm + unzigzag(v - 1)) / 10.0)
+            filtered = mm / 10.0 if mm > 0 else None
+            yield gate, first + (i << decimation), t, filtered, raw
+        self.last_us = t
+
+    def unwrap(self, t0):
+        # micros() läuft nach ~71 Minuten über: Abstand zur letzten Abtastung vorzeichenrichtig addieren
+        if self.last_us is None:
+            return t0
+        delta = (t0 - self.last_us) & 0xFFFFFFFF
+        return self.last_us + (delta - (1 << 32) if delta >= 1 << 31 else delta)
+
+
+def csv_line(gate, sample, t, filtered, raw):
+    fmt = lambda v: "" if v is None else "%.1f" % v
+    return "%d,%d,%d,%s,%s\n" % (gate, sample, t, fmt(filtered), ";".join(fmt(r) for r in raw))
+
+
+class Plot:
+    WINDOW_US = 10_000_000
+
+    def __init__(self):
+        import matplotlib.pyplot as plt
+        self.plt = plt
+        plt.ion()
+        self.fig, self.ax = plt.subplots()
+        self.ax.set_xlabel("Zeit [s]")
+        self.ax.set_ylabel("Abstand [cm]")
+        self.series = {}
+
+    def add(self, gate, t, filtered, raw):
+        s = self.series.setdefault(gate, {"t": [], "f": [], "rt": [], "r": []})
+        if filtered is not None:
+            s["t"].append(t / 1e6)
+            s["f"].append(filtered)
+        for r in raw:
+            if r is not None:
+                s["rt"].append(t / 1e6)
+                s["r"].append(r)
+
+    def draw(self):
+        self.ax.clear()
+        for gate, s in sorted(self.series.items()):
+            for key_t, key_v in (("t", "f"), ("rt", "r")):
+                horizon = s[key_t][-1] - self.WINDOW_US / 1e6 if s[key_t] else 0
+                while s[key_t] and s[key_t][0] < horizon:
+                    s[key_t].pop(0)
+                    s[key_v].pop(0)
+            self.ax.plot(s["rt"], s["r"], ".", markersize=2, label="Schranke %d roh" % gate)
+            self.ax.plot(s["t"], s["f"], "-", label="Schranke %d Median" % gate)
+        self.ax.legend(loc="upper right")
+        self.plt.pause(0.001)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Empfängt den Rohdaten-Stream der Lichtschranken")
+    parser.add_argument("hosts", nargs="*", help="Schranke als host[:port]")
+    parser.add_argument("--datei", help="Mitschnitt (--roh) statt Verbindung auswerten")
+    parser.add_argument("--roh", help="Empfangene Bytes zusätzlich in diese Datei schreiben (nur ein Host)")
+    parser.add_argument("-o", "--ausgabe", help="CSV-Datei statt stdout")
+    parser.add_argument("--plot", action="store_true", help="Live-Diagramm statt CSV")
+    args = parser.parse_args()
+    if not args.hosts and not args.datei:
+        parser.error("Host oder --datei angeben")
+
+    out = open(args.ausgabe, "w") if args.ausgabe else sys.stdout
+    plot = Plot() if args.plot else None
+    if not plot:
+        out.write("schranke,abtastung,zeit_us,gefiltert_cm,roh_cm\n")
+
+    def emit(samples):
+        for gate, sample, t, filtered, raw in samples:
+            if plot:
+                plot.add(gate, t, filtered, raw)
+            else:
+                out.write(csv_line(gate, sample, t, filtered, raw))
+
+    decoders = []
+    if args.datei:
+        decoder = Decoder()
+        decoders.append(("datei", decoder))
+        with open(args.datei, "rb") as f:
+            emit(decoder.feed(f.read()))
+    else:
+        sel = selectors.DefaultSelector()
+        raw_file = open(args.roh, "wb") if args.roh else None
+        for host in args.hosts:
+            name, _, port = host.partition(":")
+            sock = socket.create_connection((name, int(port or TELEMETRY_PORT)), timeout=5)
+            sock.setblocking(False)
+            decoder = Decoder()
+            decoders.append((host, decoder))
+            sel.register(sock, selectors.EVENT_READ, decoder)
+            print("Verbunden mit %s" % host, file=sys.stderr)
+        try:
+            while sel.get_map():
+                for key, _ in sel.select(timeout=0.2):
+                    data = key.fileobj.recv(4096)
+                    if not data:
+                        sel.unregister(key.fileobj)
+                        continue
+                    if raw_file:
+                        raw_file.write(data)
+                    emit(key.data.feed(data))
+                if plot:
+                    plot.draw()
+                out.flush()
+        except KeyboardInterrupt:
+            pass
+
+    for name, d in decoders:
+        print("%s: %d Batches, %d Abtastungen fehlen, Rate zuletzt 1/%d"
+              % (name, d.batches, d.lost_samples, 1 << d.decimation), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()